@@ -57,6 +57,10 @@ FILES   += $(SRC)/pcanlog.c
 FILES   += $(SRC)/pcbcore.c
 FILES   += $(SRC)/pcblog.c
 FILES   += $(SRC)/pcbtrace.c
+FILES   += $(SRC)/pcbtransport.c
+FILES   += $(SRC)/pcbsocketcan.c
+FILES   += $(SRC)/pcbvirtual.c
+FILES   += $(SRC)/pcbwire.c
 ALL_OBJ :=  $(foreach f,$(FILES),$(OUT)/$(basename $(notdir $(f))).o)
 
 # get build version
@@ -100,7 +104,7 @@ EXTRA_LDFLAGS     ?=
 
 # Complete flags
 CFLAGS += -D$(RT) $(LIBPCANFD_INC) $(RT_CFLAGS) $(EXTRA_CFLAGS)
-LDFLAGS += -lm $(RT_LDFLAGS) $(EXTRA_LDFLAGS) $(EXTRA_LIBS) 
+LDFLAGS += -lm -lpthread $(RT_LDFLAGS) $(EXTRA_LDFLAGS) $(EXTRA_LIBS) 
 
 # Installation directory
 LIBPATH = $(DESTDIR)/usr/lib
@@ -29,6 +29,8 @@
 /* include pcan.h but renaming TPCANMsg structure */
 #define TPCANMsg _TPCANMsg
 #include <pcan.h> /* handle DWORD and other definitions from Windows */
+#include <sys/time.h>
+#include <pcanfd.h> /* struct pcanfd_msgs (CAN_ReadMany/CAN_WriteMany) */
 #undef TPCANMsg
 
 #define __stdcall
@@ -200,6 +202,11 @@
 #define PCAN_IO_DIGITAL_CLEAR         0x27U // Clear multiple digital I/O pins to 0
 #define PCAN_IO_ANALOG_VALUE          0x28U // Get value of a single analog input pin
 #define PCAN_FIRMWARE_VERSION         0x29U // Get the version of the firmware used by the device associated with a PCAN-Channel
+#define PCAN_TX_PENDING_MSGS          0x80U // Number of messages waiting in the driver Tx queue of a PCAN-Channel (Linux only)
+#define PCAN_TX_QUEUE_SIZE            0x81U // Size, in messages, of the driver Tx queue of a PCAN-Channel (Linux only)
+#define PCAN_BUSLOAD                  0x82U // Bus load measured by the device of a PCAN-Channel, in 1/100 % (Linux only)
+#define PCAN_BUSLOAD_TX               0x83U // Bus load predicted from the frames written on a PCAN-Channel, in 1/100 %, since the first query of PCAN_BUSLOAD* (which returns 0) (Linux only)
+#define PCAN_BUSLOAD_RX               0x84U // Bus load predicted from the frames read on a PCAN-Channel, in 1/100 %, since the first query of PCAN_BUSLOAD* (which returns 0) (Linux only)
 
 // PCAN parameter values
 //
@@ -316,6 +323,9 @@
 #define TPCANBitrateFD               LPSTR  // Represents a PCAN-FD bit rate string
 #define TPCANTimestampFD             UINT64 // Represents a timestamp of a received PCAN FD message
 
+// Represents a compiled PCAN-FD bit rate string (opaque)
+typedef struct _pcanbasic_fd_profile *TPCANBitrateFDProfile;
+
 ////////////////////////////////////////////////////////////
 // Structure definitions
 ////////////////////////////////////////////////////////////
@@ -350,6 +360,16 @@ typedef struct tagTPCANMsgFD
     BYTE              DATA[64]; // Data of the message (DATA[0]..DATA[63])
 } TPCANMsgFD;
 
+// Represents the durations of the steps of a CAN FD initialization, in microseconds
+//
+typedef struct tagTPCANInitTiming
+{
+    DWORD  prepare_us;         // Device lookup, bit rates parsing and sysfs checks
+    DWORD  open_us;            // Device opening and bit rates setting
+    DWORD  setup_us;           // Filters reset and sysfs refresh
+    DWORD  total_us;           // Whole initialization (with CAN_InitializeFDMany, includes waiting for the other Channels)
+} TPCANInitTiming;
+
 #ifdef __cplusplus
 extern "C" {
 #define _DEF_ARG =0
@@ -398,6 +418,92 @@ TPCANStatus __stdcall CAN_InitializeFD(
 	TPCANBitrateFD BitrateFD);
 
 
+/// <summary>
+/// Initializes several FD capable PCAN Channels at once
+/// </summary>
+/// <param name="Channels">"The handles of the FD capable PCAN Channels"</param>
+/// <param name="BitratesFD">"The speed for the communication of each Channel (FD bit rate strings)"</param>
+/// <param name="Count">"The number of Channels"</param>
+/// <param name="Statuses">"Buffer receiving the TPCANStatus of each Channel (can be NULL)"</param>
+/// <param name="Timings">"Buffer receiving the durations of the initialization of each
+/// Channel, failed ones included (can be NULL)"</param>
+/// <remarks>The devices are scanned once and opened in parallel. Channels are
+/// initialized independently: a failing Channel does not uninitialize the others.
+/// Durations of each initialization are traced in the log file (LOG_FUNCTION_PARAMETERS).
+///</remarks>
+/// <returns>"PCAN_ERROR_OK if all Channels are initialized, otherwise the first
+/// TPCANStatus error code"</returns>
+TPCANStatus __stdcall CAN_InitializeFDMany(
+	TPCANHandle *Channels,
+	TPCANBitrateFD *BitratesFD,
+	int Count,
+	TPCANStatus *Statuses,
+	TPCANInitTiming *Timings);
+
+
+/// <summary>
+/// Returns the durations of the last CAN FD initialization of a PCAN Channel
+/// </summary>
+/// <param name="Channel">"The handle of a Channel initialized with CAN_InitializeFD,
+/// CAN_InitializeFDProfile or CAN_InitializeFDMany"</param>
+/// <param name="Timing">"Buffer receiving the durations"</param>
+/// <returns>"A TPCANStatus error code"</returns>
+TPCANStatus __stdcall CAN_GetInitTiming(
+	TPCANHandle Channel,
+	TPCANInitTiming *Timing);
+
+
+/// <summary>
+/// Compiles a FD bit rate string into a reusable profile
+/// </summary>
+/// <param name="BitrateFD">"The speed for the communication (FD bit rate string)"</param>
+/// <param name="Profile">"Buffer receiving the compiled profile"</param>
+/// <remarks>The string is parsed once: initializing or resetting Channels with
+/// the profile does not parse it again, and PCAN_BITRATE_INFO_FD returns it as given.
+/// Bit timings are checked against the ranges of the hardware on first use.
+///</remarks>
+/// <returns>"A TPCANStatus error code"</returns>
+TPCANStatus __stdcall CAN_CreateBitrateFDProfile(
+	TPCANBitrateFD BitrateFD,
+	TPCANBitrateFDProfile *Profile);
+
+
+/// <summary>
+/// Initializes a FD capable PCAN Channel with a compiled bit rate profile
+/// </summary>
+/// <param name="Channel">"The handle of a FD capable PCAN Channel"</param>
+/// <param name="Profile">"A profile returned by CAN_CreateBitrateFDProfile"</param>
+/// <returns>"A TPCANStatus error code"</returns>
+TPCANStatus __stdcall CAN_InitializeFDProfile(
+	TPCANHandle Channel,
+	TPCANBitrateFDProfile Profile);
+
+
+/// <summary>
+/// Releases a profile returned by CAN_CreateBitrateFDProfile
+/// </summary>
+/// <remarks>Channels initialized with the profile remain valid</remarks>
+/// <param name="Profile">"The profile to release"</param>
+/// <returns>"A TPCANStatus error code"</returns>
+TPCANStatus __stdcall CAN_FreeBitrateFDProfile(
+	TPCANBitrateFDProfile Profile);
+
+
+/// <summary>
+/// Returns the bit rates of a profile returned by CAN_CreateBitrateFDProfile
+/// </summary>
+/// <remarks>Bit rates are computed from the clock and the bit timings of the
+/// FD bit rate string (f_clock / (brp * (1 + tseg1 + tseg2)))</remarks>
+/// <param name="Profile">"The profile"</param>
+/// <param name="NominalBitrate">"Buffer receiving the nominal bit rate, in bit/s"</param>
+/// <param name="DataBitrate">"Buffer receiving the data bit rate, in bit/s"</param>
+/// <returns>"A TPCANStatus error code"</returns>
+TPCANStatus __stdcall CAN_GetBitrateFDProfileBitrates(
+	TPCANBitrateFDProfile Profile,
+	DWORD *NominalBitrate,
+	DWORD *DataBitrate);
+
+
 /// <summary>
 /// Uninitializes one or all PCAN Channels initialized by CAN_Initialize
 /// </summary>
@@ -482,6 +588,58 @@ TPCANStatus __stdcall CAN_WriteFD(
 	TPCANMsgFD* MessageBuffer);
 
 
+#if defined(__linux__)
+/// <summary>
+/// Reads several CAN messages from the receive queue of a PCAN Channel
+/// </summary>
+/// <param name="Channel">"The handle of a PCAN Channel"</param>
+/// <param name="Messages">"A libpcanfd messages list. 'count' is the size of
+/// 'list' on input and the number of messages read on output"</param>
+/// <remarks>Messages are read with a single call to the driver and are not
+/// converted (see struct pcanfd_msg). Status and error events are returned in
+/// the list.</remarks>
+/// <returns>"A TPCANStatus error code (PCAN_ERROR_QRCVEMPTY if no message
+/// was read)"</returns>
+TPCANStatus __stdcall CAN_ReadMany(
+	TPCANHandle Channel,
+	struct pcanfd_msgs *Messages);
+
+
+/// <summary>
+/// Transmits several CAN messages over a PCAN Channel
+/// </summary>
+/// <param name="Channel">"The handle of a PCAN Channel"</param>
+/// <param name="Messages">"A libpcanfd messages list. 'count' is the number
+/// of messages to send on input and the number of messages queued on output"</param>
+/// <remarks>Messages are given to the driver with a single call.</remarks>
+/// <returns>"A TPCANStatus error code (PCAN_ERROR_QXMTFULL if only the first
+/// 'count' messages were queued)"</returns>
+TPCANStatus __stdcall CAN_WriteMany(
+	TPCANHandle Channel,
+	struct pcanfd_msgs *Messages);
+
+
+/// <summary>
+/// Returns the time a CAN or CAN FD frame takes on the wire
+/// </summary>
+/// <param name="Message">"A libpcanfd message (CAN 2.0 or CAN FD)"</param>
+/// <param name="NominalBitrate">"The nominal bit rate, in bit/s"</param>
+/// <param name="DataBitrate">"The data bit rate of FD frames with BRS, in
+/// bit/s (0: nominal bit rate)"</param>
+/// <param name="WorstCase">"PCAN_PARAMETER_ON: the stuff bits of the worst
+/// case id and data, PCAN_PARAMETER_OFF: the stuff bits of the message"</param>
+/// <param name="Nanoseconds">"Buffer receiving the duration, from the start
+/// of frame to the end of the interframe space"</param>
+/// <returns>"A TPCANStatus error code"</returns>
+TPCANStatus __stdcall CAN_GetFrameTime(
+	const struct pcanfd_msg *Message,
+	DWORD NominalBitrate,
+	DWORD DataBitrate,
+	BYTE WorstCase,
+	UINT64 *Nanoseconds);
+#endif
+
+
 /// <summary>
 /// Configures the reception filter. 
 /// </summary>
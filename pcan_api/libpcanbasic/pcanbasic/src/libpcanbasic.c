@@ -35,6 +35,7 @@
 #include "pcblog.h"
 
 #include <stdio.h>
+#include <stdlib.h>	/* calloc */
 
 #define MAX_LOG 256		/* Max length of a log string */
 
@@ -76,6 +77,129 @@ TPCANStatus CAN_InitializeFD(
 	return sts;
 }
 
+TPCANStatus CAN_InitializeFDMany(
+	TPCANHandle *Channels,
+	TPCANBitrateFD *BitratesFD,
+	int Count,
+	TPCANStatus *Statuses,
+	TPCANInitTiming *Timings) {
+	TPCANStatus sts;
+	TPCANStatus *psts;
+	TPCANInitTiming *ptim;
+	char szLog[MAX_LOG];
+	int i;
+
+	/* logging */
+	pcblog_write_entry("CAN_InitializeFDMany");
+	snprintf(szLog, MAX_LOG, "Count: %d", Count);
+	pcblog_write_param("CAN_InitializeFDMany", szLog);
+	for (i = 0; Channels != NULL && BitratesFD != NULL && i < Count; i++) {
+		snprintf(szLog, MAX_LOG, "Channel: 0x%02X, BitrateFD: {%s}", Channels[i], BitratesFD[i]);
+		pcblog_write_param("CAN_InitializeFDMany", szLog);
+	}
+	/* per-channel status and timings are needed to log them */
+	psts = Statuses;
+	if (psts == NULL && Count > 0)
+		psts = (TPCANStatus *) calloc(Count, sizeof(*psts));
+	ptim = Timings;
+	if (ptim == NULL && Count > 0)
+		ptim = (TPCANInitTiming *) calloc(Count, sizeof(*ptim));
+	/* forward call */
+	sts = pcanbasic_initialize_fd_many(Channels, BitratesFD, Count, psts, ptim);
+	for (i = 0; psts != NULL && ptim != NULL && Channels != NULL && i < Count; i++) {
+		snprintf(szLog, MAX_LOG, "Channel: 0x%02X, Status: 0x%X, Total: %u us (prepare: %u us, open: %u us, setup: %u us)",
+				Channels[i], psts[i], ptim[i].total_us, ptim[i].prepare_us, ptim[i].open_us, ptim[i].setup_us);
+		pcblog_write_param("CAN_InitializeFDMany", szLog);
+	}
+	if (psts != Statuses)
+		free(psts);
+	if (ptim != Timings)
+		free(ptim);
+	pcblog_write_exit("CAN_InitializeFDMany", sts);
+	return sts;
+}
+
+TPCANStatus CAN_GetInitTiming(
+	TPCANHandle Channel,
+	TPCANInitTiming *Timing) {
+	TPCANStatus sts;
+	char szLog[MAX_LOG];
+
+	/* logging */
+	pcblog_write_entry("CAN_GetInitTiming");
+	snprintf(szLog, MAX_LOG, "Channel: 0x%02X", Channel);
+	pcblog_write_param("CAN_GetInitTiming", szLog);
+	/* forward call */
+	sts = pcanbasic_get_init_timing(Channel, Timing);
+	pcblog_write_exit("CAN_GetInitTiming", sts);
+	return sts;
+}
+
+TPCANStatus CAN_CreateBitrateFDProfile(
+	TPCANBitrateFD BitrateFD,
+	TPCANBitrateFDProfile *Profile) {
+	TPCANStatus sts;
+	char szLog[MAX_LOG];
+
+	/* logging */
+	pcblog_write_entry("CAN_CreateBitrateFDProfile");
+	snprintf(szLog, MAX_LOG, "BitrateFD: {%s}", BitrateFD);
+	pcblog_write_param("CAN_CreateBitrateFDProfile", szLog);
+	/* forward call */
+	sts = pcanbasic_fd_profile_create(BitrateFD, Profile);
+	pcblog_write_exit("CAN_CreateBitrateFDProfile", sts);
+	return sts;
+}
+
+TPCANStatus CAN_InitializeFDProfile(
+	TPCANHandle Channel,
+	TPCANBitrateFDProfile Profile) {
+	TPCANStatus sts;
+	char szLog[MAX_LOG];
+
+	/* logging */
+	pcblog_write_entry("CAN_InitializeFDProfile");
+	snprintf(szLog, MAX_LOG, "Channel: 0x%02X, Profile: %p", Channel, (void *) Profile);
+	pcblog_write_param("CAN_InitializeFDProfile", szLog);
+	/* forward call */
+	sts = pcanbasic_initialize_fd_profile(Channel, Profile);
+	pcblog_write_exit("CAN_InitializeFDProfile", sts);
+	return sts;
+}
+
+TPCANStatus CAN_FreeBitrateFDProfile(
+	TPCANBitrateFDProfile Profile) {
+	TPCANStatus sts;
+	char szLog[MAX_LOG];
+
+	/* logging */
+	pcblog_write_entry("CAN_FreeBitrateFDProfile");
+	snprintf(szLog, MAX_LOG, "Profile: %p", (void *) Profile);
+	pcblog_write_param("CAN_FreeBitrateFDProfile", szLog);
+	/* forward call */
+	sts = pcanbasic_fd_profile_free(Profile);
+	pcblog_write_exit("CAN_FreeBitrateFDProfile", sts);
+	return sts;
+}
+
+TPCANStatus CAN_GetBitrateFDProfileBitrates(
+	TPCANBitrateFDProfile Profile,
+	DWORD *NominalBitrate,
+	DWORD *DataBitrate) {
+	TPCANStatus sts;
+	char szLog[MAX_LOG];
+
+	/* logging */
+	pcblog_write_entry("CAN_GetBitrateFDProfileBitrates");
+	snprintf(szLog, MAX_LOG, "Profile: %p, NominalBitrate: %p, DataBitrate: %p",
+			(void *) Profile, (void *) NominalBitrate, (void *) DataBitrate);
+	pcblog_write_param("CAN_GetBitrateFDProfileBitrates", szLog);
+	/* forward call */
+	sts = pcanbasic_fd_profile_get_bitrates(Profile, NominalBitrate, DataBitrate);
+	pcblog_write_exit("CAN_GetBitrateFDProfileBitrates", sts);
+	return sts;
+}
+
 TPCANStatus CAN_Uninitialize(
         TPCANHandle Channel) {
 	TPCANStatus sts;
@@ -195,6 +319,65 @@ TPCANStatus CAN_WriteFD(
 	return sts;
 }
 
+TPCANStatus CAN_ReadMany(
+	TPCANHandle Channel,
+	struct pcanfd_msgs *Messages) {
+	TPCANStatus sts;
+	char szLog[MAX_LOG];
+
+	/* logging */
+	pcblog_write_entry("CAN_ReadMany");
+	snprintf(szLog, MAX_LOG, "Channel: 0x%02X, Messages: 0x%p, Count: %u", Channel,
+			Messages, Messages ? Messages->count : 0);
+	pcblog_write_param("CAN_ReadMany", szLog);
+	/* forward call */
+	sts = pcanbasic_read_msgs(Channel, Messages);
+	pcblog_write_exit("CAN_ReadMany", sts);
+	return sts;
+}
+
+TPCANStatus CAN_WriteMany(
+	TPCANHandle Channel,
+	struct pcanfd_msgs *Messages) {
+	TPCANStatus sts;
+	char szLog[MAX_LOG];
+
+	/* logging */
+	pcblog_write_entry("CAN_WriteMany");
+	snprintf(szLog, MAX_LOG, "Channel: 0x%02X, Messages: 0x%p, Count: %u", Channel,
+			Messages, Messages ? Messages->count : 0);
+	pcblog_write_param("CAN_WriteMany", szLog);
+	/* forward call */
+	sts = pcanbasic_write_msgs(Channel, Messages);
+	pcblog_write_exit("CAN_WriteMany", sts);
+	return sts;
+}
+
+TPCANStatus CAN_GetFrameTime(
+	const struct pcanfd_msg *Message,
+	DWORD NominalBitrate,
+	DWORD DataBitrate,
+	BYTE WorstCase,
+	UINT64 *Nanoseconds) {
+	TPCANStatus sts;
+	char szLog[MAX_LOG];
+	__u64 ns = 0;
+
+	/* logging */
+	pcblog_write_entry("CAN_GetFrameTime");
+	snprintf(szLog, MAX_LOG,
+			"Message: 0x%p, NominalBitrate: %u, DataBitrate: %u, WorstCase: %u, Nanoseconds: 0x%p",
+			Message, NominalBitrate, DataBitrate, WorstCase, Nanoseconds);
+	pcblog_write_param("CAN_GetFrameTime", szLog);
+	/* forward call */
+	sts = pcanbasic_get_frame_time(Message, NominalBitrate, DataBitrate, WorstCase,
+			Nanoseconds ? &ns : NULL);
+	if (sts == PCAN_ERROR_OK)
+		*Nanoseconds = ns;
+	pcblog_write_exit("CAN_GetFrameTime", sts);
+	return sts;
+}
+
 TPCANStatus CAN_FilterMessages(
         TPCANHandle Channel,
         DWORD FromID,
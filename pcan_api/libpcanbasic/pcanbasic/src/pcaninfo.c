@@ -34,7 +34,11 @@
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <stddef.h>		/* offsetof */
+#include <fcntl.h>		/* openat */
+#include <unistd.h>		/* pread, close */
 #include <dirent.h>		/* scandir */
+#include <sys/inotify.h>	/* inotify_init1 */
 #include <math.h>		/* floor */
 #include <pcan.h>		/* PCAN HW types */
 #include <pcanfd.h>		/* PCAN_ERROR_BUS types */
@@ -58,6 +62,11 @@
 #define PCAN_VERSION_PATH	PCAN_CLASS_PATH "/version"
 /** Sysfs path to retrieve version information */
 #define PCAN_PROC_PATH		"/proc/pcan"
+/** Path of the device nodes */
+#define PCAN_DEV_PATH		"/dev"
+/** inotify events that denote a (un)plugged device */
+#define PCANINFO_MONITOR_MASK	(IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | \
+				IN_DELETE_SELF | IN_MOVE_SELF)
 
 /**
  * @defgroup PCAN_FILEINFO PCAN files in found Sysfs
@@ -139,28 +148,152 @@
 /** "No error" status error code */
 #define PCANINFO_ERR_OK 	0
 
+/** Max size of a value read from a sysfs attribute file */
+#define PCANINFO_ATTR_MAX_SIZE	(PCANINFO_MAX_CHAR_SIZE + 5)
+
+/**
+ * Describes how a sysfs attribute file is mapped into a PCANINFO structure
+ */
+struct pcaninfo_attr {
+	const char *filename;	/**< Name of the sysfs file */
+	size_t offset;			/**< Offset of the target member in struct pcaninfo */
+	size_t size;			/**< Size of the target string member (0 if uint32_t) */
+	int is_ex;				/**< 'flag' is a PCANINFO_FLAG_EX_xx value */
+	uint32_t flag;			/**< PCANINFO_FLAG_xx bit of the attribute */
+	int legacy;				/**< File may be prefixed with PCAN_FILEINFO_PREFIX_LEGACY */
+};
+
+/** @cond Doxygen_Suppress */
+#define ATTR_U32(file, member, flag, legacy) \
+	{ file, offsetof(struct pcaninfo, member), 0, 0, flag, legacy }
+#define ATTR_U32_EX(file, member, flag) \
+	{ file, offsetof(struct pcaninfo, member), 0, 1, flag, 0 }
+#define ATTR_STR(file, member, flag, legacy) \
+	{ file, offsetof(struct pcaninfo, member), \
+		sizeof(((struct pcaninfo *)0)->member), 0, flag, legacy }
+#define ATTR_STR_EX(file, member, flag) \
+	{ file, offsetof(struct pcaninfo, member), \
+		sizeof(((struct pcaninfo *)0)->member), 1, flag, 0 }
+/** @endcond */
+
+/** Supported sysfs attributes of a PCAN device */
+static const struct pcaninfo_attr pcaninfo_attrs[] = {
+	ATTR_STR(PCAN_FILEINFO_ADAPTER_NAME, adapter_name, PCANINFO_FLAG_ADAPTER_NAME, 0),
+	ATTR_U32(PCAN_FILEINFO_ADAPTER_NB, adapter_nb, PCANINFO_FLAG_ADAPTER_NB, 0),
+	ATTR_STR(PCAN_FILEINFO_ADAPTER_VERSION, adapter_version, PCANINFO_FLAG_ADAPTER_VERSION, 0),
+	ATTR_U32(PCAN_FILEINFO_NOM_BITRATE, nom_bitrate, PCANINFO_FLAG_NOM_BITRATE, 1),
+	ATTR_U32(PCAN_FILEINFO_BTR0BTR1, btr0btr1, PCANINFO_FLAG_BTR0BTR1, 0),
+	ATTR_U32(PCAN_FILEINFO_CLOCK, clock, PCANINFO_FLAG_CLOCK, 1),
+	ATTR_U32_EX(PCAN_FILEINFO_CLK_DRIFT, clk_drift, PCANINFO_FLAG_EX_CLK_DRIFT),
+	ATTR_U32(PCAN_FILEINFO_CTRLNB, ctrlnb, PCANINFO_FLAG_CTRLNB, 0),
+	ATTR_U32(PCAN_FILEINFO_DATA_BITRATE, data_bitrate, PCANINFO_FLAG_DATA_BITRATE, 1),
+	ATTR_STR(PCAN_FILEINFO_DEV, dev, PCANINFO_FLAG_DEV, 1),
+	/* SGr Note: this field, if exists, must be used as device path,
+	 * instead of "path", which is compatible only with the non-RT
+	 * version of the pcan driver. */
+	ATTR_STR_EX(PCAN_FILEINFO_DEV_NAME, dev_name, PCANINFO_FLAG_EX_DEV_NAME),
+	ATTR_U32(PCAN_FILEINFO_DEVID, devid, PCANINFO_FLAG_DEVID, 1),
+	ATTR_U32(PCAN_FILEINFO_ERRORS, errors, PCANINFO_FLAG_ERRORS, 0),
+	ATTR_U32(PCAN_FILEINFO_HWTYPE, hwtype, PCANINFO_FLAG_HWTYPE, 1),
+	ATTR_U32_EX(PCAN_FILEINFO_INIT_FLAGS, init_flags, PCANINFO_FLAG_EX_INIT_FLAGS),
+	ATTR_U32(PCAN_FILEINFO_IRQS, irqs, PCANINFO_FLAG_IRQS, 0),
+	ATTR_U32_EX(PCAN_FILEINFO_MASS_STORAGE_MODE, mass_storage_mode, PCANINFO_FLAG_EX_MASS_STORAGE_MODE),
+	ATTR_U32(PCAN_FILEINFO_MINOR, minor, PCANINFO_FLAG_MINOR, 1),
+	ATTR_U32(PCAN_FILEINFO_READ, read, PCANINFO_FLAG_READ, 0),
+	ATTR_U32(PCAN_FILEINFO_SN, sn, PCANINFO_FLAG_SN, 0),
+	ATTR_U32(PCAN_FILEINFO_STATUS, status, PCANINFO_FLAG_STATUS, 0),
+	ATTR_STR(PCAN_FILEINFO_TYPE, type, PCANINFO_FLAG_TYPE, 0),
+	ATTR_U32(PCAN_FILEINFO_WRITE, write, PCANINFO_FLAG_WRITE, 0),
+	ATTR_U32(PCAN_FILEINFO_BASE, base, PCANINFO_FLAG_BASE, 0),
+	ATTR_U32(PCAN_FILEINFO_IRQ, irq, PCANINFO_FLAG_IRQ, 0),
+	ATTR_U32(PCAN_FILEINFO_BUSLOAD, bus_load, PCANINFO_FLAG_BUSLOAD, 0),
+	ATTR_U32(PCAN_FILEINFO_BUSSTATE, bus_state, PCANINFO_FLAG_BUSSTATE, 0),
+	ATTR_U32(PCAN_FILEINFO_RXERR, rxerr, PCANINFO_FLAG_RXERR, 0),
+	ATTR_U32(PCAN_FILEINFO_TXERR, txerr, PCANINFO_FLAG_TXERR, 0),
+	ATTR_U32(PCAN_FILEINFO_RX_FIFO_RATIO, rx_fifo_ratio, PCANINFO_FLAG_RX_FIFO_RATIO, 0),
+	ATTR_U32(PCAN_FILEINFO_TX_FIFO_RATIO, tx_fifo_ratio, PCANINFO_FLAG_TX_FIFO_RATIO, 0),
+	/* handle extra flags with availflag_ex */
+	ATTR_U32_EX(PCAN_FILEINFO_NOM_BRP, nom_brp, PCANINFO_FLAG_EX_NOM_BRP),
+	ATTR_U32_EX(PCAN_FILEINFO_NOM_SAMPLE_POINT, nom_sample_point, PCANINFO_FLAG_EX_NOM_SAMPLE_POINT),
+	ATTR_U32_EX(PCAN_FILEINFO_NOM_SJW, nom_sjw, PCANINFO_FLAG_EX_NOM_SJW),
+	ATTR_U32_EX(PCAN_FILEINFO_NOM_TSEG1, nom_tseg1, PCANINFO_FLAG_EX_NOM_TSEG1),
+	ATTR_U32_EX(PCAN_FILEINFO_NOM_TSEG2, nom_tseg2, PCANINFO_FLAG_EX_NOM_TSEG2),
+	ATTR_U32_EX(PCAN_FILEINFO_NOM_TQ, nom_tq, PCANINFO_FLAG_EX_NOM_TQ),
+	ATTR_U32_EX(PCAN_FILEINFO_DATA_BRP, data_brp, PCANINFO_FLAG_EX_DATA_BRP),
+	ATTR_U32_EX(PCAN_FILEINFO_DATA_SAMPLE_POINT, data_sample_point, PCANINFO_FLAG_EX_DATA_SAMPLE_POINT),
+	ATTR_U32_EX(PCAN_FILEINFO_DATA_SJW, data_sjw, PCANINFO_FLAG_EX_DATA_SJW),
+	ATTR_U32_EX(PCAN_FILEINFO_DATA_TSEG1, data_tseg1, PCANINFO_FLAG_EX_DATA_TSEG1),
+	ATTR_U32_EX(PCAN_FILEINFO_DATA_TSEG2, data_tseg2, PCANINFO_FLAG_EX_DATA_TSEG2),
+	ATTR_U32_EX(PCAN_FILEINFO_DATA_TQ, data_tq, PCANINFO_FLAG_EX_DATA_TQ),
+	ATTR_U32_EX(PCAN_FILEINFO_TS_FIXED, ts_fixed, PCANINFO_FLAG_EX_TS_FIXED),
+};
+/** Number of supported sysfs attributes */
+#define PCANINFO_ATTR_COUNT	(sizeof(pcaninfo_attrs) / sizeof(pcaninfo_attrs[0]))
+
+/**
+ * Holds opened sysfs attribute files of a device
+ */
+struct pcaninfo_poller {
+	struct pcaninfo *pci;		/**< Device updated by the poller (not owned) */
+	int length;					/**< Number of opened attributes */
+	struct {
+		const struct pcaninfo_attr *attr;	/**< Attribute description */
+		int fd;								/**< Opened attribute file */
+	} attrs[];
+};
+
 /* PRIVATE FUNCTIONS DECLARATIONS */
 /** function used by scandir to get all files except '.' and '..' */
 static int classdir_selector(const struct dirent *ent);
- /**
-  * @fn int load_devinfo(struct pcaninfo * pci)
-  * @brief Retrieves information for a PCAN device.
-  *
-  * @param pci [in,out] {buffer to store PCAN data.
-  * 	classpath and name must be set.}
-  * @return a PCANINFO_ERR_xx status code
-  */
-static int load_devinfo(struct pcaninfo * pci);
 /**
- * @fn int parse_file(struct pcaninfo *pci, char *path, char *filename)
- * @brief Parses a sysfs pcan file and populates the struct pcaninfo buffer
+ * @fn int open_devdir(struct pcaninfo * pci)
+ * @brief Opens (once) the sysfs directory of a PCAN device and caches
+ * its file descriptor in the PCANINFO structure.
+ *
+ * @param pci [in,out] {PCAN device, classpath and name must be set.}
+ * @return The directory file descriptor or -1 on error (errno is set)
+ */
+static int open_devdir(struct pcaninfo * pci);
+/**
+ * @fn int open_attr(int dirfd, const struct pcaninfo_attr *attr)
+ * @brief Opens a sysfs attribute file, trying its legacy name if needed.
+ *
+ * @param[in] dirfd Sysfs directory of the device
+ * @param[in] attr Attribute to open
+ * @return The file descriptor or -1 on error (errno is set)
+ */
+static int open_attr(int dirfd, const struct pcaninfo_attr *attr);
+/**
+ * @fn int pread_attr(struct pcaninfo * pci, const struct pcaninfo_attr *attr, int fd)
+ * @brief Reads (from offset 0) an opened sysfs attribute file and stores its
+ * value in a PCANINFO structure.
+ *
+ * @param[in, out] pci PCANINFO structure to update
+ * @param[in] attr Attribute to read
+ * @param[in] fd File descriptor of the attribute
+ * @return a PCANINFO_ERR_xx status code
+ */
+static int pread_attr(struct pcaninfo * pci, const struct pcaninfo_attr *attr, int fd);
+/**
+ * @fn int load_attrs(struct pcaninfo * pci, uint32_t flags, uint32_t flags_ex)
+ * @brief Loads the selected sysfs attributes of a PCAN device and updates
+ * the derived members ('path' and 'hwcategory').
  *
- * @param[in, out] pci buffer to store data
- * @param[in] path Path of the file to read
- * @param[in] filename Name of the file to read
+ * @param pci [in,out] {buffer to store PCAN data.
+ * 	classpath and name must be set.}
+ * @param flags [in] Attributes to load (see PCANINFO_FLAG_xx)
+ * @param flags_ex [in] Attributes to load (see PCANINFO_FLAG_EX_xx)
  * @return a PCANINFO_ERR_xx status code
  */
-static int parse_file(struct pcaninfo *pci, char *path, char *filename);
+static int load_attrs(struct pcaninfo * pci, uint32_t flags, uint32_t flags_ex);
+/**
+ * @fn enum pcaninfo_hw get_hwcategory(uint32_t hwtype)
+ * @brief Maps a pcan driver hardware type to a PCANINFO category.
+ *
+ * @param hwtype [in] Hardware type (see HW_xx in pcan.h)
+ * @return The PCANINFO hardware category
+ */
+static enum pcaninfo_hw get_hwcategory(uint32_t hwtype);
 
 /**
  * @fn char * pretty_unit(ulong val, char * buffer, size_t len)
@@ -172,16 +305,6 @@ static int parse_file(struct pcaninfo *pci, char *path, char *filename);
  * @return The 'buffer' param
  */
 static char * pretty_unit(ulong val, char * buffer, size_t len);
-/**
- * @fn char * pretty_bus_state(uint state, char * buffer, size_t len)
- * @brief Formats a PCAN bus state.
- *
- * @param[in] val Value to format
- * @param[in, out] Buffer to store the formatted string
- * @param[in] Size of the buffer
- * @return The 'buffer' param
- */
-static char * pretty_bus_state(uint state, char * buffer, size_t len);
 
 /* PRIVATE FUNCTIONS */
 int classdir_selector(const struct dirent *ent) {
@@ -196,365 +319,139 @@ int classdir_selector(const struct dirent *ent) {
 		return 0;
 	return 1;
 }
-int classfile_selector(const struct dirent *ent) {
-	if (ent->d_name[0] == '.') {
-		if (ent->d_name[1] == 0)
-			return 0;
-		if (ent->d_name[1] == '.' &&
-			ent->d_name[2] == 0)
-				return 0;
+int open_devdir(struct pcaninfo * pci) {
+	char path[2 * PCANINFO_MAX_CHAR_SIZE];
+	int fd;
+
+	if (pci->availflag_ex & PCANINFO_FLAG_EX_DIRFD)
+		return pci->dirfd;
+	snprintf(path, sizeof(path), "%s/%s", pci->classpath, pci->name);
+	fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (fd < 0) {
+		int err = errno;
+
+		pcanlog_log(LVL_NORMAL, "ERROR: failed to open directory (errno=%d) '%s'.\n", err, path);
+		errno = err;
+		return -1;
+	}
+	pcanlog_log(LVL_DEBUG, "Opened directory '%s' (fd=%d).\n", path, fd);
+	pci->dirfd = fd;
+	pci->availflag_ex |= PCANINFO_FLAG_EX_DIRFD;
+	return fd;
+}
+
+int open_attr(int dirfd, const struct pcaninfo_attr *attr) {
+	char legacy[PCANINFO_MAX_CHAR_SIZE];
+	int fd;
+
+	fd = openat(dirfd, attr->filename, O_RDONLY | O_CLOEXEC);
+	if (fd < 0 && errno == ENOENT && attr->legacy) {
+		snprintf(legacy, sizeof(legacy), "%s%s", PCAN_FILEINFO_PREFIX_LEGACY, attr->filename);
+		fd = openat(dirfd, legacy, O_RDONLY | O_CLOEXEC);
 	}
-	if (ent->d_type == DT_DIR)
-		return 0;
-	return 1;
+	return fd;
 }
 
-int load_devinfo(struct pcaninfo * pci) {
-	struct dirent **ent;
-	int i, n;
-	char * path;
+int pread_attr(struct pcaninfo * pci, const struct pcaninfo_attr *attr, int fd) {
+	char buf[PCANINFO_ATTR_MAX_SIZE];
+	uint32_t *avail;
+	char *member;
+	ssize_t len;
 
-	/* initialization */
-	n = strnlen(pci->classpath, PCANINFO_MAX_CHAR_SIZE) + strnlen(pci->name, PCANINFO_MAX_CHAR_SIZE) + 2;	/* 2 = '/' + '\0' */
-	path = (char *) malloc(n);
-	if (path == NULL) {
-		pcanlog_log(LVL_NORMAL, "ERROR: failed to allocate memory to scan directory '%s/%s'.\n", pci->classpath, pci->name);
-		return errno = ENOMEM;
-	}
-	snprintf(path, n, "%s/%s", pci->classpath, pci->name);
-	pcanlog_log(LVL_DEBUG, "Scanning directory '%s'...\n", path);
-	/* scan sys dirs */
-	ent = NULL;
-	n = scandir(path, &ent, classfile_selector, alphasort);
-	/* foreach file, load info */
-	for (i = 0; i < n; i++) {
-#ifdef _DIRENT_HAVE_D_TYPE
-		if (ent[i]->d_type == DT_REG)	/* skip directories & links*/
-#endif
-		/* SGr Note: this file is not a pcan one and reading it might
-		 * lead to segfault with Xenomai */
-		if (strcmp(ent[i]->d_name, PCAN_FILEINFO_UEVENT))
-			parse_file(pci, path, ent[i]->d_name);
+	avail = attr->is_ex ? &pci->availflag_ex : &pci->availflag;
+	/* sysfs regenerates the content of an attribute read from offset 0 */
+	len = pread(fd, buf, sizeof(buf) - 1, 0);
+	if (len < 0) {
+		int err = errno;
+
+		pcanlog_log(LVL_NORMAL, "ERROR: failed to read file '%s' (errno=%d).\n", attr->filename, err);
+		*avail &= ~attr->flag;
+		return err;
+	}
+	buf[len] = 0;
+	if (len >= 1 && buf[len - 1] == '\n')
+		buf[len - 1] = 0;
+	member = (char *)pci + attr->offset;
+	if (attr->size) {
+		strncpy(member, buf, attr->size);
+		member[attr->size - 1] = 0;
+	}
+	else
+		*(uint32_t *)member = strtoul(buf, NULL, 0);
+	*avail |= attr->flag;
+	return PCANINFO_ERR_OK;
+}
+
+int load_attrs(struct pcaninfo * pci, uint32_t flags, uint32_t flags_ex) {
+	const struct pcaninfo_attr *attr;
+	int dirfd, fd;
+	size_t i;
 
-		/* SGr Note: fill "path" AFTER having read /sysfs so that 
-		 * "dev_name" can be used instead of "path" in case it has 
-		 * been discovered... */
+	dirfd = open_devdir(pci);
+	if (dirfd < 0)
+		return errno;
+	for (i = 0; i < PCANINFO_ATTR_COUNT; i++) {
+		attr = &pcaninfo_attrs[i];
+		if (!(attr->flag & (attr->is_ex ? flags_ex : flags)))
+			continue;
+		fd = open_attr(dirfd, attr);
+		if (fd < 0) {
+			/* attribute is not (or no more) exported by the driver */
+			if (attr->is_ex)
+				pci->availflag_ex &= ~attr->flag;
+			else
+				pci->availflag &= ~attr->flag;
+			continue;
+		}
+		pread_attr(pci, attr, fd);
+		close(fd);
+	}
 
+	/* SGr Note: fill "path" AFTER having read /sysfs so that
+	 * "dev_name" can be used instead of "path" in case it has
+	 * been discovered... */
+	if (flags_ex & PCANINFO_FLAG_EX_DEV_NAME) {
 		/* RT support: sysfs var "dev_name" holds the correct string to
 		 * open device */
 		if (pci->availflag_ex & PCANINFO_FLAG_EX_DEV_NAME) {
 			strncpy(pci->path, pci->dev_name, sizeof(pci->path));
+			pci->path[sizeof(pci->path) - 1] = 0;
 		} else {
 			/* retrocompatibility with older pcan drivers
 			 * (RT not supported) */
 			snprintf(pci->path, sizeof(pci->path), "/dev/%s", pci->name);
 		}
-
-		free(ent[i]);
 	}
-	switch (pci->hwtype) {
+	if (flags & PCANINFO_FLAG_HWTYPE)
+		pci->hwcategory = get_hwcategory(pci->hwtype);
+	time(&pci->time_update);
+	return PCANINFO_ERR_OK;
+}
+
+enum pcaninfo_hw get_hwcategory(uint32_t hwtype) {
+	switch (hwtype) {
 		case HW_ISA:
 		case HW_ISA_SJA:
-			pci->hwcategory = PCANINFO_HW_ISA;
-			break;
+			return PCANINFO_HW_ISA;
 		case HW_DONGLE_SJA:
 		case HW_DONGLE_SJA_EPP:
 		case HW_DONGLE_PRO:
 		case HW_DONGLE_PRO_EPP:
-			pci->hwcategory = PCANINFO_HW_DNG;
-			break;
+			return PCANINFO_HW_DNG;
 		case HW_PCI:
 		case HW_PCI_FD:
-			pci->hwcategory = PCANINFO_HW_PCI;
-			break;
+			return PCANINFO_HW_PCI;
 		case HW_USB:
 		case HW_USB_PRO:
 		case HW_USB_PRO_FD:
 		case HW_USB_FD:
 		case HW_USB_X6:
-			pci->hwcategory = PCANINFO_HW_USB;
-			break;
+			return PCANINFO_HW_USB;
 		case HW_PCCARD:
-			pci->hwcategory = PCANINFO_HW_PCC;
-			break;
+			return PCANINFO_HW_PCC;
 		default:
-			pci->hwcategory = PCANINFO_HW_NONE;
-			break;
+			return PCANINFO_HW_NONE;
 	}
-	/* mark the structure as initialized */
-	pci->availflag |= PCANINFO_FLAG_INITIALIZED;
-	time(&pci->time_update);
-	/* uninitialize */
-	if (ent)
-		free(ent);
-	if (path)
-		free(path);
-	return PCANINFO_ERR_OK;
-}
-
-int parse_file(struct pcaninfo *pci, char *path, char *filename) {
-	char * filepath;
-	FILE * f;
-	char * line;
-	size_t len;
-	ssize_t read;
-
-	/* Invalid argument ? */
-	if (pci == NULL || path == NULL || filename == NULL ||
-			path[0] == 0 || filename[0] == 0)
-		return errno = EINVAL;
-	/* initialization */
-	filepath = (char *) malloc(strlen(path) + strlen(filename) + 2);
-	if (filepath == NULL) {
-		pcanlog_log(LVL_NORMAL, "ERROR: failed to allocate memory to parse file '%s/%s'.\n", path, filename);
-		return errno = ENOMEM;
-	}
-	sprintf(filepath, "%s/%s", path, filename);
-	pcanlog_log(LVL_DEBUG, "Parsing file '%s'...\n", filepath);
-
-	line = NULL;
-	len = 0;
-	/* open file */
-	f = fopen(filepath, "r");
-	if (f == NULL) {
-		errno = ENOENT;
-		pcanlog_log(LVL_NORMAL, "ERROR: failed to open file '%s'.\n", filepath);
-	}
-	else
-	{
-		/* read first line */
-		read = getline(&line, &len, f);
-		if (read != -1) {
-			/* fill in the right PCANINFO parameter based on filename */
-			if (strcmp(filename, PCAN_FILEINFO_ADAPTER_NAME) == 0) {
-				len = MIN(PCANINFO_MAX_CHAR_SIZE, read);
-				strncpy(pci->adapter_name, line, len);
-				if (len >= 1 && pci->adapter_name[len - 1] == '\n')
-					pci->adapter_name[len - 1] = 0;
-				pci->adapter_name[PCANINFO_MAX_CHAR_SIZE - 1] = 0;
-				pci->availflag |= PCANINFO_FLAG_ADAPTER_NAME;
-			}
-			else if (strcmp(filename, PCAN_FILEINFO_ADAPTER_NB) == 0) {
-				pci->adapter_nb = strtoul(line, NULL, 0);
-				pci->availflag |= PCANINFO_FLAG_ADAPTER_NB;
-			}
-			else if (strcmp(filename, PCAN_FILEINFO_ADAPTER_VERSION) == 0) {
-				len = MIN(PCANINFO_MAX_CHAR_SIZE, read);
-				strncpy(pci->adapter_version, line, len);
-				if (len >= 1 && pci->adapter_version[len - 1] == '\n')
-					pci->adapter_version[len - 1] = 0;
-				pci->adapter_version[PCANINFO_MAX_CHAR_SIZE - 1] = 0;
-				pci->availflag |= PCANINFO_FLAG_ADAPTER_VERSION;
-			}
-			else if (strcmp(filename, PCAN_FILEINFO_NOM_BITRATE) == 0 ||
-					strcmp(filename, LEGACY_GET_FILEINFO_NAME(PCAN_FILEINFO_NOM_BITRATE)) == 0) {
-				pci->nom_bitrate = strtoul(line, NULL, 0);
-				pci->availflag |= PCANINFO_FLAG_NOM_BITRATE;
-			}
-			else if (strcmp(filename, PCAN_FILEINFO_BTR0BTR1) == 0) {
-				pci->btr0btr1 = strtoul(line, NULL, 0);
-				pci->availflag |= PCANINFO_FLAG_BTR0BTR1;
-			}
-			else if (strcmp(filename, PCAN_FILEINFO_CLOCK) == 0 ||
-				strcmp(filename, LEGACY_GET_FILEINFO_NAME(PCAN_FILEINFO_CLOCK)) == 0) {
-				pci->clock = strtoul(line, NULL, 0);
-				pci->availflag |= PCANINFO_FLAG_CLOCK;
-			}
-			else if (strcmp(filename, PCAN_FILEINFO_CLK_DRIFT) == 0) {
-				pci->clk_drift = strtoul(line, NULL, 0);
-				pci->availflag_ex |= PCANINFO_FLAG_EX_CLK_DRIFT;
-			}
-			else if (strcmp(filename, PCAN_FILEINFO_CTRLNB) == 0) {
-				pci->ctrlnb = strtoul(line, NULL, 0);
-				pci->availflag |= PCANINFO_FLAG_CTRLNB;
-			}
-			else if (strcmp(filename, PCAN_FILEINFO_DATA_BITRATE) == 0 ||
-					strcmp(filename, LEGACY_GET_FILEINFO_NAME(PCAN_FILEINFO_DATA_BITRATE)) == 0) {
-				pci->data_bitrate = strtoul(line, NULL, 0);
-				pci->availflag |= PCANINFO_FLAG_DATA_BITRATE;
-			}
-			else if (strcmp(filename, PCAN_FILEINFO_DEV) == 0 ||
-					strcmp(filename, LEGACY_GET_FILEINFO_NAME(PCAN_FILEINFO_DEV)) == 0) {
-				len = MIN(PCANINFO_MAX_CHAR_SIZE, read);
-				strncpy(pci->dev, line, len);
-				if (len >= 1 && pci->dev[len - 1] == '\n')
-					pci->dev[len - 1] = 0;
-				pci->dev[PCANINFO_MAX_CHAR_SIZE - 1] = 0;
-				pci->availflag |= PCANINFO_FLAG_DEV;
-			}
-			else if (strcmp(filename, PCAN_FILEINFO_DEV_NAME) == 0) {
-				len = MIN(sizeof(pci->dev_name), read);
-				strncpy(pci->dev_name, line, len);
-				if (len >= 1 && pci->dev_name[len - 1] == '\n')
-					pci->dev_name[len - 1] = 0;
-				pci->dev_name[sizeof(pci->dev_name) - 1] = 0;
-				pci->availflag_ex |= PCANINFO_FLAG_EX_DEV_NAME;
-
-				/* SGr Note: this field, if exists, must be used
-				 * as device path, instead of "path", which is
-				 * compatible only with the non-RT version of
-				 * the pcan driver. */
-			}
-			else if (strcmp(filename, PCAN_FILEINFO_DEVID) == 0 ||
-					strcmp(filename, LEGACY_GET_FILEINFO_NAME(PCAN_FILEINFO_DEVID)) == 0) {
-				pci->devid = strtoul(line, NULL, 0);
-				pci->availflag |= PCANINFO_FLAG_DEVID;
-			}
-			else if (strcmp(filename, PCAN_FILEINFO_ERRORS) == 0) {
-				pci->errors = strtoul(line, NULL, 0);
-				pci->availflag |= PCANINFO_FLAG_ERRORS;
-			}
-			else if (strcmp(filename, PCAN_FILEINFO_HWTYPE) == 0 ||
-					strcmp(filename, LEGACY_GET_FILEINFO_NAME(PCAN_FILEINFO_HWTYPE)) == 0) {
-				pci->hwtype = strtoul(line, NULL, 0);
-				pci->availflag |= PCANINFO_FLAG_HWTYPE;
-			}
-			else if (strcmp(filename, PCAN_FILEINFO_INIT_FLAGS) == 0) {
-				pci->init_flags = strtoul(line, NULL, 0);
-				pci->availflag_ex |= PCANINFO_FLAG_EX_INIT_FLAGS;
-			}
-			else if (strcmp(filename, PCAN_FILEINFO_IRQS) == 0) {
-				pci->irqs = strtoul(line, NULL, 0);
-				pci->availflag |= PCANINFO_FLAG_IRQS;
-			}
-			else if (strcmp(filename, PCAN_FILEINFO_MASS_STORAGE_MODE) == 0) {
-				pci->mass_storage_mode = strtoul(line, NULL, 0);
-				pci->availflag_ex |= PCANINFO_FLAG_EX_MASS_STORAGE_MODE;
-			}
-			else if (strcmp(filename, PCAN_FILEINFO_MINOR) == 0 ||
-					strcmp(filename, LEGACY_GET_FILEINFO_NAME(PCAN_FILEINFO_MINOR)) == 0) {
-				pci->minor = strtoul(line, NULL, 0);
-				pci->availflag |= PCANINFO_FLAG_MINOR;
-			}
-			else if (strcmp(filename, PCAN_FILEINFO_READ) == 0) {
-				pci->read = strtoul(line, NULL, 0);
-				pci->availflag |= PCANINFO_FLAG_READ;
-			}
-			else if (strcmp(filename, PCAN_FILEINFO_SN) == 0) {
-				pci->sn = strtoul(line, NULL, 0);
-				pci->availflag |= PCANINFO_FLAG_SN;
-			}
-			else if (strcmp(filename, PCAN_FILEINFO_STATUS) == 0) {
-				pci->status = strtoul(line, NULL, 0);
-				pci->availflag |= PCANINFO_FLAG_STATUS;
-			}
-			else if (strcmp(filename, PCAN_FILEINFO_TYPE) == 0) {
-				len = MIN(PCANINFO_MAX_CHAR_SIZE, read);
-				strncpy(pci->type, line, len);
-				if (len >= 1 && pci->type[len - 1] == '\n')
-					pci->type[len - 1] = 0;
-				pci->type[PCANINFO_MAX_CHAR_SIZE - 1] = 0;
-				pci->availflag |= PCANINFO_FLAG_TYPE;
-			}
-			else if (strcmp(filename, PCAN_FILEINFO_WRITE) == 0) {
-				pci->write = strtoul(line, NULL, 0);
-				pci->availflag |= PCANINFO_FLAG_WRITE;
-			}
-			else if (strcmp(filename, PCAN_FILEINFO_BASE) == 0) {
-				pci->base = strtoul(line, NULL, 0);
-				pci->availflag |= PCANINFO_FLAG_BASE;
-			}
-			else if (strcmp(filename, PCAN_FILEINFO_IRQ) == 0) {
-				pci->irq = strtoul(line, NULL, 0);
-				pci->availflag |= PCANINFO_FLAG_IRQ;
-			}
-			else if (strcmp(filename, PCAN_FILEINFO_BUSLOAD) == 0) {
-				pci->bus_load = strtoul(line, NULL, 0);
-				pci->availflag |= PCANINFO_FLAG_BUSLOAD;
-			}
-			else if (strcmp(filename, PCAN_FILEINFO_BUSSTATE) == 0) {
-				pci->bus_state = strtoul(line, NULL, 0);
-				pci->availflag |= PCANINFO_FLAG_BUSSTATE;
-			}
-			else if (strcmp(filename, PCAN_FILEINFO_RXERR) == 0) {
-				pci->rxerr = strtoul(line, NULL, 0);
-				pci->availflag |= PCANINFO_FLAG_RXERR;
-			}
-			else if (strcmp(filename, PCAN_FILEINFO_TXERR) == 0) {
-				pci->txerr = strtoul(line, NULL, 0);
-				pci->availflag |= PCANINFO_FLAG_TXERR;
-			}
-			else if (strcmp(filename, PCAN_FILEINFO_RX_FIFO_RATIO) == 0) {
-				pci->rx_fifo_ratio = strtoul(line, NULL, 0);
-				pci->availflag |= PCANINFO_FLAG_RX_FIFO_RATIO;
-			}
-			else if (strcmp(filename, PCAN_FILEINFO_TX_FIFO_RATIO) == 0) {
-				pci->tx_fifo_ratio = strtoul(line, NULL, 0);
-				pci->availflag |= PCANINFO_FLAG_TX_FIFO_RATIO;
-			}
-			/* handle extra flags with availflag_ex */
-			else if (strcmp(filename, PCAN_FILEINFO_NOM_BRP) == 0) {
-				pci->nom_brp = strtoul(line, NULL, 0);
-				pci->availflag_ex |= PCANINFO_FLAG_EX_NOM_BRP;
-			}
-			else if (strcmp(filename, PCAN_FILEINFO_NOM_SAMPLE_POINT) == 0) {
-				pci->nom_sample_point = strtoul(line, NULL, 0);
-				pci->availflag_ex |= PCANINFO_FLAG_EX_NOM_SAMPLE_POINT;
-			}
-			else if (strcmp(filename, PCAN_FILEINFO_NOM_SJW) == 0) {
-				pci->nom_sjw = strtoul(line, NULL, 0);
-				pci->availflag_ex |= PCANINFO_FLAG_EX_NOM_SJW;
-			}
-			else if (strcmp(filename, PCAN_FILEINFO_NOM_TSEG1) == 0) {
-				pci->nom_tseg1 = strtoul(line, NULL, 0);
-				pci->availflag_ex |= PCANINFO_FLAG_EX_NOM_TSEG1;
-			}
-			else if (strcmp(filename, PCAN_FILEINFO_NOM_TSEG2) == 0) {
-				pci->nom_tseg2 = strtoul(line, NULL, 0);
-				pci->availflag_ex |= PCANINFO_FLAG_EX_NOM_TSEG2;
-			}
-			else if (strcmp(filename, PCAN_FILEINFO_NOM_TQ) == 0) {
-				pci->nom_tq = strtoul(line, NULL, 0);
-				pci->availflag_ex |= PCANINFO_FLAG_EX_NOM_TQ;
-			}
-			else if (strcmp(filename, PCAN_FILEINFO_DATA_BRP) == 0) {
-				pci->data_brp = strtoul(line, NULL, 0);
-				pci->availflag_ex |= PCANINFO_FLAG_EX_DATA_BRP;
-			}
-			else if (strcmp(filename, PCAN_FILEINFO_DATA_SAMPLE_POINT) == 0) {
-				pci->data_sample_point = strtoul(line, NULL, 0);
-				pci->availflag_ex |= PCANINFO_FLAG_EX_DATA_SAMPLE_POINT;
-			}
-			else if (strcmp(filename, PCAN_FILEINFO_DATA_SJW) == 0) {
-				pci->data_sjw = strtoul(line, NULL, 0);
-				pci->availflag_ex |= PCANINFO_FLAG_EX_DATA_SJW;
-			}
-			else if (strcmp(filename, PCAN_FILEINFO_DATA_TSEG1) == 0) {
-				pci->data_tseg1 = strtoul(line, NULL, 0);
-				pci->availflag_ex |= PCANINFO_FLAG_EX_DATA_TSEG1;
-			}
-			else if (strcmp(filename, PCAN_FILEINFO_DATA_TSEG2) == 0) {
-				pci->data_tseg2 = strtoul(line, NULL, 0);
-				pci->availflag_ex |= PCANINFO_FLAG_EX_DATA_TSEG2;
-			}
-			else if (strcmp(filename, PCAN_FILEINFO_DATA_TQ) == 0) {
-				pci->data_tq = strtoul(line, NULL, 0);
-				pci->availflag_ex |= PCANINFO_FLAG_EX_DATA_TQ;
-			}
-			else if (strcmp(filename, PCAN_FILEINFO_TS_FIXED) == 0) {
-				pci->ts_fixed = strtoul(line, NULL, 0);
-				pci->availflag_ex |= PCANINFO_FLAG_EX_TS_FIXED;
-			}
-			else {
-				/* unsupported files */
-				if (strcmp(filename, PCAN_FILEINFO_UEVENT) != 0) {
-					pcanlog_log(LVL_DEBUG, "WARNING: unsupported file '%s'.\n", filename);
-				}
-			}
-		}
-		else {
-			pcanlog_log(LVL_NORMAL, "ERROR: failed to read line in file '%s'.\n", filename);
-			errno = EIO;
-		}
-	}
-	/* uninitialize */
-	if (line)
-		free(line);
-	if (f)
-		fclose(f);
-	if (filepath)
-		free(filepath);
-	return errno;
 }
 
 char * pretty_unit(ulong val, char * buffer, size_t len) {
@@ -611,9 +508,51 @@ char * pretty_bus_state(uint state, char * buffer, size_t len) {
  */
 
 int pcaninfo_update(struct pcaninfo * pci) {
+	int ires;
+
+	if (pci == NULL || pci->classpath == NULL || pci->name[0] == 0)
+		return errno = EINVAL;
+	ires = load_attrs(pci, PCANINFO_ALL_FLAGS, PCANINFO_ALL_FLAGS);
+	if (ires == PCANINFO_ERR_OK)
+		/* mark the structure as initialized */
+		pci->availflag |= PCANINFO_FLAG_INITIALIZED | PCANINFO_FLAG_IDENTIFIED;
+	return ires;
+}
+
+int pcaninfo_refresh(struct pcaninfo * pci, uint32_t flags, uint32_t flags_ex) {
 	if (pci == NULL || pci->classpath == NULL || pci->name[0] == 0)
 		return errno = EINVAL;
-	return load_devinfo(pci);
+	return load_attrs(pci, flags, flags_ex);
+}
+
+void pcaninfo_copy(struct pcaninfo * dst, const struct pcaninfo * src) {
+	if (dst == NULL || src == NULL || dst == src)
+		return;
+	pcaninfo_release(dst);
+	memcpy(dst, src, sizeof(*dst));
+	/* the directory fd is owned by 'src' */
+	dst->availflag_ex &= ~PCANINFO_FLAG_EX_DIRFD;
+	dst->dirfd = -1;
+}
+
+void pcaninfo_release(struct pcaninfo * pci) {
+	if (pci == NULL)
+		return;
+	if (pci->availflag_ex & PCANINFO_FLAG_EX_DIRFD) {
+		close(pci->dirfd);
+		pci->availflag_ex &= ~PCANINFO_FLAG_EX_DIRFD;
+		pci->dirfd = -1;
+	}
+}
+
+void pcaninfo_free(struct pcaninfo_list * pcilist) {
+	int i;
+
+	if (pcilist == NULL)
+		return;
+	for (i = 0; i < pcilist->length; i++)
+		pcaninfo_release(&pcilist->infos[i]);
+	free(pcilist);
 }
 
 int pcaninfo_get(struct pcaninfo_list ** pcilist, int do_init) {
@@ -645,9 +584,21 @@ int pcaninfo_get(struct pcaninfo_list ** pcilist, int do_init) {
 	if (npcan > 0) {
 		for (i = 0; i < npcan; i++) {
 			pcil->infos[i].classpath = PCAN_CLASS_PATH;
+			pcil->infos[i].dirfd = -1;
 			strncpy(pcil->infos[i].name, entpcan[i]->d_name, entpcan[i]->d_reclen);
-			if (do_init)
-				load_devinfo(&pcil->infos[i]);
+			switch (do_init) {
+			case PCANINFO_INIT_NONE:
+				break;
+			case PCANINFO_INIT_IDENT:
+				/* only what is needed to select and open a device,
+				 * other attributes are loaded on demand */
+				if (load_attrs(&pcil->infos[i], PCANINFO_IDENT_FLAGS, PCANINFO_IDENT_FLAGS_EX) == PCANINFO_ERR_OK)
+					pcil->infos[i].availflag |= PCANINFO_FLAG_IDENTIFIED;
+				break;
+			default:
+				pcaninfo_update(&pcil->infos[i]);
+				break;
+			}
 			free(entpcan[i]);
 		}
 	}
@@ -892,7 +843,7 @@ int pcaninfo_print(void) {
 	int i, ires;
 
 	pcilist = NULL;
-	ires = pcaninfo_get(&pcilist, 1);
+	ires = pcaninfo_get(&pcilist, PCANINFO_INIT_FULL);
 	if (ires != 0)
 		return ires;
 
@@ -905,7 +856,7 @@ int pcaninfo_print(void) {
 		pcaninfo_output(&pcilist->infos[i]);
 		fprintf(stdout, "\n");
 	}
-	free(pcilist);
+	pcaninfo_free(pcilist);
 	return ires;
 }
 
@@ -1018,3 +969,117 @@ char* pcaninfo_bitrate_to_init_string(struct pcaninfo * pci, char *buffer, uint
 	return buffer;
 }
 
+int pcaninfo_monitor_open(void) {
+	int fd;
+
+	fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (fd < 0) {
+		pcanlog_log(LVL_VERBOSE, "Failed to create inotify descriptor (errno=%d).\n", errno);
+		return -1;
+	}
+	if (inotify_add_watch(fd, PCAN_CLASS_PATH, PCANINFO_MONITOR_MASK) < 0) {
+		pcanlog_log(LVL_VERBOSE, "Failed to watch directory '%s' (errno=%d).\n", PCAN_CLASS_PATH, errno);
+		close(fd);
+		return -1;
+	}
+	/* kernfs does not always notify the creation of class devices,
+	 * the device nodes (created by devtmpfs or udev) are watched too */
+	if (inotify_add_watch(fd, PCAN_DEV_PATH, PCANINFO_MONITOR_MASK) < 0)
+		pcanlog_log(LVL_VERBOSE, "Failed to watch directory '%s' (errno=%d).\n", PCAN_DEV_PATH, errno);
+	return fd;
+}
+
+int pcaninfo_monitor_poll(int fd) {
+	char buf[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+	const struct inotify_event *ev;
+	ssize_t len;
+	char *ptr;
+	int changed;
+
+	changed = 0;
+	for (;;) {
+		len = read(fd, buf, sizeof(buf));
+		if (len < 0) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				break;
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		if (len == 0)
+			break;
+		for (ptr = buf; ptr < buf + len; ptr += sizeof(*ev) + ev->len) {
+			ev = (const struct inotify_event *) ptr;
+			/* lost events or watched directory removed */
+			if (ev->mask & (IN_Q_OVERFLOW | IN_IGNORED | IN_DELETE_SELF | IN_MOVE_SELF))
+				return -1;
+			/* every pcan device (and device node) is named 'pcanXXX' */
+			if (ev->len > 0 && strncmp(ev->name, PCAN_USBMISC_PREFIX, strlen(PCAN_USBMISC_PREFIX)) == 0) {
+				pcanlog_log(LVL_DEBUG, "Device '%s' %s.\n", ev->name,
+						(ev->mask & (IN_CREATE | IN_MOVED_TO)) ? "added" : "removed");
+				changed = 1;
+			}
+		}
+	}
+	return changed;
+}
+
+struct pcaninfo_poller * pcaninfo_poller_open(struct pcaninfo * pci, uint32_t flags, uint32_t flags_ex) {
+	struct pcaninfo_poller *poller;
+	const struct pcaninfo_attr *attr;
+	int dirfd, fd;
+	size_t i;
+
+	if (pci == NULL || pci->classpath == NULL || pci->name[0] == 0) {
+		errno = EINVAL;
+		return NULL;
+	}
+	dirfd = open_devdir(pci);
+	if (dirfd < 0)
+		return NULL;
+	poller = (struct pcaninfo_poller *) calloc(1, sizeof(*poller) +
+			PCANINFO_ATTR_COUNT * sizeof(poller->attrs[0]));
+	if (poller == NULL) {
+		errno = ENOMEM;
+		return NULL;
+	}
+	poller->pci = pci;
+	for (i = 0; i < PCANINFO_ATTR_COUNT; i++) {
+		attr = &pcaninfo_attrs[i];
+		if (!(attr->flag & (attr->is_ex ? flags_ex : flags)))
+			continue;
+		fd = open_attr(dirfd, attr);
+		if (fd < 0)
+			continue;
+		poller->attrs[poller->length].attr = attr;
+		poller->attrs[poller->length].fd = fd;
+		poller->length++;
+	}
+	pcanlog_log(LVL_DEBUG, "Polling %d attributes of '%s'.\n", poller->length, pci->name);
+	return poller;
+}
+
+int pcaninfo_poller_read(struct pcaninfo_poller * poller) {
+	int i, ires, err;
+
+	if (poller == NULL)
+		return errno = EINVAL;
+	ires = PCANINFO_ERR_OK;
+	for (i = 0; i < poller->length; i++) {
+		err = pread_attr(poller->pci, poller->attrs[i].attr, poller->attrs[i].fd);
+		if (err != PCANINFO_ERR_OK)
+			ires = err;
+	}
+	time(&poller->pci->time_update);
+	return ires;
+}
+
+void pcaninfo_poller_close(struct pcaninfo_poller * poller) {
+	int i;
+
+	if (poller == NULL)
+		return;
+	for (i = 0; i < poller->length; i++)
+		close(poller->attrs[i].fd);
+	free(poller);
+}
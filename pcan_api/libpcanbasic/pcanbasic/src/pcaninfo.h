@@ -76,6 +76,7 @@
 #define PCANINFO_FLAG_ADAPTER_VERSION	(1<<25)	/**< 'adapter_version' parameter is defined */
 #define PCANINFO_FLAG_RX_FIFO_RATIO	(1<<26)	/**< 'adapter_version' parameter is defined */
 #define PCANINFO_FLAG_TX_FIFO_RATIO	(1<<27)	/**< 'adapter_version' parameter is defined */
+#define PCANINFO_FLAG_IDENTIFIED	(1<<28)	/**< identification parameters are loaded (see PCANINFO_IDENT_FLAGS) */
 
 #define PCANINFO_FLAG_EX_NOM_BRP	(1<<0)	/**< 'nom_brp' parameter is defined */
 #define PCANINFO_FLAG_EX_NOM_SJW	(1<<1)	/**< 'nom_sjw' parameter is defined */
@@ -94,8 +95,33 @@
 #define PCANINFO_FLAG_EX_NOM_TQ		(1<<14)			/**< 'nom_tq' parameter is defined */
 #define PCANINFO_FLAG_EX_TS_FIXED	(1<<15)			/**< 'ts_fixed' parameter is defined */
 #define PCANINFO_FLAG_EX_CLK_DRIFT	(1<<16)			/**< 'clk_drift' parameter is defined */
+#define PCANINFO_FLAG_EX_DIRFD		(1U<<31)			/**< 'dirfd' holds an opened sysfs directory */
 /** @} */
 
+/**
+ * @defgroup PCANINFO_INIT Values for parameter 'do_init' of pcaninfo_get()
+ *
+ * @{
+ */
+#define PCANINFO_INIT_NONE	0	/**< only 'classpath' and 'name' are set */
+#define PCANINFO_INIT_FULL	1	/**< every sysfs attribute is loaded */
+#define PCANINFO_INIT_IDENT	2	/**< only identification attributes are loaded */
+/** @} */
+
+/**
+ * Attributes loaded with PCANINFO_INIT_IDENT: those are the ones
+ * required to map a device to a TPCANHandle and to open it.
+ */
+#define PCANINFO_IDENT_FLAGS	(PCANINFO_FLAG_HWTYPE | PCANINFO_FLAG_MINOR | \
+				PCANINFO_FLAG_BASE | PCANINFO_FLAG_IRQ)
+#define PCANINFO_IDENT_FLAGS_EX	(PCANINFO_FLAG_EX_DEV_NAME)
+/** Mask selecting all the attributes of a device */
+#define PCANINFO_ALL_FLAGS	0xffffffffU
+/** Attributes that change while a device is used (counters and bus state) */
+#define PCANINFO_VOLATILE_FLAGS	(PCANINFO_FLAG_BUSLOAD | PCANINFO_FLAG_BUSSTATE | \
+				PCANINFO_FLAG_RXERR | PCANINFO_FLAG_TXERR | \
+				PCANINFO_FLAG_READ | PCANINFO_FLAG_WRITE)
+
 /**
  * Defines the number of available categories in PCANINFO Hardware
  */
@@ -174,6 +200,7 @@ struct pcaninfo {
 
 	time_t time_update;
 	enum pcaninfo_hw hwcategory;		/**< Hardware category code */
+	int dirfd;							/**< Cached sysfs directory (valid if PCANINFO_FLAG_EX_DIRFD is set) */
 };
 
 /**
@@ -199,14 +226,57 @@ extern "C" {
  */
 int pcaninfo_update(struct pcaninfo * pci);
 
+/**
+ * @fn int pcaninfo_refresh(struct pcaninfo * pci, uint32_t flags, uint32_t flags_ex)
+ * @brief Reloads only the selected attributes of a PCANINFO structure
+ * (classpath and name must be initialized). Attributes are read with
+ * pread() from the cached sysfs directory of the device, which is opened
+ * on first use.
+ *
+ * @param[in, out] pci Pointer to the PCANINFO structure to update
+ * @param[in] flags Attributes to reload (see PCANINFO_FLAG_xx)
+ * @param[in] flags_ex Extra attributes to reload (see PCANINFO_FLAG_EX_xx)
+ * @return Status error code (0 if no error)
+ */
+int pcaninfo_refresh(struct pcaninfo * pci, uint32_t flags, uint32_t flags_ex);
+
+/**
+ * @fn void pcaninfo_copy(struct pcaninfo * dst, const struct pcaninfo * src)
+ * @brief Copies a PCANINFO structure. The cached sysfs directory is not
+ * shared: the copy opens its own on its next refresh.
+ *
+ * @param[in, out] dst Pointer to the destination PCANINFO structure
+ * 		(zeroed or previously initialized, its resources are released)
+ * @param[in] src Pointer to the PCANINFO structure to copy
+ */
+void pcaninfo_copy(struct pcaninfo * dst, const struct pcaninfo * src);
+
+/**
+ * @fn void pcaninfo_release(struct pcaninfo * pci)
+ * @brief Releases the resources (cached sysfs directory) held by a
+ * PCANINFO structure. The structure itself is not freed.
+ *
+ * @param[in, out] pci Pointer to the PCANINFO structure to release
+ */
+void pcaninfo_release(struct pcaninfo * pci);
+
+/**
+ * @fn void pcaninfo_free(struct pcaninfo_list * pcilist)
+ * @brief Releases and frees a list returned by pcaninfo_get().
+ *
+ * @param[in] pcilist The list to free (may be NULL)
+ */
+void pcaninfo_free(struct pcaninfo_list * pcilist);
+
 /**
  * @fn int pcaninfo_get(struct pcaninfo_list ** pcilist)
  * @brief Retrieves available PCAN devices' information.
  *
  * @param[out] pcilist buffer to store PCAN devices' information
- * @param[in] do_init state if the PCANINFO should be fully initialized (value=1)
- * 		otherwise (value=0) only the following members are valid:
- * 		'classpath', 'name'.
+ * @param[in] do_init state if the PCANINFO should be fully initialized
+ * 		(PCANINFO_INIT_FULL), only identified (PCANINFO_INIT_IDENT),
+ * 		otherwise (PCANINFO_INIT_NONE) only the following members are
+ * 		valid: 'classpath', 'name'.
  * @return Status error code (0 if no error)
  */
 int pcaninfo_get(struct pcaninfo_list ** pcilist, int do_init);
@@ -219,6 +289,17 @@ int pcaninfo_get(struct pcaninfo_list ** pcilist, int do_init);
  */
 void pcaninfo_output(struct pcaninfo * pci);
 
+/**
+ * @fn char * pretty_bus_state(uint state, char * buffer, size_t len)
+ * @brief Formats a PCAN bus state.
+ *
+ * @param[in] state Bus state to format (PCANFD_ERROR_xxx)
+ * @param[in, out] buffer Buffer to store the formatted string
+ * @param[in] len Size of the buffer
+ * @return The 'buffer' param
+ */
+char * pretty_bus_state(uint state, char * buffer, size_t len);
+
 /**
  * @fn int pcaninfo_print(void)
  * @brief Discovers PCAN devices and prints to std output their information
@@ -259,6 +340,63 @@ char* pcaninfo_bitrate_to_string(struct pcaninfo * pci, char *buffer, uint size)
 */
 char* pcaninfo_bitrate_to_init_string(struct pcaninfo * pci, char *buffer, uint size);
 
+/**
+* @fn int pcaninfo_monitor_open(void)
+* @brief Creates a non-blocking inotify descriptor notified when PCAN
+* devices are plugged or unplugged (entries of the pcan sysfs class and
+* pcan device nodes).
+*
+* @return The inotify file descriptor or -1 if the devices can not be
+* 	monitored (errno is set)
+*/
+int pcaninfo_monitor_open(void);
+
+/**
+* @fn int pcaninfo_monitor_poll(int fd)
+* @brief Consumes the pending events of a descriptor returned by
+* pcaninfo_monitor_open() without blocking.
+*
+* @param[in] fd The inotify file descriptor
+* @return 1 if PCAN devices changed, 0 if not, -1 if the monitor is no
+* 	more valid (ex. pcan driver removed) and should be closed
+*/
+int pcaninfo_monitor_poll(int fd);
+
+/**
+ * Holds opened sysfs attribute files of a device (see pcaninfo_poller_open)
+ */
+struct pcaninfo_poller;
+
+/**
+* @fn struct pcaninfo_poller * pcaninfo_poller_open(struct pcaninfo * pci, uint32_t flags, uint32_t flags_ex)
+* @brief Opens the selected sysfs attributes of a device once, so that they
+* can be re-read periodically at the cost of a single pread() each.
+*
+* @param[in] pci PCANINFO structure updated by pcaninfo_poller_read(), it
+* 	must remain valid until the poller is closed
+* @param[in] flags Attributes to poll (ex. PCANINFO_VOLATILE_FLAGS)
+* @param[in] flags_ex Extra attributes to poll (see PCANINFO_FLAG_EX_xx)
+* @return The poller or NULL on error (errno is set)
+*/
+struct pcaninfo_poller * pcaninfo_poller_open(struct pcaninfo * pci, uint32_t flags, uint32_t flags_ex);
+
+/**
+* @fn int pcaninfo_poller_read(struct pcaninfo_poller * poller)
+* @brief Re-reads the attributes held by a poller into its PCANINFO structure.
+*
+* @param[in] poller The poller
+* @return Status error code (0 if no error, ex. ENODEV if device was removed)
+*/
+int pcaninfo_poller_read(struct pcaninfo_poller * poller);
+
+/**
+* @fn void pcaninfo_poller_close(struct pcaninfo_poller * poller)
+* @brief Closes the attributes held by a poller and frees it.
+*
+* @param[in] poller The poller (may be NULL)
+*/
+void pcaninfo_poller_close(struct pcaninfo_poller * poller);
+
 #ifdef __cplusplus
 };
 #endif
@@ -34,6 +34,8 @@
 #include <errno.h>		/* to handle errno returned by libpcanfd */
 #include <unistd.h>		/* usleep */
 #include <ctype.h>		/* isspace */
+#include <time.h>		/* clock_gettime */
+#include <pthread.h>	/* pthread_create */
 
 /* NOTE: the new PCANBasic API uses libpcanfd source code, here is why:
  *  - to avoid code duplication. libpcanfd and pcanbasic both use
@@ -57,6 +59,8 @@
 #include "resource.h"		/* used to translate error msgs */
 #include "pcblog.h"			/* pcanbasic-logger used by get/set_value */
 #include "pcbtrace.h"		/* pcanbasic-logger used by get/set_value */
+#include "pcbtransport.h"	/* pcan chardev, SocketCAN or virtual channels */
+#include "pcbwire.h"		/* wire time of frames, predicted bus load */
 #include "version.h"		/* API version */
 
 #if !defined(LOG_LEVEL)
@@ -89,9 +93,15 @@
 #define DEFAULT_PARAM_RCV_STATUS		PCAN_PARAMETER_ON
 /**
  * Minimum time elapsed (in µs) before refreshing the struct pcaninfo devices
+ * (only used if devices can not be monitored with inotify)
  */
 #define PCANINFO_TIME_REFRESH		100000
 
+/**
+ * Maximum length of a CAN FD initialization string
+ */
+#define FD_PARAM_INIT_MAX_LEN		500
+
 /**
  * Maximum size for hardware name
  */
@@ -115,6 +125,20 @@
 /** @} */
 
 /* PRIVATE TYPES	*/
+/**
+ * Stores a CAN FD bit rate string compiled once (see CAN_CreateBitrateFDProfile).
+ */
+struct _pcanbasic_fd_profile {
+	struct pcanfd_init init;	/**< Bit timings, as given to pcanfd_set_init (bitrate fields are 0). */
+	__u32 nom_bitrate;			/**< Computed nominal bit rate (bps). */
+	__u32 data_bitrate;			/**< Computed data bit rate (bps). */
+	__u32 validated_hwtype;		/**< Type of the hardware whose bit timing ranges were checked (0 if none). */
+	int refcount;				/**< Number of users (application and channels). */
+	size_t len;					/**< Length of 'bitratefd'. */
+	char bitratefd[];			/**< Bit rate string as given by the application. */
+};
+/** bit timing ranges of a CAN FD device (nominal and data) */
+struct __array_of_struct(pcanfd_bittiming_range, 2);
 /**
  * Stores information on an initialized PCANBasic channel.
  * This structure maps a TPCANHandle to a file descriptor,
@@ -123,8 +147,9 @@
 struct _pcanbasic_channel {
 	TPCANHandle channel;		/**< CAN channel. */
 	TPCANBaudrate btr0btr1; 	/**< Nominal bit rate as BTR0BTR1. */
-	TPCANBitrateFD bitratefd;	/**< String configuration for nominal & data bit rates. */
+	struct _pcanbasic_fd_profile *fd_profile;	/**< Compiled nominal & data bit rates (FD only, referenced). */
 	int fd;						/**< File descriptor, if 0 then channel is not initialized. */
+	const struct pcbtransport *tp;	/**< Operations on the file descriptor (pcan chardev or SocketCAN). */
 	uint fd_flags;				/**< File descriptor's flags for libpcanfd. */
 	__u8 bitrate_adapting;		/**< Allows initialization with already opened channels. */
 	__u8 busoff_reset;			/**< Automatically resets bus when busoff. */
@@ -134,8 +159,26 @@ struct _pcanbasic_channel {
 	SLIST_ENTRY(_pcanbasic_channel) entries;	/**< Single linked list. */
 
 	struct pcbtrace_ctx	tracer;	/**< PCANBasic tracing context. */
+	TPCANInitTiming init_timing;	/**< Durations of the last FD initialization. */
+	struct pcbwire_load tx_load;	/**< Bus load predicted from the written frames. */
+	struct pcbwire_load rx_load;	/**< Bus load predicted from the read frames. */
+	__u8 load_metering;			/**< Frames are accounted in tx_load/rx_load (set by the first PCAN_BUSLOAD* query). */
 };
 typedef struct _pcanbasic_channel pcanbasic_channel;
+/**
+ * Stores the state of an on-going CAN FD initialization. The 'open' step
+ * only uses this context so that it can run in parallel for several channels.
+ */
+struct _pcanbasic_fd_init_ctx {
+	TPCANHandle channel;				/**< CAN channel to initialize. */
+	struct _pcanbasic_fd_profile *profile;	/**< Requested bit rates (referenced by the caller). */
+	pcanbasic_channel *pchan;			/**< Channel being initialized (NULL if none). */
+	__u8 inserted;						/**< States if 'pchan' was already in the channels list. */
+	TPCANStatus sts;					/**< Status of the initialization. */
+	struct timespec t_start;			/**< Start time of the initialization. */
+	TPCANInitTiming timing;			/**< Durations of the initialization steps. */
+};
+typedef struct _pcanbasic_fd_init_ctx pcanbasic_fd_init_ctx;
 /**
  * PCANBASIC Core persistent data
  */
@@ -143,6 +186,8 @@ struct _pcanbasic_core {
 	int initialized;				/**< States if structure (SLIST especially) was initialized. */
 	struct timeval last_update;		/**< Time of the last pcaninfo hw update (avoid unnecessary updates). */
 	struct pcaninfo_list *devices;	/**< Known pcan devices list. */
+	int devices_monitor;			/**< inotify fd invalidating 'devices' on hot-plug (-1 if unavailable). */
+	struct timeval last_monitor_open;	/**< Time of the last attempt to open 'devices_monitor'. */
 	SLIST_HEAD(PCANBASIC_channel_SLIST, _pcanbasic_channel) channels;	/* First element of the linked list of initialized channels. */
 };
 typedef struct _pcanbasic_core pcanbasic_core;
@@ -174,6 +219,14 @@ static void pcanbasic_init(void);
  * @brief Updates struct pcaninfo device list.
  */
 static void pcanbasic_refresh_hw(void);
+/**
+ * @fn struct pcaninfo_list * pcanbasic_get_devices(void)
+ * @brief Returns the cached list of PCAN devices, the list is only
+ * rebuilt when devices are plugged or unplugged.
+ *
+ * @return The list of known PCAN devices (may be NULL)
+ */
+static struct pcaninfo_list * pcanbasic_get_devices(void);
 /**
  * @fn void pcanbasic_atexit(void)
  * @brief Cleans up API's objects.
@@ -229,6 +282,7 @@ static TPCANStatus pcanbasic_errno_to_status(int err);
 static TPCANStatus pcanbasic_errno_to_status_ctx(int err, int ctx);
 #define PCB_CTX_READ 1
 #define PCB_CTX_WRITE 2
+#define PCB_CTX_OPTION 3
 /**
  * @fn pcanbasic_channel* pcanbasic_create_channel(TPCANHandle channel, __u8 add_to_list)
  * @brief Allocates and initializes a pcanbasic_channel structure.
@@ -239,6 +293,72 @@ static TPCANStatus pcanbasic_errno_to_status_ctx(int err, int ctx);
  */
 static pcanbasic_channel* pcanbasic_create_channel(TPCANHandle channel, __u8 add_to_list);
 
+/**
+ * @fn const struct pcbtransport * pcanbasic_get_transport(TPCANHandle channel, struct pcaninfo *pinfo)
+ * @brief Gets the transport of a channel: SocketCAN if the channel is mapped
+ * to an interface (see PCBSOCKETCAN_ENV), a virtual bus if it is mapped to
+ * one (see PCBVIRTUAL_ENV), the pcan driver otherwise.
+ *
+ * @param channel The handle of the channel.
+ * @param pinfo Device information of the channel, its name and path are
+ * 	set to the interface or bus if the channel is mapped to one.
+ * @return The transport of the channel.
+ */
+static const struct pcbtransport * pcanbasic_get_transport(TPCANHandle channel, struct pcaninfo *pinfo);
+
+/**
+ * @fn int pcanbasic_is_pcan_device(TPCANHandle channel)
+ * @brief Tells if a channel is a pcan device, i.e. if it is not mapped to a
+ * SocketCAN interface nor to a virtual bus (those don't need sysfs).
+ *
+ * @param channel The handle of the channel.
+ * @return 1 if the channel is a pcan device, 0 otherwise.
+ */
+static int pcanbasic_is_pcan_device(TPCANHandle channel);
+
+/**
+ * @fn int pcanbasic_open_transport(pcanbasic_channel *pchan)
+ * @brief Opens a channel which is not a pcan device (SocketCAN interface or
+ * virtual bus) with the bit rates of its initialization.
+ *
+ * @param pchan The channel, its transport is set by pcanbasic_get_transport.
+ * @return A file descriptor or a negative errno.
+ */
+static int pcanbasic_open_transport(pcanbasic_channel *pchan);
+
+/**
+ * @fn void pcanbasic_get_bitrates(const pcanbasic_channel *pchan, __u32 *nom_bitrate, __u32 *data_bitrate)
+ * @brief Gets the bit rates of the initialization of a channel (FD bit rate
+ * profile, or BTR0BTR1 at 8 MHz).
+ *
+ * @param pchan The channel.
+ * @param nom_bitrate Buffer receiving the nominal bit rate (bps).
+ * @param data_bitrate Buffer receiving the data bit rate (bps, 0 if not FD).
+ */
+static void pcanbasic_get_bitrates(const pcanbasic_channel *pchan, __u32 *nom_bitrate, __u32 *data_bitrate);
+
+/**
+ * @fn void pcanbasic_account_msgs(const pcanbasic_channel *pchan, struct pcbwire_load *load, const struct pcanfd_msg *list, __u32 count)
+ * @brief Accounts the wire time of CAN messages in a predicted bus load,
+ * once the bus load was queried on the channel (nothing is done before).
+ *
+ * @param pchan The channel, giving the bit rates.
+ * @param load Bus load of the channel (tx_load or rx_load).
+ * @param list Messages written or read (status messages are ignored).
+ * @param count Number of messages in 'list'.
+ */
+static void pcanbasic_account_msgs(const pcanbasic_channel *pchan, struct pcbwire_load *load,
+		const struct pcanfd_msg *list, __u32 count);
+
+/**
+ * @fn __u32 pcanbasic_get_load(struct pcbwire_load *load)
+ * @brief Returns a predicted bus load at the current time.
+ *
+ * @param load Bus load of a channel.
+ * @return The bus load of the last complete window (1/100 %).
+ */
+static __u32 pcanbasic_get_load(struct pcbwire_load *load);
+
 /**
  * @fn TPCANStatus pcanbasic_bus_state_to_condition(enum pcanfd_status	bus_state)
  * @brief Returns the channel condition based on a pcanfd_status enum.
@@ -292,6 +412,54 @@ static TPCANStatus pcanbasic_get_version(pcanbasic_channel * pchan, char * buf,
  * @return 0 if no error, an errno otherwise.
  */
 static int pcanbasic_parse_fd_init(struct pcanfd_init * pfdi, TPCANBitrateFD fdbitrate);
+/**
+ * @fn TPCANStatus pcanbasic_initialize_fd_prepare(pcanbasic_fd_init_ctx *ctx)
+ * @brief Finds the device of a CAN FD channel, parses its bit rates and
+ * checks it can be initialized (first step of an FD initialization).
+ *
+ * @param ctx Initialization context ('channel' and 'profile' must be set)
+ * @return A TPCANStatus error code (also stored in ctx->sts)
+ */
+static TPCANStatus pcanbasic_initialize_fd_prepare(pcanbasic_fd_init_ctx *ctx);
+/**
+ * @fn void * pcanbasic_initialize_fd_open(void *arg)
+ * @brief Opens and configures the device of a prepared CAN FD channel
+ * (second step of an FD initialization). Only the channel of the context
+ * is accessed, so it can be used as a thread routine.
+ *
+ * @param arg Initialization context (pcanbasic_fd_init_ctx)
+ * @return NULL (status is stored in the context)
+ */
+static void * pcanbasic_initialize_fd_open(void *arg);
+/**
+ * @fn void pcanbasic_initialize_fd_commit(pcanbasic_fd_init_ctx *ctx)
+ * @brief Inserts an opened channel in the list of initialized channels or
+ * releases it if its device was not opened (last step of an FD initialization).
+ *
+ * @param ctx Initialization context
+ */
+static void pcanbasic_initialize_fd_commit(pcanbasic_fd_init_ctx *ctx);
+/**
+ * @fn int pcanbasic_fd_profile_check(const struct _pcanbasic_fd_profile *profile, const struct pcanfd_bittiming_range *ranges, __u32 count)
+ * @brief Checks the bit timings of a profile against the ranges of a device.
+ *
+ * @param profile The profile to check
+ * @param ranges Nominal (and data) bit timing ranges of the device
+ * @param count Number of items in 'ranges' (data bit rate is not checked if 1)
+ * @return 0 if the bit timings fit the ranges, EINVAL otherwise
+ */
+static int pcanbasic_fd_profile_check(const struct _pcanbasic_fd_profile *profile,
+		const struct pcanfd_bittiming_range *ranges, __u32 count);
+/**
+ * @fn void pcanbasic_fd_profile_release(struct _pcanbasic_fd_profile *profile)
+ * @brief Drops a reference to a profile, freeing it when it is no more used.
+ */
+static void pcanbasic_fd_profile_release(struct _pcanbasic_fd_profile *profile);
+/**
+ * @fn __u32 pcanbasic_elapsed_us(const struct timespec *from, const struct timespec *to)
+ * @brief Returns the duration between two timestamps in microseconds.
+ */
+static __u32 pcanbasic_elapsed_us(const struct timespec *from, const struct timespec *to);
 /**
  * @fn TPCANStatus pcanbasic_read_common(TPCANHandle channel, TPCANMsgFD* message, struct timeval *t)
  * @brief A common function to read CAN messages (CAN20 or CANFD message).
@@ -311,6 +479,22 @@ static TPCANStatus pcanbasic_read_common(TPCANHandle channel, TPCANMsgFD* messag
  * @return A TPCANStatus error code.
  */
 static TPCANStatus pcanbasic_write_common(TPCANHandle channel, TPCANMsgFD* message);
+/**
+ * @fn void pcanbasic_msg_to_basic(const struct pcanfd_msg *msg, TPCANMsgFD* message)
+ * @brief Converts a libpcanfd message into a PCANBasic message.
+ *
+ * @param[in] msg Message or event received from the driver.
+ * @param[out] message Buffer to store the PCANBasic message.
+ */
+static void pcanbasic_msg_to_basic(const struct pcanfd_msg *msg, TPCANMsgFD* message);
+/**
+ * @fn void pcanbasic_msg_from_basic(const TPCANMsgFD* message, struct pcanfd_msg *msg)
+ * @brief Converts a PCANBasic message into a libpcanfd message.
+ *
+ * @param[in] message PCANBasic message to convert.
+ * @param[out] msg Buffer to store the libpcanfd message.
+ */
+static void pcanbasic_msg_from_basic(const TPCANMsgFD* message, struct pcanfd_msg *msg);
 
 /* PRIVATE VARIABLES	*/
 /**
@@ -343,21 +527,67 @@ void pcanbasic_init(void) {
 	pcanlog_log(LVL_VERBOSE, "Initializing PCAN-Basic API...\n");
 	SLIST_INIT(&g_basiccore.channels);
 	g_basiccore.devices = NULL;
-	pcanbasic_refresh_hw();
+	g_basiccore.devices_monitor = -1;
+	/* devices are scanned at the first lookup of a pcan device */
 	g_basiccore.initialized = 1;
 	atexit(pcanbasic_atexit);
 }
 
 void pcanbasic_refresh_hw(void) {
 	if (g_basiccore.devices) {
-		free(g_basiccore.devices);
+		pcaninfo_free(g_basiccore.devices);
 		g_basiccore.devices = NULL;
 	}
 	pcanlog_log(LVL_VERBOSE, "Refreshing hardware device list...\n");
-	pcaninfo_get(&g_basiccore.devices, 1);
+	/* other attributes are loaded when a device is actually selected */
+	pcaninfo_get(&g_basiccore.devices, PCANINFO_INIT_IDENT);
 	gettimeofday(&g_basiccore.last_update, NULL);
 }
 
+struct pcaninfo_list * pcanbasic_get_devices(void) {
+	struct timeval t, tsub;
+	int refresh;
+
+	refresh = (g_basiccore.devices == NULL);
+	if (g_basiccore.devices_monitor < 0) {
+		/* (re)install the hot-plug monitor BEFORE scanning devices,
+		 * so that no event can be missed; while the driver is absent,
+		 * retry no more often than the timed rescans */
+		gettimeofday(&t, NULL);
+		timersub(&t, &g_basiccore.last_monitor_open, &tsub);
+		if (tsub.tv_sec > 0 || tsub.tv_usec > PCANINFO_TIME_REFRESH) {
+			g_basiccore.last_monitor_open = t;
+			g_basiccore.devices_monitor = pcaninfo_monitor_open();
+		}
+		if (g_basiccore.devices_monitor > -1)
+			refresh = 1;
+		else {
+			/* devices can not be monitored: fallback to timed rescans */
+			timersub(&t, &g_basiccore.last_update, &tsub);
+			if (tsub.tv_sec > 0 || tsub.tv_usec > PCANINFO_TIME_REFRESH)
+				refresh = 1;
+		}
+	}
+	else {
+		switch (pcaninfo_monitor_poll(g_basiccore.devices_monitor)) {
+		case 0:
+			break;
+		case 1:
+			refresh = 1;
+			break;
+		default:
+			/* monitor is lost (ex. driver removed) */
+			close(g_basiccore.devices_monitor);
+			g_basiccore.devices_monitor = -1;
+			refresh = 1;
+			break;
+		}
+	}
+	if (refresh)
+		pcanbasic_refresh_hw();
+	return g_basiccore.devices;
+}
+
 void pcanbasic_atexit(void) {
 	pcanbasic_channel *plist;
 
@@ -370,8 +600,12 @@ void pcanbasic_atexit(void) {
 	for (plist = g_basiccore.channels.slh_first; plist != NULL; plist = plist->entries.sle_next) {
 		pcanbasic_uninitialize(plist->channel);
 	}
+	if (g_basiccore.devices_monitor > -1) {
+		close(g_basiccore.devices_monitor);
+		g_basiccore.devices_monitor = -1;
+	}
 	if (g_basiccore.devices) {
-		free(g_basiccore.devices);
+		pcaninfo_free(g_basiccore.devices);
 		g_basiccore.devices = NULL;
 		memset(&g_basiccore, 0, sizeof(g_basiccore));
 	}
@@ -403,19 +637,18 @@ void pcanbasic_free_channel(pcanbasic_channel * pchan) {
 	if (pchan->fd > -1) {
 		// check pending tx msgs
 		struct pcanfd_state fds;
-		pcanfd_get_state(pchan->fd, &fds);
+		pchan->tp->get_state(pchan->fd, &fds);
 		if (fds.tx_pending_msgs > 0) {
 			// wait some time to transmit any pending msgs
 			usleep(50000);
 		}
-		pcanfd_close(pchan->fd);
+		pchan->tp->close(pchan->fd);
 		pchan->fd = -1;
 	}
-	if (pchan->bitratefd) {
-		free(pchan->bitratefd);
-		pchan->bitratefd = NULL;
-	}
+	pcanbasic_fd_profile_release(pchan->fd_profile);
+	pchan->fd_profile = NULL;
 	if (pchan->pinfo) {
+		pcaninfo_release(pchan->pinfo);
 		free(pchan->pinfo);
 		pchan->pinfo = NULL;
 	}
@@ -519,13 +752,10 @@ struct pcaninfo * pcanbasic_get_device(TPCANHandle channel, uint hwtype, uint ba
 	struct pcaninfo * pinfo;
 	enum pcaninfo_hw hw;
 	uint index, count;
-	struct timeval t, tsub;
 
-	/* get time to see if device hw info needs an update */
-	gettimeofday(&t, NULL);
-	timersub(&t, &g_basiccore.last_update, &tsub);
-	if (tsub.tv_sec > 0 || tsub.tv_usec > PCANINFO_TIME_REFRESH)
-		pcanbasic_refresh_hw();
+	/* get the (cached) known devices */
+	if (pcanbasic_get_devices() == NULL)
+		return NULL;
 	/* get the device's hardware category and minor/index from the channel */
 	pcanbasic_get_hw(channel, &hw, &index);
 	/* detection algorithm depends on HW being plug'n play */
@@ -603,6 +833,12 @@ TPCANStatus pcanbasic_errno_to_status_ctx(int err, int ctx) {
 		case PCB_CTX_WRITE:
 			return PCAN_ERROR_QXMTFULL;
 		}
+		break;
+	case EOPNOTSUPP:
+		/* an option the transport does not support is an unknown parameter */
+		if (ctx == PCB_CTX_OPTION)
+			return PCAN_ERROR_ILLPARAMTYPE;
+		break;
 	}
 	return pcanbasic_errno_to_status(err);
 }
@@ -621,6 +857,7 @@ pcanbasic_channel* pcanbasic_create_channel(TPCANHandle channel, __u8 add_to_lis
 	}
 	pchan->channel = channel;
 	pchan->fd = -1;
+	pchan->tp = &pcbtransport_pcanfd;
 	pchan->bitrate_adapting = DEFAULT_PARAM_BITRATE_ADAPTING;
 	pchan->listen_only = DEFAULT_PARAM_LISTEN_ONLY;
 	pchan->rcv_status = DEFAULT_PARAM_RCV_STATUS;
@@ -631,6 +868,89 @@ pcanbasic_channel* pcanbasic_create_channel(TPCANHandle channel, __u8 add_to_lis
 	return pchan;
 }
 
+const struct pcbtransport * pcanbasic_get_transport(TPCANHandle channel, struct pcaninfo *pinfo) {
+	const struct pcbtransport *tp;
+	char name[PCBSOCKETCAN_IFNAME_SIZE];
+
+	if (pcbtransport_lookup(PCBSOCKETCAN_ENV, channel, name, sizeof(name)))
+		tp = &pcbtransport_socketcan;
+	else if (pcbtransport_lookup(PCBVIRTUAL_ENV, channel, name, PCBVIRTUAL_NAME_SIZE)) {
+		tp = &pcbtransport_virtual;
+		pinfo->hwcategory = PCANINFO_HW_VIRTUAL;
+	}
+	else
+		return &pcbtransport_pcanfd;
+	snprintf(pinfo->name, sizeof(pinfo->name), "%s", name);
+	snprintf(pinfo->path, sizeof(pinfo->path), "%s", name);
+	return tp;
+}
+
+int pcanbasic_is_pcan_device(TPCANHandle channel) {
+	char name[PCBSOCKETCAN_IFNAME_SIZE];
+
+	return !pcbtransport_lookup(PCBSOCKETCAN_ENV, channel, name, sizeof(name)) &&
+			!pcbtransport_lookup(PCBVIRTUAL_ENV, channel, name, sizeof(name));
+}
+
+void pcanbasic_get_bitrates(const pcanbasic_channel *pchan, __u32 *nom_bitrate, __u32 *data_bitrate) {
+	__u32 brp, tq;
+
+	if (pchan->fd_profile != NULL) {
+		*nom_bitrate = pchan->fd_profile->nom_bitrate;
+		*data_bitrate = pchan->fd_profile->data_bitrate;
+		return;
+	}
+	/* SJA1000 BTR0BTR1 at 8 MHz */
+	brp = 1 + ((pchan->btr0btr1 & 0x3f00) >> 8);
+	tq = 1 + (1 + ((pchan->btr0btr1 & 0x0070) >> 4)) + (1 + (pchan->btr0btr1 & 0x000f));
+	*nom_bitrate = 8000000 / (brp * tq);
+	*data_bitrate = 0;
+}
+
+void pcanbasic_account_msgs(const pcanbasic_channel *pchan, struct pcbwire_load *load,
+		const struct pcanfd_msg *list, __u32 count) {
+	struct timespec t;
+	__u32 i, nom_bitrate, data_bitrate;
+	__u64 busy = 0;
+
+	if (!pchan->load_metering)
+		return;
+	pcanbasic_get_bitrates(pchan, &nom_bitrate, &data_bitrate);
+	for (i = 0; i < count; i++) {
+		/* status and error events do not take any bus time */
+		if (list[i].type == PCANFD_TYPE_CAN20_MSG || list[i].type == PCANFD_TYPE_CANFD_MSG)
+			busy += pcbwire_frame_ns(&list[i], nom_bitrate, data_bitrate);
+	}
+	if (busy == 0)
+		return;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	pcbwire_load_add(load, t.tv_sec * 1000000000ULL + t.tv_nsec, busy);
+}
+
+__u32 pcanbasic_get_load(struct pcbwire_load *load) {
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return pcbwire_load_get(load, t.tv_sec * 1000000000ULL + t.tv_nsec);
+}
+
+int pcanbasic_open_transport(pcanbasic_channel *pchan) {
+	__u32 nom_bitrate, data_bitrate;
+	int fd;
+
+	if (pchan->tp == &pcbtransport_socketcan)
+		fd = pcbsocketcan_open(pchan->pinfo->name, pchan->fd_profile != NULL);
+	else {
+		pcanbasic_get_bitrates(pchan, &nom_bitrate, &data_bitrate);
+		fd = pcbvirtual_open(pchan->pinfo->name, pchan->fd_profile != NULL,
+				nom_bitrate, data_bitrate);
+	}
+	if (fd < 0)
+		pcanlog_log(LVL_NORMAL, "ERROR: failed to open '%s' (%s transport, err=%d).\n",
+				pchan->pinfo->name, pchan->tp->name, fd);
+	return fd;
+}
+
 TPCANStatus pcanbasic_bus_state_to_condition(enum pcanfd_status	bus_state) {
 	TPCANStatus sts;
 
@@ -660,13 +980,13 @@ __u8 pcanbasic_get_filter(pcanbasic_channel * pchan) {
 
 	pfml = NULL;
 	memset(&fds, 0, sizeof(fds));
-	pcanfd_get_state(pchan->fd, &fds);
+	pchan->tp->get_state(pchan->fd, &fds);
 	res = PCAN_FILTER_CLOSE;
 
 	if (fds.filters_counter > 0) {
 		pfml = calloc(1, sizeof(*pfml) + fds.filters_counter * sizeof(pfml->list[0]));
 		pfml->count = fds.filters_counter;
-		ires = pcanfd_get_filters(pchan->fd, pfml);
+		ires = pchan->tp->get_filters(pchan->fd, pfml);
 		if (!ires) {
 			bclosed = 1;
 			/* the driver check for all filters
@@ -719,7 +1039,7 @@ TPCANStatus pcanbasic_get_condition(TPCANHandle channel) {
 	if (pchan == NULL) {
 		/* get device via sysfs */
 		pci = pcanbasic_get_device(channel, 0, 0, 0);
-		if (pci)
+		if (pci && pcaninfo_refresh(pci, PCANINFO_FLAG_BUSSTATE, 0) == 0)
 			sts = (pci->bus_state == 0) ? PCAN_CHANNEL_AVAILABLE : PCAN_CHANNEL_OCCUPIED;
 		else
 			sts = PCAN_CHANNEL_UNAVAILABLE;
@@ -744,6 +1064,8 @@ int pcanbasic_get_features(TPCANHandle channel) {
 	if (pchan == NULL) {
 		/* get device via sysfs */
 		pci = pcanbasic_get_device(channel, 0, 0, 0);
+		if (pci)
+			pcaninfo_refresh(pci, PCANINFO_FLAG_DATA_BITRATE, 0);
 	}
 	else
 		pci = pchan->pinfo;
@@ -752,7 +1074,7 @@ int pcanbasic_get_features(TPCANHandle channel) {
 		if (pchan != NULL) {
 			// get inter-frame delay
 			ibuf = 0;
-			ires = pcanfd_get_option(pchan->fd, PCANFD_OPT_IFRAME_DELAYUS, &ibuf, sizeof(ibuf));
+			ires = pchan->tp->get_option(pchan->fd, PCANFD_OPT_IFRAME_DELAYUS, &ibuf, sizeof(ibuf));
 			if (ires >= 0)
 				value |= FEATURE_DELAY_CAPABLE;
 		}
@@ -764,7 +1086,7 @@ TPCANStatus pcanbasic_get_version(pcanbasic_channel * pchan, char * buf, int siz
 	struct pcanfd_state fds;
 	int ires;
 
-	ires = pcanfd_get_state(pchan->fd, &fds);
+	ires = pchan->tp->get_state(pchan->fd, &fds);
 	if (ires == 0) {
 		snprintf(buf, size, "%d.%d.%d", fds.ver_major, fds.ver_minor, fds.ver_subminor);
 		return PCAN_ERROR_OK;
@@ -831,12 +1153,12 @@ int pcanbasic_parse_fd_init(struct pcanfd_init * pfdi, TPCANBitrateFD fdbitrate)
 	 * f_clock_mhz=20, nom_brp=5, nom_tseg1=2, nom_tseg2=1, nom_sjw=1, data_brp=2, data_tseg1=3, data_tseg2=1, data_sjw=1
 	 */
 	memset(pfdi, 0, sizeof(*pfdi));
-	sfd_init = strndup(fdbitrate, 500);
+	sfd_init = strndup(fdbitrate, FD_PARAM_INIT_MAX_LEN);
 	if (sfd_init == NULL)
 		return ENOMEM;
 	pcanlog_log(LVL_DEBUG, "Parsing FD string: '%s'.\n", sfd_init);
-	tok = strtok_r(sfd_init, ",", &saveptr1);
-	while (tok) {
+	/* the next token is taken before any 'continue' */
+	for (tok = strtok_r(sfd_init, ",", &saveptr1); tok; tok = strtok_r(NULL, ",", &saveptr1)) {
 		pcanlog_log(LVL_DEBUG, "Parsing key/value pair: '%s'.\n", tok);
 		skey = strtok_r(tok, "=", &saveptr2);
 		if (skey == NULL)
@@ -878,80 +1200,266 @@ int pcanbasic_parse_fd_init(struct pcanfd_init * pfdi, TPCANBitrateFD fdbitrate)
 		else if(strcmp(skey, FD_PARAM_INIT_DATA_SJW) == 0) {
 			pfdi->data.sjw = val;
 		}
-		tok = strtok_r(NULL, ",", &saveptr1);
 	}
 	free(sfd_init);
 	return 0;
 }
 
-TPCANStatus pcanbasic_read_common(
-        TPCANHandle channel,
-		TPCANMsgFD* message,
-		struct timeval *t) {
+TPCANStatus pcanbasic_initialize_fd_prepare(pcanbasic_fd_init_ctx *ctx) {
 	TPCANStatus sts;
 	pcanbasic_channel *pchan;
-	struct pcanfd_msg msg;
-	int ires;
+	struct pcaninfo * pinfo;
+	struct timespec t;
 
-	if (message == NULL) {
-		sts = PCAN_ERROR_ILLPARAMVAL;
-		goto pcanbasic_read_common_exit;
+	clock_gettime(CLOCK_MONOTONIC, &ctx->t_start);
+	ctx->pchan = NULL;
+	ctx->inserted = 0;
+	/* check if channel exists */
+	pchan = pcanbasic_get_channel(ctx->channel, 0);
+	if (pchan != NULL) {
+		/* channel is already initialized */
+		if (pchan->fd > -1) {
+			sts = PCAN_ERROR_INITIALIZE;
+			/* initialized with different bitrate */
+			if (pchan->bitrate_adapting && pchan->fd_profile != NULL &&
+					strcmp(pchan->fd_profile->bitratefd, ctx->profile->bitratefd) == 0)
+				sts = PCAN_ERROR_CAUTION;
+			goto pcanbasic_initialize_fd_prepare_exit;
+		}
+		/* channel is not initialized */
+		else {
+			/* this means that flags were set for initialization
+			 * jump directly after malloc */
+			ctx->inserted = 1;
+			goto pcanbasic_initialize_malloc_post;
+		}
 	}
-	/* get initialized channel */
-	pchan = pcanbasic_get_channel(channel, 1);
+	/* allocate and initialize a new PCANBASIC_channel */
+	pchan = pcanbasic_create_channel(ctx->channel, 0);
 	if (pchan == NULL) {
-		sts = PCAN_ERROR_INITIALIZE;
-		goto pcanbasic_read_common_exit;
+		errno = ENOMEM;
+		sts = PCAN_ERROR_UNKNOWN;
+		goto pcanbasic_initialize_fd_prepare_exit;
 	}
-	/* read msg via libpcanfd */
-	ires = pcanfd_recv_msg(pchan->fd, &msg);
-	/* SGr Notes: move return code test next to the function call */
-	if (ires < 0) {
-		sts = pcanbasic_errno_to_status_ctx(-ires, PCB_CTX_READ);
-		goto pcanbasic_read_common_exit;
+
+pcanbasic_initialize_malloc_post:
+	ctx->pchan = pchan;
+	sts = PCAN_ERROR_OK;
+	/* channel mapped to a SocketCAN interface or virtual bus: no pcan device */
+	pchan->tp = pcanbasic_get_transport(ctx->channel, pchan->pinfo);
+	if (pchan->tp != &pcbtransport_pcanfd) {
+		ctx->profile->refcount++;
+		pcanbasic_fd_profile_release(pchan->fd_profile);
+		pchan->fd_profile = ctx->profile;
+		goto pcanbasic_initialize_fd_prepare_exit;
 	}
-	/* discard message if rcv_status is OFF */
-	if (pchan->rcv_status == PCAN_PARAMETER_OFF) {
-		sts = PCAN_ERROR_QRCVEMPTY;
-		goto pcanbasic_read_common_exit;
+	/* find a corresponding device */
+	pinfo = pcanbasic_get_device(ctx->channel, 0, 0, 0);
+	if (pinfo == NULL) {
+		sts = PCAN_ERROR_NODRIVER;
+		goto pcanbasic_initialize_fd_prepare_exit;
 	}
-	sts = PCAN_ERROR_OK;
-	/* convert msg to PCANBasic structure */
+	/* complete struct initialization */
+	ctx->profile->refcount++;
+	pcanbasic_fd_profile_release(pchan->fd_profile);
+	pchan->fd_profile = ctx->profile;
+	pcaninfo_copy(pchan->pinfo, pinfo);
+	pcaninfo_refresh(pchan->pinfo, PCANINFO_FLAG_BUSSTATE |
+			PCANINFO_FLAG_NOM_BITRATE | PCANINFO_FLAG_DATA_BITRATE, 0);
+	/* check if CAN channel is used by another application */
+	if (pchan->pinfo->bus_state != 0) {
+		/* check bitrate adaptation */
+		if (!pchan->bitrate_adapting) {
+			/* not allowed, both bit rates must match */
+			if (pchan->pinfo->nom_bitrate != ctx->profile->nom_bitrate ||
+				pchan->pinfo->data_bitrate != ctx->profile->data_bitrate) {
+				sts = PCAN_ERROR_INITIALIZE;
+				goto pcanbasic_initialize_fd_prepare_exit;
+			}
+		}
+		else {
+			sts = PCAN_ERROR_CAUTION;
+		}
+	}
+
+pcanbasic_initialize_fd_prepare_exit:
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	ctx->timing.prepare_us = pcanbasic_elapsed_us(&ctx->t_start, &t);
+	ctx->sts = sts;
+	return sts;
+}
+
+void * pcanbasic_initialize_fd_open(void *arg) {
+	pcanbasic_fd_init_ctx *ctx = (pcanbasic_fd_init_ctx *) arg;
+	pcanbasic_channel *pchan = ctx->pchan;
+	struct timespec t0, t1;
+
+	struct _pcanbasic_fd_profile *profile = ctx->profile;
+	struct pcanfd_bittiming_ranges_2 ranges;
+	struct pcanfd_init init;
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	if (pchan->tp != &pcbtransport_pcanfd) {
+		pchan->fd = pcanbasic_open_transport(pchan);
+		clock_gettime(CLOCK_MONOTONIC, &t1);
+		ctx->timing.open_us = pcanbasic_elapsed_us(&t0, &t1);
+		if (pchan->fd < 0)
+			ctx->sts = PCAN_ERROR_ILLOPERATION;
+		return NULL;
+	}
+	pchan->fd_flags = OFD_BITRATE | OFD_DBITRATE | OFD_BRPTSEGSJW | OFD_CLOCKHZ | OFD_NONBLOCKING;
+	if (pchan->listen_only == PCAN_PARAMETER_ON)
+		pchan->fd_flags |= PCANFD_INIT_LISTEN_ONLY;
+	if (profile->validated_hwtype == pchan->pinfo->hwtype) {
+		/* profile is known to fit this kind of hardware */
+		pchan->fd = pcanfd_open(pchan->pinfo->path, pchan->fd_flags,
+				profile->init.nominal.brp, profile->init.nominal.tseg1,
+				profile->init.nominal.tseg2, profile->init.nominal.sjw,
+				profile->init.data.brp, profile->init.data.tseg1,
+				profile->init.data.tseg2, profile->init.data.sjw,
+				profile->init.clock_Hz);
+	}
+	else {
+		/* check the bit timings against the device capabilities
+		 * before applying them */
+		pchan->fd = pcanfd_open(pchan->pinfo->path, OFD_NONBLOCKING |
+				(pchan->fd_flags & PCANFD_INIT_LISTEN_ONLY));
+		if (pchan->fd > -1) {
+			memset(&ranges, 0, sizeof(ranges));
+			ranges.count = 2;
+			if (pcanfd_get_bittiming_ranges(pchan->fd, (struct pcanfd_bittiming_ranges *) &ranges) < 0) {
+				/* driver can not tell: let pcanfd_set_init() decide */
+				pcanlog_log(LVL_VERBOSE, "Bit timing ranges of '%s' are not available.\n", pchan->pinfo->path);
+			}
+			else if (pcanbasic_fd_profile_check(profile, ranges.list, ranges.count) != 0) {
+				pcanlog_log(LVL_NORMAL, "ERROR: bit rates {%s} are out of the ranges of '%s'.\n",
+						profile->bitratefd, pchan->pinfo->path);
+				pchan->tp->close(pchan->fd);
+				pchan->fd = -1;
+				ctx->sts = PCAN_ERROR_ILLPARAMVAL;
+			}
+		}
+		if (pchan->fd > -1) {
+			init = profile->init;
+			init.flags |= pchan->fd_flags & PCANFD_INIT_LISTEN_ONLY;
+			if (pchan->tp->set_init(pchan->fd, &init) < 0) {
+				pchan->tp->close(pchan->fd);
+				pchan->fd = -1;
+			}
+			else
+				profile->validated_hwtype = pchan->pinfo->hwtype;
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	ctx->timing.open_us = pcanbasic_elapsed_us(&t0, &t1);
+	if (pchan->fd < 0) {
+		if (ctx->sts != PCAN_ERROR_ILLPARAMVAL)
+			ctx->sts = PCAN_ERROR_ILLOPERATION;
+		return NULL;
+	}
+	/* remove previously set filters */
+	pchan->tp->del_filters(pchan->fd);
+	/* refresh pcaninfo struct to update bitrate information
+	 * (and load the attributes skipped by the device scan) */
+	if (ctx->sts == PCAN_ERROR_OK || !(pchan->pinfo->availflag & PCANINFO_FLAG_INITIALIZED))
+		pcaninfo_update(pchan->pinfo);
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	ctx->timing.setup_us = pcanbasic_elapsed_us(&t1, &t0);
+	return NULL;
+}
+
+void pcanbasic_initialize_fd_commit(pcanbasic_fd_init_ctx *ctx) {
+	pcanbasic_channel *pchan = ctx->pchan;
+	struct timespec t;
+
+	/* failed initializations are timed too (see pcanbasic_initialize_fd_many) */
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	ctx->timing.total_us = pcanbasic_elapsed_us(&ctx->t_start, &t);
+	if (pchan == NULL)
+		return;
+	if (pchan->fd < 0) {
+		if (ctx->inserted)
+			SLIST_REMOVE(&g_basiccore.channels, pchan, _pcanbasic_channel, entries);
+		pcanbasic_free_channel(pchan);
+		ctx->pchan = NULL;
+		return;
+	}
+	pchan->init_timing = ctx->timing;
+	/* insert new channel info in list */
+	if (!ctx->inserted)
+		SLIST_INSERT_HEAD(&g_basiccore.channels, pchan, entries);
+	pcanlog_log(LVL_VERBOSE, "Channel 0x%02x initialized in %u us (prepare=%u us, open=%u us, setup=%u us).\n",
+			ctx->channel, ctx->timing.total_us, ctx->timing.prepare_us,
+			ctx->timing.open_us, ctx->timing.setup_us);
+}
+
+__u32 pcanbasic_elapsed_us(const struct timespec *from, const struct timespec *to) {
+	return (__u32) ((to->tv_sec - from->tv_sec) * 1000000LL +
+			(to->tv_nsec - from->tv_nsec) / 1000);
+}
+
+int pcanbasic_fd_profile_check(const struct _pcanbasic_fd_profile *profile,
+		const struct pcanfd_bittiming_range *ranges, __u32 count) {
+	const struct pcan_bittiming *bt;
+	const struct pcanfd_bittiming_range *r;
+	__u32 i;
+
+	for (i = 0; i < count && i < 2; i++) {
+		bt = (i == 0) ? &profile->init.nominal : &profile->init.data;
+		r = &ranges[i];
+		if (bt->brp < r->brp_min || bt->brp > r->brp_max ||
+				(r->brp_inc > 1 && (bt->brp - r->brp_min) % r->brp_inc) ||
+				bt->tseg1 < r->tseg1_min || bt->tseg1 > r->tseg1_max ||
+				bt->tseg2 < r->tseg2_min || bt->tseg2 > r->tseg2_max ||
+				bt->sjw < r->sjw_min || bt->sjw > r->sjw_max) {
+			pcanlog_log(LVL_VERBOSE, "%s bit timing brp=%u tseg1=%u tseg2=%u sjw=%u out of range "
+					"(brp=[%u..%u]/%u tseg1=[%u..%u] tseg2=[%u..%u] sjw=[%u..%u]).\n",
+					(i == 0) ? "Nominal" : "Data", bt->brp, bt->tseg1, bt->tseg2, bt->sjw,
+					r->brp_min, r->brp_max, r->brp_inc, r->tseg1_min, r->tseg1_max,
+					r->tseg2_min, r->tseg2_max, r->sjw_min, r->sjw_max);
+			return EINVAL;
+		}
+	}
+	return 0;
+}
+
+void pcanbasic_fd_profile_release(struct _pcanbasic_fd_profile *profile) {
+	if (profile == NULL)
+		return;
+	if (--profile->refcount <= 0)
+		free(profile);
+}
+
+void pcanbasic_msg_to_basic(const struct pcanfd_msg *msg, TPCANMsgFD* message) {
 	memset(message, 0, sizeof(*message));
-	message->ID = msg.id;
-	message->DLC = pcanbasic_get_fd_dlc(msg.data_len);
-	switch (msg.type) {
+	message->ID = msg->id;
+	message->DLC = pcanbasic_get_fd_dlc(msg->data_len);
+	switch (msg->type) {
 	case PCANFD_TYPE_CANFD_MSG:
 		message->MSGTYPE |= PCAN_MESSAGE_FD;
 		/* no break */
 	case PCANFD_TYPE_CAN20_MSG:
-		if (msg.data_len > sizeof(message->DATA))
-			pcanlog_log(LVL_ALWAYS, "Received malformed CAN message (data_len=%d)", msg.data_len);
-		memcpy(message->DATA, msg.data, msg.data_len);
+		if (msg->data_len > sizeof(message->DATA))
+			pcanlog_log(LVL_ALWAYS, "Received malformed CAN message (data_len=%d)", msg->data_len);
+		memcpy(message->DATA, msg->data, msg->data_len);
 		/* standard or extended CAN msg */
-		if((msg.flags & PCANFD_MSG_EXT) == PCANFD_MSG_EXT)
+		if((msg->flags & PCANFD_MSG_EXT) == PCANFD_MSG_EXT)
 			message->MSGTYPE |= PCAN_MESSAGE_EXTENDED;
 		else
 			message->MSGTYPE |= PCAN_MESSAGE_STANDARD;
 		/* RTR msg ? */
-		if((msg.flags & PCANFD_MSG_RTR) == PCANFD_MSG_RTR)
+		if((msg->flags & PCANFD_MSG_RTR) == PCANFD_MSG_RTR)
 			message->MSGTYPE |= PCAN_MESSAGE_RTR;
 		/* FD flags */
-		if((msg.flags & PCANFD_MSG_BRS) == PCANFD_MSG_BRS)
+		if((msg->flags & PCANFD_MSG_BRS) == PCANFD_MSG_BRS)
 			message->MSGTYPE |= PCAN_MESSAGE_BRS;
-		if((msg.flags & PCANFD_MSG_ESI) == PCANFD_MSG_ESI)
+		if((msg->flags & PCANFD_MSG_ESI) == PCANFD_MSG_ESI)
 			message->MSGTYPE |= PCANFD_MSG_ESI;
 		break;
 	case PCANFD_TYPE_STATUS:
-		if (pchan->busoff_reset && (msg.flags & PCANFD_ERROR_BUS) && msg.id == PCANFD_ERROR_BUSOFF) {
-			/* auto-reset */
-			pcanbasic_reset(channel);
-			sts = PCAN_ERROR_BUSOFF;
-			goto pcanbasic_read_common_exit;
-		}
 		message->MSGTYPE = PCAN_MESSAGE_STATUS;
 		message->DLC = 4;
-		switch (msg.id) {
+		switch (msg->id) {
 		case PCANFD_ERROR_WARNING:
 			message->DATA[3] |= CAN_ERR_BUSLIGHT;
 			break;
@@ -981,14 +1489,80 @@ TPCANStatus pcanbasic_read_common(
 		}
 		break;
 	case PCANFD_TYPE_ERROR_MSG:
-		message->ID = 1 << msg.id;
+		message->ID = 1 << msg->id;
 		message->MSGTYPE = PCAN_MESSAGE_ERRFRAME;
-		message->DATA[0] = (msg.flags & PCANFD_ERRMSG_RX) == PCANFD_ERRMSG_RX ? 1 : 0;
-		message->DATA[1] = msg.data[0];
-		message->DATA[2] = msg.ctrlr_data[0];
-		message->DATA[3] = msg.ctrlr_data[1];
+		message->DATA[0] = (msg->flags & PCANFD_ERRMSG_RX) == PCANFD_ERRMSG_RX ? 1 : 0;
+		message->DATA[1] = msg->data[0];
+		message->DATA[2] = msg->ctrlr_data[0];
+		message->DATA[3] = msg->ctrlr_data[1];
 		break;
 	}
+}
+
+void pcanbasic_msg_from_basic(const TPCANMsgFD* message, struct pcanfd_msg *msg) {
+	memset(msg, 0, sizeof(*msg));
+	msg->id = message->ID;
+	msg->data_len = pcanbasic_get_fd_len(message->DLC);
+	memcpy(msg->data, message->DATA, msg->data_len);
+	/* set message FD type */
+	if ((message->MSGTYPE & PCAN_MESSAGE_FD) == PCAN_MESSAGE_FD)
+		msg->type = PCANFD_TYPE_CANFD_MSG;
+	else
+		msg->type = PCANFD_TYPE_CAN20_MSG;
+	/* set message type */
+	if ((message->MSGTYPE & PCAN_MESSAGE_EXTENDED) == PCAN_MESSAGE_EXTENDED)
+		msg->flags = PCANFD_MSG_EXT;
+	else
+		msg->flags = PCANFD_MSG_STD;
+	/* set extra flags */
+	if ((message->MSGTYPE & PCAN_MESSAGE_RTR) == PCAN_MESSAGE_RTR)
+		msg->flags |= PCANFD_MSG_RTR;
+	if ((message->MSGTYPE & PCAN_MESSAGE_BRS) == PCAN_MESSAGE_BRS)
+		msg->flags |= PCANFD_MSG_BRS;
+}
+
+TPCANStatus pcanbasic_read_common(
+        TPCANHandle channel,
+		TPCANMsgFD* message,
+		struct timeval *t) {
+	TPCANStatus sts;
+	pcanbasic_channel *pchan;
+	struct pcanfd_msg msg;
+	int ires;
+
+	if (message == NULL) {
+		sts = PCAN_ERROR_ILLPARAMVAL;
+		goto pcanbasic_read_common_exit;
+	}
+	/* get initialized channel */
+	pchan = pcanbasic_get_channel(channel, 1);
+	if (pchan == NULL) {
+		sts = PCAN_ERROR_INITIALIZE;
+		goto pcanbasic_read_common_exit;
+	}
+	/* read msg via libpcanfd */
+	ires = pchan->tp->recv_msg(pchan->fd, &msg);
+	/* SGr Notes: move return code test next to the function call */
+	if (ires < 0) {
+		sts = pcanbasic_errno_to_status_ctx(-ires, PCB_CTX_READ);
+		goto pcanbasic_read_common_exit;
+	}
+	/* discard message if rcv_status is OFF */
+	if (pchan->rcv_status == PCAN_PARAMETER_OFF) {
+		sts = PCAN_ERROR_QRCVEMPTY;
+		goto pcanbasic_read_common_exit;
+	}
+	/* check bus-off auto-reset */
+	if (msg.type == PCANFD_TYPE_STATUS && pchan->busoff_reset &&
+		(msg.flags & PCANFD_ERROR_BUS) && msg.id == PCANFD_ERROR_BUSOFF) {
+		pcanbasic_reset(channel);
+		sts = PCAN_ERROR_BUSOFF;
+		goto pcanbasic_read_common_exit;
+	}
+	sts = PCAN_ERROR_OK;
+	pcanbasic_account_msgs(pchan, &pchan->rx_load, &msg, 1);
+	/* convert msg to PCANBasic structure */
+	pcanbasic_msg_to_basic(&msg, message);
 	/* copy timestamp */
 	if (t != NULL)
 		*t = msg.timestamp;
@@ -1022,28 +1596,10 @@ TPCANStatus pcanbasic_write_common(
 		goto pcanbasic_write_exit;
 	}
 	/* convert message and send it */
-	memset(&msg, 0, sizeof(msg));
-	msg.id = message->ID;
-	msg.data_len = pcanbasic_get_fd_len(message->DLC);
-	memcpy(msg.data, message->DATA, msg.data_len);
-	/* set message FD type */
-	if ((message->MSGTYPE & PCAN_MESSAGE_FD) == PCAN_MESSAGE_FD)
-		msg.type = PCANFD_TYPE_CANFD_MSG;
-	else
-		msg.type = PCANFD_TYPE_CAN20_MSG;
-	/* set message type */
-	if ((message->MSGTYPE & PCAN_MESSAGE_EXTENDED) == PCAN_MESSAGE_EXTENDED)
-		msg.flags = PCANFD_MSG_EXT;
-	else
-		msg.flags = PCANFD_MSG_STD;
-	/* set extra flags */
-	if ((message->MSGTYPE & PCAN_MESSAGE_RTR) == PCAN_MESSAGE_RTR)
-		msg.flags |= PCANFD_MSG_RTR;
-	if ((message->MSGTYPE & PCAN_MESSAGE_BRS) == PCAN_MESSAGE_BRS)
-		msg.flags |= PCANFD_MSG_BRS;
+	pcanbasic_msg_from_basic(message, &msg);
 	pcanlog_log(LVL_VERBOSE, "Writing message: ID=0x%04x; TYPE=0x%02x; FLAGS=0x%02x; DATA=[0x%02x...].\n",
 		msg.id, msg.type, msg.flags, msg.data[0]);
-	ires = pcanfd_send_msg(pchan->fd, &msg);
+	ires = pchan->tp->send_msg(pchan->fd, &msg);
 	if (ires < 0) {
 		sts = pcanbasic_errno_to_status_ctx(-ires, PCB_CTX_WRITE);
 		/* check busoff auto reset */
@@ -1051,6 +1607,7 @@ TPCANStatus pcanbasic_write_common(
 			pcanbasic_reset(channel);
 		goto pcanbasic_write_exit;
 	}
+	pcanbasic_account_msgs(pchan, &pchan->tx_load, &msg, 1);
 	gettimeofday(&tv, NULL);
 	pcbtrace_write_msg(&pchan->tracer, message, msg.data_len, &tv, 0);
 	sts = PCAN_ERROR_OK;
@@ -1070,6 +1627,79 @@ struct pcaninfo * pcanbasic_get_info(TPCANHandle channel) {
 	return NULL;
 }
 
+TPCANStatus pcanbasic_fd_profile_create(TPCANBitrateFD bitratefd, struct _pcanbasic_fd_profile **profile) {
+	struct _pcanbasic_fd_profile *p;
+	struct pcan_bittiming *bt;
+	size_t len;
+	int i;
+
+	if (bitratefd == NULL || profile == NULL)
+		return PCAN_ERROR_ILLPARAMVAL;
+	*profile = NULL;
+	len = strnlen(bitratefd, FD_PARAM_INIT_MAX_LEN);
+	p = (struct _pcanbasic_fd_profile *) calloc(1, sizeof(*p) + len + 1);
+	if (p == NULL) {
+		errno = ENOMEM;
+		return PCAN_ERROR_UNKNOWN;
+	}
+	if (pcanbasic_parse_fd_init(&p->init, bitratefd) != 0) {
+		free(p);
+		return PCAN_ERROR_ILLPARAMVAL;
+	}
+	/* every field is needed as pcanfd_set_init() is called with
+	 * bitrates set to 0 */
+	for (i = 0; i < 2; i++) {
+		bt = (i == 0) ? &p->init.nominal : &p->init.data;
+		if (p->init.clock_Hz == 0 || bt->brp == 0 || bt->tseg1 == 0 ||
+				bt->tseg2 == 0 || bt->sjw == 0) {
+			pcanlog_log(LVL_NORMAL, "ERROR: incomplete bit rates {%s}.\n", bitratefd);
+			free(p);
+			return PCAN_ERROR_ILLPARAMVAL;
+		}
+	}
+	/* same flags as pcanfd_open(OFD_BITRATE|OFD_DBITRATE|OFD_BRPTSEGSJW|OFD_CLOCKHZ) */
+	p->init.flags = PCANFD_INIT_FD;
+	p->nom_bitrate = p->init.clock_Hz / (p->init.nominal.brp *
+			(1 + p->init.nominal.tseg1 + p->init.nominal.tseg2));
+	p->data_bitrate = p->init.clock_Hz / (p->init.data.brp *
+			(1 + p->init.data.tseg1 + p->init.data.tseg2));
+	memcpy(p->bitratefd, bitratefd, len);
+	p->bitratefd[len] = 0;
+	p->len = len;
+	p->refcount = 1;
+	*profile = p;
+	return PCAN_ERROR_OK;
+}
+
+TPCANStatus pcanbasic_fd_profile_free(struct _pcanbasic_fd_profile *profile) {
+	if (profile == NULL)
+		return PCAN_ERROR_ILLPARAMVAL;
+	/* channels initialized with the profile keep it alive */
+	pcanbasic_fd_profile_release(profile);
+	return PCAN_ERROR_OK;
+}
+
+TPCANStatus pcanbasic_fd_profile_get_bitrates(struct _pcanbasic_fd_profile *profile,
+		__u32 *nom_bitrate, __u32 *data_bitrate) {
+	if (profile == NULL || nom_bitrate == NULL || data_bitrate == NULL)
+		return PCAN_ERROR_ILLPARAMVAL;
+	*nom_bitrate = profile->nom_bitrate;
+	*data_bitrate = profile->data_bitrate;
+	return PCAN_ERROR_OK;
+}
+
+TPCANStatus pcanbasic_get_init_timing(TPCANHandle channel, TPCANInitTiming *timing) {
+	pcanbasic_channel *pchan;
+
+	if (timing == NULL)
+		return PCAN_ERROR_ILLPARAMVAL;
+	pchan = pcanbasic_get_channel(channel, 1);
+	if (pchan == NULL)
+		return PCAN_ERROR_INITIALIZE;
+	*timing = pchan->init_timing;
+	return PCAN_ERROR_OK;
+}
+
 TPCANHandle pcanbasic_get_handle(char * device, struct pcaninfo_list * plist) {
 	TPCANHandle result = PCAN_NONEBUS;
 	struct pcaninfo_list * pcil;
@@ -1079,9 +1709,12 @@ TPCANHandle pcanbasic_get_handle(char * device, struct pcaninfo_list * plist) {
 
 	if (device == NULL)
 		return PCAN_NONEBUS;
-	/* auto-load devices information if it is not provided */
+	/* use the cached devices information if it is not provided */
 	if (plist == NULL) {
-		if (pcaninfo_get(&pcil, 1) != 0)
+		if (!g_basiccore.initialized)
+			pcanbasic_init();
+		pcil = pcanbasic_get_devices();
+		if (pcil == NULL)
 			return result;
 	}
 	else
@@ -1091,9 +1724,10 @@ TPCANHandle pcanbasic_get_handle(char * device, struct pcaninfo_list * plist) {
 	memset(&hw_count, 0, sizeof(hw_count));
 	for (i = 0; i < pcil->length; i++) {
 		pci = &pcil->infos[i];
-		/* load pci information if it was not done yet */
-		if (!(pci->availflag & PCANINFO_FLAG_INITIALIZED))
-			pcaninfo_update(pci);
+		/* load pci identification if it was not done yet */
+		if (!(pci->availflag & (PCANINFO_FLAG_INITIALIZED | PCANINFO_FLAG_IDENTIFIED)) &&
+				pcaninfo_refresh(pci, PCANINFO_IDENT_FLAGS, PCANINFO_IDENT_FLAGS_EX) == 0)
+			pci->availflag |= PCANINFO_FLAG_IDENTIFIED;
 		hw_count[pci->hwcategory]++;
 
 		/* SGr Notes: "dev" is not part of sysfs in RT world: do the
@@ -1137,10 +1771,6 @@ TPCANHandle pcanbasic_get_handle(char * device, struct pcaninfo_list * plist) {
 			}
 		}
 	}
-	/* release local allocation */
-	if (plist == NULL && pcil)
-		free(pcil);
-
 	return result;
 }
 
@@ -1187,6 +1817,22 @@ TPCANStatus pcanbasic_initialize(
 
 pcanbasic_initialize_malloc_post:
 	sts = PCAN_ERROR_OK;
+	/* channel mapped to a SocketCAN interface or virtual bus: no pcan device */
+	pchan->tp = pcanbasic_get_transport(channel, pchan->pinfo);
+	if (pchan->tp != &pcbtransport_pcanfd) {
+		pchan->btr0btr1 = btr0btr1;
+		pchan->fd = pcanbasic_open_transport(pchan);
+		if (pchan->fd < 0) {
+			sts = PCAN_ERROR_ILLOPERATION;
+			if (inserted)
+				SLIST_REMOVE(&g_basiccore.channels, pchan, _pcanbasic_channel, entries);
+			pcanbasic_free_channel(pchan);
+			goto pcanbasic_initialize_exit;
+		}
+		if (!inserted)
+			SLIST_INSERT_HEAD(&g_basiccore.channels, pchan, entries);
+		goto pcanbasic_initialize_exit;
+	}
 	/* find a corresponding device */
 	pinfo = pcanbasic_get_device(channel, hwtype, base, irq);
 	if (pinfo == NULL) {
@@ -1198,7 +1844,8 @@ pcanbasic_initialize_malloc_post:
 	}
 	/* complete struct initialization */
 	pchan->btr0btr1 = btr0btr1;
-	memcpy(pchan->pinfo, pinfo, sizeof(*pinfo));
+	pcaninfo_copy(pchan->pinfo, pinfo);
+	pcaninfo_refresh(pchan->pinfo, PCANINFO_FLAG_BUSSTATE | PCANINFO_FLAG_BTR0BTR1, 0);
 	/* check if CAN channel is used by another application */
 	if (pchan->pinfo->bus_state != 0) {
 		/* check bitrate adaptation */
@@ -1232,9 +1879,10 @@ pcanbasic_initialize_malloc_post:
 	if (!inserted)
 		SLIST_INSERT_HEAD(&g_basiccore.channels, pchan, entries);
 	/* remove previously set filters */
-	pcanfd_del_filters(pchan->fd);
-	/* refresh pcaninfo struct to update bitrate information */
-	if (sts == PCAN_ERROR_OK)
+	pchan->tp->del_filters(pchan->fd);
+	/* refresh pcaninfo struct to update bitrate information
+	 * (and load the attributes skipped by the device scan) */
+	if (sts == PCAN_ERROR_OK || !(pchan->pinfo->availflag & PCANINFO_FLAG_INITIALIZED))
 		pcaninfo_update(pchan->pinfo);
 
 pcanbasic_initialize_exit:
@@ -1244,106 +1892,121 @@ pcanbasic_initialize_exit:
 TPCANStatus pcanbasic_initialize_fd(
     TPCANHandle channel,
 	TPCANBitrateFD bitratefd) {
+	struct _pcanbasic_fd_profile *profile;
 	TPCANStatus sts;
-	pcanbasic_channel *pchan;
-	struct pcaninfo * pinfo;
-	__u8 inserted;
-	struct pcanfd_init fdi;
 
-	inserted = 0;
-	/* check if channel exists */
-	pchan = pcanbasic_get_channel(channel, 0);
-	if (pchan != NULL) {
-		/* channel is already initialized */
-		if (pchan->fd > -1) {
-			sts = PCAN_ERROR_INITIALIZE;
-			/* initialized with different bitrate */
-			if (pchan->bitrate_adapting && strcmp(pchan->bitratefd, bitratefd) == 0)
-				sts = PCAN_ERROR_CAUTION;
-			goto pcanbasic_initialize_fd_exit;
-		}
-		/* channel is not initialized */
-		else {
-			/* this means that flags were set for initialization
-			 * jump directly after malloc */
-			inserted = 1;
-			goto pcanbasic_initialize_malloc_post;
-		}
-	}
-	/* allocate and initialize a new PCANBASIC_channel */
-	pchan = pcanbasic_create_channel(channel, 0);
-	if (pchan == NULL) {
+	sts = pcanbasic_fd_profile_create(bitratefd, &profile);
+	if (sts != PCAN_ERROR_OK)
+		return PCAN_ERROR_INITIALIZE;
+	sts = pcanbasic_initialize_fd_profile(channel, profile);
+	/* the channel holds its own reference */
+	pcanbasic_fd_profile_release(profile);
+	return sts;
+}
+
+TPCANStatus pcanbasic_initialize_fd_profile(
+		TPCANHandle channel,
+		struct _pcanbasic_fd_profile *profile) {
+	pcanbasic_fd_init_ctx ctx;
+
+	if (profile == NULL)
+		return PCAN_ERROR_ILLPARAMVAL;
+	memset(&ctx, 0, sizeof(ctx));
+	ctx.channel = channel;
+	ctx.profile = profile;
+	pcanbasic_initialize_fd_prepare(&ctx);
+	if (ctx.pchan != NULL &&
+			(ctx.sts == PCAN_ERROR_OK || ctx.sts == PCAN_ERROR_CAUTION))
+		pcanbasic_initialize_fd_open(&ctx);
+	/* channel is released if its device was not opened */
+	pcanbasic_initialize_fd_commit(&ctx);
+	return ctx.sts;
+}
+
+TPCANStatus pcanbasic_initialize_fd_many(
+		TPCANHandle *channels,
+		TPCANBitrateFD *bitratesfd,
+		int count,
+		TPCANStatus *statuses,
+		TPCANInitTiming *timings) {
+	TPCANStatus sts;
+	pcanbasic_fd_init_ctx *ctxs;
+	pthread_t *threads;
+	__u8 *started;
+	int i, j;
+
+	if (channels == NULL || bitratesfd == NULL || count <= 0)
+		return PCAN_ERROR_ILLPARAMVAL;
+	ctxs = (pcanbasic_fd_init_ctx *) calloc(count, sizeof(*ctxs));
+	threads = (pthread_t *) calloc(count, sizeof(*threads));
+	started = (__u8 *) calloc(count, sizeof(*started));
+	if (ctxs == NULL || threads == NULL || started == NULL) {
 		errno = ENOMEM;
 		sts = PCAN_ERROR_UNKNOWN;
-		goto pcanbasic_initialize_fd_exit;
-	}
-
-pcanbasic_initialize_malloc_post:
-	sts = PCAN_ERROR_OK;
-	/* find a corresponding device */
-	pinfo = pcanbasic_get_device(channel, 0, 0, 0);
-	if (pinfo == NULL) {
-		sts = PCAN_ERROR_NODRIVER;
-		if (inserted)
-			SLIST_REMOVE(&g_basiccore.channels, pchan, _pcanbasic_channel, entries);
-		pcanbasic_free_channel(pchan);
-		goto pcanbasic_initialize_fd_exit;
+		goto pcanbasic_initialize_fd_many_exit;
 	}
-	/* complete struct initialization */
-	if (pcanbasic_parse_fd_init(&fdi, bitratefd) != 0) {
-		sts = PCAN_ERROR_INITIALIZE;
-		if (inserted)
-			SLIST_REMOVE(&g_basiccore.channels, pchan, _pcanbasic_channel, entries);
-		pcanbasic_free_channel(pchan);
-		goto pcanbasic_initialize_fd_exit;
+	/* assert API is initialized and share a single device scan, if any
+	 * channel is a pcan device */
+	if (!g_basiccore.initialized)
+		pcanbasic_init();
+	for (i = 0; i < count; i++) {
+		if (pcanbasic_is_pcan_device(channels[i])) {
+			pcanbasic_get_devices();
+			break;
+		}
 	}
-	if (pchan->bitratefd)
-		free(pchan->bitratefd);
-	pchan->bitratefd = strdup(bitratefd);
-	memcpy(pchan->pinfo, pinfo, sizeof(*pinfo));
-	/* check if CAN channel is used by another application */
-	if (pchan->pinfo->bus_state != 0) {
-		/* check bitrate adaptation */
-		if (!pchan->bitrate_adapting) {
-			/* not allowed, compare bitratefd */
-			if (pchan->pinfo->nom_bitrate != fdi.nominal.bitrate &&
-				pchan->pinfo->data_bitrate != fdi.data.bitrate) {
-				sts = PCAN_ERROR_INITIALIZE;
-				if (inserted)
-					SLIST_REMOVE(&g_basiccore.channels, pchan, _pcanbasic_channel, entries);
-				pcanbasic_free_channel(pchan);
-				goto pcanbasic_initialize_fd_exit;
-			}
+	/* lookups and sysfs checks rely on the shared core data:
+	 * they are done sequentially */
+	for (i = 0; i < count; i++) {
+		ctxs[i].channel = channels[i];
+		clock_gettime(CLOCK_MONOTONIC, &ctxs[i].t_start);
+		if (pcanbasic_fd_profile_create(bitratesfd[i], &ctxs[i].profile) != PCAN_ERROR_OK) {
+			ctxs[i].sts = PCAN_ERROR_INITIALIZE;
+			continue;
 		}
-		else {
-			sts = PCAN_ERROR_CAUTION;
+		for (j = 0; j < i; j++) {
+			if (channels[j] == channels[i])
+				break;
+		}
+		if (j < i) {
+			/* same channel requested twice */
+			ctxs[i].sts = PCAN_ERROR_INITIALIZE;
+			continue;
 		}
+		pcanbasic_initialize_fd_prepare(&ctxs[i]);
 	}
-
-	pchan->fd_flags = OFD_BITRATE | OFD_DBITRATE | OFD_BRPTSEGSJW | OFD_CLOCKHZ | OFD_NONBLOCKING;
-	if (pchan->listen_only == PCAN_PARAMETER_ON)
-		pchan->fd_flags |= PCANFD_INIT_LISTEN_ONLY;
-	pchan->fd = pcanfd_open(pchan->pinfo->path, pchan->fd_flags,
-			fdi.nominal.brp, fdi.nominal.tseg1, fdi.nominal.tseg2, fdi.nominal.sjw,
-			fdi.data.brp, fdi.data.tseg1, fdi.data.tseg2, fdi.data.sjw,
-			fdi.clock_Hz);
-	if (pchan->fd < 0) {
-		sts = PCAN_ERROR_ILLOPERATION;
-		if (inserted)
-			SLIST_REMOVE(&g_basiccore.channels, pchan, _pcanbasic_channel, entries);
-		pcanbasic_free_channel(pchan);
-		goto pcanbasic_initialize_fd_exit;
+	/* opening a device (and setting its bitrate) only involves that
+	 * device: this is done in parallel */
+	for (i = 0; i < count; i++) {
+		if (ctxs[i].pchan == NULL ||
+				(ctxs[i].sts != PCAN_ERROR_OK && ctxs[i].sts != PCAN_ERROR_CAUTION))
+			continue;
+		if (pthread_create(&threads[i], NULL, pcanbasic_initialize_fd_open, &ctxs[i]) == 0)
+			started[i] = 1;
+		else
+			pcanbasic_initialize_fd_open(&ctxs[i]);
 	}
-	/* insert new channel info in list */
-	if (!inserted)
-		SLIST_INSERT_HEAD(&g_basiccore.channels, pchan, entries);
-	/* remove previously set filters */
-	pcanfd_del_filters(pchan->fd);
-	/* refresh pcaninfo struct to update bitrate information */
-	if (sts == PCAN_ERROR_OK)
-		pcaninfo_update(pchan->pinfo);
-
-pcanbasic_initialize_fd_exit:
+	sts = PCAN_ERROR_OK;
+	for (i = 0; i < count; i++) {
+		if (started[i])
+			pthread_join(threads[i], NULL);
+		pcanbasic_initialize_fd_commit(&ctxs[i]);
+		pcanbasic_fd_profile_release(ctxs[i].profile);
+		if (statuses)
+			statuses[i] = ctxs[i].sts;
+		if (timings)
+			timings[i] = ctxs[i].timing;
+		if (sts == PCAN_ERROR_OK)
+			sts = ctxs[i].sts;
+	}
+
+pcanbasic_initialize_fd_many_exit:
+	if (started)
+		free(started);
+	if (threads)
+		free(threads);
+	if (ctxs)
+		free(ctxs);
 	return sts;
 }
 
@@ -1385,19 +2048,29 @@ TPCANStatus pcanbasic_reset(
 		sts = PCAN_ERROR_INITIALIZE;
 		goto pcanbasic_reset_exit;
 	}
+	if (pchan->tp != &pcbtransport_pcanfd) {
+		/* reopen the socket or node: flushes its queues */
+		pchan->tp->close(pchan->fd);
+		pchan->fd = pcanbasic_open_transport(pchan);
+		sts = (pchan->fd < 0) ? PCAN_ERROR_ILLOPERATION : PCAN_ERROR_OK;
+		goto pcanbasic_reset_exit;
+	}
 	/* get fd initialization to restore it later */
-	pcanfd_get_init(pchan->fd, &pfdinit);
+	if (pchan->fd_profile != NULL)
+		pfdinit = pchan->fd_profile->init;
+	else
+		pchan->tp->get_init(pchan->fd, &pfdinit);
 	if (pchan->listen_only)
 		pfdinit.flags |= PCANFD_INIT_LISTEN_ONLY;
 	/* close and open file descriptor */
-	pcanfd_close(pchan->fd);
+	pchan->tp->close(pchan->fd);
 	pchan->fd = pcanfd_open(pchan->pinfo->path, OFD_NONBLOCKING);	/* no flag as we will use set_init */
 	if (pchan->fd < 0) {
 		sts = PCAN_ERROR_ILLOPERATION;
 		goto pcanbasic_reset_exit;
 	}
 	/* re-set config */
-	if (pcanfd_set_init(pchan->fd, &pfdinit) < 0) {
+	if (pchan->tp->set_init(pchan->fd, &pfdinit) < 0) {
 		sts = PCAN_ERROR_ILLOPERATION;
 		goto pcanbasic_reset_exit;
 	}
@@ -1421,7 +2094,7 @@ TPCANStatus pcanbasic_get_status(
 		goto pcanbasic_get_status_exit;
 	}
 	/* read status and convert result */
-	ires = pcanfd_get_state(pchan->fd, &fds);
+	ires = pchan->tp->get_state(pchan->fd, &fds);
 	if (ires < 0) {
 		sts = pcanbasic_errno_to_status(-ires);
 		goto pcanbasic_get_status_exit;
@@ -1514,6 +2187,150 @@ TPCANStatus pcanbasic_write_fd(
 	return pcanbasic_write_common(channel, message);
 }
 
+TPCANStatus pcanbasic_read_msgs(
+		TPCANHandle channel,
+		struct pcanfd_msgs *msgs) {
+	TPCANStatus sts;
+	pcanbasic_channel *pchan;
+	TPCANMsgFD message;
+	__u32 i, count;
+	int ires;
+
+	if (msgs == NULL) {
+		sts = PCAN_ERROR_ILLPARAMVAL;
+		goto pcanbasic_read_msgs_exit;
+	}
+	count = msgs->count;
+	msgs->count = 0;
+	/* get initialized channel */
+	pchan = pcanbasic_get_channel(channel, 1);
+	if (pchan == NULL) {
+		sts = PCAN_ERROR_INITIALIZE;
+		goto pcanbasic_read_msgs_exit;
+	}
+	if (count == 0) {
+		sts = PCAN_ERROR_OK;
+		goto pcanbasic_read_msgs_exit;
+	}
+	/* read all the pending msgs (up to count) with a single ioctl */
+	msgs->count = count;
+	ires = pchan->tp->recv_msgs(pchan->fd, msgs);
+	if (ires < 0) {
+		msgs->count = 0;
+		sts = pcanbasic_errno_to_status_ctx(-ires, PCB_CTX_READ);
+		goto pcanbasic_read_msgs_exit;
+	}
+	/* discard messages if rcv_status is OFF */
+	if (pchan->rcv_status == PCAN_PARAMETER_OFF)
+		msgs->count = 0;
+	if (msgs->count == 0) {
+		sts = PCAN_ERROR_QRCVEMPTY;
+		goto pcanbasic_read_msgs_exit;
+	}
+	sts = PCAN_ERROR_OK;
+	for (i = 0; i < msgs->count; i++) {
+		struct pcanfd_msg *msg = &msgs->list[i];
+
+		/* check bus-off auto-reset: msgs read after the event are lost */
+		if (msg->type == PCANFD_TYPE_STATUS && pchan->busoff_reset &&
+			(msg->flags & PCANFD_ERROR_BUS) && msg->id == PCANFD_ERROR_BUSOFF) {
+			msgs->count = i;
+			pcanbasic_reset(channel);
+			sts = PCAN_ERROR_BUSOFF;
+			goto pcanbasic_read_msgs_exit;
+		}
+		/* trace message (converted only if tracing is enabled) */
+		if (pchan->tracer.status) {
+			pcanbasic_msg_to_basic(msg, &message);
+			pcbtrace_write_msg(&pchan->tracer, &message, msg->data_len, &msg->timestamp, 1);
+		}
+	}
+	pcanbasic_account_msgs(pchan, &pchan->rx_load, msgs->list, msgs->count);
+	pcanlog_log(LVL_VERBOSE, "Read %u messages.\n", msgs->count);
+
+pcanbasic_read_msgs_exit:
+	return sts;
+}
+
+TPCANStatus pcanbasic_write_msgs(
+		TPCANHandle channel,
+		struct pcanfd_msgs *msgs) {
+	TPCANStatus sts;
+	pcanbasic_channel *pchan;
+	TPCANMsgFD message;
+	struct timeval tv;
+	__u32 i, count;
+	int ires;
+
+	if (msgs == NULL) {
+		sts = PCAN_ERROR_ILLPARAMVAL;
+		goto pcanbasic_write_msgs_exit;
+	}
+	count = msgs->count;
+	msgs->count = 0;
+	/* get initialized channel */
+	pchan = pcanbasic_get_channel(channel, 1);
+	if (pchan == NULL) {
+		sts = PCAN_ERROR_INITIALIZE;
+		goto pcanbasic_write_msgs_exit;
+	}
+	if (count == 0) {
+		sts = PCAN_ERROR_OK;
+		goto pcanbasic_write_msgs_exit;
+	}
+	pcanlog_log(LVL_VERBOSE, "Writing %u messages.\n", count);
+	/* the driver sets count to the number of msgs put in the tx queue */
+	msgs->count = count;
+	ires = pchan->tp->send_msgs(pchan->fd, msgs);
+	if (ires < 0) {
+		sts = pcanbasic_errno_to_status_ctx(-ires, PCB_CTX_WRITE);
+		/* check busoff auto reset */
+		if(sts == PCAN_ERROR_BUSOFF && pchan->busoff_reset)
+			pcanbasic_reset(channel);
+		/* some msgs may have been queued before the error */
+		if (msgs->count >= count)
+			msgs->count = 0;
+		goto pcanbasic_write_msgs_trace;
+	}
+	sts = (msgs->count < count) ? PCAN_ERROR_QXMTFULL : PCAN_ERROR_OK;
+
+pcanbasic_write_msgs_trace:
+	pcanbasic_account_msgs(pchan, &pchan->tx_load, msgs->list, msgs->count);
+	if (pchan->tracer.status && msgs->count > 0) {
+		gettimeofday(&tv, NULL);
+		for (i = 0; i < msgs->count; i++) {
+			pcanbasic_msg_to_basic(&msgs->list[i], &message);
+			pcbtrace_write_msg(&pchan->tracer, &message, msgs->list[i].data_len, &tv, 0);
+		}
+	}
+
+pcanbasic_write_msgs_exit:
+	return sts;
+}
+
+TPCANStatus pcanbasic_get_frame_time(
+		const struct pcanfd_msg *msg,
+		__u32 nom_bitrate,
+		__u32 data_bitrate,
+		__u8 worst_case,
+		__u64 *ns) {
+	TPCANStatus sts;
+
+	if (msg == NULL || ns == NULL || nom_bitrate == 0 ||
+		(msg->type != PCANFD_TYPE_CAN20_MSG && msg->type != PCANFD_TYPE_CANFD_MSG)) {
+		sts = PCAN_ERROR_ILLPARAMVAL;
+		goto pcanbasic_get_frame_time_exit;
+	}
+	if (worst_case)
+		*ns = pcbwire_frame_ns_worst(msg, nom_bitrate, data_bitrate);
+	else
+		*ns = pcbwire_frame_ns(msg, nom_bitrate, data_bitrate);
+	sts = PCAN_ERROR_OK;
+
+pcanbasic_get_frame_time_exit:
+	return sts;
+}
+
 TPCANStatus pcanbasic_filter(
         TPCANHandle channel,
         DWORD from,
@@ -1542,7 +2359,7 @@ TPCANStatus pcanbasic_filter(
 		filter.msg_flags = PCAN_MESSAGE_STANDARD;
 		break;
 	}
-	ires = pcanfd_add_filter(pchan->fd, &filter);
+	ires = pchan->tp->add_filter(pchan->fd, &filter);
 	if (ires < 0) {
 		sts = pcanbasic_errno_to_status(-ires);
 		goto pcanbasic_filter_exit;
@@ -1757,7 +2574,7 @@ TPCANStatus pcanbasic_get_value(
 		memcpy(buffer, pchan->pinfo->type, size);
 		break;
 	case PCAN_CONTROLLER_NUMBER:
-		ires = pcanfd_get_state(pchan->fd, &state);
+		ires = pchan->tp->get_state(pchan->fd, &state);
 		if (ires < 0) {
 			sts = pcanbasic_errno_to_status(-ires);
 			goto pcanbasic_get_value_exit;
@@ -1810,14 +2627,18 @@ TPCANStatus pcanbasic_get_value(
 		memcpy(buffer, &pchan->pinfo->btr0btr1, size);
 		break;
 	case PCAN_BITRATE_INFO_FD:
+		/* reported as given at initialization */
 		size = 0;
-		if (pchan->bitratefd != NULL)
-			size = strlen(pchan->bitratefd);
-		if (len < size) {
+		if (pchan->fd_profile != NULL)
+			size = pchan->fd_profile->len;
+		if (len <= size) {
 			sts = PCAN_ERROR_ILLPARAMVAL;
 			goto pcanbasic_get_value_exit;
 		}
-		snprintf(buffer, size, "%s", pchan->bitratefd);
+		if (pchan->fd_profile != NULL)
+			memcpy(buffer, pchan->fd_profile->bitratefd, size + 1);
+		else
+			((char *) buffer)[0] = 0;
 		break;
 	case PCAN_BUSSPEED_NOMINAL:
 		size = sizeof(pchan->pinfo->nom_bitrate);
@@ -1847,9 +2668,9 @@ TPCANStatus pcanbasic_get_value(
 			sts = PCAN_ERROR_ILLPARAMVAL;
 			goto pcanbasic_get_value_exit;
 		}
-		ires = pcanfd_get_option(pchan->fd, PCANFD_OPT_ALLOWED_MSGS, &itmp, sizeof(itmp));
+		ires = pchan->tp->get_option(pchan->fd, PCANFD_OPT_ALLOWED_MSGS, &itmp, sizeof(itmp));
 		if (ires < 0) {
-			sts = pcanbasic_errno_to_status(-ires);
+			sts = pcanbasic_errno_to_status_ctx(-ires, PCB_CTX_OPTION);
 			goto pcanbasic_get_value_exit;
 		}
 		itmp = (itmp & PCANFD_ALLOWED_MSG_ERROR) == PCANFD_ALLOWED_MSG_ERROR ?
@@ -1862,9 +2683,9 @@ TPCANStatus pcanbasic_get_value(
 			sts = PCAN_ERROR_ILLPARAMVAL;
 			goto pcanbasic_get_value_exit;
 		}
-		ires = pcanfd_get_option(pchan->fd, PCANFD_OPT_ALLOWED_MSGS, &itmp, sizeof(itmp));
+		ires = pchan->tp->get_option(pchan->fd, PCANFD_OPT_ALLOWED_MSGS, &itmp, sizeof(itmp));
 		if (ires < 0) {
-			sts = pcanbasic_errno_to_status(-ires);
+			sts = pcanbasic_errno_to_status_ctx(-ires, PCB_CTX_OPTION);
 			goto pcanbasic_get_value_exit;
 		}
 		itmp = (itmp & PCANFD_ALLOWED_MSG_RTR) == PCANFD_ALLOWED_MSG_RTR ?
@@ -1877,9 +2698,9 @@ TPCANStatus pcanbasic_get_value(
 			sts = PCAN_ERROR_ILLPARAMVAL;
 			goto pcanbasic_get_value_exit;
 		}
-		ires = pcanfd_get_option(pchan->fd, PCANFD_OPT_ALLOWED_MSGS, &itmp, sizeof(itmp));
+		ires = pchan->tp->get_option(pchan->fd, PCANFD_OPT_ALLOWED_MSGS, &itmp, sizeof(itmp));
 		if (ires < 0) {
-			sts = pcanbasic_errno_to_status(-ires);
+			sts = pcanbasic_errno_to_status_ctx(-ires, PCB_CTX_OPTION);
 			goto pcanbasic_get_value_exit;
 		}
 		itmp = (itmp & PCANFD_ALLOWED_MSG_STATUS) == PCANFD_ALLOWED_MSG_STATUS ?
@@ -1892,9 +2713,9 @@ TPCANStatus pcanbasic_get_value(
 			sts = PCAN_ERROR_ILLPARAMVAL;
 			goto pcanbasic_get_value_exit;
 		}
-		ires = pcanfd_get_option(pchan->fd, PCANFD_OPT_IFRAME_DELAYUS, buffer, len);
+		ires = pchan->tp->get_option(pchan->fd, PCANFD_OPT_IFRAME_DELAYUS, buffer, len);
 		if (ires < 0) {
-			sts = pcanbasic_errno_to_status(-ires);
+			sts = pcanbasic_errno_to_status_ctx(-ires, PCB_CTX_OPTION);
 			goto pcanbasic_get_value_exit;
 		}
 		break;
@@ -1904,9 +2725,9 @@ TPCANStatus pcanbasic_get_value(
 			sts = PCAN_ERROR_ILLPARAMVAL;
 			goto pcanbasic_get_value_exit;
 		}
-		ires = pcanfd_get_option(pchan->fd, PCANFD_OPT_ACC_FILTER_11B, buffer, len);
+		ires = pchan->tp->get_option(pchan->fd, PCANFD_OPT_ACC_FILTER_11B, buffer, len);
 		if (ires < 0) {
-			sts = pcanbasic_errno_to_status(-ires);
+			sts = pcanbasic_errno_to_status_ctx(-ires, PCB_CTX_OPTION);
 			goto pcanbasic_get_value_exit;
 		}
 		break;
@@ -1916,9 +2737,9 @@ TPCANStatus pcanbasic_get_value(
 			sts = PCAN_ERROR_ILLPARAMVAL;
 			goto pcanbasic_get_value_exit;
 		}
-		ires = pcanfd_get_option(pchan->fd, PCANFD_OPT_ACC_FILTER_29B, buffer, len);
+		ires = pchan->tp->get_option(pchan->fd, PCANFD_OPT_ACC_FILTER_29B, buffer, len);
 		if (ires < 0) {
-			sts = pcanbasic_errno_to_status(-ires);
+			sts = pcanbasic_errno_to_status_ctx(-ires, PCB_CTX_OPTION);
 			goto pcanbasic_get_value_exit;
 		}
 		break;
@@ -1928,9 +2749,9 @@ TPCANStatus pcanbasic_get_value(
 			sts = PCAN_ERROR_ILLPARAMVAL;
 			goto pcanbasic_get_value_exit;
 		}
-		ires = pcanfd_get_option(pchan->fd, PCANFD_IO_DIGITAL_CFG, buffer, len);
+		ires = pchan->tp->get_option(pchan->fd, PCANFD_IO_DIGITAL_CFG, buffer, len);
 		if (ires < 0) {
-			sts = pcanbasic_errno_to_status(-ires);
+			sts = pcanbasic_errno_to_status_ctx(-ires, PCB_CTX_OPTION);
 			goto pcanbasic_get_value_exit;
 		}
 		break;
@@ -1940,9 +2761,9 @@ TPCANStatus pcanbasic_get_value(
 			sts = PCAN_ERROR_ILLPARAMVAL;
 			goto pcanbasic_get_value_exit;
 		}
-		ires = pcanfd_get_option(pchan->fd, PCANFD_IO_DIGITAL_VAL, buffer, len);
+		ires = pchan->tp->get_option(pchan->fd, PCANFD_IO_DIGITAL_VAL, buffer, len);
 		if (ires < 0) {
-			sts = pcanbasic_errno_to_status(-ires);
+			sts = pcanbasic_errno_to_status_ctx(-ires, PCB_CTX_OPTION);
 			goto pcanbasic_get_value_exit;
 		}
 		break;
@@ -1952,9 +2773,9 @@ TPCANStatus pcanbasic_get_value(
 			sts = PCAN_ERROR_ILLPARAMVAL;
 			goto pcanbasic_get_value_exit;
 		}
-		ires = pcanfd_get_option(pchan->fd, PCANFD_IO_ANALOG_VAL, buffer, len);
+		ires = pchan->tp->get_option(pchan->fd, PCANFD_IO_ANALOG_VAL, buffer, len);
 		if (ires < 0) {
-			sts = pcanbasic_errno_to_status(-ires);
+			sts = pcanbasic_errno_to_status_ctx(-ires, PCB_CTX_OPTION);
 			goto pcanbasic_get_value_exit;
 		}
 		break;
@@ -1966,6 +2787,56 @@ TPCANStatus pcanbasic_get_value(
 		}
 		memcpy(buffer, &pchan->pinfo->adapter_version, size);
 		break;
+	case PCAN_TX_PENDING_MSGS:
+	case PCAN_TX_QUEUE_SIZE:
+		ires = pchan->tp->get_state(pchan->fd, &state);
+		if (ires < 0) {
+			sts = pcanbasic_errno_to_status(-ires);
+			goto pcanbasic_get_value_exit;
+		}
+		size = sizeof(state.tx_pending_msgs);
+		if (len < size) {
+			sts = PCAN_ERROR_ILLPARAMVAL;
+			goto pcanbasic_get_value_exit;
+		}
+		if (parameter == PCAN_TX_PENDING_MSGS)
+			memcpy(buffer, &state.tx_pending_msgs, size);
+		else
+			memcpy(buffer, &state.tx_max_msgs, size);
+		break;
+	case PCAN_BUSLOAD:
+		/* the predicted loads are accounted from now on */
+		pchan->load_metering = 1;
+		ires = pchan->tp->get_state(pchan->fd, &state);
+		if (ires < 0) {
+			sts = pcanbasic_errno_to_status(-ires);
+			goto pcanbasic_get_value_exit;
+		}
+		/* 0xffff: the device does not measure the bus load */
+		if (state.bus_load == 0xffff) {
+			sts = PCAN_ERROR_ILLOPERATION;
+			goto pcanbasic_get_value_exit;
+		}
+		itmp = state.bus_load;
+		size = sizeof(itmp);
+		if (len < size) {
+			sts = PCAN_ERROR_ILLPARAMVAL;
+			goto pcanbasic_get_value_exit;
+		}
+		memcpy(buffer, &itmp, size);
+		break;
+	case PCAN_BUSLOAD_TX:
+	case PCAN_BUSLOAD_RX:
+		pchan->load_metering = 1;
+		size = sizeof(itmp);
+		if (len < size) {
+			sts = PCAN_ERROR_ILLPARAMVAL;
+			goto pcanbasic_get_value_exit;
+		}
+		itmp = pcanbasic_get_load((parameter == PCAN_BUSLOAD_TX) ?
+				&pchan->tx_load : &pchan->rx_load);
+		memcpy(buffer, &itmp, size);
+		break;
 	default:
 		sts = PCAN_ERROR_UNKNOWN;
 		goto pcanbasic_get_value_exit;
@@ -2177,14 +3048,14 @@ TPCANStatus pcanbasic_set_value(
 			goto pcanbasic_set_value_exit;
 		}
 		/* deleting all, opens everything */
-		pcanfd_del_filters(pchan->fd);
+		pchan->tp->del_filters(pchan->fd);
 		if (ctmp == PCAN_FILTER_CLOSE) {
 			/* if (id_from > id_to) everything is closed */
 			struct pcanfd_msg_filter filter;
 			filter.id_from = 1;
 			filter.id_to = 0;
 			filter.msg_flags = 0;
-			pcanfd_add_filter(pchan->fd, &filter);
+			pchan->tp->add_filter(pchan->fd, &filter);
 		}
 		break;
 	case PCAN_BUSOFF_AUTORESET:
@@ -2249,9 +3120,9 @@ TPCANStatus pcanbasic_set_value(
 			goto pcanbasic_set_value_exit;
 		}
 		/* get options to retrieve all flags */
-		ires = pcanfd_get_option(pchan->fd, PCANFD_OPT_ALLOWED_MSGS, &itmp, sizeof(itmp));
+		ires = pchan->tp->get_option(pchan->fd, PCANFD_OPT_ALLOWED_MSGS, &itmp, sizeof(itmp));
 		if (ires < 0) {
-			sts = pcanbasic_errno_to_status(-ires);
+			sts = pcanbasic_errno_to_status_ctx(-ires, PCB_CTX_OPTION);
 			goto pcanbasic_set_value_exit;
 		}
 		/* change flag */
@@ -2259,9 +3130,9 @@ TPCANStatus pcanbasic_set_value(
 			itmp |= PCANFD_ALLOWED_MSG_ERROR;
 		else
 			itmp = itmp & ~PCANFD_ALLOWED_MSG_ERROR;
-		ires = pcanfd_set_option(pchan->fd, PCANFD_OPT_ALLOWED_MSGS, &itmp, sizeof(itmp));
+		ires = pchan->tp->set_option(pchan->fd, PCANFD_OPT_ALLOWED_MSGS, &itmp, sizeof(itmp));
 		if (ires < 0) {
-			sts = pcanbasic_errno_to_status(-ires);
+			sts = pcanbasic_errno_to_status_ctx(-ires, PCB_CTX_OPTION);
 			goto pcanbasic_set_value_exit;
 		}
 		break;
@@ -2272,9 +3143,9 @@ TPCANStatus pcanbasic_set_value(
 			goto pcanbasic_set_value_exit;
 		}
 		/* get options to retrieve all flags */
-		ires = pcanfd_get_option(pchan->fd, PCANFD_OPT_ALLOWED_MSGS, &itmp, sizeof(itmp));
+		ires = pchan->tp->get_option(pchan->fd, PCANFD_OPT_ALLOWED_MSGS, &itmp, sizeof(itmp));
 		if (ires < 0) {
-			sts = pcanbasic_errno_to_status(-ires);
+			sts = pcanbasic_errno_to_status_ctx(-ires, PCB_CTX_OPTION);
 			goto pcanbasic_set_value_exit;
 		}
 		/* change flag */
@@ -2282,9 +3153,9 @@ TPCANStatus pcanbasic_set_value(
 			itmp |= PCANFD_ALLOWED_MSG_RTR;
 		else
 			itmp = itmp & ~PCANFD_ALLOWED_MSG_RTR;
-		ires = pcanfd_set_option(pchan->fd, PCANFD_OPT_ALLOWED_MSGS, &itmp, sizeof(itmp));
+		ires = pchan->tp->set_option(pchan->fd, PCANFD_OPT_ALLOWED_MSGS, &itmp, sizeof(itmp));
 		if (ires < 0) {
-			sts = pcanbasic_errno_to_status(-ires);
+			sts = pcanbasic_errno_to_status_ctx(-ires, PCB_CTX_OPTION);
 			goto pcanbasic_set_value_exit;
 		}
 		break;
@@ -2295,9 +3166,9 @@ TPCANStatus pcanbasic_set_value(
 			goto pcanbasic_set_value_exit;
 		}
 		/* get options to retrieve all flags */
-		ires = pcanfd_get_option(pchan->fd, PCANFD_OPT_ALLOWED_MSGS, &itmp, sizeof(itmp));
+		ires = pchan->tp->get_option(pchan->fd, PCANFD_OPT_ALLOWED_MSGS, &itmp, sizeof(itmp));
 		if (ires < 0) {
-			sts = pcanbasic_errno_to_status(-ires);
+			sts = pcanbasic_errno_to_status_ctx(-ires, PCB_CTX_OPTION);
 			goto pcanbasic_set_value_exit;
 		}
 		/* change flag */
@@ -2305,9 +3176,9 @@ TPCANStatus pcanbasic_set_value(
 			itmp |= PCANFD_ALLOWED_MSG_STATUS;
 		else
 			itmp = itmp & ~PCANFD_ALLOWED_MSG_STATUS;
-		ires = pcanfd_set_option(pchan->fd, PCANFD_OPT_ALLOWED_MSGS, &itmp, sizeof(itmp));
+		ires = pchan->tp->set_option(pchan->fd, PCANFD_OPT_ALLOWED_MSGS, &itmp, sizeof(itmp));
 		if (ires < 0) {
-			sts = pcanbasic_errno_to_status(-ires);
+			sts = pcanbasic_errno_to_status_ctx(-ires, PCB_CTX_OPTION);
 			goto pcanbasic_set_value_exit;
 		}
 		break;
@@ -2317,9 +3188,9 @@ TPCANStatus pcanbasic_set_value(
 			sts = PCAN_ERROR_ILLPARAMVAL;
 			goto pcanbasic_set_value_exit;
 		}
-		ires = pcanfd_set_option(pchan->fd, PCANFD_OPT_IFRAME_DELAYUS, buffer, len);
+		ires = pchan->tp->set_option(pchan->fd, PCANFD_OPT_IFRAME_DELAYUS, buffer, len);
 		if (ires < 0) {
-			sts = pcanbasic_errno_to_status(-ires);
+			sts = pcanbasic_errno_to_status_ctx(-ires, PCB_CTX_OPTION);
 			goto pcanbasic_set_value_exit;
 		}
 		break;
@@ -2329,9 +3200,9 @@ TPCANStatus pcanbasic_set_value(
 			sts = PCAN_ERROR_ILLPARAMVAL;
 			goto pcanbasic_set_value_exit;
 		}
-		ires = pcanfd_set_option(pchan->fd, PCANFD_OPT_ACC_FILTER_11B, buffer, len);
+		ires = pchan->tp->set_option(pchan->fd, PCANFD_OPT_ACC_FILTER_11B, buffer, len);
 		if (ires < 0) {
-			sts = pcanbasic_errno_to_status(-ires);
+			sts = pcanbasic_errno_to_status_ctx(-ires, PCB_CTX_OPTION);
 			goto pcanbasic_set_value_exit;
 		}
 		break;
@@ -2341,9 +3212,9 @@ TPCANStatus pcanbasic_set_value(
 			sts = PCAN_ERROR_ILLPARAMVAL;
 			goto pcanbasic_set_value_exit;
 		}
-		ires = pcanfd_set_option(pchan->fd, PCANFD_OPT_ACC_FILTER_29B, buffer, len);
+		ires = pchan->tp->set_option(pchan->fd, PCANFD_OPT_ACC_FILTER_29B, buffer, len);
 		if (ires < 0) {
-			sts = pcanbasic_errno_to_status(-ires);
+			sts = pcanbasic_errno_to_status_ctx(-ires, PCB_CTX_OPTION);
 			goto pcanbasic_set_value_exit;
 		}
 		break;
@@ -2353,9 +3224,9 @@ TPCANStatus pcanbasic_set_value(
 			sts = PCAN_ERROR_ILLPARAMVAL;
 			goto pcanbasic_set_value_exit;
 		}
-		ires = pcanfd_set_option(pchan->fd, PCANFD_IO_DIGITAL_CFG, buffer, len);
+		ires = pchan->tp->set_option(pchan->fd, PCANFD_IO_DIGITAL_CFG, buffer, len);
 		if (ires < 0) {
-			sts = pcanbasic_errno_to_status(-ires);
+			sts = pcanbasic_errno_to_status_ctx(-ires, PCB_CTX_OPTION);
 			goto pcanbasic_set_value_exit;
 		}
 		break;
@@ -2365,9 +3236,9 @@ TPCANStatus pcanbasic_set_value(
 			sts = PCAN_ERROR_ILLPARAMVAL;
 			goto pcanbasic_set_value_exit;
 		}
-		ires = pcanfd_set_option(pchan->fd, PCANFD_IO_DIGITAL_VAL, buffer, len);
+		ires = pchan->tp->set_option(pchan->fd, PCANFD_IO_DIGITAL_VAL, buffer, len);
 		if (ires < 0) {
-			sts = pcanbasic_errno_to_status(-ires);
+			sts = pcanbasic_errno_to_status_ctx(-ires, PCB_CTX_OPTION);
 			goto pcanbasic_set_value_exit;
 		}
 		break;
@@ -2377,9 +3248,9 @@ TPCANStatus pcanbasic_set_value(
 			sts = PCAN_ERROR_ILLPARAMVAL;
 			goto pcanbasic_set_value_exit;
 		}
-		ires = pcanfd_set_option(pchan->fd, PCANFD_IO_DIGITAL_SET, buffer, len);
+		ires = pchan->tp->set_option(pchan->fd, PCANFD_IO_DIGITAL_SET, buffer, len);
 		if (ires < 0) {
-			sts = pcanbasic_errno_to_status(-ires);
+			sts = pcanbasic_errno_to_status_ctx(-ires, PCB_CTX_OPTION);
 			goto pcanbasic_set_value_exit;
 		}
 		break;
@@ -2389,9 +3260,9 @@ TPCANStatus pcanbasic_set_value(
 			sts = PCAN_ERROR_ILLPARAMVAL;
 			goto pcanbasic_set_value_exit;
 		}
-		ires = pcanfd_set_option(pchan->fd, PCANFD_IO_DIGITAL_CLR, buffer, len);
+		ires = pchan->tp->set_option(pchan->fd, PCANFD_IO_DIGITAL_CLR, buffer, len);
 		if (ires < 0) {
-			sts = pcanbasic_errno_to_status(-ires);
+			sts = pcanbasic_errno_to_status_ctx(-ires, PCB_CTX_OPTION);
 			goto pcanbasic_set_value_exit;
 		}
 		break;
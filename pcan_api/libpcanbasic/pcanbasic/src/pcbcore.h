@@ -32,8 +32,6 @@
 #include "../PCANBasic.h"
 #include "pcaninfo.h"
 
-
-
 /* Extra functions to ease PCANBasic API usage on linux */
 /**
  * @fn PCANINFO * pcanbasic_get_info(TPCANHandle channel)
@@ -49,11 +47,23 @@ struct pcaninfo * pcanbasic_get_info(TPCANHandle channel);
  * @brief Returns the handle corresponding to a file path (like "/dev/pcanusb1").
  *
  * @param device a buffer holding the device path (with a NULL-termination char.)
- * @param pcil An initialized list of PCANINFO (if NULL, scanning is done internally)
+ * @param pcil An initialized list of PCANINFO (if NULL, the internal device
+ * 	cache is used: it is only rescanned when devices are (un)plugged)
  * @return A Channel handle corresponding to the device or PCAN_NONEBUS if not found.
  */
 TPCANHandle pcanbasic_get_handle(char * device, struct pcaninfo_list * pcil);
 
+/**
+ * @fn TPCANStatus pcanbasic_get_init_timing(TPCANHandle channel, TPCANInitTiming *timing)
+ * @brief Returns the durations of the CAN FD initialization of a channel.
+ *
+ * @param channel The handle of a channel initialized with CAN_InitializeFD,
+ * 	CAN_InitializeFDProfile or CAN_InitializeFDMany
+ * @param timing Buffer to store the durations
+ * @return A TPCANStatus error code
+ */
+TPCANStatus pcanbasic_get_init_timing(TPCANHandle channel, TPCANInitTiming *timing);
+
 /**
  * @fn __u8 pcanbasic_get_fd_dlc(int len)
  * @brief Returns the DLC associated to a length.
@@ -85,6 +95,29 @@ TPCANStatus pcanbasic_initialize_fd(
 		TPCANHandle channel,
 		TPCANBitrateFD bitratefd);
 
+TPCANStatus pcanbasic_initialize_fd_many(
+		TPCANHandle *channels,
+		TPCANBitrateFD *bitratesfd,
+		int count,
+		TPCANStatus *statuses,
+		TPCANInitTiming *timings);
+
+TPCANStatus pcanbasic_fd_profile_create(
+		TPCANBitrateFD bitratefd,
+		TPCANBitrateFDProfile *profile);
+
+TPCANStatus pcanbasic_initialize_fd_profile(
+		TPCANHandle channel,
+		TPCANBitrateFDProfile profile);
+
+TPCANStatus pcanbasic_fd_profile_free(
+		TPCANBitrateFDProfile profile);
+
+TPCANStatus pcanbasic_fd_profile_get_bitrates(
+		TPCANBitrateFDProfile profile,
+		__u32 *nom_bitrate,
+		__u32 *data_bitrate);
+
 TPCANStatus pcanbasic_uninitialize(
         TPCANHandle channel);
 
@@ -112,6 +145,21 @@ TPCANStatus pcanbasic_write_fd(
 		TPCANHandle channel,
 		TPCANMsgFD* message);
 
+TPCANStatus pcanbasic_read_msgs(
+		TPCANHandle channel,
+		struct pcanfd_msgs *msgs);
+
+TPCANStatus pcanbasic_write_msgs(
+		TPCANHandle channel,
+		struct pcanfd_msgs *msgs);
+
+TPCANStatus pcanbasic_get_frame_time(
+		const struct pcanfd_msg *msg,
+		__u32 nom_bitrate,
+		__u32 data_bitrate,
+		__u8 worst_case,
+		__u64 *ns);
+
 TPCANStatus pcanbasic_filter(
         TPCANHandle channel,
         DWORD from,
@@ -0,0 +1,537 @@
+/* SPDX-License-Identifier: LGPL-2.1-only */
+/*
+ * @file pcbsocketcan.c
+ * @brief SocketCAN transport of the PCANBasic channels
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ *
+ * PCAN is a registered Trademark of PEAK-System Germany GmbH
+ *
+ * A channel mapped to a SocketCAN interface (can, vcan...) is a raw CAN
+ * socket bound to it. Frames are converted from/to struct pcanfd_msg:
+ *   - lists are sent and received with one sendmmsg()/recvmmsg() per batch
+ *     of PCBSOCKETCAN_BATCH frames,
+ *   - timestamps come from SO_TIMESTAMPING: the hardware time when the
+ *     interface gives it, the time the kernel received the frame otherwise,
+ *   - bus-off, error passive/warning and restart error frames are turned
+ *     into status messages and give the bus state,
+ *   - the id range filters of the pcan driver are applied when receiving.
+ */
+
+#define _GNU_SOURCE		/* recvmmsg, sendmmsg */
+#include "pcbtransport.h"
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/ioctl.h>
+#include <sys/time.h>
+#include <net/if.h>
+#include <linux/can.h>
+#include <linux/can/raw.h>
+#include <linux/can/error.h>
+#include <linux/errqueue.h>
+#include <linux/net_tstamp.h>
+#include <linux/sockios.h>
+
+/*
+ * DEFINES
+ */
+#define PCBSOCKETCAN_BATCH			32		/**< frames per recvmmsg/sendmmsg */
+#define PCBSOCKETCAN_MAX_FD			1024	/**< sockets above are refused */
+#define PCBSOCKETCAN_MAX_FILTERS	64		/**< id range filters per socket */
+/**
+ * Approximate kernel memory used by a queued frame (skb truesize), to turn
+ * the socket buffer sizes into counts of frames
+ */
+#define PCBSOCKETCAN_SKB_SIZE		768
+
+/**
+ * State of a CAN socket
+ */
+struct pcbsocketcan_sock {
+	int fd_frames;						/**< CAN FD frames enabled */
+	struct timeval tv_init;				/**< time the socket was opened */
+	enum pcanfd_status bus_state;		/**< last state given by an error frame */
+	__u32 tx_frames;					/**< frames sent */
+	__u32 rx_frames;					/**< frames received */
+	__u8 tx_errors;						/**< tx error counter of the controller */
+	__u8 rx_errors;						/**< rx error counter of the controller */
+	__u32 filters_count;				/**< count of id range filters */
+	struct pcanfd_msg_filter filters[PCBSOCKETCAN_MAX_FILTERS];
+};
+
+/* sockets opened by pcbsocketcan_open(), by fd, changed under g_lock */
+static struct pcbsocketcan_sock *g_socks[PCBSOCKETCAN_MAX_FD];
+static pthread_mutex_t g_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* PRIVATE FUNCTIONS */
+static struct pcbsocketcan_sock *pcbsocketcan_get(int fd) {
+	struct pcbsocketcan_sock *ps;
+
+	if (fd < 0 || fd >= PCBSOCKETCAN_MAX_FD)
+		return NULL;
+	pthread_mutex_lock(&g_lock);
+	ps = g_socks[fd];
+	pthread_mutex_unlock(&g_lock);
+	return ps;
+}
+
+/* a full tx queue of a CAN interface gives ENOBUFS */
+static int pcbsocketcan_errno(int err) {
+	return (err == ENOBUFS || err == EWOULDBLOCK) ? -EAGAIN : -err;
+}
+
+/* converts an error frame, returns 0 if it gives no status */
+static int pcbsocketcan_err_to_msg(struct pcbsocketcan_sock *ps, const struct canfd_frame *cf, struct pcanfd_msg *msg) {
+	enum pcanfd_status st = PCANFD_UNKNOWN;
+
+	if (cf->can_id & CAN_ERR_CNT) {
+		ps->tx_errors = cf->data[6];
+		ps->rx_errors = cf->data[7];
+	}
+	if (cf->can_id & CAN_ERR_BUSOFF)
+		st = PCANFD_ERROR_BUSOFF;
+	else if (cf->can_id & CAN_ERR_RESTARTED)
+		st = PCANFD_ERROR_ACTIVE;
+	else if (cf->can_id & CAN_ERR_CRTL) {
+		if (cf->data[1] & (CAN_ERR_CRTL_RX_PASSIVE | CAN_ERR_CRTL_TX_PASSIVE))
+			st = PCANFD_ERROR_PASSIVE;
+		else if (cf->data[1] & (CAN_ERR_CRTL_RX_WARNING | CAN_ERR_CRTL_TX_WARNING))
+			st = PCANFD_ERROR_WARNING;
+		else if (cf->data[1] & (CAN_ERR_CRTL_RX_OVERFLOW | CAN_ERR_CRTL_TX_OVERFLOW)) {
+			msg->type = PCANFD_TYPE_STATUS;
+			msg->flags |= PCANFD_ERROR_CTRLR;
+			msg->id = (cf->data[1] & CAN_ERR_CRTL_RX_OVERFLOW) ?
+					PCANFD_RX_OVERFLOW : PCANFD_TX_OVERFLOW;
+			return 1;
+		}
+#if defined(CAN_ERR_CRTL_ACTIVE)
+		else if (cf->data[1] & CAN_ERR_CRTL_ACTIVE)
+			st = PCANFD_ERROR_ACTIVE;
+#endif
+	}
+	if (st == PCANFD_UNKNOWN)
+		return 0;
+	ps->bus_state = st;
+	msg->type = PCANFD_TYPE_STATUS;
+	msg->flags |= PCANFD_ERROR_BUS | PCANFD_ERRCNT;
+	msg->id = st;
+	msg->ctrlr_data[PCANFD_RXERRCNT] = ps->rx_errors;
+	msg->ctrlr_data[PCANFD_TXERRCNT] = ps->tx_errors;
+	return 1;
+}
+
+/* converts a received frame (nbytes long), returns 0 if it is dropped */
+static int pcbsocketcan_to_msg(struct pcbsocketcan_sock *ps, const struct canfd_frame *cf, int nbytes,
+		struct msghdr *mh, struct pcanfd_msg *msg) {
+	struct cmsghdr *cm;
+	const struct scm_timestamping *ts = NULL;
+
+	memset(msg, 0, offsetof(struct pcanfd_msg, data));
+	for (cm = CMSG_FIRSTHDR(mh); cm != NULL; cm = CMSG_NXTHDR(mh, cm)) {
+		if (cm->cmsg_level == SOL_SOCKET && cm->cmsg_type == SCM_TIMESTAMPING)
+			ts = (const struct scm_timestamping *) CMSG_DATA(cm);
+	}
+	if (ts != NULL && (ts->ts[2].tv_sec || ts->ts[2].tv_nsec)) {
+		msg->timestamp.tv_sec = ts->ts[2].tv_sec;
+		msg->timestamp.tv_usec = ts->ts[2].tv_nsec / 1000;
+		msg->flags = PCANFD_TIMESTAMP | PCANFD_HWTIMESTAMP;
+	}
+	else if (ts != NULL && (ts->ts[0].tv_sec || ts->ts[0].tv_nsec)) {
+		msg->timestamp.tv_sec = ts->ts[0].tv_sec;
+		msg->timestamp.tv_usec = ts->ts[0].tv_nsec / 1000;
+		msg->flags = PCANFD_TIMESTAMP;
+	}
+	else {
+		gettimeofday(&msg->timestamp, NULL);
+		msg->flags = PCANFD_TIMESTAMP;
+	}
+
+	if (cf->can_id & CAN_ERR_FLAG)
+		return pcbsocketcan_err_to_msg(ps, cf, msg);
+
+	if (cf->can_id & CAN_EFF_FLAG) {
+		msg->id = cf->can_id & CAN_EFF_MASK;
+		msg->flags |= PCANFD_MSG_EXT;
+	}
+	else
+		msg->id = cf->can_id & CAN_SFF_MASK;
+	if (cf->can_id & CAN_RTR_FLAG)
+		msg->flags |= PCANFD_MSG_RTR;
+	if (nbytes == CANFD_MTU) {
+		msg->type = PCANFD_TYPE_CANFD_MSG;
+		if (cf->flags & CANFD_BRS)
+			msg->flags |= PCANFD_MSG_BRS;
+		if (cf->flags & CANFD_ESI)
+			msg->flags |= PCANFD_MSG_ESI;
+	}
+	else
+		msg->type = PCANFD_TYPE_CAN20_MSG;
+	msg->data_len = cf->len;
+	memcpy(msg->data, cf->data, cf->len);
+	ps->rx_frames++;
+	return !pcbtransport_filtered(ps->filters, ps->filters_count, msg);
+}
+
+/* converts a message to send, returns the frame length or a negative errno */
+static int pcbsocketcan_from_msg(const struct pcbsocketcan_sock *ps, const struct pcanfd_msg *msg, struct canfd_frame *cf) {
+	int nbytes;
+
+	memset(cf, 0, sizeof(*cf));
+	switch (msg->type) {
+	case PCANFD_TYPE_CANFD_MSG:
+		if (!ps->fd_frames || msg->data_len > CANFD_MAX_DLEN)
+			return -EINVAL;
+		if (msg->flags & PCANFD_MSG_BRS)
+			cf->flags |= CANFD_BRS;
+		nbytes = CANFD_MTU;
+		break;
+	case PCANFD_TYPE_CAN20_MSG:
+		if (msg->data_len > CAN_MAX_DLEN)
+			return -EINVAL;
+		nbytes = CAN_MTU;
+		break;
+	default:
+		return -EINVAL;
+	}
+	if (msg->flags & PCANFD_MSG_EXT)
+		cf->can_id = (msg->id & CAN_EFF_MASK) | CAN_EFF_FLAG;
+	else
+		cf->can_id = msg->id & CAN_SFF_MASK;
+	if (msg->flags & PCANFD_MSG_RTR)
+		cf->can_id |= CAN_RTR_FLAG;
+	cf->len = msg->data_len;
+	memcpy(cf->data, msg->data, msg->data_len);
+	return nbytes;
+}
+
+static int pcbsocketcan_close(int fd) {
+	struct pcbsocketcan_sock *ps = NULL;
+
+	if (fd >= 0 && fd < PCBSOCKETCAN_MAX_FD) {
+		pthread_mutex_lock(&g_lock);
+		ps = g_socks[fd];
+		g_socks[fd] = NULL;
+		pthread_mutex_unlock(&g_lock);
+	}
+	free(ps);
+	return close(fd) < 0 ? -errno : 0;
+}
+
+/* bit rates are set with "ip link" */
+static int pcbsocketcan_set_init(int fd, struct pcanfd_init *pfdi) {
+	(void)fd;
+	(void)pfdi;
+	return -EOPNOTSUPP;
+}
+
+static int pcbsocketcan_get_init(int fd, struct pcanfd_init *pfdi) {
+	(void)fd;
+	(void)pfdi;
+	return -EOPNOTSUPP;
+}
+
+static int pcbsocketcan_get_state(int fd, struct pcanfd_state *pfds) {
+	struct pcbsocketcan_sock *ps = pcbsocketcan_get(fd);
+	int outq, size;
+	socklen_t len;
+
+	if (ps == NULL)
+		return -EBADF;
+	memset(pfds, 0, sizeof(*pfds));
+	pfds->tv_init = ps->tv_init;
+	pfds->bus_state = ps->bus_state;
+	pfds->device_id = 0xffffffff;
+	pfds->open_counter = 1;
+	pfds->filters_counter = ps->filters_count;
+	pfds->bus_load = 0xffff;
+	pfds->tx_frames_counter = ps->tx_frames;
+	pfds->rx_frames_counter = ps->rx_frames;
+	pfds->tx_error_counter = ps->tx_errors;
+	pfds->rx_error_counter = ps->rx_errors;
+	/* estimated from the socket buffers */
+	len = sizeof(size);
+	if (getsockopt(fd, SOL_SOCKET, SO_SNDBUF, &size, &len) == 0)
+		pfds->tx_max_msgs = size / PCBSOCKETCAN_SKB_SIZE;
+	len = sizeof(size);
+	if (getsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, &len) == 0)
+		pfds->rx_max_msgs = size / PCBSOCKETCAN_SKB_SIZE;
+	if (ioctl(fd, SIOCOUTQ, &outq) == 0 && outq > 0)
+		pfds->tx_pending_msgs = (outq + PCBSOCKETCAN_SKB_SIZE - 1) / PCBSOCKETCAN_SKB_SIZE;
+	return 0;
+}
+
+static int pcbsocketcan_add_filter(int fd, const struct pcanfd_msg_filter *pf) {
+	struct pcbsocketcan_sock *ps = pcbsocketcan_get(fd);
+
+	if (ps == NULL)
+		return -EBADF;
+	if (ps->filters_count >= PCBSOCKETCAN_MAX_FILTERS)
+		return -ENOMEM;
+	ps->filters[ps->filters_count++] = *pf;
+	return 0;
+}
+
+static int pcbsocketcan_get_filters(int fd, struct pcanfd_msg_filters *pfl) {
+	struct pcbsocketcan_sock *ps = pcbsocketcan_get(fd);
+	__u32 i;
+
+	if (ps == NULL)
+		return -EBADF;
+	for (i = 0; i < pfl->count && i < ps->filters_count; i++)
+		pfl->list[i] = ps->filters[i];
+	pfl->count = i;
+	return 0;
+}
+
+static int pcbsocketcan_del_filters(int fd) {
+	struct pcbsocketcan_sock *ps = pcbsocketcan_get(fd);
+
+	if (ps == NULL)
+		return -EBADF;
+	ps->filters_count = 0;
+	return 0;
+}
+
+static int pcbsocketcan_send_msg(int fd, const struct pcanfd_msg *pfdm) {
+	struct pcbsocketcan_sock *ps = pcbsocketcan_get(fd);
+	struct canfd_frame cf;
+	int nbytes;
+
+	if (ps == NULL)
+		return -EBADF;
+	nbytes = pcbsocketcan_from_msg(ps, pfdm, &cf);
+	if (nbytes < 0)
+		return nbytes;
+	if (send(fd, &cf, nbytes, MSG_DONTWAIT) != nbytes)
+		return pcbsocketcan_errno(errno);
+	ps->tx_frames++;
+	return 0;
+}
+
+/* sends the list, sets its count to the number of msgs sent */
+static int pcbsocketcan_send_msgs(int fd, struct pcanfd_msgs *pfdml) {
+	struct pcbsocketcan_sock *ps = pcbsocketcan_get(fd);
+	struct canfd_frame cf[PCBSOCKETCAN_BATCH];
+	struct iovec iov[PCBSOCKETCAN_BATCH];
+	struct mmsghdr mm[PCBSOCKETCAN_BATCH];
+	__u32 sent, n, i;
+	int nbytes, res, err;
+
+	if (ps == NULL)
+		return -EBADF;
+	err = 0;
+	sent = 0;
+	while (sent < pfdml->count) {
+		n = pfdml->count - sent;
+		if (n > PCBSOCKETCAN_BATCH)
+			n = PCBSOCKETCAN_BATCH;
+		memset(mm, 0, n * sizeof(mm[0]));
+		for (i = 0; i < n; i++) {
+			nbytes = pcbsocketcan_from_msg(ps, &pfdml->list[sent + i], &cf[i]);
+			if (nbytes < 0) {
+				/* send the valid msgs before it */
+				err = nbytes;
+				n = i;
+				break;
+			}
+			iov[i].iov_base = &cf[i];
+			iov[i].iov_len = nbytes;
+			mm[i].msg_hdr.msg_iov = &iov[i];
+			mm[i].msg_hdr.msg_iovlen = 1;
+		}
+		if (n == 0)
+			break;
+		res = sendmmsg(fd, mm, n, MSG_DONTWAIT);
+		if (res < 0) {
+			err = pcbsocketcan_errno(errno);
+			break;
+		}
+		sent += res;
+		ps->tx_frames += res;
+		if ((__u32)res < n || err)
+			break;
+	}
+	pfdml->count = sent;
+	/* an error is only returned if nothing was sent */
+	return (sent == 0 && err) ? err : 0;
+}
+
+static int pcbsocketcan_recv_msg(int fd, struct pcanfd_msg *pfdm) {
+	struct pcbsocketcan_sock *ps = pcbsocketcan_get(fd);
+	struct canfd_frame cf;
+	char ctrl[CMSG_SPACE(sizeof(struct scm_timestamping))];
+	struct iovec iov;
+	struct msghdr mh;
+	ssize_t nbytes;
+
+	if (ps == NULL)
+		return -EBADF;
+	do {
+		iov.iov_base = &cf;
+		iov.iov_len = sizeof(cf);
+		memset(&mh, 0, sizeof(mh));
+		mh.msg_iov = &iov;
+		mh.msg_iovlen = 1;
+		mh.msg_control = ctrl;
+		mh.msg_controllen = sizeof(ctrl);
+		nbytes = recvmsg(fd, &mh, MSG_DONTWAIT);
+		if (nbytes < 0)
+			return pcbsocketcan_errno(errno);
+	} while (!pcbsocketcan_to_msg(ps, &cf, (int)nbytes, &mh, pfdm));
+	return 0;
+}
+
+/* receives up to count msgs, sets count to the number of msgs received */
+static int pcbsocketcan_recv_msgs(int fd, struct pcanfd_msgs *pfdml) {
+	struct pcbsocketcan_sock *ps = pcbsocketcan_get(fd);
+	struct canfd_frame cf[PCBSOCKETCAN_BATCH];
+	char ctrl[PCBSOCKETCAN_BATCH][CMSG_SPACE(sizeof(struct scm_timestamping))];
+	struct iovec iov[PCBSOCKETCAN_BATCH];
+	struct mmsghdr mm[PCBSOCKETCAN_BATCH];
+	__u32 count, n, i;
+	int res;
+
+	if (ps == NULL)
+		return -EBADF;
+	count = 0;
+	while (count < pfdml->count) {
+		n = pfdml->count - count;
+		if (n > PCBSOCKETCAN_BATCH)
+			n = PCBSOCKETCAN_BATCH;
+		memset(mm, 0, n * sizeof(mm[0]));
+		for (i = 0; i < n; i++) {
+			iov[i].iov_base = &cf[i];
+			iov[i].iov_len = sizeof(cf[i]);
+			mm[i].msg_hdr.msg_iov = &iov[i];
+			mm[i].msg_hdr.msg_iovlen = 1;
+			mm[i].msg_hdr.msg_control = ctrl[i];
+			mm[i].msg_hdr.msg_controllen = sizeof(ctrl[i]);
+		}
+		res = recvmmsg(fd, mm, n, MSG_DONTWAIT, NULL);
+		if (res < 0) {
+			if (count == 0) {
+				pfdml->count = 0;
+				return pcbsocketcan_errno(errno);
+			}
+			break;
+		}
+		for (i = 0; i < (__u32)res; i++) {
+			if (pcbsocketcan_to_msg(ps, &cf[i], (int)mm[i].msg_len,
+					&mm[i].msg_hdr, &pfdml->list[count]))
+				count++;
+		}
+		/* the socket queue is empty */
+		if ((__u32)res < n)
+			break;
+	}
+	pfdml->count = count;
+	return 0;
+}
+
+static int pcbsocketcan_get_option(int fd, int name, void *value, int size) {
+	(void)fd;
+	(void)name;
+	(void)value;
+	(void)size;
+	return -EOPNOTSUPP;
+}
+
+static int pcbsocketcan_set_option(int fd, int name, void *value, int size) {
+	(void)fd;
+	(void)name;
+	(void)value;
+	(void)size;
+	return -EOPNOTSUPP;
+}
+
+/* GLOBAL FUNCTIONS */
+const struct pcbtransport pcbtransport_socketcan = {
+	.name = "socketcan",
+	.close = pcbsocketcan_close,
+	.set_init = pcbsocketcan_set_init,
+	.get_init = pcbsocketcan_get_init,
+	.get_state = pcbsocketcan_get_state,
+	.add_filter = pcbsocketcan_add_filter,
+	.get_filters = pcbsocketcan_get_filters,
+	.del_filters = pcbsocketcan_del_filters,
+	.send_msg = pcbsocketcan_send_msg,
+	.send_msgs = pcbsocketcan_send_msgs,
+	.recv_msg = pcbsocketcan_recv_msg,
+	.recv_msgs = pcbsocketcan_recv_msgs,
+	.get_option = pcbsocketcan_get_option,
+	.set_option = pcbsocketcan_set_option,
+};
+
+int pcbsocketcan_open(const char *ifname, int fd_frames) {
+	struct pcbsocketcan_sock *ps;
+	struct sockaddr_can addr;
+	can_err_mask_t err_mask;
+	int fd, on, ts_flags, err;
+
+	fd = socket(PF_CAN, SOCK_RAW | SOCK_NONBLOCK | SOCK_CLOEXEC, CAN_RAW);
+	if (fd < 0)
+		return -errno;
+	if (fd >= PCBSOCKETCAN_MAX_FD) {
+		err = -EMFILE;
+		goto pcbsocketcan_open_close;
+	}
+	memset(&addr, 0, sizeof(addr));
+	addr.can_family = AF_CAN;
+	addr.can_ifindex = if_nametoindex(ifname);
+	if (addr.can_ifindex == 0) {
+		err = -ENODEV;
+		goto pcbsocketcan_open_close;
+	}
+	if (fd_frames) {
+		on = 1;
+		if (setsockopt(fd, SOL_CAN_RAW, CAN_RAW_FD_FRAMES, &on, sizeof(on)) < 0) {
+			err = -errno;
+			goto pcbsocketcan_open_close;
+		}
+	}
+	/* the bus state is given by the error frames */
+	err_mask = CAN_ERR_BUSOFF | CAN_ERR_CRTL | CAN_ERR_RESTARTED;
+	setsockopt(fd, SOL_CAN_RAW, CAN_RAW_ERR_FILTER, &err_mask, sizeof(err_mask));
+	/* hardware timestamps if the interface gives them, else software */
+	ts_flags = SOF_TIMESTAMPING_RX_HARDWARE | SOF_TIMESTAMPING_RAW_HARDWARE |
+			SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE;
+	setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPING, &ts_flags, sizeof(ts_flags));
+	if (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+		err = -errno;
+		goto pcbsocketcan_open_close;
+	}
+	ps = (struct pcbsocketcan_sock *) calloc(1, sizeof(*ps));
+	if (ps == NULL) {
+		err = -ENOMEM;
+		goto pcbsocketcan_open_close;
+	}
+	ps->fd_frames = fd_frames;
+	ps->bus_state = PCANFD_ERROR_ACTIVE;
+	gettimeofday(&ps->tv_init, NULL);
+	pthread_mutex_lock(&g_lock);
+	g_socks[fd] = ps;
+	pthread_mutex_unlock(&g_lock);
+	return fd;
+
+pcbsocketcan_open_close:
+	close(fd);
+	return err;
+}
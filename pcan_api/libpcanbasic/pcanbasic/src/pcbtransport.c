@@ -0,0 +1,86 @@
+/* SPDX-License-Identifier: LGPL-2.1-only */
+/*
+ * @file pcbtransport.c
+ * @brief pcan driver chardev transport of the PCANBasic channels, and the
+ * helpers shared by the transports
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ *
+ * PCAN is a registered Trademark of PEAK-System Germany GmbH
+ */
+
+#include "pcbtransport.h"
+#include "libpcanfd.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+const struct pcbtransport pcbtransport_pcanfd = {
+	.name = "pcanfd",
+	.close = pcanfd_close,
+	.set_init = pcanfd_set_init,
+	.get_init = pcanfd_get_init,
+	.get_state = pcanfd_get_state,
+	.add_filter = pcanfd_add_filter,
+	.get_filters = pcanfd_get_filters,
+	.del_filters = pcanfd_del_filters,
+	.send_msg = pcanfd_send_msg,
+	.send_msgs = pcanfd_send_msgs,
+	.recv_msg = pcanfd_recv_msg,
+	.recv_msgs = pcanfd_recv_msgs,
+	.get_option = pcanfd_get_option,
+	.set_option = pcanfd_set_option,
+};
+
+int pcbtransport_lookup(const char *env, TPCANHandle channel, char *name, size_t size) {
+	const char *val;
+	char *map, *item, *save, *eq;
+	int found = 0;
+
+	val = getenv(env);
+	if (val == NULL || *val == '\0')
+		return 0;
+	map = strdup(val);
+	if (map == NULL)
+		return 0;
+	/* "handle=name" items separated by commas or spaces */
+	for (item = strtok_r(map, ", ", &save); item != NULL && !found;
+			item = strtok_r(NULL, ", ", &save)) {
+		eq = strchr(item, '=');
+		if (eq == NULL || eq[1] == '\0')
+			continue;
+		*eq = '\0';
+		if (strtoul(item, NULL, 0) != channel)
+			continue;
+		snprintf(name, size, "%s", eq + 1);
+		found = 1;
+	}
+	free(map);
+	return found;
+}
+
+int pcbtransport_filtered(const struct pcanfd_msg_filter *filters, __u32 count, const struct pcanfd_msg *msg) {
+	__u32 i;
+
+	if (count == 0 || msg->type == PCANFD_TYPE_STATUS)
+		return 0;
+	for (i = 0; i < count; i++) {
+		if (msg->id >= filters[i].id_from && msg->id <= filters[i].id_to &&
+				!((msg->flags ^ filters[i].msg_flags) & PCANFD_MSG_EXT))
+			return 0;
+	}
+	return 1;
+}
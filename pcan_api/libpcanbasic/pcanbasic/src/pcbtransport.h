@@ -0,0 +1,143 @@
+/* SPDX-License-Identifier: LGPL-2.1-only */
+/*
+ * @file pcbtransport.h
+ * @brief Transports of the PCANBasic channels (pcan chardev, SocketCAN, virtual bus)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ *
+ * PCAN is a registered Trademark of PEAK-System Germany GmbH
+ */
+
+#ifndef __PCBTRANSPORT_H__
+#define __PCBTRANSPORT_H__
+
+/*
+ * INCLUDES
+ */
+#include <stddef.h>
+#include "../PCANBasic.h"	/* PCANBasic types, struct pcanfd_msg */
+
+/*
+ * DEFINES
+ */
+/**
+ * Environment variable mapping PCANBasic channels to SocketCAN interfaces,
+ * ex. "0x51=can0,0x52=vcan0"
+ */
+#define PCBSOCKETCAN_ENV			"PCANBASIC_SOCKETCAN"
+#define PCBSOCKETCAN_IFNAME_SIZE	16	/**< IFNAMSIZ */
+/**
+ * Environment variable mapping PCANBasic channels to in-process virtual
+ * buses, ex. "0x51=bus0,0x52=bus0" (both channels on the same bus)
+ */
+#define PCBVIRTUAL_ENV				"PCANBASIC_VIRTUAL"
+/**
+ * Environment variable enabling the wire-time pacing of the virtual buses
+ * when set to "1"
+ */
+#define PCBVIRTUAL_PACING_ENV		"PCANBASIC_VIRTUAL_PACING"
+#define PCBVIRTUAL_NAME_SIZE		16	/**< max length of a bus name */
+
+/**
+ * Operations of a channel transport on an opened file descriptor.
+ * They follow libpcanfd: they return 0 (or a positive value) on success and
+ * a negative errno otherwise.
+ */
+struct pcbtransport {
+	const char *name;		/**< name of the transport */
+	int (*close)(int fd);
+	int (*set_init)(int fd, struct pcanfd_init *pfdi);
+	int (*get_init)(int fd, struct pcanfd_init *pfdi);
+	int (*get_state)(int fd, struct pcanfd_state *pfds);
+	int (*add_filter)(int fd, const struct pcanfd_msg_filter *pf);
+	int (*get_filters)(int fd, struct pcanfd_msg_filters *pfl);
+	int (*del_filters)(int fd);
+	int (*send_msg)(int fd, const struct pcanfd_msg *pfdm);
+	int (*send_msgs)(int fd, struct pcanfd_msgs *pfdml);
+	int (*recv_msg)(int fd, struct pcanfd_msg *pfdm);
+	int (*recv_msgs)(int fd, struct pcanfd_msgs *pfdml);
+	int (*get_option)(int fd, int name, void *value, int size);
+	int (*set_option)(int fd, int name, void *value, int size);
+};
+
+/** pcan driver chardev (libpcanfd) */
+extern const struct pcbtransport pcbtransport_pcanfd;
+
+/** SocketCAN raw socket */
+extern const struct pcbtransport pcbtransport_socketcan;
+
+/** In-process virtual bus */
+extern const struct pcbtransport pcbtransport_virtual;
+
+/**
+ * @fn int pcbtransport_lookup(const char *env, TPCANHandle channel, char *name, size_t size)
+ * @brief Gets the name a channel is mapped to in an environment variable
+ * holding "handle=name" items separated by commas or spaces (see
+ * PCBSOCKETCAN_ENV and PCBVIRTUAL_ENV).
+ *
+ * @param env name of the environment variable
+ * @param channel PCANBasic channel handle
+ * @param name buffer receiving the name the channel is mapped to
+ * @param size size of the buffer
+ * @return 1 if the channel is mapped, 0 otherwise
+ */
+int pcbtransport_lookup(const char *env, TPCANHandle channel, char *name, size_t size);
+
+/**
+ * @fn int pcbtransport_filtered(const struct pcanfd_msg_filter *filters, __u32 count, const struct pcanfd_msg *msg)
+ * @brief Tells if a received message is rejected by id range filters, like
+ * the pcan driver does (status messages are never filtered).
+ *
+ * @param filters list of id range filters
+ * @param count number of filters, 0 accepts every message
+ * @param msg received message
+ * @return 1 if the message is rejected, 0 otherwise
+ */
+int pcbtransport_filtered(const struct pcanfd_msg_filter *filters, __u32 count, const struct pcanfd_msg *msg);
+
+/**
+ * @fn int pcbsocketcan_open(const char *ifname, int fd_frames)
+ * @brief Opens a non-blocking raw CAN socket bound to an interface.
+ *
+ * The bit rates of the interface are not changed, they are set with
+ * "ip link" (ex. "ip link set can0 type can bitrate 1000000").
+ *
+ * @param ifname name of the interface
+ * @param fd_frames 1 to send and receive CAN FD frames
+ * @return the socket or a negative errno
+ */
+int pcbsocketcan_open(const char *ifname, int fd_frames);
+
+/**
+ * @fn int pcbvirtual_open(const char *bus, int fd_frames, __u32 nom_bitrate, __u32 data_bitrate)
+ * @brief Opens a node on an in-process virtual bus, the bus is created by
+ * its first node. Frames sent by a node are received by the other nodes of
+ * the bus.
+ *
+ * The bit rates of the bus are the ones of its first node. When pacing is
+ * enabled (see PCBVIRTUAL_PACING_ENV), frames take their wire time at these
+ * bit rates: they are received and timestamped at the end of their
+ * transmission, after the frames sent before them on the bus.
+ *
+ * @param bus name of the bus
+ * @param fd_frames 1 to send CAN FD frames
+ * @param nom_bitrate nominal bit rate (bps), 0 if unknown (no pacing)
+ * @param data_bitrate data bit rate (bps), 0 if none
+ * @return a file descriptor, readable when messages are received, or a
+ * 	negative errno
+ */
+int pcbvirtual_open(const char *bus, int fd_frames, __u32 nom_bitrate, __u32 data_bitrate);
+
+#endif
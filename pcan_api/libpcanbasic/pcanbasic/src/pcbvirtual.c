@@ -0,0 +1,653 @@
+/* SPDX-License-Identifier: LGPL-2.1-only */
+/*
+ * @file pcbvirtual.c
+ * @brief In-process virtual bus transport of the PCANBasic channels
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ *
+ * PCAN is a registered Trademark of PEAK-System Germany GmbH
+ *
+ * A virtual bus links the channels (nodes) mapped to it in the same
+ * process, without any driver:
+ *   - each node receives in a bounded lock-free MPMC ring (one sequence
+ *     number per cell), a frame sent on the bus is pushed in the ring of
+ *     every other node,
+ *   - with pacing, a frame starts when the bus is idle and takes its wire
+ *     time (pcbwire.h): it is timestamped and can be read at its end. The
+ *     Tx queue of a node holds PCBVIRTUAL_TXQ_SIZE frames not on the wire
+ *     yet. Without pacing (or bit rate), frames are received when sent,
+ *   - the fd of a node is a CLOCK_MONOTONIC timerfd armed at the arrival
+ *     time of its next frame: it can be polled like a pcan device.
+ */
+
+#include "pcbtransport.h"
+#include "pcbwire.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <time.h>
+#include <sched.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <sys/timerfd.h>
+
+/*
+ * DEFINES
+ */
+#define PCBVIRTUAL_RING_SIZE	4096	/**< Rx ring of a node (power of 2) */
+#define PCBVIRTUAL_TXQ_SIZE		64		/**< Tx queue of a node (power of 2) */
+#define PCBVIRTUAL_MAX_NODES	16		/**< nodes per bus */
+#define PCBVIRTUAL_MAX_FD		1024	/**< timerfds above are refused */
+#define PCBVIRTUAL_MAX_FILTERS	64		/**< id range filters per node */
+#define PCBVIRTUAL_NEVER		INT64_MAX
+
+/**
+ * Cell of a ring: 'seq' is its position when free, its position + 1 when
+ * it holds a message
+ */
+struct pcbvirtual_cell {
+	atomic_ulong seq;
+	_Atomic int64_t arrival_ns;			/**< CLOCK_MONOTONIC end of frame */
+	struct pcanfd_msg msg;
+};
+
+/**
+ * Bounded multi-producer multi-consumer ring
+ */
+struct pcbvirtual_ring {
+	atomic_ulong head;					/**< next position to read */
+	char pad0[64 - sizeof(atomic_ulong)];
+	atomic_ulong tail;					/**< next position to write */
+	char pad1[64 - sizeof(atomic_ulong)];
+	struct pcbvirtual_cell cells[PCBVIRTUAL_RING_SIZE];
+};
+
+struct pcbvirtual_bus;
+
+/**
+ * Node of a bus, one per opened channel
+ */
+struct pcbvirtual_node {
+	struct pcbvirtual_bus *bus;
+	int fd;								/**< timerfd, readable when a frame arrived */
+	int fd_frames;						/**< CAN FD frames allowed */
+	struct pcbvirtual_ring *ring;		/**< received frames */
+	pthread_mutex_t wake_lock;			/**< serializes the (re)arming of fd */
+	_Atomic int64_t wake_ns;			/**< time fd is armed at */
+	atomic_int overflow;				/**< a frame was lost, ring was full */
+	struct timeval tv_init;				/**< time the node was opened */
+	__u32 tx_frames;					/**< frames sent */
+	__u32 rx_frames;					/**< frames read */
+	__u64 tx_count;						/**< frames sent (Tx queue position) */
+	int64_t tx_end_ns[PCBVIRTUAL_TXQ_SIZE];	/**< end of the last frames sent */
+	__u32 filters_count;				/**< count of id range filters */
+	struct pcanfd_msg_filter filters[PCBVIRTUAL_MAX_FILTERS];
+};
+
+/**
+ * Virtual bus
+ */
+struct pcbvirtual_bus {
+	char name[PCBVIRTUAL_NAME_SIZE];
+	struct pcbvirtual_bus *next;		/**< list of the buses */
+	int nodes_count;
+	_Atomic(struct pcbvirtual_node *) nodes[PCBVIRTUAL_MAX_NODES];
+	atomic_int senders;					/**< nodes sending on the bus */
+	_Atomic int64_t idle_ns;			/**< end of the last frame on the wire */
+	int pacing;							/**< frames take their wire time */
+	__u32 nom_bitrate;					/**< nominal bit rate (bps) */
+	__u32 data_bitrate;					/**< data bit rate (bps) */
+	int64_t realtime_ns;				/**< CLOCK_REALTIME - CLOCK_MONOTONIC */
+};
+
+/* buses and nodes, changed under g_lock */
+static pthread_mutex_t g_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct pcbvirtual_bus *g_buses;
+static struct pcbvirtual_node *g_nodes[PCBVIRTUAL_MAX_FD];
+
+/* PRIVATE FUNCTIONS */
+static int64_t pcbvirtual_now(clockid_t clock) {
+	struct timespec ts;
+
+	clock_gettime(clock, &ts);
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static struct pcbvirtual_node *pcbvirtual_get(int fd) {
+	if (fd < 0 || fd >= PCBVIRTUAL_MAX_FD)
+		return NULL;
+	return g_nodes[fd];
+}
+
+static struct pcbvirtual_ring *pcbvirtual_ring_alloc(void) {
+	struct pcbvirtual_ring *r;
+	unsigned long i;
+
+	if (posix_memalign((void **) &r, 64, sizeof(*r)) != 0)
+		return NULL;
+	atomic_init(&r->head, 0);
+	atomic_init(&r->tail, 0);
+	for (i = 0; i < PCBVIRTUAL_RING_SIZE; i++) {
+		atomic_init(&r->cells[i].seq, i);
+		atomic_init(&r->cells[i].arrival_ns, 0);
+	}
+	return r;
+}
+
+/* returns 0 if the ring is full */
+static int pcbvirtual_ring_push(struct pcbvirtual_ring *r, const struct pcanfd_msg *msg, int64_t arrival_ns) {
+	struct pcbvirtual_cell *c;
+	unsigned long pos, seq;
+	long dif;
+
+	pos = atomic_load_explicit(&r->tail, memory_order_relaxed);
+	for (;;) {
+		c = &r->cells[pos & (PCBVIRTUAL_RING_SIZE - 1)];
+		seq = atomic_load_explicit(&c->seq, memory_order_acquire);
+		dif = (long)(seq - pos);
+		if (dif == 0) {
+			if (atomic_compare_exchange_weak_explicit(&r->tail, &pos, pos + 1,
+					memory_order_relaxed, memory_order_relaxed))
+				break;
+		}
+		else if (dif < 0)
+			return 0;
+		else
+			pos = atomic_load_explicit(&r->tail, memory_order_relaxed);
+	}
+	c->msg = *msg;
+	atomic_store_explicit(&c->arrival_ns, arrival_ns, memory_order_relaxed);
+	atomic_store_explicit(&c->seq, pos + 1, memory_order_release);
+	return 1;
+}
+
+/*
+ * pops the first message if it arrived at 'now_ns'. Returns 1 if popped, 0
+ * if the ring is empty, -1 if the first message arrives at '*arrival_ns'.
+ */
+static int pcbvirtual_ring_pop(struct pcbvirtual_ring *r, struct pcanfd_msg *msg, int64_t now_ns, int64_t *arrival_ns) {
+	struct pcbvirtual_cell *c;
+	unsigned long pos, seq;
+	long dif;
+
+	pos = atomic_load_explicit(&r->head, memory_order_relaxed);
+	for (;;) {
+		c = &r->cells[pos & (PCBVIRTUAL_RING_SIZE - 1)];
+		seq = atomic_load_explicit(&c->seq, memory_order_acquire);
+		dif = (long)(seq - (pos + 1));
+		if (dif == 0) {
+			/* the cell can not be reused before head moves */
+			*arrival_ns = atomic_load_explicit(&c->arrival_ns, memory_order_relaxed);
+			if (*arrival_ns > now_ns)
+				return -1;
+			if (atomic_compare_exchange_weak_explicit(&r->head, &pos, pos + 1,
+					memory_order_relaxed, memory_order_relaxed))
+				break;
+		}
+		else if (dif < 0)
+			return 0;
+		else
+			pos = atomic_load_explicit(&r->head, memory_order_relaxed);
+	}
+	if (msg != NULL)
+		*msg = c->msg;
+	atomic_store_explicit(&c->seq, pos + PCBVIRTUAL_RING_SIZE, memory_order_release);
+	return 1;
+}
+
+static void pcbvirtual_arm(struct pcbvirtual_node *pn, int64_t at_ns) {
+	struct itimerspec its;
+
+	memset(&its, 0, sizeof(its));
+	if (at_ns != PCBVIRTUAL_NEVER) {
+		/* 0 disarms the timer: a past time fires it at once */
+		if (at_ns <= 0)
+			at_ns = 1;
+		its.it_value.tv_sec = at_ns / 1000000000LL;
+		its.it_value.tv_nsec = at_ns % 1000000000LL;
+	}
+	timerfd_settime(pn->fd, TFD_TIMER_ABSTIME, &its, NULL);
+	atomic_store(&pn->wake_ns, at_ns);
+}
+
+/* producer side: makes fd readable at 'arrival_ns' at the latest */
+static void pcbvirtual_wake(struct pcbvirtual_node *pn, int64_t arrival_ns) {
+	/* the push is ordered before the load of the wake time (see
+	 * pcbvirtual_rearm()) */
+	atomic_thread_fence(memory_order_seq_cst);
+	if (arrival_ns >= atomic_load(&pn->wake_ns))
+		return;
+	pthread_mutex_lock(&pn->wake_lock);
+	if (arrival_ns < atomic_load(&pn->wake_ns))
+		pcbvirtual_arm(pn, arrival_ns);
+	pthread_mutex_unlock(&pn->wake_lock);
+}
+
+/* consumer side: nothing more to read, rearms fd for the next message */
+static void pcbvirtual_rearm(struct pcbvirtual_node *pn) {
+	struct pcbvirtual_ring *r = pn->ring;
+	struct pcbvirtual_cell *c;
+	unsigned long pos;
+	uint64_t expirations;
+	int64_t at_ns = PCBVIRTUAL_NEVER;
+
+	pthread_mutex_lock(&pn->wake_lock);
+	if (read(pn->fd, &expirations, sizeof(expirations)) < 0) {
+		/* not expired */
+	}
+	/* the wake time is reset before the ring is checked: a message pushed
+	 * after the check sees it and takes the lock to arm fd once this one
+	 * is done, a message pushed before is seen here */
+	atomic_store(&pn->wake_ns, PCBVIRTUAL_NEVER);
+	atomic_thread_fence(memory_order_seq_cst);
+	pos = atomic_load(&r->head);
+	c = &r->cells[pos & (PCBVIRTUAL_RING_SIZE - 1)];
+	if (atomic_load_explicit(&c->seq, memory_order_acquire) == pos + 1)
+		at_ns = atomic_load_explicit(&c->arrival_ns, memory_order_relaxed);
+	pcbvirtual_arm(pn, at_ns);
+	pthread_mutex_unlock(&pn->wake_lock);
+}
+
+/* Tx queue: frames sent by the node and not on the wire yet */
+static __u32 pcbvirtual_tx_pending(const struct pcbvirtual_node *pn, int64_t now_ns) {
+	__u32 i, pending = 0;
+
+	for (i = 0; i < PCBVIRTUAL_TXQ_SIZE; i++)
+		pending += pn->tx_end_ns[i] > now_ns;
+	return pending;
+}
+
+/* puts a message on the bus, returns 0 or a negative errno */
+static int pcbvirtual_post(struct pcbvirtual_node *pn, const struct pcanfd_msg *pfdm, int64_t now_ns) {
+	struct pcbvirtual_bus *bus = pn->bus;
+	struct pcbvirtual_node *peer;
+	struct pcanfd_msg msg;
+	int64_t idle, start, end, wire, ts;
+	__u32 i;
+
+	switch (pfdm->type) {
+	case PCANFD_TYPE_CANFD_MSG:
+		if (!pn->fd_frames || pfdm->data_len > 64)
+			return -EINVAL;
+		break;
+	case PCANFD_TYPE_CAN20_MSG:
+		if (pfdm->data_len > 8)
+			return -EINVAL;
+		break;
+	default:
+		return -EINVAL;
+	}
+	end = now_ns;
+	if (bus->pacing) {
+		/* the oldest frame of the Tx queue is not on the wire yet */
+		if (pn->tx_end_ns[pn->tx_count & (PCBVIRTUAL_TXQ_SIZE - 1)] > now_ns)
+			return -EAGAIN;
+		wire = (int64_t)pcbwire_frame_ns(pfdm, bus->nom_bitrate, bus->data_bitrate);
+		idle = atomic_load(&bus->idle_ns);
+		do {
+			start = (idle > now_ns) ? idle : now_ns;
+			end = start + wire;
+		} while (!atomic_compare_exchange_weak(&bus->idle_ns, &idle, end));
+		pn->tx_end_ns[pn->tx_count & (PCBVIRTUAL_TXQ_SIZE - 1)] = end;
+	}
+	pn->tx_count++;
+	pn->tx_frames++;
+
+	memcpy(&msg, pfdm, offsetof(struct pcanfd_msg, data) + pfdm->data_len);
+	ts = end + bus->realtime_ns;
+	msg.timestamp.tv_sec = ts / 1000000000LL;
+	msg.timestamp.tv_usec = (ts % 1000000000LL) / 1000;
+	msg.flags = (pfdm->flags & (PCANFD_MSG_EXT | PCANFD_MSG_RTR |
+			PCANFD_MSG_BRS | PCANFD_MSG_ESI)) | PCANFD_TIMESTAMP;
+	for (i = 0; i < PCBVIRTUAL_MAX_NODES; i++) {
+		peer = atomic_load_explicit(&bus->nodes[i], memory_order_acquire);
+		if (peer == NULL || peer == pn)
+			continue;
+		if (!pcbvirtual_ring_push(peer->ring, &msg, end)) {
+			atomic_store(&peer->overflow, 1);
+			continue;
+		}
+		pcbvirtual_wake(peer, end);
+	}
+	return 0;
+}
+
+/* reads up to 'count' messages, returns the number read */
+static __u32 pcbvirtual_read(struct pcbvirtual_node *pn, struct pcanfd_msg *list, __u32 count) {
+	int64_t now_ns, arrival_ns;
+	__u32 n = 0;
+	int res = 0;
+
+	if (count && atomic_exchange(&pn->overflow, 0)) {
+		memset(&list[n], 0, sizeof(list[n]));
+		list[n].type = PCANFD_TYPE_STATUS;
+		list[n].flags = PCANFD_ERROR_CTRLR | PCANFD_TIMESTAMP;
+		list[n].id = PCANFD_RX_OVERFLOW;
+		gettimeofday(&list[n].timestamp, NULL);
+		n++;
+	}
+	now_ns = pcbvirtual_now(CLOCK_MONOTONIC);
+	while (n < count) {
+		res = pcbvirtual_ring_pop(pn->ring, &list[n], now_ns, &arrival_ns);
+		if (res <= 0)
+			break;
+		pn->rx_frames++;
+		if (!pcbtransport_filtered(pn->filters, pn->filters_count, &list[n]))
+			n++;
+	}
+	if (res <= 0)
+		pcbvirtual_rearm(pn);
+	return n;
+}
+
+static struct pcbvirtual_bus *pcbvirtual_bus_get(const char *name, __u32 nom_bitrate, __u32 data_bitrate) {
+	struct pcbvirtual_bus *bus;
+	const char *pacing;
+
+	for (bus = g_buses; bus != NULL; bus = bus->next)
+		if (!strcmp(bus->name, name))
+			return bus;
+	bus = (struct pcbvirtual_bus *) calloc(1, sizeof(*bus));
+	if (bus == NULL)
+		return NULL;
+	snprintf(bus->name, sizeof(bus->name), "%s", name);
+	pacing = getenv(PCBVIRTUAL_PACING_ENV);
+	bus->pacing = pacing != NULL && !strcmp(pacing, "1");
+	bus->nom_bitrate = nom_bitrate;
+	bus->data_bitrate = data_bitrate;
+	bus->realtime_ns = pcbvirtual_now(CLOCK_REALTIME) - pcbvirtual_now(CLOCK_MONOTONIC);
+	bus->next = g_buses;
+	g_buses = bus;
+	return bus;
+}
+
+static void pcbvirtual_bus_put(struct pcbvirtual_bus *bus) {
+	struct pcbvirtual_bus **pb;
+
+	if (bus->nodes_count > 0)
+		return;
+	for (pb = &g_buses; *pb != NULL; pb = &(*pb)->next) {
+		if (*pb == bus) {
+			*pb = bus->next;
+			break;
+		}
+	}
+	free(bus);
+}
+
+static int pcbvirtual_close(int fd) {
+	struct pcbvirtual_node *pn;
+	struct pcbvirtual_bus *bus;
+	int i;
+
+	pthread_mutex_lock(&g_lock);
+	pn = pcbvirtual_get(fd);
+	if (pn == NULL) {
+		pthread_mutex_unlock(&g_lock);
+		return -EBADF;
+	}
+	bus = pn->bus;
+	for (i = 0; i < PCBVIRTUAL_MAX_NODES; i++)
+		if (atomic_load(&bus->nodes[i]) == pn)
+			atomic_store(&bus->nodes[i], NULL);
+	/* wait for the senders that may still push in the ring */
+	while (atomic_load(&bus->senders) != 0)
+		sched_yield();
+	bus->nodes_count--;
+	pcbvirtual_bus_put(bus);
+	g_nodes[fd] = NULL;
+	pthread_mutex_unlock(&g_lock);
+	close(pn->fd);
+	pthread_mutex_destroy(&pn->wake_lock);
+	free(pn->ring);
+	free(pn);
+	return 0;
+}
+
+static int pcbvirtual_set_init(int fd, struct pcanfd_init *pfdi) {
+	struct pcbvirtual_node *pn = pcbvirtual_get(fd);
+	const struct pcan_bittiming *bt;
+	__u32 bitrate[2];
+	int i;
+
+	if (pn == NULL)
+		return -EBADF;
+	for (i = 0; i < 2; i++) {
+		bt = i ? &pfdi->data : &pfdi->nominal;
+		bitrate[i] = bt->bitrate;
+		if (bitrate[i] == 0 && bt->brp != 0)
+			bitrate[i] = pfdi->clock_Hz / (bt->brp * (1 + bt->tseg1 + bt->tseg2));
+	}
+	if (bitrate[0] == 0)
+		return -EINVAL;
+	pn->bus->nom_bitrate = bitrate[0];
+	pn->bus->data_bitrate = bitrate[1];
+	return 0;
+}
+
+static int pcbvirtual_get_init(int fd, struct pcanfd_init *pfdi) {
+	struct pcbvirtual_node *pn = pcbvirtual_get(fd);
+
+	if (pn == NULL)
+		return -EBADF;
+	memset(pfdi, 0, sizeof(*pfdi));
+	pfdi->nominal.bitrate = pn->bus->nom_bitrate;
+	pfdi->data.bitrate = pn->bus->data_bitrate;
+	return 0;
+}
+
+static int pcbvirtual_get_state(int fd, struct pcanfd_state *pfds) {
+	struct pcbvirtual_node *pn = pcbvirtual_get(fd);
+	int64_t now_ns;
+
+	if (pn == NULL)
+		return -EBADF;
+	now_ns = pcbvirtual_now(CLOCK_MONOTONIC);
+	memset(pfds, 0, sizeof(*pfds));
+	pfds->tv_init = pn->tv_init;
+	pfds->bus_state = PCANFD_ERROR_ACTIVE;
+	pfds->device_id = 0xffffffff;
+	pfds->open_counter = 1;
+	pfds->filters_counter = pn->filters_count;
+	pfds->bus_load = 0xffff;
+	pfds->tx_frames_counter = pn->tx_frames;
+	pfds->rx_frames_counter = pn->rx_frames;
+	pfds->tx_max_msgs = pn->bus->pacing ? PCBVIRTUAL_TXQ_SIZE : 0;
+	pfds->tx_pending_msgs = pn->bus->pacing ? pcbvirtual_tx_pending(pn, now_ns) : 0;
+	pfds->rx_max_msgs = PCBVIRTUAL_RING_SIZE;
+	pfds->rx_pending_msgs = (__u32)(atomic_load(&pn->ring->tail) - atomic_load(&pn->ring->head));
+	return 0;
+}
+
+static int pcbvirtual_add_filter(int fd, const struct pcanfd_msg_filter *pf) {
+	struct pcbvirtual_node *pn = pcbvirtual_get(fd);
+
+	if (pn == NULL)
+		return -EBADF;
+	if (pn->filters_count >= PCBVIRTUAL_MAX_FILTERS)
+		return -ENOMEM;
+	pn->filters[pn->filters_count++] = *pf;
+	return 0;
+}
+
+static int pcbvirtual_get_filters(int fd, struct pcanfd_msg_filters *pfl) {
+	struct pcbvirtual_node *pn = pcbvirtual_get(fd);
+	__u32 i;
+
+	if (pn == NULL)
+		return -EBADF;
+	for (i = 0; i < pfl->count && i < pn->filters_count; i++)
+		pfl->list[i] = pn->filters[i];
+	pfl->count = i;
+	return 0;
+}
+
+static int pcbvirtual_del_filters(int fd) {
+	struct pcbvirtual_node *pn = pcbvirtual_get(fd);
+
+	if (pn == NULL)
+		return -EBADF;
+	pn->filters_count = 0;
+	return 0;
+}
+
+static int pcbvirtual_send_msg(int fd, const struct pcanfd_msg *pfdm) {
+	struct pcbvirtual_node *pn = pcbvirtual_get(fd);
+	int err;
+
+	if (pn == NULL)
+		return -EBADF;
+	atomic_fetch_add(&pn->bus->senders, 1);
+	err = pcbvirtual_post(pn, pfdm, pcbvirtual_now(CLOCK_MONOTONIC));
+	atomic_fetch_sub(&pn->bus->senders, 1);
+	return err;
+}
+
+/* sends the list, sets its count to the number of msgs sent */
+static int pcbvirtual_send_msgs(int fd, struct pcanfd_msgs *pfdml) {
+	struct pcbvirtual_node *pn = pcbvirtual_get(fd);
+	int64_t now_ns;
+	__u32 i;
+	int err = 0;
+
+	if (pn == NULL)
+		return -EBADF;
+	now_ns = pcbvirtual_now(CLOCK_MONOTONIC);
+	atomic_fetch_add(&pn->bus->senders, 1);
+	for (i = 0; i < pfdml->count; i++) {
+		err = pcbvirtual_post(pn, &pfdml->list[i], now_ns);
+		if (err)
+			break;
+	}
+	atomic_fetch_sub(&pn->bus->senders, 1);
+	pfdml->count = i;
+	/* an error is only returned if nothing was sent */
+	return i ? 0 : err;
+}
+
+static int pcbvirtual_recv_msg(int fd, struct pcanfd_msg *pfdm) {
+	struct pcbvirtual_node *pn = pcbvirtual_get(fd);
+
+	if (pn == NULL)
+		return -EBADF;
+	return pcbvirtual_read(pn, pfdm, 1) ? 0 : -EAGAIN;
+}
+
+/* receives up to count msgs, sets count to the number of msgs received */
+static int pcbvirtual_recv_msgs(int fd, struct pcanfd_msgs *pfdml) {
+	struct pcbvirtual_node *pn = pcbvirtual_get(fd);
+
+	if (pn == NULL)
+		return -EBADF;
+	pfdml->count = pcbvirtual_read(pn, pfdml->list, pfdml->count);
+	return pfdml->count ? 0 : -EAGAIN;
+}
+
+static int pcbvirtual_get_option(int fd, int name, void *value, int size) {
+	(void)fd;
+	(void)name;
+	(void)value;
+	(void)size;
+	return -EOPNOTSUPP;
+}
+
+static int pcbvirtual_set_option(int fd, int name, void *value, int size) {
+	(void)fd;
+	(void)name;
+	(void)value;
+	(void)size;
+	return -EOPNOTSUPP;
+}
+
+/* GLOBAL FUNCTIONS */
+const struct pcbtransport pcbtransport_virtual = {
+	.name = "virtual",
+	.close = pcbvirtual_close,
+	.set_init = pcbvirtual_set_init,
+	.get_init = pcbvirtual_get_init,
+	.get_state = pcbvirtual_get_state,
+	.add_filter = pcbvirtual_add_filter,
+	.get_filters = pcbvirtual_get_filters,
+	.del_filters = pcbvirtual_del_filters,
+	.send_msg = pcbvirtual_send_msg,
+	.send_msgs = pcbvirtual_send_msgs,
+	.recv_msg = pcbvirtual_recv_msg,
+	.recv_msgs = pcbvirtual_recv_msgs,
+	.get_option = pcbvirtual_get_option,
+	.set_option = pcbvirtual_set_option,
+};
+
+int pcbvirtual_open(const char *bus, int fd_frames, __u32 nom_bitrate, __u32 data_bitrate) {
+	struct pcbvirtual_node *pn;
+	struct pcbvirtual_bus *pb;
+	int i, err;
+
+	pn = (struct pcbvirtual_node *) calloc(1, sizeof(*pn));
+	if (pn == NULL)
+		return -ENOMEM;
+	pn->ring = pcbvirtual_ring_alloc();
+	if (pn->ring == NULL) {
+		err = -ENOMEM;
+		goto pcbvirtual_open_free;
+	}
+	pn->fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (pn->fd < 0) {
+		err = -errno;
+		goto pcbvirtual_open_free;
+	}
+	if (pn->fd >= PCBVIRTUAL_MAX_FD) {
+		err = -EMFILE;
+		goto pcbvirtual_open_close;
+	}
+	pthread_mutex_init(&pn->wake_lock, NULL);
+	atomic_init(&pn->wake_ns, PCBVIRTUAL_NEVER);
+	atomic_init(&pn->overflow, 0);
+	pn->fd_frames = fd_frames;
+	gettimeofday(&pn->tv_init, NULL);
+
+	pthread_mutex_lock(&g_lock);
+	pb = pcbvirtual_bus_get(bus, nom_bitrate, data_bitrate);
+	if (pb == NULL) {
+		pthread_mutex_unlock(&g_lock);
+		err = -ENOMEM;
+		goto pcbvirtual_open_close;
+	}
+	for (i = 0; i < PCBVIRTUAL_MAX_NODES; i++)
+		if (atomic_load(&pb->nodes[i]) == NULL)
+			break;
+	if (i == PCBVIRTUAL_MAX_NODES) {
+		pcbvirtual_bus_put(pb);
+		pthread_mutex_unlock(&g_lock);
+		err = -EBUSY;
+		goto pcbvirtual_open_close;
+	}
+	pn->bus = pb;
+	pb->nodes_count++;
+	g_nodes[pn->fd] = pn;
+	atomic_store_explicit(&pb->nodes[i], pn, memory_order_release);
+	pthread_mutex_unlock(&g_lock);
+	return pn->fd;
+
+pcbvirtual_open_close:
+	close(pn->fd);
+pcbvirtual_open_free:
+	free(pn->ring);
+	free(pn);
+	return err;
+}
@@ -0,0 +1,360 @@
+/* SPDX-License-Identifier: LGPL-2.1-only */
+/*
+ * @file pcbwire.c
+ * @brief Time taken by CAN and CAN FD frames on the wire
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ *
+ * PCAN is a registered Trademark of PEAK-System Germany GmbH
+ *
+ * The frames are built into a packed bit stream (ISO 11898-1:2015) to count
+ * the stuff bits inserted after 5 identical bits:
+ *   - CAN 2.0: SOF to the end of the CRC (CRC-15 computed) are stuffed,
+ *   - CAN FD: SOF to the end of the data are stuffed, the CRC field (stuff
+ *     count, CRC-17 or CRC-21) has a fixed stuff bit every 4 bits.
+ *
+ * The CRC-15 and the stuff bits are computed a byte at a time from tables
+ * built on first use, so that every sent frame can be accounted.
+ */
+
+#include "pcbwire.h"
+#include "pcbcore.h"	/* pcanbasic_get_fd_dlc, pcanbasic_get_fd_len */
+
+#include <pthread.h>	/* pthread_once */
+
+/*
+ * DEFINES
+ */
+#define PCBWIRE_MAX_BITS	(1 + 32 + 8 + 4 + 64 * 8 + 15)	/**< SOF to CRC */
+#define PCBWIRE_MAX_BYTES	((PCBWIRE_MAX_BITS + 7) / 8 + 1)
+#define PCBWIRE_CRC15_POLY	0x4599
+/** CRC delimiter, ACK slot, ACK delimiter, EOF, interframe space */
+#define PCBWIRE_TAIL_BITS	(1 + 1 + 1 + 7 + 3)
+/** stuffing states: no bit yet, or last bit (0/1) and its run length (1..4) */
+#define PCBWIRE_STUFF_STATES	9
+
+/**
+ * Stuffed bit stream being built, MSB first
+ */
+struct pcbwire_stream {
+	__u32 count;		/**< bits written */
+	__u32 pending;		/**< bits of 'acc' not yet stored in 'bytes' */
+	__u64 acc;			/**< bit accumulator */
+	__u8 bytes[PCBWIRE_MAX_BYTES];
+};
+
+/**
+ * Layout of a frame
+ */
+struct pcbwire_frame {
+	int fd;				/**< CAN FD frame */
+	int brs;			/**< CAN FD frame with bit rate switch */
+	__u32 len;			/**< data bytes on the wire */
+	__u32 brs_end;		/**< bits up to the BRS bit (FD) */
+};
+
+/* PRIVATE VARIABLES */
+static pthread_once_t g_tables_once = PTHREAD_ONCE_INIT;
+static __u16 g_crc15[256];
+/** next stuffing state and stuff bits count after a byte, per state */
+static __u8 g_stuff_next[PCBWIRE_STUFF_STATES][256];
+static __u8 g_stuff_count[PCBWIRE_STUFF_STATES][256];
+
+/* PRIVATE FUNCTIONS */
+/* one bit through the stuffing state machine, returns the stuff bits added */
+static int pcbwire_stuff_step(__u8 *state, int bit) {
+	int last, run;
+
+	if (*state == 0) {
+		last = bit;
+		run = 1;
+	}
+	else {
+		last = (*state - 1) >> 2;
+		run = ((*state - 1) & 3) + 1;
+		if (bit == last)
+			run++;
+		else {
+			last = bit;
+			run = 1;
+		}
+	}
+	if (run == 5) {
+		/* the complement bit starts a new run */
+		*state = 1 + ((!last) << 2);
+		return 1;
+	}
+	*state = 1 + (last << 2) + (run - 1);
+	return 0;
+}
+
+static void pcbwire_init_tables(void) {
+	int i, b, state;
+
+	for (i = 0; i < 256; i++) {
+		__u16 crc = i << 7;
+
+		for (b = 0; b < 8; b++)
+			crc = (crc & 0x4000) ? ((crc << 1) ^ PCBWIRE_CRC15_POLY) : (crc << 1);
+		g_crc15[i] = crc & 0x7fff;
+	}
+	for (state = 0; state < PCBWIRE_STUFF_STATES; state++) {
+		for (i = 0; i < 256; i++) {
+			__u8 s = state;
+			int count = 0;
+
+			for (b = 7; b >= 0; b--)
+				count += pcbwire_stuff_step(&s, (i >> b) & 1);
+			g_stuff_next[state][i] = s;
+			g_stuff_count[state][i] = count;
+		}
+	}
+}
+
+static void pcbwire_put(struct pcbwire_stream *s, __u32 value, int n) {
+	s->acc = (s->acc << n) | (value & ((1ULL << n) - 1));
+	s->count += n;
+	s->pending += n;
+	while (s->pending >= 8) {
+		s->pending -= 8;
+		s->bytes[(s->count - s->pending) / 8 - 1] = (__u8)(s->acc >> s->pending);
+	}
+}
+
+/* stores the pending bits, left aligned in the last byte */
+static void pcbwire_flush(struct pcbwire_stream *s) {
+	s->bytes[s->count / 8] = s->pending ? (__u8)(s->acc << (8 - s->pending)) : 0;
+}
+
+static __u32 pcbwire_bit(const struct pcbwire_stream *s, __u32 pos) {
+	return (s->bytes[pos / 8] >> (7 - pos % 8)) & 1;
+}
+
+/* 8 bits starting at any position 'pos' (pcbwire_flush() done) */
+static __u32 pcbwire_byte(const struct pcbwire_stream *s, __u32 pos) {
+	__u32 w = (s->bytes[pos / 8] << 8) | s->bytes[pos / 8 + 1];
+
+	return (w >> (8 - pos % 8)) & 0xff;
+}
+
+/* CRC-15 of the bits written so far, 'bytes' being byte aligned */
+static __u16 pcbwire_crc15(const struct pcbwire_stream *s) {
+	__u16 crc = 0;
+	__u32 i;
+
+	for (i = 0; i < s->count / 8; i++)
+		crc = ((crc << 8) ^ g_crc15[((crc >> 7) ^ s->bytes[i]) & 0xff]) & 0x7fff;
+	for (i *= 8; i < s->count; i++) {
+		int next = pcbwire_bit(s, i) ^ ((crc >> 14) & 1);
+
+		crc = (crc << 1) & 0x7fff;
+		if (next)
+			crc ^= PCBWIRE_CRC15_POLY;
+	}
+	return crc;
+}
+
+/* counts the stuff bits of the bits [from, end[, from the stuffing state */
+static __u32 pcbwire_stuff(const struct pcbwire_stream *s, __u32 from, __u32 end, __u8 *state) {
+	__u32 stuff = 0;
+
+	for (; from + 8 <= end; from += 8) {
+		__u32 b = pcbwire_byte(s, from);
+
+		stuff += g_stuff_count[*state][b];
+		*state = g_stuff_next[*state][b];
+	}
+	for (; from < end; from++)
+		stuff += pcbwire_stuff_step(state, pcbwire_bit(s, from));
+	return stuff;
+}
+
+/* writes the frame from SOF to the end of the data (and the CRC-15 of a
+ * CAN 2.0 frame) when 'payload' is set, only counts its bits otherwise */
+static void pcbwire_build(const struct pcanfd_msg *msg, struct pcbwire_stream *s, struct pcbwire_frame *f, int payload) {
+	int ext = !!(msg->flags & PCANFD_MSG_EXT);
+	int rtr;
+	__u32 i;
+	__u8 dlc;
+
+	f->fd = (msg->type == PCANFD_TYPE_CANFD_MSG);
+	f->brs = f->fd && (msg->flags & PCANFD_MSG_BRS);
+	rtr = !f->fd && (msg->flags & PCANFD_MSG_RTR);
+	dlc = f->fd ? pcanbasic_get_fd_dlc(msg->data_len) : (msg->data_len > 8 ? 8 : msg->data_len);
+	f->len = rtr ? 0 : (__u32)pcanbasic_get_fd_len(dlc);
+	if (!f->fd && f->len > 8)
+		f->len = 8;
+
+	s->count = 0;
+	s->pending = 0;
+	s->acc = 0;
+
+	/* arbitration and control fields */
+	pcbwire_put(s, 0, 1);							/* SOF */
+	if (ext) {
+		pcbwire_put(s, msg->id >> 18, 11);			/* base id */
+		pcbwire_put(s, 1, 1);						/* SRR */
+		pcbwire_put(s, 1, 1);						/* IDE */
+		pcbwire_put(s, msg->id, 18);				/* extended id */
+	}
+	else {
+		pcbwire_put(s, msg->id, 11);
+	}
+	if (f->fd) {
+		pcbwire_put(s, 0, 1);						/* RRS */
+		if (!ext)
+			pcbwire_put(s, 0, 1);					/* IDE */
+		pcbwire_put(s, 1, 1);						/* FDF */
+		pcbwire_put(s, 0, 1);						/* res */
+		pcbwire_put(s, f->brs, 1);
+		f->brs_end = s->count;
+		pcbwire_put(s, !!(msg->flags & PCANFD_MSG_ESI), 1);
+	}
+	else {
+		pcbwire_put(s, rtr, 1);					/* RTR */
+		if (ext)
+			pcbwire_put(s, 0, 1);					/* r1 */
+		else
+			pcbwire_put(s, 0, 1);					/* IDE */
+		pcbwire_put(s, 0, 1);						/* r0 */
+		f->brs_end = 0;
+	}
+	pcbwire_put(s, dlc, 4);
+	if (!payload) {
+		s->count += f->len * 8 + (f->fd ? 0 : 15);
+		return;
+	}
+	for (i = 0; i < f->len; i++)
+		pcbwire_put(s, (i < msg->data_len) ? msg->data[i] : 0, 8);
+	if (!f->fd) {
+		pcbwire_flush(s);
+		pcbwire_put(s, pcbwire_crc15(s), 15);
+	}
+	pcbwire_flush(s);
+}
+
+/* fills 'bits' from the frame bits and its stuff bits (dynamic stuff bits
+ * up to the BRS bit and from the BRS bit to the end of the stream) */
+static void pcbwire_count(const struct pcbwire_frame *f, __u32 count, __u32 stuff_nom, __u32 stuff_data, struct pcbwire_bits *bits) {
+	__u32 crc_field;
+
+	if (!f->fd) {
+		bits->nominal = count + stuff_nom + stuff_data + PCBWIRE_TAIL_BITS;
+		bits->data = 0;
+		bits->stuff = stuff_nom + stuff_data;
+		return;
+	}
+
+	/* stuff count and CRC, with a fixed stuff bit before each 4 bits */
+	crc_field = 4 + ((f->len <= 16) ? 17 : 21);
+	stuff_data += (crc_field + 3) / 4;
+	if (f->brs) {
+		bits->nominal = f->brs_end + stuff_nom + PCBWIRE_TAIL_BITS - 1;
+		bits->data = (count - f->brs_end) + stuff_data + crc_field + 1;
+	}
+	else {
+		bits->nominal = count + stuff_nom + stuff_data + crc_field + PCBWIRE_TAIL_BITS;
+		bits->data = 0;
+	}
+	bits->stuff = stuff_nom + stuff_data;
+}
+
+/* GLOBAL FUNCTIONS */
+void pcbwire_frame_bits(const struct pcanfd_msg *msg, struct pcbwire_bits *bits) {
+	struct pcbwire_stream s;
+	struct pcbwire_frame f;
+	__u32 stuff_nom;
+	__u8 state = 0;
+
+	pthread_once(&g_tables_once, pcbwire_init_tables);
+	pcbwire_build(msg, &s, &f, 1);
+	stuff_nom = pcbwire_stuff(&s, 0, f.brs_end, &state);
+	pcbwire_count(&f, s.count, stuff_nom, pcbwire_stuff(&s, f.brs_end, s.count, &state), bits);
+}
+
+void pcbwire_frame_bits_worst(const struct pcanfd_msg *msg, struct pcbwire_bits *bits) {
+	struct pcbwire_stream s;
+	struct pcbwire_frame f;
+	__u32 stuff_nom;
+
+	/* a stuff bit every 4 bits after the first one */
+	pcbwire_build(msg, &s, &f, 0);
+	stuff_nom = f.brs_end ? (f.brs_end - 1) / 4 : 0;
+	pcbwire_count(&f, s.count, stuff_nom, (s.count - 1) / 4 - stuff_nom, bits);
+}
+
+__u64 pcbwire_bits_ns(const struct pcbwire_bits *bits, __u32 nom_bitrate, __u32 data_bitrate) {
+	__u64 ns;
+
+	if (nom_bitrate == 0)
+		return 0;
+	if (data_bitrate == 0)
+		data_bitrate = nom_bitrate;
+	ns = (bits->nominal * 1000000000ULL + nom_bitrate - 1) / nom_bitrate;
+	if (bits->data)
+		ns += (bits->data * 1000000000ULL + data_bitrate - 1) / data_bitrate;
+	return ns;
+}
+
+__u64 pcbwire_frame_ns(const struct pcanfd_msg *msg, __u32 nom_bitrate, __u32 data_bitrate) {
+	struct pcbwire_bits bits;
+
+	if (nom_bitrate == 0)
+		return 0;
+	pcbwire_frame_bits(msg, &bits);
+	return pcbwire_bits_ns(&bits, nom_bitrate, data_bitrate);
+}
+
+__u64 pcbwire_frame_ns_worst(const struct pcanfd_msg *msg, __u32 nom_bitrate, __u32 data_bitrate) {
+	struct pcbwire_bits bits;
+
+	if (nom_bitrate == 0)
+		return 0;
+	pcbwire_frame_bits_worst(msg, &bits);
+	return pcbwire_bits_ns(&bits, nom_bitrate, data_bitrate);
+}
+
+void pcbwire_load_init(struct pcbwire_load *load, __u64 window_ns) {
+	load->window_ns = window_ns ? window_ns : PCBWIRE_LOAD_WINDOW_NS;
+	load->start_ns = 0;
+	load->busy_ns = 0;
+	load->last = 0;
+}
+
+/* closes the current window if 'now_ns' is past its end */
+static void pcbwire_load_roll(struct pcbwire_load *load, __u64 now_ns) {
+	__u64 elapsed;
+
+	if (load->window_ns == 0)
+		pcbwire_load_init(load, 0);
+	elapsed = now_ns - load->start_ns;
+	if (now_ns < load->start_ns || elapsed < load->window_ns)
+		return;
+	/* a window without any frame has no load */
+	load->last = (elapsed < 2 * load->window_ns) ?
+		(__u32)(load->busy_ns * 10000 / load->window_ns) : 0;
+	load->start_ns = now_ns - elapsed % load->window_ns;
+	load->busy_ns = 0;
+}
+
+void pcbwire_load_add(struct pcbwire_load *load, __u64 now_ns, __u64 busy_ns) {
+	pcbwire_load_roll(load, now_ns);
+	load->busy_ns += busy_ns;
+}
+
+__u32 pcbwire_load_get(struct pcbwire_load *load, __u64 now_ns) {
+	pcbwire_load_roll(load, now_ns);
+	return load->last;
+}
@@ -0,0 +1,148 @@
+/* SPDX-License-Identifier: LGPL-2.1-only */
+/*
+ * @file pcbwire.h
+ * @brief Time taken by CAN and CAN FD frames on the wire
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ *
+ * PCAN is a registered Trademark of PEAK-System Germany GmbH
+ */
+
+#ifndef __PCBWIRE_H__
+#define __PCBWIRE_H__
+
+/*
+ * INCLUDES
+ */
+#include "../PCANBasic.h"	/* PCANBasic types, struct pcanfd_msg */
+
+/*
+ * DEFINES
+ */
+#define PCBWIRE_LOAD_WINDOW_NS	100000000ULL	/**< default bus load window (100ms) */
+
+/**
+ * Bits of a frame on the wire, from the start of frame to the end of the
+ * interframe space, stuff bits included.
+ */
+struct pcbwire_bits {
+	__u32 nominal;		/**< bits sent at the nominal bit rate */
+	__u32 data;			/**< bits sent at the data bit rate (FD with BRS) */
+	__u32 stuff;		/**< stuff bits (included in nominal and data) */
+};
+
+/**
+ * @fn void pcbwire_frame_bits(const struct pcanfd_msg *msg, struct pcbwire_bits *bits)
+ * @brief Counts the bits of a frame, with the stuff bits given by its
+ * actual id, DLC, data and CRC.
+ *
+ * The data phase of a FD frame with BRS starts after the BRS bit and ends
+ * with the CRC delimiter. FD data lengths are rounded up to the next DLC
+ * length (padding bytes are 0).
+ *
+ * @param msg CAN 2.0 or CAN FD message
+ * @param bits buffer receiving the bit counts
+ */
+void pcbwire_frame_bits(const struct pcanfd_msg *msg, struct pcbwire_bits *bits);
+
+/**
+ * @fn void pcbwire_frame_bits_worst(const struct pcanfd_msg *msg, struct pcbwire_bits *bits)
+ * @brief Counts the bits of a frame with the worst case stuffing of its
+ * id format and DLC: a stuff bit every 4 bits after the first stuffed bit.
+ *
+ * @param msg CAN 2.0 or CAN FD message (id and data are not used)
+ * @param bits buffer receiving the bit counts
+ */
+void pcbwire_frame_bits_worst(const struct pcanfd_msg *msg, struct pcbwire_bits *bits);
+
+/**
+ * @fn __u64 pcbwire_bits_ns(const struct pcbwire_bits *bits, __u32 nom_bitrate, __u32 data_bitrate)
+ * @brief Returns the time taken by bits counted by pcbwire_frame_bits() or
+ * pcbwire_frame_bits_worst().
+ *
+ * @param bits bit counts of a frame
+ * @param nom_bitrate nominal bit rate (bps), 0 returns 0
+ * @param data_bitrate data bit rate (bps), nominal bit rate if 0
+ * @return the duration in nanoseconds (rounded up)
+ */
+__u64 pcbwire_bits_ns(const struct pcbwire_bits *bits, __u32 nom_bitrate, __u32 data_bitrate);
+
+/**
+ * @fn __u64 pcbwire_frame_ns(const struct pcanfd_msg *msg, __u32 nom_bitrate, __u32 data_bitrate)
+ * @brief Returns the time a frame takes on the wire, interframe space
+ * included.
+ *
+ * @param msg CAN 2.0 or CAN FD message
+ * @param nom_bitrate nominal bit rate (bps)
+ * @param data_bitrate data bit rate (bps), nominal bit rate if 0
+ * @return the duration in nanoseconds
+ */
+__u64 pcbwire_frame_ns(const struct pcanfd_msg *msg, __u32 nom_bitrate, __u32 data_bitrate);
+
+/**
+ * @fn __u64 pcbwire_frame_ns_worst(const struct pcanfd_msg *msg, __u32 nom_bitrate, __u32 data_bitrate)
+ * @brief Returns the longest time a frame with the id format and DLC of
+ * 'msg' can take on the wire, interframe space included.
+ *
+ * @param msg CAN 2.0 or CAN FD message
+ * @param nom_bitrate nominal bit rate (bps)
+ * @param data_bitrate data bit rate (bps), nominal bit rate if 0
+ * @return the duration in nanoseconds
+ */
+__u64 pcbwire_frame_ns_worst(const struct pcanfd_msg *msg, __u32 nom_bitrate, __u32 data_bitrate);
+
+/**
+ * Bus load predicted from the wire time of frames, over fixed windows.
+ * Not thread safe, like the rest of a channel state.
+ */
+struct pcbwire_load {
+	__u64 window_ns;	/**< length of a window */
+	__u64 start_ns;		/**< start of the current window */
+	__u64 busy_ns;		/**< wire time accounted in the current window */
+	__u32 last;			/**< load of the last complete window (1/100 %) */
+};
+
+/**
+ * @fn void pcbwire_load_init(struct pcbwire_load *load, __u64 window_ns)
+ * @brief Initializes a bus load meter (a zeroed meter is initialized with
+ * the default window on first use).
+ *
+ * @param load bus load meter
+ * @param window_ns window length, PCBWIRE_LOAD_WINDOW_NS if 0
+ */
+void pcbwire_load_init(struct pcbwire_load *load, __u64 window_ns);
+
+/**
+ * @fn void pcbwire_load_add(struct pcbwire_load *load, __u64 now_ns, __u64 busy_ns)
+ * @brief Accounts the wire time of frames in the window of 'now_ns'.
+ *
+ * @param load bus load meter
+ * @param now_ns current time (CLOCK_MONOTONIC)
+ * @param busy_ns wire time of the frames
+ */
+void pcbwire_load_add(struct pcbwire_load *load, __u64 now_ns, __u64 busy_ns);
+
+/**
+ * @fn __u32 pcbwire_load_get(struct pcbwire_load *load, __u64 now_ns)
+ * @brief Returns the load of the last complete window.
+ *
+ * @param load bus load meter
+ * @param now_ns current time (CLOCK_MONOTONIC)
+ * @return the bus load in hundredths of percent (above 10000 when more
+ * frames were accounted than the bus can carry)
+ */
+__u32 pcbwire_load_get(struct pcbwire_load *load, __u64 now_ns);
+
+#endif
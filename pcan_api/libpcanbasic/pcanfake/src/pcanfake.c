@@ -0,0 +1,1148 @@
+/* SPDX-License-Identifier: LGPL-2.1-only */
+/*
+ * @file pcanfake.c
+ * @brief LD_PRELOAD shim emulating pcan driver devices
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ *
+ * PCAN is a registered Trademark of PEAK-System Germany GmbH
+ *
+ * The shim serves a fake "/sys/class/pcan" tree of PCAN-USB FD channels and
+ * emulates their "/dev/pcanusbfdN" nodes: open() of a node returns an
+ * eventfd (readable when the Rx queue is not empty, like the select() of the
+ * driver) and the PCANFD_xxx ioctl() of pcanfd.h are served on it. The
+ * libpcanfd/libpcanbasic stack runs unmodified above it:
+ *
+ *	LD_PRELOAD=libpcanfake.so PCANFAKE_RX_RATE=1000 ./app
+ *
+ * See readme.txt for the environment variables.
+ */
+
+#define _GNU_SOURCE
+
+#include <dlfcn.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+#include "pcan.h"
+#include "pcanfd.h"
+
+/*
+ * DEFINES
+ */
+#define PCANFAKE_ENV_CHANNELS	"PCANFAKE_CHANNELS"		/**< count of channels */
+#define PCANFAKE_ENV_ROOT		"PCANFAKE_ROOT"			/**< fake class directory */
+#define PCANFAKE_ENV_RX_RATE	"PCANFAKE_RX_RATE"		/**< injected frames/s */
+#define PCANFAKE_ENV_RX_ID		"PCANFAKE_RX_ID"		/**< id of injected frames */
+#define PCANFAKE_ENV_RX_QUEUE	"PCANFAKE_RX_QUEUE"		/**< Rx queue size */
+#define PCANFAKE_ENV_LATENCY	"PCANFAKE_LATENCY_US"	/**< ioctl latencies */
+#define PCANFAKE_ENV_ECHO		"PCANFAKE_ECHO"			/**< sender receives its frames */
+#define PCANFAKE_ENV_LOOPBACK	"PCANFAKE_LOOPBACK"		/**< other channels receive them */
+
+#define PCANFAKE_CLASS_PATH		"/sys/class/pcan"
+#define PCANFAKE_DEV_PREFIX		"/dev/"
+#define PCANFAKE_NAME_PREFIX	"pcanusbfd"
+#define PCANFAKE_MINOR_BASE		32				/**< first pcan USB minor */
+#define PCANFAKE_MAJOR			246
+#define PCANFAKE_CHANNELS		2
+#define PCANFAKE_MAX_CHANNELS	16
+#define PCANFAKE_MAX_FDS		1024
+#define PCANFAKE_MAX_FILTERS	64
+#define PCANFAKE_RX_QUEUE		2048
+#define PCANFAKE_TX_QUEUE		500
+#define PCANFAKE_RX_ID			0x100
+#define PCANFAKE_CLOCK			80000000
+#define PCANFAKE_BITRATE		500000			/**< default bit rate */
+#define PCANFAKE_DRV_VERSION	"8.15.2"
+#define PCANFAKE_VER_MAJOR		8
+#define PCANFAKE_VER_MINOR		15
+#define PCANFAKE_VER_SUBMINOR	2
+#define PCANFAKE_FEATURES		(PCANFD_FEATURE_FD | PCANFD_FEATURE_IFRAME_DELAYUS | \
+								PCANFD_FEATURE_HWTIMESTAMP | PCANFD_FEATURE_DEVICEID)
+
+/** ioctl() groups sharing a latency */
+enum pcanfake_lat {
+	PCANFAKE_LAT_INIT,		/**< SET_INIT, GET_INIT */
+	PCANFAKE_LAT_STATE,		/**< GET_STATE */
+	PCANFAKE_LAT_FILTER,	/**< ADD_FILTERS, GET_FILTERS */
+	PCANFAKE_LAT_SEND,		/**< SEND_MSG, SEND_MSGS */
+	PCANFAKE_LAT_RECV,		/**< RECV_MSG, RECV_MSGS */
+	PCANFAKE_LAT_OPTION,	/**< GET_OPTION, SET_OPTION */
+	PCANFAKE_LAT_OTHER,		/**< any other ioctl() */
+	PCANFAKE_LAT_COUNT
+};
+
+static const char *pcanfake_lat_names[PCANFAKE_LAT_COUNT] = {
+	"init", "state", "filter", "send", "recv", "option", "other"
+};
+
+/**
+ * An emulated CAN channel
+ */
+struct pcanfake_chan {
+	pthread_mutex_t lock;				/**< guards the whole channel */
+	pthread_cond_t rx_cond;				/**< signaled when a frame is queued */
+	char name[32];						/**< sysfs name (pcanusbfd32) */
+	char dev_name[48];					/**< device node (/dev/pcanusbfd32) */
+	char dir[PATH_MAX];					/**< fake sysfs directory */
+	int minor;							/**< device minor */
+	int index;							/**< index of the channel */
+	int fd;								/**< eventfd of the opened device or -1 */
+	int nonblock;						/**< opened with O_NONBLOCK */
+	int evt_set;						/**< eventfd counter is not 0 */
+	int initialized;					/**< PCANFD_SET_INIT done */
+	struct pcanfd_init init;			/**< current initialization */
+	struct timeval tv_init;				/**< time of the initialization */
+	__u32 device_id;					/**< PCANFD_OPT_DEVICE_ID */
+	__u32 allowed_msgs;					/**< PCANFD_OPT_ALLOWED_MSGS */
+	__u32 iframe_delay;					/**< PCANFD_OPT_IFRAME_DELAYUS */
+	__u32 hwts_mode;					/**< PCANFD_OPT_HWTIMESTAMP_MODE */
+	__u64 acc_11b;						/**< PCANFD_OPT_ACC_FILTER_11B */
+	__u64 acc_29b;						/**< PCANFD_OPT_ACC_FILTER_29B */
+	__u32 filters_count;				/**< count of id range filters */
+	struct pcanfd_msg_filter filters[PCANFAKE_MAX_FILTERS];
+	struct pcanfd_msg *rx;				/**< Rx queue */
+	__u32 rx_head;						/**< oldest queued frame */
+	__u32 rx_count;						/**< queued frames */
+	int rx_overflow;					/**< a frame was lost, queue was full */
+	__u32 tx_frames;					/**< frames sent */
+	__u32 rx_frames;					/**< frames received */
+	__u64 injected;						/**< frames injected since open */
+	__u64 inject_start_ns;				/**< time the injection started */
+};
+
+/* PRIVATE VARIABLES */
+static struct pcanfake_chan g_chans[PCANFAKE_MAX_CHANNELS];
+static int g_chans_count;
+/** opened channel of each fd */
+static struct pcanfake_chan * volatile g_fds[PCANFAKE_MAX_FDS];
+/** fake tree standing for PCANFAKE_CLASS_PATH (empty if not served) */
+static char g_root[PATH_MAX];
+static int g_root_created;
+static __u32 g_rx_size = PCANFAKE_RX_QUEUE;
+static __u32 g_rx_id = PCANFAKE_RX_ID;
+static double g_rx_rate;
+static int g_echo;
+static int g_loopback;
+static __u64 g_lat_ns[PCANFAKE_LAT_COUNT];
+
+/* injection thread */
+static pthread_mutex_t g_inject_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_inject_cond;
+static pthread_t g_inject_thread;
+static int g_inject_running;
+static int g_inject_stop;
+
+/* real functions */
+static int (*real_open)(const char *, int, ...);
+static int (*real_open64)(const char *, int, ...);
+static int (*real_openat)(int, const char *, int, ...);
+static int (*real_openat64)(int, const char *, int, ...);
+static FILE * (*real_fopen)(const char *, const char *);
+static FILE * (*real_fopen64)(const char *, const char *);
+static int (*real_scandir)(const char *, struct dirent ***,
+		int (*)(const struct dirent *),
+		int (*)(const struct dirent **, const struct dirent **));
+static int (*real_scandir64)(const char *, struct dirent64 ***,
+		int (*)(const struct dirent64 *),
+		int (*)(const struct dirent64 **, const struct dirent64 **));
+static int (*real_inotify_add_watch)(int, const char *, uint32_t);
+static int (*real_ioctl)(int, unsigned long, ...);
+static int (*real_close)(int);
+
+/** next definition of a function (resolved once) */
+#define REAL(f) ((__typeof__(real_##f))pcanfake_resolve((void **)&real_##f, #f))
+
+/* PRIVATE FUNCTIONS */
+static void *pcanfake_resolve(void **pf, const char *name) {
+	if (*pf == NULL)
+		*pf = dlsym(RTLD_NEXT, name);
+	return *pf;
+}
+
+static __u64 pcanfake_now(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (__u64)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* the driver runs on the caller's CPU: the latency is spent, not slept */
+static void pcanfake_delay(enum pcanfake_lat lat) {
+	__u64 end;
+
+	if (g_lat_ns[lat] == 0)
+		return;
+	end = pcanfake_now() + g_lat_ns[lat];
+	while (pcanfake_now() < end)
+		;
+}
+
+static int pcanfake_need_mode(int flags) {
+	return (flags & O_CREAT) || (flags & O_TMPFILE) == O_TMPFILE;
+}
+
+/* rewrites a path of the sysfs pcan class into the fake tree */
+static const char *pcanfake_path(const char *path, char *buf, size_t size) {
+	size_t len = sizeof(PCANFAKE_CLASS_PATH) - 1;
+
+	if (g_root[0] == 0 || path == NULL ||
+			strncmp(path, PCANFAKE_CLASS_PATH, len) ||
+			(path[len] != 0 && path[len] != '/'))
+		return path;
+	snprintf(buf, size, "%s%s", g_root, path + len);
+	return buf;
+}
+
+static struct pcanfake_chan *pcanfake_dev(const char *path) {
+	int i;
+
+	if (g_root[0] == 0 || path == NULL ||
+			strncmp(path, PCANFAKE_DEV_PREFIX, sizeof(PCANFAKE_DEV_PREFIX) - 1))
+		return NULL;
+	for (i = 0; i < g_chans_count; i++) {
+		if (!strcmp(path, g_chans[i].dev_name))
+			return &g_chans[i];
+	}
+	return NULL;
+}
+
+static struct pcanfake_chan *pcanfake_chan_of(int fd) {
+	if (fd < 0 || fd >= PCANFAKE_MAX_FDS)
+		return NULL;
+	return g_fds[fd];
+}
+
+/* writes a sysfs attribute of a channel */
+static void pcanfake_attr(struct pcanfake_chan *ch, const char *attr, const char *fmt, ...) {
+	char path[PATH_MAX + 32], buf[64];
+	va_list ap;
+	int fd, len;
+
+	va_start(ap, fmt);
+	len = vsnprintf(buf, sizeof(buf) - 1, fmt, ap);
+	va_end(ap);
+	if (len < 0 || len >= (int)sizeof(buf) - 1)
+		return;
+	buf[len++] = '\n';
+	snprintf(path, sizeof(path), "%s/%s", ch->dir, attr);
+	fd = REAL(open)(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (fd < 0)
+		return;
+	if (write(fd, buf, len) != len)
+		fprintf(stderr, "pcanfake: failed to write '%s' (errno=%d)\n", path, errno);
+	REAL(close)(fd);
+}
+
+static void pcanfake_remove_tree(void) {
+	struct dirent **ents;
+	char path[PATH_MAX + 300];
+	int i, j, n;
+
+	for (i = 0; i < g_chans_count; i++) {
+		n = REAL(scandir)(g_chans[i].dir, &ents, NULL, NULL);
+		for (j = 0; j < n; j++) {
+			if (ents[j]->d_name[0] != '.') {
+				snprintf(path, sizeof(path), "%s/%s", g_chans[i].dir, ents[j]->d_name);
+				unlink(path);
+			}
+			free(ents[j]);
+		}
+		if (n >= 0)
+			free(ents);
+		rmdir(g_chans[i].dir);
+	}
+	snprintf(path, sizeof(path), "%s/version", g_root);
+	unlink(path);
+	rmdir(g_root);
+}
+
+static int pcanfake_create_tree(void) {
+	struct pcanfake_chan *ch;
+	char path[PATH_MAX + 16];
+	FILE *f;
+	int i;
+
+	if (mkdir(g_root, 0755) == 0)
+		g_root_created = 1;
+	else if (errno != EEXIST)
+		return -errno;
+	snprintf(path, sizeof(path), "%s/version", g_root);
+	f = REAL(fopen)(path, "w");
+	if (f == NULL)
+		return -errno;
+	fprintf(f, "%s\n", PCANFAKE_DRV_VERSION);
+	fclose(f);
+	for (i = 0; i < g_chans_count; i++) {
+		ch = &g_chans[i];
+		if (mkdir(ch->dir, 0755) && errno != EEXIST)
+			return -errno;
+		pcanfake_attr(ch, "hwtype", "%d", HW_USB_FD);
+		pcanfake_attr(ch, "type", "usbfd");
+		pcanfake_attr(ch, "minor", "%d", ch->minor);
+		pcanfake_attr(ch, "dev", "%d:%d", PCANFAKE_MAJOR, ch->minor);
+		pcanfake_attr(ch, "dev_name", "%s", ch->dev_name);
+		pcanfake_attr(ch, "adapter_name", "PCAN-USB FD");
+		pcanfake_attr(ch, "adapter_number", "%d", ch->index);
+		pcanfake_attr(ch, "adapter_version", "3.2.0");
+		pcanfake_attr(ch, "ctrlr_number", "0");
+		pcanfake_attr(ch, "serial_number", "0x%08x", 0x00004e00 + ch->index);
+		pcanfake_attr(ch, "devid", "0x%08x", ch->device_id);
+		pcanfake_attr(ch, "clock", "%d", PCANFAKE_CLOCK);
+		pcanfake_attr(ch, "nom_bitrate", "0");
+		pcanfake_attr(ch, "data_bitrate", "0");
+		pcanfake_attr(ch, "bus_state", "0");
+		pcanfake_attr(ch, "bus_load", "0");
+		pcanfake_attr(ch, "init_flags", "0x00000000");
+		pcanfake_attr(ch, "irqs", "0");
+		pcanfake_attr(ch, "status", "0");
+		pcanfake_attr(ch, "errors", "0");
+		pcanfake_attr(ch, "read", "0");
+		pcanfake_attr(ch, "write", "0");
+		pcanfake_attr(ch, "rx_error_counter", "0");
+		pcanfake_attr(ch, "tx_error_counter", "0");
+	}
+	return 0;
+}
+
+/* "N" for every ioctl, or "name=N,..." (see pcanfake_lat_names) */
+static void pcanfake_parse_latency(const char *val) {
+	char *buf, *item, *save, *eq;
+	int i;
+
+	if (val == NULL || *val == 0)
+		return;
+	if (strchr(val, '=') == NULL) {
+		for (i = 0; i < PCANFAKE_LAT_COUNT; i++)
+			g_lat_ns[i] = strtoull(val, NULL, 0) * 1000;
+		return;
+	}
+	buf = strdup(val);
+	if (buf == NULL)
+		return;
+	for (item = strtok_r(buf, ", ", &save); item != NULL;
+			item = strtok_r(NULL, ", ", &save)) {
+		eq = strchr(item, '=');
+		if (eq == NULL)
+			continue;
+		*eq++ = 0;
+		for (i = 0; i < PCANFAKE_LAT_COUNT; i++) {
+			if (!strcmp(item, pcanfake_lat_names[i]))
+				g_lat_ns[i] = strtoull(eq, NULL, 0) * 1000;
+		}
+	}
+	free(buf);
+}
+
+static int pcanfake_env_int(const char *name, int def) {
+	const char *val = getenv(name);
+
+	return (val != NULL && *val != 0) ? (int)strtol(val, NULL, 0) : def;
+}
+
+/* rejected by the acceptance filter: code in the low 32 bits, mask (bits
+ * set: don't care) in the high 32 bits, as the defaults set at open() */
+static int pcanfake_acc_filtered(__u64 acc, __u32 id, __u32 id_mask) {
+	const __u32 code = (__u32)acc;
+	const __u32 mask = (__u32)(acc >> 32);
+
+	return ((id ^ code) & ~mask & id_mask) != 0;
+}
+
+/* rejected by the filters or by the allowed messages (lock held) */
+static int pcanfake_filtered(const struct pcanfake_chan *ch, const struct pcanfd_msg *msg) {
+	__u32 i;
+
+	switch (msg->type) {
+	case PCANFD_TYPE_STATUS:
+		return !(ch->allowed_msgs & PCANFD_ALLOWED_MSG_STATUS);
+	case PCANFD_TYPE_ERROR_MSG:
+		return !(ch->allowed_msgs & PCANFD_ALLOWED_MSG_ERROR);
+	default:
+		break;
+	}
+	if ((msg->flags & PCANFD_MSG_RTR) && !(ch->allowed_msgs & PCANFD_ALLOWED_MSG_RTR))
+		return 1;
+	if (msg->flags & PCANFD_MSG_EXT) {
+		if (pcanfake_acc_filtered(ch->acc_29b, msg->id, CAN_MAX_EXTENDED_ID))
+			return 1;
+	} else if (pcanfake_acc_filtered(ch->acc_11b, msg->id, CAN_MAX_STANDARD_ID)) {
+		return 1;
+	}
+	if (ch->filters_count == 0)
+		return 0;
+	for (i = 0; i < ch->filters_count; i++) {
+		if (msg->id >= ch->filters[i].id_from && msg->id <= ch->filters[i].id_to &&
+				!((msg->flags ^ ch->filters[i].msg_flags) & PCANFD_MSG_EXT))
+			return 0;
+	}
+	return 1;
+}
+
+/* the eventfd is readable as long as something can be read (lock held) */
+static void pcanfake_update_evt(struct pcanfake_chan *ch) {
+	eventfd_t v;
+	int ready = ch->rx_count > 0 || ch->rx_overflow;
+
+	if (ready && !ch->evt_set) {
+		eventfd_write(ch->fd, 1);
+		ch->evt_set = 1;
+	}
+	else if (!ready && ch->evt_set) {
+		eventfd_read(ch->fd, &v);
+		ch->evt_set = 0;
+	}
+}
+
+/* queues a received frame (lock held) */
+static void pcanfake_push(struct pcanfake_chan *ch, const struct pcanfd_msg *msg) {
+	struct pcanfd_msg *dst;
+
+	if (ch->fd < 0 || !ch->initialized || pcanfake_filtered(ch, msg))
+		return;
+	if (ch->rx_count >= g_rx_size) {
+		ch->rx_overflow = 1;
+		pcanfake_update_evt(ch);
+		return;
+	}
+	dst = &ch->rx[(ch->rx_head + ch->rx_count) % g_rx_size];
+	*dst = *msg;
+	ch->rx_count++;
+	ch->rx_frames++;
+	pcanfake_update_evt(ch);
+	pthread_cond_signal(&ch->rx_cond);
+}
+
+/* dequeues up to 'count' frames, returns the count read (lock held) */
+static __u32 pcanfake_pop(struct pcanfake_chan *ch, struct pcanfd_msg *list, __u32 count) {
+	__u32 n = 0;
+
+	if (count && ch->rx_overflow) {
+		memset(&list[n], 0, sizeof(list[n]));
+		list[n].type = PCANFD_TYPE_STATUS;
+		list[n].flags = PCANFD_ERROR_CTRLR | PCANFD_TIMESTAMP;
+		list[n].id = PCANFD_RX_OVERFLOW;
+		gettimeofday(&list[n].timestamp, NULL);
+		ch->rx_overflow = 0;
+		n++;
+	}
+	while (n < count && ch->rx_count > 0) {
+		list[n++] = ch->rx[ch->rx_head];
+		ch->rx_head = (ch->rx_head + 1) % g_rx_size;
+		ch->rx_count--;
+	}
+	pcanfake_update_evt(ch);
+	return n;
+}
+
+/* waits for something to read, or returns EAGAIN (lock held) */
+static int pcanfake_wait_rx(struct pcanfake_chan *ch) {
+	while (ch->rx_count == 0 && !ch->rx_overflow) {
+		if (ch->nonblock)
+			return EAGAIN;
+		pthread_cond_wait(&ch->rx_cond, &ch->lock);
+	}
+	return 0;
+}
+
+/* what the other channels (loopback) and the sender (echo) receive */
+static void pcanfake_transmit(struct pcanfake_chan *from, const struct pcanfd_msg *list, __u32 count) {
+	struct pcanfake_chan *ch;
+	struct pcanfd_msg msg;
+	__u32 i;
+	int c;
+
+	for (c = 0; c < g_chans_count; c++) {
+		ch = &g_chans[c];
+		if ((ch == from) ? !g_echo : !g_loopback)
+			continue;
+		pthread_mutex_lock(&ch->lock);
+		for (i = 0; i < count; i++) {
+			msg = list[i];
+			msg.flags = (msg.flags & (PCANFD_MSG_RTR | PCANFD_MSG_EXT | PCANFD_MSG_BRS |
+					PCANFD_MSG_ESI)) | PCANFD_TIMESTAMP;
+			gettimeofday(&msg.timestamp, NULL);
+			pcanfake_push(ch, &msg);
+		}
+		pthread_mutex_unlock(&ch->lock);
+	}
+}
+
+/* frames due since the start of the injection (lock held) */
+static __u64 pcanfake_inject(struct pcanfake_chan *ch, __u64 now_ns) {
+	struct pcanfd_msg msg;
+	__u64 due;
+	int i;
+
+	if (now_ns <= ch->inject_start_ns)
+		return ch->inject_start_ns + (__u64)(1e9 / g_rx_rate);
+	due = (__u64)((now_ns - ch->inject_start_ns) * g_rx_rate / 1e9);
+	/* catch up with a burst, but not more than a full queue */
+	if (due > ch->injected + g_rx_size)
+		ch->injected = due - g_rx_size;
+	memset(&msg, 0, sizeof(msg));
+	msg.type = PCANFD_TYPE_CAN20_MSG;
+	msg.id = g_rx_id;
+	msg.flags = PCANFD_TIMESTAMP | ((g_rx_id > CAN_MAX_STANDARD_ID) ? PCANFD_MSG_EXT : 0);
+	msg.data_len = 8;
+	gettimeofday(&msg.timestamp, NULL);
+	for (; ch->injected < due; ch->injected++) {
+		for (i = 0; i < 8; i++)
+			msg.data[i] = (__u8)(ch->injected >> (8 * i));
+		pcanfake_push(ch, &msg);
+	}
+	return ch->inject_start_ns + (__u64)((ch->injected + 1) * 1e9 / g_rx_rate);
+}
+
+static void *pcanfake_inject_main(void *arg) {
+	struct pcanfake_chan *ch;
+	struct timespec ts;
+	__u64 now_ns, next_ns, t;
+	int i;
+
+	(void)arg;
+	pthread_mutex_lock(&g_inject_lock);
+	while (!g_inject_stop) {
+		pthread_mutex_unlock(&g_inject_lock);
+		now_ns = pcanfake_now();
+		next_ns = now_ns + 1000000000ULL;
+		for (i = 0; i < g_chans_count; i++) {
+			ch = &g_chans[i];
+			pthread_mutex_lock(&ch->lock);
+			if (ch->fd >= 0 && ch->initialized) {
+				t = pcanfake_inject(ch, now_ns);
+				if (t < next_ns)
+					next_ns = t;
+			}
+			pthread_mutex_unlock(&ch->lock);
+		}
+		ts.tv_sec = next_ns / 1000000000ULL;
+		ts.tv_nsec = next_ns % 1000000000ULL;
+		pthread_mutex_lock(&g_inject_lock);
+		if (!g_inject_stop)
+			pthread_cond_timedwait(&g_inject_cond, &g_inject_lock, &ts);
+	}
+	pthread_mutex_unlock(&g_inject_lock);
+	return NULL;
+}
+
+/* starts the injection thread, or wakes it up to reschedule */
+static void pcanfake_inject_kick(void) {
+	pthread_condattr_t attr;
+
+	if (g_rx_rate <= 0)
+		return;
+	pthread_mutex_lock(&g_inject_lock);
+	if (!g_inject_running) {
+		pthread_condattr_init(&attr);
+		pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+		pthread_cond_init(&g_inject_cond, &attr);
+		pthread_condattr_destroy(&attr);
+		if (pthread_create(&g_inject_thread, NULL, pcanfake_inject_main, NULL) == 0)
+			g_inject_running = 1;
+		else
+			fprintf(stderr, "pcanfake: failed to start the Rx injection thread\n");
+	}
+	else
+		pthread_cond_signal(&g_inject_cond);
+	pthread_mutex_unlock(&g_inject_lock);
+}
+
+static __u32 pcanfake_bitrate(const struct pcan_bittiming *bt, __u32 clock_Hz) {
+	__u32 tq;
+
+	if (bt->bitrate)
+		return bt->bitrate;
+	tq = bt->brp * (1 + bt->tseg1 + bt->tseg2);
+	return tq ? clock_Hz / tq : 0;
+}
+
+static int pcanfake_set_init(struct pcanfake_chan *ch, const struct pcanfd_init *pfdi) {
+	__u32 data;
+
+	if (pfdi == NULL)
+		return EINVAL;
+	ch->init = *pfdi;
+	if (ch->init.clock_Hz == 0)
+		ch->init.clock_Hz = PCANFAKE_CLOCK;
+	/* pcanfd_open() without bit rate: the default one of the driver */
+	ch->init.nominal.bitrate = pcanfake_bitrate(&pfdi->nominal, ch->init.clock_Hz);
+	if (ch->init.nominal.bitrate == 0)
+		ch->init.nominal.bitrate = PCANFAKE_BITRATE;
+	ch->init.nominal.bitrate_real = ch->init.nominal.bitrate;
+	data = 0;
+	if (pfdi->flags & PCANFD_INIT_FD) {
+		data = pcanfake_bitrate(&pfdi->data, ch->init.clock_Hz);
+		ch->init.data.bitrate = data;
+		ch->init.data.bitrate_real = data;
+	}
+	gettimeofday(&ch->tv_init, NULL);
+	ch->initialized = 1;
+	ch->injected = 0;
+	ch->inject_start_ns = pcanfake_now();
+	pcanfake_attr(ch, "nom_bitrate", "%u", ch->init.nominal.bitrate);
+	pcanfake_attr(ch, "data_bitrate", "%u", data);
+	pcanfake_attr(ch, "clock", "%u", ch->init.clock_Hz);
+	pcanfake_attr(ch, "init_flags", "0x%08x", ch->init.flags);
+	pcanfake_attr(ch, "bus_state", "%d", PCANFD_ERROR_ACTIVE);
+	return 0;
+}
+
+static void pcanfake_get_state(struct pcanfake_chan *ch, struct pcanfd_state *pfds) {
+	memset(pfds, 0, sizeof(*pfds));
+	pfds->ver_major = PCANFAKE_VER_MAJOR;
+	pfds->ver_minor = PCANFAKE_VER_MINOR;
+	pfds->ver_subminor = PCANFAKE_VER_SUBMINOR;
+	pfds->tv_init = ch->tv_init;
+	pfds->bus_state = ch->initialized ? PCANFD_ERROR_ACTIVE : PCANFD_UNKNOWN;
+	pfds->device_id = ch->device_id;
+	pfds->open_counter = 1;
+	pfds->filters_counter = ch->filters_count;
+	pfds->hw_type = HW_USB_FD;
+	pfds->channel_number = 0;
+	pfds->bus_load = 0xffff;
+	pfds->tx_max_msgs = PCANFAKE_TX_QUEUE;
+	pfds->tx_pending_msgs = 0;
+	pfds->rx_max_msgs = g_rx_size;
+	pfds->rx_pending_msgs = ch->rx_count;
+	pfds->tx_frames_counter = ch->tx_frames;
+	pfds->rx_frames_counter = ch->rx_frames;
+	pfds->host_time_ns = pcanfake_now();
+	pfds->hw_time_ns = pfds->host_time_ns;
+}
+
+static int pcanfake_get_option(struct pcanfake_chan *ch, struct pcanfd_option *opt) {
+	__u32 v32 = 0;
+	__u64 v64 = 0;
+	int size = sizeof(v32);
+
+	switch (opt->name) {
+	case PCANFD_OPT_CHANNEL_FEATURES:
+		v32 = PCANFAKE_FEATURES;
+		break;
+	case PCANFD_OPT_DEVICE_ID:
+		v32 = ch->device_id;
+		break;
+	case PCANFD_OPT_ALLOWED_MSGS:
+		v32 = ch->allowed_msgs;
+		break;
+	case PCANFD_OPT_ACC_FILTER_11B:
+		v64 = ch->acc_11b;
+		size = sizeof(v64);
+		break;
+	case PCANFD_OPT_ACC_FILTER_29B:
+		v64 = ch->acc_29b;
+		size = sizeof(v64);
+		break;
+	case PCANFD_OPT_IFRAME_DELAYUS:
+		v32 = ch->iframe_delay;
+		break;
+	case PCANFD_OPT_HWTIMESTAMP_MODE:
+		v32 = ch->hwts_mode;
+		break;
+	case PCANFD_OPT_DRV_VERSION:
+		v32 = (PCANFAKE_VER_MAJOR << 24) | (PCANFAKE_VER_MINOR << 16) |
+			(PCANFAKE_VER_SUBMINOR << 8);
+		break;
+	case PCANFD_OPT_FW_VERSION:
+		v32 = (3 << 24) | (2 << 16);
+		break;
+	default:
+		return EOPNOTSUPP;
+	}
+	if (opt->size < size) {
+		opt->size = size;
+		return ENOSPC;
+	}
+	if (opt->value == NULL)
+		return EFAULT;
+	memcpy(opt->value, (size == sizeof(v64)) ? (void *)&v64 : (void *)&v32, size);
+	opt->size = size;
+	return 0;
+}
+
+static int pcanfake_set_option(struct pcanfake_chan *ch, const struct pcanfd_option *opt) {
+	__u32 v32 = 0;
+	__u64 v64 = 0;
+
+	if (opt->value == NULL || opt->size < (int)sizeof(v32))
+		return EINVAL;
+	memcpy(&v32, opt->value, sizeof(v32));
+	if (opt->size >= (int)sizeof(v64))
+		memcpy(&v64, opt->value, sizeof(v64));
+	switch (opt->name) {
+	case PCANFD_OPT_DEVICE_ID:
+		ch->device_id = v32;
+		pcanfake_attr(ch, "devid", "0x%08x", v32);
+		break;
+	case PCANFD_OPT_ALLOWED_MSGS:
+		ch->allowed_msgs = v32;
+		break;
+	case PCANFD_OPT_ACC_FILTER_11B:
+		ch->acc_11b = v64;
+		break;
+	case PCANFD_OPT_ACC_FILTER_29B:
+		ch->acc_29b = v64;
+		break;
+	case PCANFD_OPT_IFRAME_DELAYUS:
+		ch->iframe_delay = v32;
+		break;
+	case PCANFD_OPT_HWTIMESTAMP_MODE:
+		if (v32 >= PCANFD_OPT_HWTIMESTAMP_MAX)
+			return EINVAL;
+		ch->hwts_mode = v32;
+		break;
+	default:
+		return EOPNOTSUPP;
+	}
+	return 0;
+}
+
+static int pcanfake_extra_params(struct pcanfake_chan *ch, struct pcan_extra_params *ep) {
+	switch (ep->nSubFunction) {
+	case SF_GET_HCDEVICENO:
+#ifndef USES_32BITS_DEVICENO
+		ep->func.ucHCDeviceNo = (__u8)ch->device_id;
+#else
+		ep->func.dwSerialNumber = ch->device_id;
+#endif
+		return 0;
+	case SF_SET_HCDEVICENO:
+#ifndef USES_32BITS_DEVICENO
+		ch->device_id = ep->func.ucHCDeviceNo;
+#else
+		ch->device_id = ep->func.dwSerialNumber;
+#endif
+		pcanfake_attr(ch, "devid", "0x%08x", ch->device_id);
+		return 0;
+	default:
+		return EINVAL;
+	}
+}
+
+static enum pcanfake_lat pcanfake_lat_of(unsigned long request) {
+	switch (request) {
+	case PCANFD_SET_INIT:
+	case PCANFD_GET_INIT:
+		return PCANFAKE_LAT_INIT;
+	case PCANFD_GET_STATE:
+		return PCANFAKE_LAT_STATE;
+	case PCANFD_ADD_FILTERS:
+	case PCANFD_GET_FILTERS:
+		return PCANFAKE_LAT_FILTER;
+	case PCANFD_SEND_MSG:
+	case PCANFD_SEND_MSGS:
+		return PCANFAKE_LAT_SEND;
+	case PCANFD_RECV_MSG:
+	case PCANFD_RECV_MSGS:
+		return PCANFAKE_LAT_RECV;
+	case PCANFD_GET_OPTION:
+	case PCANFD_SET_OPTION:
+		return PCANFAKE_LAT_OPTION;
+	default:
+		return PCANFAKE_LAT_OTHER;
+	}
+}
+
+/* serves an ioctl() of an opened channel, returns 0 or an errno */
+static int pcanfake_ioctl(struct pcanfake_chan *ch, unsigned long request, void *arg) {
+	struct pcanfd_msg_filters *pfl;
+	struct pcanfd_msgs *pfml;
+	struct pcanfd_available_clocks *pac;
+	struct pcanfd_bittiming_ranges *pbr;
+	__u32 i, n;
+	int err = 0;
+
+	pcanfake_delay(pcanfake_lat_of(request));
+	if (arg == NULL && request != PCANFD_ADD_FILTERS)
+		return EFAULT;
+
+	/* sent frames are delivered without holding the sender lock */
+	switch (request) {
+	case PCANFD_SEND_MSG:
+		pthread_mutex_lock(&ch->lock);
+		if (!ch->initialized)
+			err = EBADFD;
+		else
+			ch->tx_frames++;
+		pthread_mutex_unlock(&ch->lock);
+		if (!err)
+			pcanfake_transmit(ch, (struct pcanfd_msg *)arg, 1);
+		return err;
+	case PCANFD_SEND_MSGS:
+		pfml = (struct pcanfd_msgs *)arg;
+		pthread_mutex_lock(&ch->lock);
+		if (!ch->initialized)
+			err = EBADFD;
+		else
+			ch->tx_frames += pfml->count;
+		pthread_mutex_unlock(&ch->lock);
+		if (!err)
+			pcanfake_transmit(ch, pfml->list, pfml->count);
+		return err;
+	default:
+		break;
+	}
+
+	pthread_mutex_lock(&ch->lock);
+	switch (request) {
+	case PCANFD_SET_INIT:
+		err = pcanfake_set_init(ch, (struct pcanfd_init *)arg);
+		break;
+	case PCANFD_GET_INIT:
+		*(struct pcanfd_init *)arg = ch->init;
+		break;
+	case PCANFD_GET_STATE:
+		pcanfake_get_state(ch, (struct pcanfd_state *)arg);
+		break;
+	case PCANFD_ADD_FILTERS:
+		pfl = (struct pcanfd_msg_filters *)arg;
+		if (pfl == NULL) {
+			ch->filters_count = 0;
+			break;
+		}
+		if (ch->filters_count + pfl->count > PCANFAKE_MAX_FILTERS) {
+			err = ENOMEM;
+			break;
+		}
+		memcpy(&ch->filters[ch->filters_count], pfl->list, pfl->count * sizeof(pfl->list[0]));
+		ch->filters_count += pfl->count;
+		break;
+	case PCANFD_GET_FILTERS:
+		pfl = (struct pcanfd_msg_filters *)arg;
+		n = (pfl->count < ch->filters_count) ? pfl->count : ch->filters_count;
+		memcpy(pfl->list, ch->filters, n * sizeof(pfl->list[0]));
+		pfl->count = n;
+		break;
+	case PCANFD_RECV_MSG:
+		err = pcanfake_wait_rx(ch);
+		if (!err)
+			pcanfake_pop(ch, (struct pcanfd_msg *)arg, 1);
+		break;
+	case PCANFD_RECV_MSGS:
+		pfml = (struct pcanfd_msgs *)arg;
+		n = pfml->count;
+		pfml->count = 0;
+		if (n == 0)
+			break;
+		err = pcanfake_wait_rx(ch);
+		if (!err)
+			pfml->count = pcanfake_pop(ch, pfml->list, n);
+		break;
+	case PCANFD_GET_AVAILABLE_CLOCKS:
+		pac = (struct pcanfd_available_clocks *)arg;
+		if (pac->count >= 1) {
+			pac->list[0].clock_Hz = PCANFAKE_CLOCK;
+			pac->list[0].clock_src = 0;
+			pac->count = 1;
+		}
+		break;
+	case PCANFD_GET_BITTIMING_RANGES:
+		/* PCAN-USB FD nominal and data ranges */
+		pbr = (struct pcanfd_bittiming_ranges *)arg;
+		n = (pbr->count < 2) ? pbr->count : 2;
+		for (i = 0; i < n; i++) {
+			pbr->list[i].brp_min = 1;
+			pbr->list[i].brp_max = 1024;
+			pbr->list[i].brp_inc = 1;
+			pbr->list[i].tseg1_min = 1;
+			pbr->list[i].tseg1_max = i ? 32 : 256;
+			pbr->list[i].tseg2_min = 1;
+			pbr->list[i].tseg2_max = i ? 16 : 128;
+			pbr->list[i].sjw_min = 1;
+			pbr->list[i].sjw_max = i ? 16 : 128;
+		}
+		pbr->count = n;
+		break;
+	case PCANFD_GET_OPTION:
+		err = pcanfake_get_option(ch, (struct pcanfd_option *)arg);
+		break;
+	case PCANFD_SET_OPTION:
+		err = pcanfake_set_option(ch, (struct pcanfd_option *)arg);
+		break;
+	case PCAN_EXTRA_PARAMS:
+		err = pcanfake_extra_params(ch, (struct pcan_extra_params *)arg);
+		break;
+	default:
+		err = ENOTTY;
+		break;
+	}
+	pthread_mutex_unlock(&ch->lock);
+	/* the injection starts with the initialization */
+	if (request == PCANFD_SET_INIT && !err)
+		pcanfake_inject_kick();
+	return err;
+}
+
+static int pcanfake_open_dev(struct pcanfake_chan *ch, int flags) {
+	int fd;
+
+	pthread_mutex_lock(&ch->lock);
+	if (ch->fd >= 0) {
+		pthread_mutex_unlock(&ch->lock);
+		errno = EBUSY;
+		return -1;
+	}
+	fd = eventfd(0, EFD_NONBLOCK | ((flags & O_CLOEXEC) ? EFD_CLOEXEC : 0));
+	if (fd < 0 || fd >= PCANFAKE_MAX_FDS) {
+		if (fd >= 0)
+			REAL(close)(fd);
+		pthread_mutex_unlock(&ch->lock);
+		errno = EMFILE;
+		return -1;
+	}
+	ch->fd = fd;
+	ch->nonblock = !!(flags & O_NONBLOCK);
+	ch->evt_set = 0;
+	ch->initialized = 0;
+	memset(&ch->init, 0, sizeof(ch->init));
+	ch->allowed_msgs = PCANFD_ALLOWED_MSG_ALL;
+	ch->iframe_delay = 0;
+	ch->hwts_mode = PCANFD_OPT_HWTIMESTAMP_COOKED;
+	ch->acc_11b = 0x000007ff00000000ULL;
+	ch->acc_29b = 0x1fffffff00000000ULL;
+	ch->filters_count = 0;
+	ch->rx_head = 0;
+	ch->rx_count = 0;
+	ch->rx_overflow = 0;
+	ch->tx_frames = 0;
+	ch->rx_frames = 0;
+	g_fds[fd] = ch;
+	pthread_mutex_unlock(&ch->lock);
+	pcanfake_inject_kick();
+	return fd;
+}
+
+static int pcanfake_close_dev(struct pcanfake_chan *ch, int fd) {
+	pthread_mutex_lock(&ch->lock);
+	g_fds[fd] = NULL;
+	ch->fd = -1;
+	ch->initialized = 0;
+	pcanfake_attr(ch, "nom_bitrate", "0");
+	pcanfake_attr(ch, "data_bitrate", "0");
+	pcanfake_attr(ch, "bus_state", "0");
+	pthread_mutex_unlock(&ch->lock);
+	return REAL(close)(fd);
+}
+
+__attribute__((constructor))
+static void pcanfake_init(void) {
+	struct pcanfake_chan *ch;
+	const char *val;
+	int i;
+
+	g_chans_count = pcanfake_env_int(PCANFAKE_ENV_CHANNELS, PCANFAKE_CHANNELS);
+	if (g_chans_count < 0)
+		g_chans_count = 0;
+	if (g_chans_count > PCANFAKE_MAX_CHANNELS)
+		g_chans_count = PCANFAKE_MAX_CHANNELS;
+	i = pcanfake_env_int(PCANFAKE_ENV_RX_QUEUE, PCANFAKE_RX_QUEUE);
+	g_rx_size = (i > 0) ? (__u32)i : PCANFAKE_RX_QUEUE;
+	g_rx_id = (__u32)pcanfake_env_int(PCANFAKE_ENV_RX_ID, PCANFAKE_RX_ID) & CAN_MAX_EXTENDED_ID;
+	val = getenv(PCANFAKE_ENV_RX_RATE);
+	g_rx_rate = (val != NULL) ? strtod(val, NULL) : 0.;
+	g_echo = pcanfake_env_int(PCANFAKE_ENV_ECHO, 0);
+	g_loopback = pcanfake_env_int(PCANFAKE_ENV_LOOPBACK, 0);
+	pcanfake_parse_latency(getenv(PCANFAKE_ENV_LATENCY));
+
+	val = getenv(PCANFAKE_ENV_ROOT);
+	if (val != NULL && *val != 0)
+		snprintf(g_root, sizeof(g_root), "%s", val);
+	else
+		snprintf(g_root, sizeof(g_root), "/tmp/pcanfake.%d", (int)getpid());
+	for (i = 0; i < g_chans_count; i++) {
+		ch = &g_chans[i];
+		pthread_mutex_init(&ch->lock, NULL);
+		pthread_cond_init(&ch->rx_cond, NULL);
+		ch->index = i;
+		ch->minor = PCANFAKE_MINOR_BASE + i;
+		ch->fd = -1;
+		ch->device_id = 0xffffffff;
+		snprintf(ch->name, sizeof(ch->name), PCANFAKE_NAME_PREFIX "%d", ch->minor);
+		snprintf(ch->dev_name, sizeof(ch->dev_name), PCANFAKE_DEV_PREFIX "%s", ch->name);
+		snprintf(ch->dir, sizeof(ch->dir), "%.*s/%s", PATH_MAX - 40, g_root, ch->name);
+		ch->rx = (struct pcanfd_msg *)calloc(g_rx_size, sizeof(ch->rx[0]));
+		if (ch->rx == NULL) {
+			g_chans_count = i;
+			break;
+		}
+	}
+	if (pcanfake_create_tree()) {
+		fprintf(stderr, "pcanfake: failed to create '%s' (errno=%d)\n", g_root, errno);
+		g_root[0] = 0;
+	}
+}
+
+__attribute__((destructor))
+static void pcanfake_exit(void) {
+	if (g_inject_running) {
+		pthread_mutex_lock(&g_inject_lock);
+		g_inject_stop = 1;
+		pthread_cond_signal(&g_inject_cond);
+		pthread_mutex_unlock(&g_inject_lock);
+		pthread_join(g_inject_thread, NULL);
+		g_inject_running = 0;
+	}
+	if (g_root[0] && g_root_created)
+		pcanfake_remove_tree();
+}
+
+/* INTERCEPTED FUNCTIONS */
+int open(const char *path, int flags, ...) {
+	char buf[PATH_MAX];
+	struct pcanfake_chan *ch;
+	mode_t mode = 0;
+	va_list ap;
+
+	if (pcanfake_need_mode(flags)) {
+		va_start(ap, flags);
+		mode = va_arg(ap, mode_t);
+		va_end(ap);
+	}
+	ch = pcanfake_dev(path);
+	if (ch != NULL)
+		return pcanfake_open_dev(ch, flags);
+	return REAL(open)(pcanfake_path(path, buf, sizeof(buf)), flags, mode);
+}
+
+int open64(const char *path, int flags, ...) {
+	char buf[PATH_MAX];
+	struct pcanfake_chan *ch;
+	mode_t mode = 0;
+	va_list ap;
+
+	if (pcanfake_need_mode(flags)) {
+		va_start(ap, flags);
+		mode = va_arg(ap, mode_t);
+		va_end(ap);
+	}
+	ch = pcanfake_dev(path);
+	if (ch != NULL)
+		return pcanfake_open_dev(ch, flags);
+	return REAL(open64)(pcanfake_path(path, buf, sizeof(buf)), flags, mode);
+}
+
+/* _FORTIFY_SOURCE entry points */
+int __open_2(const char *path, int flags) {
+	return open(path, flags);
+}
+
+int __open64_2(const char *path, int flags) {
+	return open64(path, flags);
+}
+
+int openat(int dirfd, const char *path, int flags, ...) {
+	mode_t mode = 0;
+	va_list ap;
+
+	if (pcanfake_need_mode(flags)) {
+		va_start(ap, flags);
+		mode = va_arg(ap, mode_t);
+		va_end(ap);
+	}
+	if (path[0] == '/')
+		return open(path, flags, mode);
+	return REAL(openat)(dirfd, path, flags, mode);
+}
+
+int openat64(int dirfd, const char *path, int flags, ...) {
+	mode_t mode = 0;
+	va_list ap;
+
+	if (pcanfake_need_mode(flags)) {
+		va_start(ap, flags);
+		mode = va_arg(ap, mode_t);
+		va_end(ap);
+	}
+	if (path[0] == '/')
+		return open64(path, flags, mode);
+	return REAL(openat64)(dirfd, path, flags, mode);
+}
+
+FILE *fopen(const char *path, const char *mode) {
+	char buf[PATH_MAX];
+
+	return REAL(fopen)(pcanfake_path(path, buf, sizeof(buf)), mode);
+}
+
+FILE *fopen64(const char *path, const char *mode) {
+	char buf[PATH_MAX];
+
+	return REAL(fopen64)(pcanfake_path(path, buf, sizeof(buf)), mode);
+}
+
+int scandir(const char *path, struct dirent ***namelist,
+		int (*filter)(const struct dirent *),
+		int (*compar)(const struct dirent **, const struct dirent **)) {
+	char buf[PATH_MAX];
+
+	return REAL(scandir)(pcanfake_path(path, buf, sizeof(buf)), namelist, filter, compar);
+}
+
+int scandir64(const char *path, struct dirent64 ***namelist,
+		int (*filter)(const struct dirent64 *),
+		int (*compar)(const struct dirent64 **, const struct dirent64 **)) {
+	char buf[PATH_MAX];
+
+	return REAL(scandir64)(pcanfake_path(path, buf, sizeof(buf)), namelist, filter, compar);
+}
+
+int inotify_add_watch(int fd, const char *path, uint32_t mask) {
+	char buf[PATH_MAX];
+
+	return REAL(inotify_add_watch)(fd, pcanfake_path(path, buf, sizeof(buf)), mask);
+}
+
+int ioctl(int fd, unsigned long request, ...) {
+	struct pcanfake_chan *ch;
+	void *arg;
+	va_list ap;
+	int err;
+
+	va_start(ap, request);
+	arg = va_arg(ap, void *);
+	va_end(ap);
+	ch = pcanfake_chan_of(fd);
+	if (ch == NULL)
+		return REAL(ioctl)(fd, request, arg);
+	err = pcanfake_ioctl(ch, request, arg);
+	if (err) {
+		errno = err;
+		return -1;
+	}
+	return 0;
+}
+
+int close(int fd) {
+	struct pcanfake_chan *ch = pcanfake_chan_of(fd);
+
+	if (ch != NULL)
+		return pcanfake_close_dev(ch, fd);
+	return REAL(close)(fd);
+}
@@ -38,11 +38,39 @@
 #include <string.h>
 #include <getopt.h>
 #include <dirent.h>
+#include <errno.h>
+#include <limits.h>		/* PATH_MAX */
+#include <unistd.h>		/* unlink */
+#include <signal.h>
+#include <time.h>
+#include <pcanfd.h>		/* PCANFD_ERROR_xx bus states */
 
 #include "version.h"
 
 #define BUF_SIZE	100
 
+/** Default refresh interval of the watch mode (ms) */
+#define WATCH_DEFAULT_INTERVAL_MS	1000
+/** Weight of the last sample in the bus load moving average */
+#define WATCH_LOAD_AVG_WEIGHT		0.2
+/** Minimal gap (in %) between bus load and its average to report a trend */
+#define WATCH_LOAD_TREND_DEADBAND	1.0
+
+/**
+ * Watch mode state of a device
+ */
+struct watch_dev {
+	struct pcaninfo *pci;			/**< Watched device */
+	struct pcaninfo_poller *poller;	/**< Opened volatile attributes */
+	uint32_t read;					/**< 'read' counter at last sample */
+	uint32_t write;					/**< 'write' counter at last sample */
+	double rx_rate;					/**< Frames read per second */
+	double tx_rate;					/**< Frames written per second */
+	double load_avg;				/**< Moving average of the bus load (%) */
+	const char *load_trend;			/**< Bus load compared with its average before the last sample */
+	int removed;					/**< Device can no more be read */
+};
+
 static const char *exec_name;
 
 /* Definition of command-line options. */
@@ -50,18 +78,36 @@ static void print_info(void);
 static int print_usage(int error);
 static void print_help(void);
 static void print_version(void);
+static int is_requested(struct pcaninfo *pci, int argc, char * argv[]);
+static int watch_devices(struct pcaninfo_list *pcilist, int argc, char * argv[]);
+static void watch_print(struct watch_dev *wd);
+static int watch_write_prometheus(const char *path, struct watch_dev *wds, int count);
 
 
 /* Flag set by '--verbose'. */
 static int verbose_flag;
 /* Flag set by '--debug'. */
 static int debug_flag;
+/* Flag set by '--watch'. */
+static int watch_flag;
+/* Refresh interval set by '--interval'. */
+static long watch_interval_ms = WATCH_DEFAULT_INTERVAL_MS;
+/* Number of refreshes set by '--count' (0 = infinite). */
+static long watch_count;
+/* Prometheus text file set by '--prometheus'. */
+static const char *prometheus_path;
+/* Set by SIGINT/SIGTERM to leave the watch mode. */
+static volatile sig_atomic_t watch_stop;
 
 static struct option long_options[] = {
 	/* These options set a flag. */
 	{ "debug", no_argument, &debug_flag, 1 },
 	{ "help", no_argument, 0, 'h' },
 	{ "verbose", no_argument, &verbose_flag, 1 },
+	{ "watch", no_argument, &watch_flag, 1 },
+	{ "interval", required_argument, 0, 'i' },
+	{ "count", required_argument, 0, 'n' },
+	{ "prometheus", required_argument, 0, 'p' },
 	{ 0, 0, 0, 0 }
 };
 
@@ -149,6 +195,7 @@ char * pretty_tpcanhandle(TPCANHandle channel, char * buf, int size) {
 
 void print_info(void) {
 	printf("'pcaninfo' lists all known PCAN devices and outputs information for each one.\n");
+	printf("In watch mode, it periodically outputs the bus state, load and frame rates of the devices.\n");
 
 }
 
@@ -160,6 +207,10 @@ void print_help() {
 	printf("  -h, --help				show this help\n");
 	printf("  -g, --debug				display debug messages\n");
 	printf("  -v, --verbose				display more messages\n");
+	printf("  -w, --watch				periodically output bus state, load and rates\n");
+	printf("  -i, --interval=MS			watch refresh interval (default: %d ms)\n", WATCH_DEFAULT_INTERVAL_MS);
+	printf("  -n, --count=N				stop watching after N refreshes\n");
+	printf("  -p, --prometheus=FILE			write watched values to FILE (Prometheus text format)\n");
 }
 
 void print_version() {
@@ -169,10 +220,9 @@ void print_version() {
 	   
 int main(int argc, char * argv[]) {
 	PCANLOG_LEVEL log_lvl;
-	char * device;
 	int c;
 	struct pcaninfo_list *pcilist;
-	int i, j, ires, doprint;
+	int i, ires, doprint;
 	char buf[BUF_SIZE];
 	TPCANHandle hdl;
 
@@ -183,13 +233,12 @@ int main(int argc, char * argv[]) {
 	else
 		++exec_name;
 	/* initialization */
-	device = NULL;
 	log_lvl = LVL_NORMAL;
 
 	/* parse command arguments */
 	while (1) {
 		int option_index = 0;
-		c = getopt_long(argc, argv, "d:hgv", long_options, &option_index);
+		c = getopt_long(argc, argv, "d:hgvwi:n:p:", long_options, &option_index);
 		/* Detect the end of the options. */
 		if (c == -1)
 			break;
@@ -205,6 +254,22 @@ int main(int argc, char * argv[]) {
 		case 'v':
 			verbose_flag = 1;
 			break;
+		case 'w':
+			watch_flag = 1;
+			break;
+		case 'i':
+			watch_interval_ms = strtol(optarg, NULL, 0);
+			if (watch_interval_ms <= 0) {
+				fprintf(stderr, "%s: invalid interval '%s'\n", exec_name, optarg);
+				exit(1);
+			}
+			break;
+		case 'n':
+			watch_count = strtol(optarg, NULL, 0);
+			break;
+		case 'p':
+			prometheus_path = optarg;
+			break;
 		case 'h':
 			print_info();
 			print_version();
@@ -224,9 +289,20 @@ int main(int argc, char * argv[]) {
 		log_lvl = LVL_DEBUG;
 	pcanlog_set(log_lvl, 0, log_lvl == LVL_DEBUG);
 
+	/* watch mode only needs to identify devices, then their volatile
+	 * attributes are kept opened */
+	if (watch_flag || prometheus_path) {
+		ires = pcaninfo_get(&pcilist, PCANINFO_INIT_IDENT);
+		if (ires != 0)
+			return -1;
+		ires = watch_devices(pcilist, argc, argv);
+		pcaninfo_free(pcilist);
+		return ires;
+	}
+
 	/* assume remaining command line arguments are devices
 	 * to look for and output */
-	ires = pcaninfo_get(&pcilist, 1);
+	ires = pcaninfo_get(&pcilist, PCANINFO_INIT_FULL);
 	if (ires != 0) {
 		return -1;
 	}
@@ -237,21 +313,7 @@ int main(int argc, char * argv[]) {
 
 	/* try to match arg and existing device name */
 	for (i = 0; i < pcilist->length; i++) {
-		if (optind >= argc)
-			doprint = 1;
-		else {
-			/* search if device is requested in args */
-			doprint = 0;
-			for (j = optind; j < argc; j++) {
-				device = argv[j];
-				if (strstr(pcilist->infos[i].name, device) != 0) {
-					doprint = 1;
-				}
-				else if (strstr(pcilist->infos[i].path, device) != 0) {
-					doprint = 1;
-				}
-			}
-		}
+		doprint = is_requested(&pcilist->infos[i], argc, argv);
 		if (doprint) {
 			pcaninfo_output(&pcilist->infos[i]);
 			hdl = pcanbasic_get_handle(pcilist->infos[i].path, pcilist);
@@ -261,7 +323,180 @@ int main(int argc, char * argv[]) {
 		}
 	}
 
-	free(pcilist);
+	pcaninfo_free(pcilist);
+
+	return 0;
+}
+
+int is_requested(struct pcaninfo *pci, int argc, char * argv[]) {
+	int j;
+
+	if (optind >= argc)
+		return 1;
+	/* search if device is requested in args */
+	for (j = optind; j < argc; j++) {
+		if (strstr(pci->name, argv[j]) != 0)
+			return 1;
+		if (strstr(pci->path, argv[j]) != 0)
+			return 1;
+	}
+	return 0;
+}
+
+static void watch_signal(int sig) {
+	(void) sig;
+	watch_stop = 1;
+}
+
+void watch_print(struct watch_dev *wd) {
+	struct pcaninfo *pci = wd->pci;
+	char state[PCANINFO_MAX_CHAR_SIZE];
+
+	if (wd->removed) {
+		fprintf(stdout, "%-16s removed\n", pci->name);
+		return;
+	}
+	fprintf(stdout, "%-16s %-16s load: %3u%% (avg %5.1f%%, %-7s) rx: %9.1f fr/s tx: %9.1f fr/s rxerr: %3u txerr: %3u\n",
+			pci->name, pretty_bus_state(pci->bus_state, state, sizeof(state)),
+			pci->bus_load, wd->load_avg, wd->load_trend,
+			wd->rx_rate, wd->tx_rate, pci->rxerr, pci->txerr);
+}
+
+int watch_write_prometheus(const char *path, struct watch_dev *wds, int count) {
+	char tmp[PATH_MAX];
+	FILE *f;
+	int i;
+
+	/* write a temporary file then rename it: the exporter never
+	 * reads a partially written file */
+	snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+	f = fopen(tmp, "w");
+	if (f == NULL) {
+		fprintf(stderr, "%s: failed to open '%s' (errno=%d)\n", exec_name, tmp, errno);
+		return -1;
+	}
+#define PROM_METRIC(metric, type, help, fmt, expr) \
+	do { \
+		fprintf(f, "# HELP " metric " " help "\n# TYPE " metric " " type "\n"); \
+		for (i = 0; i < count; i++) \
+			if (!wds[i].removed) \
+				fprintf(f, metric "{device=\"%s\"} " fmt "\n", wds[i].pci->name, expr); \
+	} while (0)
+	PROM_METRIC("pcan_bus_load_percent", "gauge", "Bus load reported by the pcan driver.",
+			"%u", wds[i].pci->bus_load);
+	PROM_METRIC("pcan_bus_load_avg_percent", "gauge", "Moving average of the bus load.",
+			"%.2f", wds[i].load_avg);
+	PROM_METRIC("pcan_bus_state", "gauge", "Bus state (0=closed, 1=active, 2=warning, 3=passive, 4=bus off).",
+			"%u", wds[i].pci->bus_state);
+	PROM_METRIC("pcan_rx_error_counter", "gauge", "Receive error counter of the CAN controller.",
+			"%u", wds[i].pci->rxerr);
+	PROM_METRIC("pcan_tx_error_counter", "gauge", "Transmit error counter of the CAN controller.",
+			"%u", wds[i].pci->txerr);
+	PROM_METRIC("pcan_rx_frames_total", "counter", "CAN frames read.",
+			"%u", wds[i].pci->read);
+	PROM_METRIC("pcan_tx_frames_total", "counter", "CAN frames written.",
+			"%u", wds[i].pci->write);
+	PROM_METRIC("pcan_rx_frames_per_second", "gauge", "CAN frames read per second.",
+			"%.1f", wds[i].rx_rate);
+	PROM_METRIC("pcan_tx_frames_per_second", "gauge", "CAN frames written per second.",
+			"%.1f", wds[i].tx_rate);
+#undef PROM_METRIC
+	if (fclose(f) != 0 || rename(tmp, path) != 0) {
+		fprintf(stderr, "%s: failed to write '%s' (errno=%d)\n", exec_name, path, errno);
+		unlink(tmp);
+		return -1;
+	}
+	return 0;
+}
+
+int watch_devices(struct pcaninfo_list *pcilist, int argc, char * argv[]) {
+	struct watch_dev *wds;
+	struct timespec next, now, prev;
+	double dt;
+	long n;
+	int i, count;
+
+	wds = (struct watch_dev *) calloc(pcilist->length > 0 ? pcilist->length : 1, sizeof(*wds));
+	if (wds == NULL)
+		return -1;
+	count = 0;
+	for (i = 0; i < pcilist->length; i++) {
+		if (!is_requested(&pcilist->infos[i], argc, argv))
+			continue;
+		wds[count].pci = &pcilist->infos[i];
+		wds[count].poller = pcaninfo_poller_open(wds[count].pci, PCANINFO_VOLATILE_FLAGS, 0);
+		if (wds[count].poller == NULL) {
+			fprintf(stderr, "%s: failed to open attributes of '%s' (errno=%d)\n",
+					exec_name, wds[count].pci->name, errno);
+			continue;
+		}
+		/* first sample: rates are computed from there */
+		pcaninfo_poller_read(wds[count].poller);
+		wds[count].read = wds[count].pci->read;
+		wds[count].write = wds[count].pci->write;
+		wds[count].load_avg = wds[count].pci->bus_load;
+		wds[count].load_trend = "steady";
+		count++;
+	}
+	if (count == 0) {
+		fprintf(stdout, "No PCAN device to watch\n");
+		free(wds);
+		return 0;
+	}
+
+	signal(SIGINT, watch_signal);
+	signal(SIGTERM, watch_signal);
+	clock_gettime(CLOCK_MONOTONIC, &next);
+	prev = next;
+	for (n = 0; !watch_stop && (watch_count <= 0 || n < watch_count); n++) {
+		/* absolute deadlines: no drift of the sampling period */
+		next.tv_sec += watch_interval_ms / 1000;
+		next.tv_nsec += (watch_interval_ms % 1000) * 1000000L;
+		if (next.tv_nsec >= 1000000000L) {
+			next.tv_sec++;
+			next.tv_nsec -= 1000000000L;
+		}
+		if (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL) != 0 && watch_stop)
+			break;
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		dt = (now.tv_sec - prev.tv_sec) + (now.tv_nsec - prev.tv_nsec) / 1e9;
+		prev = now;
+		for (i = 0; i < count; i++) {
+			struct watch_dev *wd = &wds[i];
+
+			if (wd->removed)
+				continue;
+			if (pcaninfo_poller_read(wd->poller) != 0) {
+				wd->removed = 1;
+				continue;
+			}
+			/* unsigned differences handle counters wrap-around */
+			wd->rx_rate = (uint32_t) (wd->pci->read - wd->read) / dt;
+			wd->tx_rate = (uint32_t) (wd->pci->write - wd->write) / dt;
+			wd->read = wd->pci->read;
+			wd->write = wd->pci->write;
+			/* trend against the average of the previous samples */
+			if (wd->pci->bus_load > wd->load_avg + WATCH_LOAD_TREND_DEADBAND)
+				wd->load_trend = "rising";
+			else if (wd->pci->bus_load + WATCH_LOAD_TREND_DEADBAND < wd->load_avg)
+				wd->load_trend = "falling";
+			else
+				wd->load_trend = "steady";
+			wd->load_avg += WATCH_LOAD_AVG_WEIGHT * (wd->pci->bus_load - wd->load_avg);
+		}
+		if (watch_flag) {
+			for (i = 0; i < count; i++)
+				watch_print(&wds[i]);
+			if (count > 1)
+				fprintf(stdout, "\n");
+			fflush(stdout);
+		}
+		if (prometheus_path)
+			watch_write_prometheus(prometheus_path, wds, count);
+	}
 
+	for (i = 0; i < count; i++)
+		pcaninfo_poller_close(wds[i].poller);
+	free(wds);
 	return 0;
 }
@@ -0,0 +1,153 @@
+/* SPDX-License-Identifier: LGPL-2.1-only */
+/*
+ * fd_aggregate_bench.cpp - bus time of aggregated CAN FD frames
+ *
+ * For 1 to 16 motors, compares the bus time of a control cycle (a command
+ * and a reply per motor) sent as:
+ *   - classic: one CAN 2.0 frame per command and per reply (nominal rate),
+ *   - fd: one CAN FD frame with BRS per command and per reply,
+ *   - aggregated: the commands in 64-byte BRS frames, the replies too
+ *     (fd_aggregate.hpp),
+ * with the stuff bits of actual frames (CAN_GetFrameTime()), and prints the
+ * saving of the aggregated frames over classic frames, the highest loop
+ * rate each one leaves room for on one bus, and the time taken to pack the
+ * commands and split the replies.
+ *
+ * usage: fd_aggregate_bench [-b nominal_bitrate] [-d data_bitrate]
+ *   -b  nominal bit rate (default 1000000)
+ *   -d  data bit rate (default 5000000)
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <pcanmotor/fd_aggregate.hpp>
+#include <pcanmotor/rt.hpp>
+
+using namespace pcanmotor;
+
+#define MAX_MOTORS	16
+#define CMD_CAN_ID	0x100	/* id of the aggregated commands */
+#define REPLY_CAN_ID	0x101	/* id of the aggregated replies */
+#define ITERATIONS	100000
+
+static const unsigned motors[] = { 1, 2, 4, 6, 8, 12, 16 };
+
+static uint64_t frame_ns(const struct pcanfd_msg &msg, uint32_t nom, uint32_t data)
+{
+	UINT64 ns = 0;
+
+	CAN_GetFrameTime(&msg, nom, data, PCAN_PARAMETER_OFF, &ns);
+	return ns;
+}
+
+/* bus time of one frame per command and per reply */
+static uint64_t single_ns(unsigned n, bool fd, uint32_t nom, uint32_t data)
+{
+	struct pcanfd_msg cmd, rep;
+	uint64_t ns = 0;
+
+	memset(&cmd, 0, sizeof(cmd));
+	memset(&rep, 0, sizeof(rep));
+	cmd.type = rep.type = fd ? PCANFD_TYPE_CANFD_MSG : PCANFD_TYPE_CAN20_MSG;
+	cmd.flags = rep.flags = fd ? PCANFD_MSG_BRS : 0;
+	cmd.data_len = mit::CMD_LEN;
+	rep.data_len = mit::REPLY_LEN;
+	for (unsigned m = 1; m <= n; m++) {
+		const mit::command c = { 0.1f * m, 0.f, 10.f, 1.f, 0.f };
+
+		cmd.id = rep.id = m;
+		mit::codec<>::pack(cmd.data, c);
+		mit::codec<>::pack_reply(rep.data, (uint8_t)m, 0.1 * m, 0., 0.);
+		ns += frame_ns(cmd, nom, data) + frame_ns(rep, nom, data);
+	}
+	return ns;
+}
+
+/* packs the commands of n motors and their replies */
+static void aggregate(unsigned n, fd_aggregate::aggregator &cmds,
+		fd_aggregate::aggregator &reps, msg_list<MAX_MOTORS> &cmd_frames,
+		msg_list<MAX_MOTORS> &rep_frames)
+{
+	uint8_t buf[mit::REPLY_LEN];
+
+	cmd_frames.count = 0;
+	rep_frames.count = 0;
+	for (unsigned m = 1; m <= n; m++) {
+		const mit::command c = { 0.1f * m, 0.f, 10.f, 1.f, 0.f };
+
+		cmds.add_command(cmd_frames, (uint8_t)m, c);
+		mit::codec<>::pack_reply(buf, (uint8_t)m, 0.1 * m, 0., 0.);
+		reps.add(rep_frames, (uint8_t)m, buf, sizeof(buf));
+	}
+	cmds.flush(cmd_frames);
+	reps.flush(rep_frames);
+}
+
+int main(int argc, char *argv[])
+{
+	uint32_t nom = 1000000, data = 5000000;
+	int c;
+
+	while ((c = getopt(argc, argv, "b:d:")) != -1) {
+		switch (c) {
+		case 'b':
+			nom = (uint32_t)strtoul(optarg, NULL, 0);
+			break;
+		case 'd':
+			data = (uint32_t)strtoul(optarg, NULL, 0);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-b nominal_bitrate] [-d data_bitrate]\n", argv[0]);
+			return 2;
+		}
+	}
+	if (nom == 0 || data == 0) {
+		fprintf(stderr, "invalid bit rate\n");
+		return 2;
+	}
+
+	printf("# %u/%u bps, bus time of a cycle (command + reply per motor)\n", nom, data);
+	printf("# motors  classic_us      fd_us  aggr_us  frames  saving"
+		"  max_hz classic/fd/aggr  pack_ns  split_ns\n");
+	for (unsigned n : motors) {
+		fd_aggregate::aggregator cmds(CMD_CAN_ID), reps(REPLY_CAN_ID);
+		msg_list<MAX_MOTORS> cmd_frames, rep_frames;
+		const uint64_t classic = single_ns(n, false, nom, data);
+		const uint64_t fd = single_ns(n, true, nom, data);
+		unsigned replies = 0;
+
+		cmds.set_bitrates(nom, data);
+		reps.set_bitrates(nom, data);
+		aggregate(n, cmds, reps, cmd_frames, rep_frames);
+
+		const uint64_t aggr = cmds.stats().wire_ns + reps.stats().wire_ns;
+
+		/* packing and splitting costs, without accounting */
+		cmds.set_bitrates(0, 0);
+		reps.set_bitrates(0, 0);
+		int64_t t0 = rt::now_ns();
+		for (unsigned i = 0; i < ITERATIONS; i++)
+			aggregate(n, cmds, reps, cmd_frames, rep_frames);
+		int64_t t1 = rt::now_ns();
+		for (unsigned i = 0; i < ITERATIONS; i++)
+			for (unsigned f = 0; f < rep_frames.count; f++)
+				replies += fd_aggregate::split_replies(rep_frames.list[f],
+					[](const mit::reply &r) { (void)r; });
+		int64_t t2 = rt::now_ns();
+
+		char rates[32];
+
+		if (replies != n * ITERATIONS) {
+			fprintf(stderr, "%u replies split out of %u\n", replies, n * ITERATIONS);
+			return 1;
+		}
+		snprintf(rates, sizeof(rates), "%.0f/%.0f/%.0f", 1e9 / classic, 1e9 / fd, 1e9 / aggr);
+		printf("%8u  %10.1f  %9.1f  %7.1f  %3u+%-2u  %5.1f%%  %23s  %7.0f  %8.0f\n",
+			n, classic / 1e3, fd / 1e3, aggr / 1e3, cmd_frames.count,
+			rep_frames.count, 100. * (1. - (double)aggr / classic), rates,
+			(double)(t1 - t0) / ITERATIONS, (double)(t2 - t1) / ITERATIONS);
+	}
+	return 0;
+}
@@ -0,0 +1,167 @@
+/* SPDX-License-Identifier: LGPL-2.1-only */
+/*
+ * loop_sim_bench.cpp - control loop against simulated motors
+ *
+ * Runs a control_loop on a bus of simulated motors (motor_sim.hpp): the
+ * motors are enabled, then track a sine position trajectory (kp/kd) for
+ * some seconds, then are disabled. Prints the loop statistics (wake-up,
+ * cycle and reply times, missed replies), the simulator counters and the
+ * tracking error.
+ *
+ * The loop runs through libpcanbasic on channel 0x51, the simulated motors
+ * are attached to channel 0x52, both nodes of the virtual bus by default
+ * (PCANBASIC_VIRTUAL="0x51=sim,0x52=sim", set PCANBASIC_VIRTUAL_PACING=1
+ * to add the wire times). Set PCANBASIC_VIRTUAL to use other channels,
+ * e.g. two pcan channels wired together.
+ *
+ * usage: loop_sim_bench [motors] [hz] [seconds] [workers] [latency_us]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <unistd.h>
+
+#include <pcanmotor/control_loop.hpp>
+#include <pcanmotor/motor_sim.hpp>
+
+using namespace pcanmotor;
+
+#define MAX_MOTORS	64
+#define AMPLITUDE	1.0	/* rad */
+#define FREQUENCY	1.0	/* Hz */
+#define HOST		PCAN_USBBUS1
+#define MOTORS		PCAN_USBBUS2
+#define VIRTUAL_ENV	"PCANBASIC_VIRTUAL"
+
+typedef control_loop<mit::ak10_9, MAX_MOTORS> loop;
+
+/* mode frames of every motor, from the host */
+static void send_mode(unsigned motors, mit::mode m)
+{
+	msg_list<1> l;
+	TPCANStatus sts;
+
+	memset(&l, 0, sizeof(l));
+	l.list[0].type = PCANFD_TYPE_CAN20_MSG;
+	l.list[0].data_len = mit::CMD_LEN;
+	mit::pack_mode(l.list[0].data, m);
+	for (unsigned i = 1; i <= motors; i++) {
+		l.list[0].id = i;
+		do {
+			l.count = 1;
+			sts = CAN_WriteMany(HOST, l.msgs());
+		} while (sts == PCAN_ERROR_QXMTFULL && !usleep(100));
+		if (sts != PCAN_ERROR_OK)
+			fprintf(stderr, "warning: mode frame of motor %u not "
+				"sent: 0x%x\n", i, (unsigned)sts);
+	}
+}
+
+static void print_series(const char *name, const rt::series &s)
+{
+	printf("%-8s min %9.1f avg %9.1f max %9.1f stddev %8.1f us\n", name,
+		s.min / 1e3, s.mean() / 1e3, s.max / 1e3, s.stddev() / 1e3);
+}
+
+int main(int argc, char *argv[])
+{
+	const unsigned motors = argc > 1 ? atoi(argv[1]) : 12;
+	const double rate = argc > 2 ? strtod(argv[2], NULL) : 1000;
+	const double duration = argc > 3 ? strtod(argv[3], NULL) : 5;
+	sim_config sc;
+	loop_config lc;
+	unsigned i;
+
+	if (!motors || motors > MAX_MOTORS || rate <= 0) {
+		fprintf(stderr, "usage: %s [motors] [hz] [seconds] [workers] "
+			"[latency_us]\n", argv[0]);
+		return 2;
+	}
+
+	sc.workers = argc > 4 ? atoi(argv[4]) : 2;
+	sc.latency_ns = (argc > 5 ? atoi(argv[5]) : 200) * 1000LL;
+	motor_sim<> sim(sc);
+
+	setenv(VIRTUAL_ENV, "0x51=sim,0x52=sim", 0);
+	if (CAN_Initialize(HOST, PCAN_BAUD_1M, 0, 0, 0) != PCAN_ERROR_OK ||
+			CAN_Initialize(MOTORS, PCAN_BAUD_1M, 0, 0, 0) != PCAN_ERROR_OK) {
+		fprintf(stderr, "can't initialize the channels\n");
+		return 1;
+	}
+	sim.attach(MOTORS);
+
+	lc.channel = HOST;
+	lc.period_ns = (int64_t)(rt::NSEC_PER_SEC / rate);
+	lc.thread.priority = 0;
+	lc.thread.lock_memory = false;
+	loop l(lc);
+
+	for (i = 1; i <= motors; i++) {
+		sim.add_motor((uint8_t)i);
+		l.add_motor((uint8_t)i);
+	}
+	sim.start();
+	send_mode(motors, mit::mode::enter);
+
+	/* sine trajectory, tracking error of the replies */
+	const int64_t t0 = rt::now_ns();
+	double err_sum = 0, err_max = 0;
+	uint64_t err_count = 0;
+	float target = 0;
+
+	l.start([&](loop &lp) {
+		const double t = (rt::now_ns() - t0) * 1e-9;
+
+		for (unsigned s = 0; s < lp.motors(); s++) {
+			if (lp.replied[s]) {
+				const double e = fabs(lp.state.p[s] - target);
+
+				err_sum += e * e;
+				err_max = e > err_max ? e : err_max;
+				err_count++;
+			}
+		}
+
+		target = (float)(AMPLITUDE * sin(2 * M_PI * FREQUENCY * t));
+		for (unsigned s = 0; s < lp.motors(); s++) {
+			lp.cmd.p[s] = target;
+			lp.cmd.v[s] = (float)(AMPLITUDE * 2 * M_PI * FREQUENCY *
+				cos(2 * M_PI * FREQUENCY * t));
+			lp.cmd.kp[s] = 50.f;
+			lp.cmd.kd[s] = 1.f;
+		}
+	});
+
+	struct timespec ts = rt::to_timespec((int64_t)(duration *
+		rt::NSEC_PER_SEC));
+	nanosleep(&ts, NULL);
+	l.stop();
+
+	send_mode(motors, mit::mode::exit);
+	usleep(10000);
+	sim.stop();
+
+	const loop_stats &st = l.stats();
+	const sim_stats ss = sim.stats();
+
+	printf("# %u motors at %.0f Hz, %u sim workers, %lld us reply latency\n",
+		motors, rate, sc.workers, (long long)(sc.latency_ns / 1000));
+	printf("cycles %llu overruns %llu late %llu missed replies %llu\n",
+		(unsigned long long)st.cycles,
+		(unsigned long long)st.overruns, (unsigned long long)st.late,
+		(unsigned long long)st.missed_replies);
+	print_series("wakeup", st.wakeup);
+	print_series("cycle", st.cycle);
+	print_series("replies", st.replies);
+	printf("sim: commands %llu modes %llu replies %llu ignored %llu "
+		"overflows %llu late steps %llu\n",
+		(unsigned long long)ss.commands, (unsigned long long)ss.modes,
+		(unsigned long long)ss.replies, (unsigned long long)ss.ignored,
+		(unsigned long long)ss.overflows,
+		(unsigned long long)ss.late_steps);
+	printf("tracking error (one cycle lag included): rms %.4f max %.4f "
+		"rad\n", err_count ? sqrt(err_sum / err_count) : 0., err_max);
+
+	CAN_Uninitialize(PCAN_NONEBUS);
+	return 0;
+}
@@ -0,0 +1,116 @@
+/* SPDX-License-Identifier: LGPL-2.1-only */
+/*
+ * mit_batch_bench.cpp - MIT batch encoder and decoder benchmark
+ *
+ * Encodes the commands of 1 to 64 motors, then decodes a drain of their
+ * replies, with every kernel supported by the CPU and prints the time per
+ * batch and per motor, and the speedup over the scalar kernel.
+ *
+ * usage: mit_batch_bench [iterations]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <pcanmotor/mit_batch.hpp>
+
+using namespace pcanmotor;
+
+#define MAX_MOTORS	64
+
+static const unsigned motors[] = { 1, 2, 4, 8, 12, 16, 24, 32, 48, 64 };
+
+static const mit::kernel kernels[] = {
+	mit::kernel::scalar, mit::kernel::sse2, mit::kernel::avx2,
+	mit::kernel::neon,
+};
+
+static float f[5][MAX_MOTORS];
+static uint32_t ids[MAX_MOTORS];
+static struct pcanfd_msg msgs[MAX_MOTORS];
+static struct pcanfd_msg replies[MAX_MOTORS];
+static float st[3][MAX_MOTORS];
+
+static double now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* returns the best time (ns) of one batch over 5 runs of iters batches */
+static double bench(mit::kernel k, unsigned n, unsigned iters, bool decode)
+{
+	const mit::commands_soa in = { f[0], f[1], f[2], f[3], f[4] };
+	const mit::states_soa out = { st[0], st[1], st[2] };
+	static mit::batch_decoder<> dec;
+	double best = 0;
+
+	while (dec.motors() < MAX_MOTORS)
+		dec.add_motor((uint8_t)(dec.motors() + 1));
+
+	for (int run = 0; run < 5; run++) {
+		double t0 = now_ns();
+
+		for (unsigned i = 0; i < iters; i++) {
+			if (decode)
+				dec.decode(k, replies, n, out);
+			else
+				mit::batch_codec<>::encode(k, in, ids, n, msgs);
+
+			/* don't let the compiler hoist the work out */
+			asm volatile("" : : "r"(msgs), "r"(st) : "memory");
+		}
+
+		double t = (now_ns() - t0) / iters;
+		if (!run || t < best)
+			best = t;
+	}
+
+	return best;
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned iters = argc > 1 ? strtoul(argv[1], NULL, 0) : 200000;
+	unsigned i, j;
+
+	srand(1);
+	for (i = 0; i < MAX_MOTORS; i++) {
+		ids[i] = i + 1;
+		for (j = 0; j < 5; j++)
+			f[j][i] = (float)(rand() - RAND_MAX / 2) / (RAND_MAX / 100);
+
+		replies[i].type = PCANFD_TYPE_CAN20_MSG;
+		replies[i].data_len = mit::REPLY_LEN;
+		replies[i].data[0] = (uint8_t)(i + 1);
+		for (j = 1; j < mit::REPLY_LEN; j++)
+			replies[i].data[j] = (uint8_t)rand();
+	}
+
+	printf("# best kernel: %s, %u iterations\n",
+		mit::kernel_name(mit::best_kernel()), iters);
+	printf("%-6s %-8s %6s %12s %12s %8s\n", "op", "kernel", "motors",
+		"ns/batch", "ns/motor", "speedup");
+
+	for (int decode = 0; decode < 2; decode++)
+		for (unsigned n : motors) {
+			double scalar = 0;
+
+			for (mit::kernel k : kernels) {
+				if (!mit::kernel_supported(k))
+					continue;
+
+				double t = bench(k, n, iters, decode);
+				if (k == mit::kernel::scalar)
+					scalar = t;
+
+				printf("%-6s %-8s %6u %12.1f %12.2f %8.2f\n",
+					decode ? "decode" : "encode", mit::kernel_name(k),
+					n, t, t / n, scalar / t);
+			}
+		}
+
+	return 0;
+}
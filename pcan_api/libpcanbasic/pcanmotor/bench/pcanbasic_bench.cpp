@@ -0,0 +1,502 @@
+/* SPDX-License-Identifier: LGPL-2.1-only */
+/*
+ * pcanbasic_bench.cpp - throughput and latency of libpcanbasic
+ *
+ * Measures, through the real library:
+ *   - the frames/s of CAN_Write(), CAN_WriteFD() and CAN_WriteMany(),
+ *   - the RX drain rate of CAN_Read() and CAN_ReadMany(), the difference
+ *     between CAN_Read() and CAN_ReadMany() of 1 frame being the cost of the
+ *     conversion to TPCANMsg,
+ *   - the same writes and reads with the tracer (PCAN_TRACE_STATUS) and the
+ *     logger (PCAN_LOG_STATUS, LOG_FUNCTION_ALL) on,
+ *   - the command -> reply round trip time against a MIT motor simulated
+ *     on the peer channel, replying at once (motor_sim.hpp, p50/p99/p999).
+ * The results are written as one JSON object, to track regressions between
+ * versions.
+ *
+ * The channel and its peer must see each other's frames. By default they
+ * are nodes of the in-process virtual bus (PCANBASIC_VIRTUAL, no driver
+ * needed). With -b pcan, the channels are the ones of the environment:
+ * pcan devices, SocketCAN, or the pcanfake shim with PCANFAKE_LOOPBACK=1.
+ *
+ * usage: pcanbasic_bench [-b virtual|pcan] [-c channel] [-p peer]
+ *                        [-n frames] [-r samples] [-F fd_bitrate] [-o file]
+ *   -b  backend (default virtual)
+ *   -c  channel handle (default 0x51: PCAN_USBBUS1)
+ *   -p  peer channel handle (default 0x52: PCAN_USBBUS2)
+ *   -n  frames of each throughput measure (default 100000)
+ *   -r  round trips measured (default 10000)
+ *   -F  bit rate string of the FD measures (default 500k/2M at 80 MHz)
+ *   -o  output file (default stdout)
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+
+#include <algorithm>
+#include <vector>
+
+#include <pcanmotor/channel.hpp>
+#include <pcanmotor/mit.hpp>
+#include <pcanmotor/motor_sim.hpp>
+#include <pcanmotor/rt.hpp>
+
+using namespace pcanmotor;
+
+#define BATCH		32		/* frames of a CAN_WriteMany() */
+#define READ_BATCH	64		/* frames of a CAN_ReadMany() */
+#define DRAIN_FILL	1000	/* frames queued before a drain */
+#define LOG_FRAMES	10000	/* frames of the tracing/logging measures */
+#define RTT_TIMEOUT_MS	100
+#define MOTOR_ID	1
+#define VIRTUAL_ENV	"PCANBASIC_VIRTUAL"
+
+static char fd_bitrate_default[] = "f_clock_mhz=80, nom_brp=2, "
+	"nom_tseg1=63, nom_tseg2=16, nom_sjw=16, data_brp=2, data_tseg1=15, "
+	"data_tseg2=4, data_sjw=4";
+
+static TPCANHandle chan = PCAN_USBBUS1;
+static TPCANHandle peer = PCAN_USBBUS2;
+static FILE *out;
+
+/** Result of a throughput measure */
+struct result {
+	const char *name;
+	const char *api;
+	uint64_t frames;
+	uint64_t calls;
+	uint64_t retries;	/* calls that found the TX queue full */
+	int64_t ns;
+};
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-b virtual|pcan] [-c channel] [-p peer] "
+		"[-n frames] [-r samples] [-F fd_bitrate] [-o file]\n", name);
+	exit(2);
+}
+
+static void fail(const char *what, TPCANStatus sts)
+{
+	char text[256];
+
+	if (CAN_GetErrorText(sts, 0, text) != PCAN_ERROR_OK)
+		snprintf(text, sizeof(text), "error 0x%x", (unsigned)sts);
+	fprintf(stderr, "%s: %s\n", what, text);
+	exit(1);
+}
+
+static void init(bool fd, TPCANBitrateFD fd_bitrate)
+{
+	TPCANStatus sts;
+
+	CAN_Uninitialize(chan);
+	CAN_Uninitialize(peer);
+	if (fd) {
+		sts = CAN_InitializeFD(chan, fd_bitrate);
+		if (sts == PCAN_ERROR_OK)
+			sts = CAN_InitializeFD(peer, fd_bitrate);
+	}
+	else {
+		sts = CAN_Initialize(chan, PCAN_BAUD_500K, 0, 0, 0);
+		if (sts == PCAN_ERROR_OK)
+			sts = CAN_Initialize(peer, PCAN_BAUD_500K, 0, 0, 0);
+	}
+	if (sts != PCAN_ERROR_OK)
+		fail("initialization", sts);
+}
+
+static double ns_per_frame(const result &r)
+{
+	return r.frames ? (double)r.ns / r.frames : 0.;
+}
+
+static void json_results(const std::vector<result> &res)
+{
+	const char *sep = "";
+
+	fprintf(out, "  \"results\": [");
+	for (const result &r : res) {
+		const double s = r.ns * 1e-9;
+
+		fprintf(out, "%s\n    {\"name\": \"%s\", \"api\": \"%s\", "
+			"\"frames\": %llu, \"calls\": %llu, \"retries\": %llu, "
+			"\"seconds\": %.6f, \"frames_per_s\": %.1f, "
+			"\"ns_per_frame\": %.1f}", sep, r.name, r.api,
+			(unsigned long long)r.frames, (unsigned long long)r.calls,
+			(unsigned long long)r.retries, s, s > 0 ? r.frames / s : 0.,
+			ns_per_frame(r));
+		sep = ",";
+	}
+	fprintf(out, "\n  ],\n");
+}
+
+/* difference of the ns/frame of two measures */
+static double overhead(const std::vector<result> &res, const char *name,
+		const char *ref)
+{
+	double a = 0, b = 0;
+
+	for (const result &r : res) {
+		if (!strcmp(r.name, name))
+			a = ns_per_frame(r);
+		if (!strcmp(r.name, ref))
+			b = ns_per_frame(r);
+	}
+	return a - b;
+}
+
+/* CAN_Write() or CAN_WriteFD() of n frames, one per call */
+static result bench_write(const char *name, bool fd, uint64_t n)
+{
+	result r = { name, fd ? "CAN_WriteFD" : "CAN_Write", 0, 0, 0, 0 };
+	TPCANMsgFD mfd;
+	TPCANMsg m;
+	TPCANStatus sts;
+	int64_t t0;
+
+	memset(&m, 0, sizeof(m));
+	m.ID = 0x10;
+	m.LEN = 8;
+	memset(&mfd, 0, sizeof(mfd));
+	mfd.ID = 0x10;
+	mfd.MSGTYPE = PCAN_MESSAGE_FD | PCAN_MESSAGE_BRS;
+	mfd.DLC = 15;
+
+	t0 = rt::now_ns();
+	while (r.frames < n) {
+		m.DATA[0] = mfd.DATA[0] = (BYTE)r.frames;
+		sts = fd ? CAN_WriteFD(chan, &mfd) : CAN_Write(chan, &m);
+		r.calls++;
+		if (sts == PCAN_ERROR_OK)
+			r.frames++;
+		else if (sts == PCAN_ERROR_QXMTFULL)
+			r.retries++;
+		else
+			fail(r.api, sts);
+	}
+	r.ns = rt::now_ns() - t0;
+	flush(peer);
+	return r;
+}
+
+/* CAN_WriteMany() of n frames, BATCH per call */
+static result bench_write_many(const char *name, bool fd, uint64_t n)
+{
+	result r = { name, "CAN_WriteMany", 0, 0, 0, 0 };
+	msg_list<BATCH> l;
+	TPCANStatus sts;
+	unsigned i, todo, sent;
+	int64_t t0;
+
+	memset(&l, 0, sizeof(l));
+	for (i = 0; i < BATCH; i++) {
+		l.list[i].type = fd ? PCANFD_TYPE_CANFD_MSG : PCANFD_TYPE_CAN20_MSG;
+		l.list[i].flags = fd ? PCANFD_MSG_BRS : 0;
+		l.list[i].id = 0x10;
+		l.list[i].data_len = fd ? 64 : 8;
+	}
+
+	t0 = rt::now_ns();
+	while (r.frames < n) {
+		todo = (unsigned)std::min<uint64_t>(BATCH, n - r.frames);
+		l.count = todo;
+		sts = CAN_WriteMany(chan, l.msgs());
+		r.calls++;
+		sent = (sts == PCAN_ERROR_OK) ? todo : l.count;
+		if (sts == PCAN_ERROR_QXMTFULL)
+			r.retries++;
+		else if (sts != PCAN_ERROR_OK)
+			fail(r.api, sts);
+		r.frames += sent;
+	}
+	r.ns = rt::now_ns() - t0;
+	flush(peer);
+	return r;
+}
+
+/* fills the RX queue of the peer */
+static void fill_peer(unsigned n)
+{
+	TPCANMsg m;
+	TPCANStatus sts;
+	unsigned i;
+
+	memset(&m, 0, sizeof(m));
+	m.ID = 0x20;
+	m.LEN = 8;
+	for (i = 0; i < n; ) {
+		sts = CAN_Write(chan, &m);
+		if (sts == PCAN_ERROR_OK)
+			i++;
+		else if (sts != PCAN_ERROR_QXMTFULL)
+			fail("CAN_Write", sts);
+	}
+	/* let a real device put them on the bus */
+	usleep(20000);
+}
+
+/* drains n frames queued on the peer, batch 0 meaning CAN_Read() */
+static result bench_drain(const char *name, unsigned batch, uint64_t n)
+{
+	result r = { name, batch ? "CAN_ReadMany" : "CAN_Read", 0, 0, 0, 0 };
+	msg_list<READ_BATCH> l;
+	TPCANTimestamp ts;
+	TPCANMsg m;
+	TPCANStatus sts;
+	int64_t t0;
+
+	while (r.frames < n) {
+		fill_peer((unsigned)std::min<uint64_t>(DRAIN_FILL, n - r.frames));
+		t0 = rt::now_ns();
+		for (;;) {
+			if (batch) {
+				l.count = batch;
+				sts = CAN_ReadMany(peer, l.msgs());
+				if (sts == PCAN_ERROR_OK)
+					r.frames += l.count;
+			}
+			else {
+				sts = CAN_Read(peer, &m, &ts);
+				if (sts == PCAN_ERROR_OK)
+					r.frames++;
+			}
+			r.calls++;
+			if (sts == PCAN_ERROR_QRCVEMPTY)
+				break;
+			if (sts != PCAN_ERROR_OK)
+				fail(r.api, sts);
+		}
+		r.ns += rt::now_ns() - t0;
+	}
+	return r;
+}
+
+/* PCAN_TRACE_STATUS of both channels */
+static void set_trace(char *dir, bool on)
+{
+	DWORD v = on ? PCAN_PARAMETER_ON : PCAN_PARAMETER_OFF;
+	TPCANHandle h[2] = { chan, peer };
+
+	for (int i = 0; i < 2; i++) {
+		if (on)
+			CAN_SetValue(h[i], PCAN_TRACE_LOCATION, dir,
+				(DWORD)strlen(dir) + 1);
+		if (CAN_SetValue(h[i], PCAN_TRACE_STATUS, &v, sizeof(v)) !=
+				PCAN_ERROR_OK)
+			fprintf(stderr, "warning: failed to set the trace status\n");
+	}
+}
+
+static void set_log(char *dir, bool on)
+{
+	DWORD v = on ? PCAN_PARAMETER_ON : PCAN_PARAMETER_OFF;
+	DWORD cfg = LOG_FUNCTION_ALL;
+
+	if (on) {
+		CAN_SetValue(PCAN_NONEBUS, PCAN_LOG_LOCATION, dir,
+			(DWORD)strlen(dir) + 1);
+		CAN_SetValue(PCAN_NONEBUS, PCAN_LOG_CONFIGURE, &cfg, sizeof(cfg));
+	}
+	if (CAN_SetValue(PCAN_NONEBUS, PCAN_LOG_STATUS, &v, sizeof(v)) !=
+			PCAN_ERROR_OK)
+		fprintf(stderr, "warning: failed to set the log status\n");
+}
+
+static void remove_dir(const char *dir)
+{
+	struct dirent *ent;
+	char path[512];
+	DIR *d = opendir(dir);
+
+	if (d == NULL)
+		return;
+	while ((ent = readdir(d)) != NULL) {
+		if (ent->d_name[0] == '.')
+			continue;
+		snprintf(path, sizeof(path), "%s/%s", dir, ent->d_name);
+		unlink(path);
+	}
+	closedir(d);
+	rmdir(dir);
+}
+
+static double percentile(const std::vector<int64_t> &v, double p)
+{
+	size_t i;
+
+	if (v.empty())
+		return 0;
+	i = (size_t)(p * (v.size() - 1) + 0.5);
+	return v[i] / 1e3;
+}
+
+/* command -> reply round trips, one at a time */
+static void bench_rtt(unsigned samples)
+{
+	const int fd = receive_event(chan);
+	std::vector<int64_t> rtt;
+	mit::command cmd = { 0.f, 0.f, 0.f, 0.f, 0.f };
+	TPCANTimestamp ts;
+	TPCANMsg m, r;
+	sim_config sc;
+	rt::series s;
+	unsigned lost = 0, i;
+	int64_t t0, t;
+	bool replied;
+
+	/* no rotor model: the motor replies at once */
+	sc.step_ns = 0;
+	motor_sim<> motor(sc);
+
+	flush(chan);
+	flush(peer);
+	motor.add_motor(MOTOR_ID);
+	motor.attach(peer);
+	motor.start();
+	mit::codec<>::pack(m, MOTOR_ID, cmd);
+	rtt.reserve(samples);
+	for (i = 0; i < samples; i++) {
+		t0 = rt::now_ns();
+		if (CAN_Write(chan, &m) != PCAN_ERROR_OK) {
+			lost++;
+			continue;
+		}
+		replied = false;
+		while (!replied) {
+			while (CAN_Read(chan, &r, &ts) == PCAN_ERROR_OK) {
+				if (r.LEN == mit::REPLY_LEN && r.DATA[0] == MOTOR_ID)
+					replied = true;
+			}
+			if (replied)
+				break;
+			if (rt::now_ns() - t0 > RTT_TIMEOUT_MS * 1000000LL)
+				break;
+			if (fd >= 0)
+				wait_event(fd, RTT_TIMEOUT_MS);
+		}
+		t = rt::now_ns() - t0;
+		if (!replied) {
+			lost++;
+			continue;
+		}
+		rtt.push_back(t);
+		s.add(t);
+	}
+	motor.stop();
+
+	std::sort(rtt.begin(), rtt.end());
+	fprintf(out, "  \"rtt_us\": {\"samples\": %zu, \"lost\": %u, "
+		"\"min\": %.2f, \"mean\": %.2f, \"p50\": %.2f, \"p99\": %.2f, "
+		"\"p999\": %.2f, \"max\": %.2f}\n", rtt.size(), lost,
+		s.min / 1e3, s.mean() / 1e3, percentile(rtt, 0.5),
+		percentile(rtt, 0.99), percentile(rtt, 0.999), s.max / 1e3);
+}
+
+int main(int argc, char *argv[])
+{
+	const char *backend = "virtual";
+	TPCANBitrateFD fd_bitrate = fd_bitrate_default;
+	const char *output = NULL;
+	uint64_t n = 100000;
+	unsigned samples = 10000;
+	char version[256] = "";
+	char dir[] = "/tmp/pcanbasic_bench.XXXXXX";
+	char env[64];
+	std::vector<result> res;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "b:c:p:n:r:F:o:")) != -1) {
+		switch (opt) {
+		case 'b':
+			backend = optarg;
+			break;
+		case 'c':
+			chan = (TPCANHandle)strtoul(optarg, NULL, 0);
+			break;
+		case 'p':
+			peer = (TPCANHandle)strtoul(optarg, NULL, 0);
+			break;
+		case 'n':
+			n = strtoull(optarg, NULL, 0);
+			break;
+		case 'r':
+			samples = (unsigned)strtoul(optarg, NULL, 0);
+			break;
+		case 'F':
+			fd_bitrate = optarg;
+			break;
+		case 'o':
+			output = optarg;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (!n || chan == peer)
+		usage(argv[0]);
+	if (!strcmp(backend, "virtual")) {
+		snprintf(env, sizeof(env), "0x%x=bench,0x%x=bench", chan, peer);
+		setenv(VIRTUAL_ENV, env, 1);
+	}
+	else if (strcmp(backend, "pcan"))
+		usage(argv[0]);
+	if (mkdtemp(dir) == NULL) {
+		perror("mkdtemp");
+		return 1;
+	}
+	/* the messages of the library go to stderr, stdout only gets JSON */
+	out = output ? fopen(output, "w") : fdopen(dup(STDOUT_FILENO), "w");
+	dup2(STDERR_FILENO, STDOUT_FILENO);
+	if (out == NULL) {
+		perror(output);
+		return 1;
+	}
+	CAN_GetValue(PCAN_NONEBUS, PCAN_API_VERSION, version, sizeof(version));
+
+	init(false, NULL);
+	res.push_back(bench_write("write", false, n));
+	res.push_back(bench_write_many("write_many", false, n));
+	res.push_back(bench_drain("read", 0, n));
+	res.push_back(bench_drain("read_many_1", 1, n));
+	res.push_back(bench_drain("read_many", READ_BATCH, n));
+
+	/* tracing and logging, against the "write" and "read" measures */
+	set_trace(dir, true);
+	res.push_back(bench_write("write_trace", false, LOG_FRAMES));
+	res.push_back(bench_drain("read_trace", 0, LOG_FRAMES));
+	set_trace(dir, false);
+	set_log(dir, true);
+	res.push_back(bench_write("write_log", false, LOG_FRAMES));
+	res.push_back(bench_drain("read_log", 0, LOG_FRAMES));
+	set_log(dir, false);
+	remove_dir(dir);
+
+	init(true, fd_bitrate);
+	res.push_back(bench_write("write_fd", true, n));
+	res.push_back(bench_write_many("write_many_fd", true, n));
+
+	fprintf(out, "{\n  \"bench\": \"pcanbasic_bench\",\n"
+		"  \"api_version\": \"%s\",\n  \"backend\": \"%s\",\n"
+		"  \"channel\": \"0x%x\",\n  \"peer\": \"0x%x\",\n",
+		version, backend, chan, peer);
+	json_results(res);
+	fprintf(out, "  \"overhead_ns_per_frame\": {\"read_conversion\": %.1f, "
+		"\"write_trace\": %.1f, \"read_trace\": %.1f, "
+		"\"write_log\": %.1f, \"read_log\": %.1f},\n",
+		overhead(res, "read", "read_many_1"),
+		overhead(res, "write_trace", "write"),
+		overhead(res, "read_trace", "read"),
+		overhead(res, "write_log", "write"),
+		overhead(res, "read_log", "read"));
+
+	init(false, NULL);
+	bench_rtt(samples);
+	fprintf(out, "}\n");
+
+	CAN_Uninitialize(PCAN_NONEBUS);
+	fclose(out);
+	return 0;
+}
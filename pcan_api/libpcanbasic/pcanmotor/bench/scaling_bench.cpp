@@ -0,0 +1,510 @@
+/* SPDX-License-Identifier: LGPL-2.1-only */
+/*
+ * scaling_bench.cpp - limits of the single-threaded CAN_Write/CAN_Read loop
+ *
+ * Sweeps the number of channels, the motors per channel, the loop rate and
+ * the frame format (CAN 2.0 at 1 Mbit/s or CAN FD with BRS at 1/5 Mbit/s)
+ * and runs, at each point, the loop of the Python tests and of most
+ * applications: one thread that, every period, writes the command of each
+ * motor of each channel with one CAN_Write()/CAN_WriteFD() and then reads
+ * the replies with CAN_Read()/CAN_ReadFD() until they all came or the
+ * period is over (the thread sleeps in poll() on the receive events).
+ *
+ * The motors are simulated (motor_sim.hpp, at their setpoint and replying at
+ * once) on the other nodes of virtual buses paced at their bit rates
+ * (PCANBASIC_VIRTUAL_PACING=1): frames take their wire time, stuff bits
+ * included. The motors are enabled before the measure, so that a reply
+ * echoes the position of its command, which tells the cycle it answers:
+ * late replies are not counted in the next cycle.
+ *
+ * Each point gives:
+ *   - the achieved rate: cycles whose replies all came in time, per second,
+ *   - the deadline misses (cycles with missing replies) and the overruns
+ *     (periods skipped because the previous cycle was too long),
+ *   - the CPU of the loop thread (the load of its core) and the CPU of the
+ *     other threads (simulated motors, virtual buses) per channel, in % of
+ *     the duration,
+ *   - the bus load modelled from the wire time of the frames of a cycle,
+ * and why it failed: "bus" when the modelled load is above 100%, "cpu"
+ * when the loop thread never sleeps, "late" otherwise (scheduling).
+ * The last table gives, for each format, number of channels and number of
+ * motors, the highest rate that ran without miss.
+ *
+ * usage: scaling_bench [-c channels] [-m motors] [-r rates] [-f formats]
+ *                      [-d seconds] [-C cpu]
+ *   -c  list of channel counts (default 1,2,3,4)
+ *   -m  list of motors per channel (default 1,2,4,8,12,16)
+ *   -r  list of loop rates in Hz (default 100,250,500,1000,2000,4000)
+ *   -f  formats: classic, fd or classic,fd (default)
+ *   -d  duration of each point (default 0.5 s)
+ *   -C  CPU of the loop thread (default none)
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <poll.h>
+
+#include <memory>
+#include <vector>
+
+#include <pcanmotor/channel.hpp>
+#include <pcanmotor/mit.hpp>
+#include <pcanmotor/motor_sim.hpp>
+#include <pcanmotor/rt.hpp>
+
+using namespace pcanmotor;
+
+#define MAX_CHANNELS	4
+#define MAX_MOTORS	16
+#define ENABLE_MS	100	/* replies of the enter frames awaited */
+#define CYCLE_TAGS	16	/* cycle number modulo, carried by p */
+#define MISS_RATIO	0.001	/* misses allowed at a "ok" point */
+#define BUSY_CPU	90.	/* % of CPU of a loop that never sleeps */
+#define VIRTUAL_ENV	"PCANBASIC_VIRTUAL"
+#define PACING_ENV	"PCANBASIC_VIRTUAL_PACING"
+
+/* nodes of the host (0x51..0x54) and of the motors (0x55..0x58) */
+#define HOST_HANDLE(c)	((TPCANHandle)(PCAN_USBBUS1 + (c)))
+#define MOTOR_HANDLE(c)	((TPCANHandle)(PCAN_USBBUS5 + (c)))
+
+#define NOM_BITRATE	1000000
+#define DATA_BITRATE	5000000
+
+/* 1 Mbit/s, 5 Mbit/s at 80 MHz */
+static char fd_bitrate[] = "f_clock_mhz=80, nom_brp=1, nom_tseg1=59, "
+	"nom_tseg2=20, nom_sjw=20, data_brp=1, data_tseg1=11, data_tseg2=4, "
+	"data_sjw=4";
+
+typedef mit::codec<> C;
+
+/** A point of the sweep */
+struct point {
+	bool fd;
+	unsigned channels;
+	unsigned motors;
+	unsigned hz;
+};
+
+/** What was measured at a point */
+struct outcome {
+	uint64_t cycles;	/* periods run */
+	uint64_t complete;	/* cycles with all the replies in time */
+	uint64_t misses;	/* cycles with missing replies */
+	uint64_t overruns;	/* periods skipped */
+	uint64_t tx_full;	/* commands refused by CAN_Write() */
+	double seconds;
+	double loop_cpu;	/* % */
+	double sim_cpu;		/* % of the other threads, per channel */
+	double load;		/* modelled bus load, % */
+};
+
+static FILE *out;
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-c channels] [-m motors] [-r rates] "
+		"[-f classic,fd] [-d seconds] [-C cpu]\n", name);
+	exit(2);
+}
+
+static void fail(const char *what, TPCANStatus sts)
+{
+	char text[256];
+
+	if (CAN_GetErrorText(sts, 0, text) != PCAN_ERROR_OK)
+		snprintf(text, sizeof(text), "error 0x%x", (unsigned)sts);
+	fprintf(stderr, "%s: %s\n", what, text);
+	exit(1);
+}
+
+/* "1,2,4" */
+static std::vector<unsigned> parse_list(const char *s, unsigned min,
+		unsigned max)
+{
+	std::vector<unsigned> v;
+	char *end;
+
+	while (*s) {
+		const unsigned long n = strtoul(s, &end, 0);
+
+		if (end == s || n < min || n > max)
+			return std::vector<unsigned>();
+		v.push_back((unsigned)n);
+		s = (*end == ',') ? end + 1 : end;
+	}
+	return v;
+}
+
+static int64_t cpu_ns(clockid_t clock)
+{
+	struct timespec ts;
+
+	clock_gettime(clock, &ts);
+	return ts.tv_sec * rt::NSEC_PER_SEC + ts.tv_nsec;
+}
+
+static void init(const point &pt)
+{
+	TPCANStatus sts = PCAN_ERROR_OK;
+	unsigned c, i;
+
+	for (c = 0; c < pt.channels && sts == PCAN_ERROR_OK; c++) {
+		for (i = 0; i < 2 && sts == PCAN_ERROR_OK; i++) {
+			const TPCANHandle h = i ? MOTOR_HANDLE(c) : HOST_HANDLE(c);
+
+			sts = pt.fd ? CAN_InitializeFD(h, fd_bitrate) :
+				CAN_Initialize(h, PCAN_BAUD_1M, 0, 0, 0);
+		}
+	}
+	if (sts != PCAN_ERROR_OK)
+		fail("initialization", sts);
+}
+
+/* modelled bus load of a channel, commands and replies */
+static double bus_load(const point &pt)
+{
+	struct pcanfd_msg cmd, rep;
+	const mit::command c = { 0.f, 0.f, 10.f, 1.f, 0.f };
+	UINT64 cmd_ns = 0, rep_ns = 0;
+
+	memset(&cmd, 0, sizeof(cmd));
+	cmd.type = pt.fd ? PCANFD_TYPE_CANFD_MSG : PCANFD_TYPE_CAN20_MSG;
+	cmd.flags = pt.fd ? PCANFD_MSG_BRS : 0;
+	cmd.id = 1;
+	cmd.data_len = mit::CMD_LEN;
+	C::pack(cmd.data, c);
+	rep = cmd;
+	rep.id = 0;
+	rep.data_len = mit::REPLY_LEN;
+	C::pack_reply(rep.data, 1, 0., 0., 0.);
+
+	CAN_GetFrameTime(&cmd, NOM_BITRATE, pt.fd ? DATA_BITRATE : 0,
+		PCAN_PARAMETER_OFF, &cmd_ns);
+	CAN_GetFrameTime(&rep, NOM_BITRATE, pt.fd ? DATA_BITRATE : 0,
+		PCAN_PARAMETER_OFF, &rep_ns);
+	return 100. * (cmd_ns + rep_ns) * pt.motors * pt.hz / rt::NSEC_PER_SEC;
+}
+
+/* enters the motor mode of the motors of channel c, flushes the replies */
+static void enable(const point &pt, unsigned c, int fd)
+{
+	const TPCANHandle h = HOST_HANDLE(c);
+	const int64_t end = rt::now_ns() + ENABLE_MS * 1000000LL;
+	unsigned m, replies = 0;
+	TPCANMsg msg;
+
+	for (m = 1; m <= pt.motors; m++) {
+		mit::pack_mode(msg, m, mit::mode::enter);
+		const TPCANStatus sts = CAN_Write(h, &msg);
+
+		if (sts != PCAN_ERROR_OK)
+			fail("motor mode", sts);
+	}
+	while (replies < pt.motors && rt::now_ns() < end) {
+		if (fd < 0)
+			usleep(100);
+		else
+			wait_event(fd, 10);
+		replies += flush(h);
+	}
+	if (replies < pt.motors) {
+		fprintf(stderr, "motor mode: %u of %u replies\n", replies,
+			pt.motors);
+		exit(1);
+	}
+}
+
+/* cycle tag of the command/reply position */
+static unsigned tag_of(float p)
+{
+	return (unsigned)lrintf(p) % CYCLE_TAGS;
+}
+
+/* reads the replies of channel c, returns the ones of this cycle */
+static unsigned read_replies(const point &pt, unsigned c, unsigned tag,
+		uint32_t &replied)
+{
+	const TPCANHandle h = HOST_HANDLE(c);
+	unsigned n = 0;
+	mit::reply rep;
+
+	for (;;) {
+		if (pt.fd) {
+			TPCANMsgFD m;
+			TPCANTimestampFD ts;
+
+			if (CAN_ReadFD(h, &m, &ts) != PCAN_ERROR_OK)
+				break;
+			if (!C::unpack(m, rep))
+				continue;
+		} else {
+			TPCANMsg m;
+			TPCANTimestamp ts;
+
+			if (CAN_Read(h, &m, &ts) != PCAN_ERROR_OK)
+				break;
+			if (!C::unpack(m, rep))
+				continue;
+		}
+		if (rep.id == 0 || rep.id > pt.motors || tag_of(rep.p) != tag)
+			continue;
+		if (!(replied & (1U << rep.id))) {
+			replied |= 1U << rep.id;
+			n++;
+		}
+	}
+	return n;
+}
+
+static outcome run_point(const point &pt, double duration, int cpu)
+{
+	outcome o;
+	std::unique_ptr<motor_sim<>> sims[MAX_CHANNELS];
+	struct pollfd pfds[MAX_CHANNELS];
+	uint32_t replied[MAX_CHANNELS];
+	rt::periodic timer(rt::NSEC_PER_SEC / pt.hz);
+	rt::thread_config tc;
+	int64_t t0, end, cpu0, proc0, now, deadline;
+	unsigned c, m, tag, left, refused;
+
+	memset(&o, 0, sizeof(o));
+	init(pt);
+	tc.priority = 0;
+	tc.cpu = cpu;
+	tc.lock_memory = false;
+	rt::setup_thread(tc);
+
+	/* no rotor model: the motors are at their setpoint, reply at once */
+	sim_config sc;
+
+	sc.step_ns = 0;
+	for (c = 0; c < pt.channels; c++) {
+		sims[c].reset(new motor_sim<>(sc));
+		for (m = 1; m <= pt.motors; m++)
+			sims[c]->add_motor(m);
+		sims[c]->attach(MOTOR_HANDLE(c));
+		sims[c]->start();
+		pfds[c].fd = receive_event(HOST_HANDLE(c));
+		pfds[c].events = POLLIN;
+		enable(pt, c, pfds[c].fd);
+	}
+
+	cpu0 = cpu_ns(CLOCK_THREAD_CPUTIME_ID);
+	proc0 = cpu_ns(CLOCK_PROCESS_CPUTIME_ID);
+	timer.start();
+	t0 = timer.next();
+	end = t0 + (int64_t)(duration * rt::NSEC_PER_SEC);
+	while (timer.next() < end) {
+		o.overruns += timer.wait();
+		deadline = timer.next();
+		tag = (unsigned)(o.cycles++ % CYCLE_TAGS);
+		left = refused = 0;
+
+		for (c = 0; c < pt.channels; c++) {
+			const TPCANHandle h = HOST_HANDLE(c);
+			const mit::command cmd = { (float)tag, 0.f, 10.f, 1.f, 0.f };
+
+			replied[c] = 0;
+			for (m = 1; m <= pt.motors; m++) {
+				TPCANStatus sts;
+
+				if (pt.fd) {
+					TPCANMsgFD msg;
+
+					C::pack(msg, m, cmd);
+					msg.MSGTYPE |= PCAN_MESSAGE_FD | PCAN_MESSAGE_BRS;
+					sts = CAN_WriteFD(h, &msg);
+				} else {
+					TPCANMsg msg;
+
+					C::pack(msg, m, cmd);
+					sts = CAN_Write(h, &msg);
+				}
+				if (sts == PCAN_ERROR_OK)
+					left++;
+				else
+					refused++;
+			}
+		}
+
+		while (left) {
+			for (c = 0; c < pt.channels; c++)
+				left -= read_replies(pt, c, tag, replied[c]);
+			if (!left)
+				break;
+
+			now = rt::now_ns();
+			if (now >= deadline)
+				break;
+
+			const struct timespec ts = rt::to_timespec(deadline - now);
+
+			ppoll(pfds, pt.channels, &ts, NULL);
+		}
+		o.tx_full += refused;
+		if (left || refused)
+			o.misses++;
+		else
+			o.complete++;
+	}
+	/* periods run, up to the end of the last one */
+	o.seconds = (timer.next() - t0) * 1e-9;
+	const int64_t loop_ns = cpu_ns(CLOCK_THREAD_CPUTIME_ID) - cpu0;
+	const int64_t all_ns = cpu_ns(CLOCK_PROCESS_CPUTIME_ID) - proc0;
+
+	o.loop_cpu = 100. * loop_ns * 1e-9 / o.seconds;
+	o.sim_cpu = 100. * (all_ns - loop_ns) * 1e-9 / o.seconds / pt.channels;
+
+	for (c = 0; c < pt.channels; c++)
+		sims[c]->stop();
+	o.load = bus_load(pt);
+
+	for (c = 0; c < pt.channels; c++) {
+		CAN_Uninitialize(HOST_HANDLE(c));
+		CAN_Uninitialize(MOTOR_HANDLE(c));
+	}
+	return o;
+}
+
+static bool point_ok(const outcome &o)
+{
+	return o.cycles && !o.tx_full &&
+		o.misses + o.overruns <= MISS_RATIO * (o.cycles + o.overruns);
+}
+
+static const char *verdict(const outcome &o)
+{
+	if (point_ok(o))
+		return "ok";
+	if (o.load > 100.)
+		return "bus";
+	if (o.loop_cpu > BUSY_CPU)
+		return "cpu";
+	return "late";
+}
+
+int main(int argc, char *argv[])
+{
+	std::vector<unsigned> channels = { 1, 2, 3, 4 };
+	std::vector<unsigned> motors = { 1, 2, 4, 8, 12, 16 };
+	std::vector<unsigned> rates = { 100, 250, 500, 1000, 2000, 4000 };
+	std::vector<bool> formats = { false, true };
+	std::vector<point> points;
+	std::vector<outcome> outcomes;
+	double duration = 0.5;
+	int cpu = -1;
+	char env[256];
+	int opt;
+	size_t len = 0;
+	unsigned c;
+
+	while ((opt = getopt(argc, argv, "c:m:r:f:d:C:")) != -1) {
+		switch (opt) {
+		case 'c':
+			channels = parse_list(optarg, 1, MAX_CHANNELS);
+			break;
+		case 'm':
+			motors = parse_list(optarg, 1, MAX_MOTORS);
+			break;
+		case 'r':
+			rates = parse_list(optarg, 1, 100000);
+			break;
+		case 'f':
+			if (!strcmp(optarg, "classic"))
+				formats = { false };
+			else if (!strcmp(optarg, "fd"))
+				formats = { true };
+			else if (strcmp(optarg, "classic,fd"))
+				usage(argv[0]);
+			break;
+		case 'd':
+			duration = strtod(optarg, NULL);
+			break;
+		case 'C':
+			cpu = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (channels.empty() || motors.empty() || rates.empty() ||
+			duration <= 0)
+		usage(argv[0]);
+
+	/* one paced virtual bus per channel, the host and its motors */
+	for (c = 0; c < MAX_CHANNELS; c++)
+		len += snprintf(env + len, sizeof(env) - len, "%s0x%x=scale%u,"
+			"0x%x=scale%u", c ? "," : "", HOST_HANDLE(c), c,
+			MOTOR_HANDLE(c), c);
+	setenv(VIRTUAL_ENV, env, 1);
+	setenv(PACING_ENV, "1", 1);
+
+	/* the messages of the library go to stderr, stdout only gets tables */
+	out = fdopen(dup(STDOUT_FILENO), "w");
+	dup2(STDERR_FILENO, STDOUT_FILENO);
+	if (out == NULL) {
+		perror("stdout");
+		return 1;
+	}
+
+	for (bool fd : formats)
+		for (unsigned nc : channels)
+			for (unsigned nm : motors)
+				for (unsigned hz : rates)
+					points.push_back({ fd, nc, nm, hz });
+
+	fprintf(out, "# %zu points of %.2f s, %s\n", points.size(), duration,
+		"CAN 2.0 1M, CAN FD 1M/5M BRS, 8-byte commands, 6-byte replies");
+	fprintf(out, "%-7s %2s %6s %5s %7s %9s %8s %8s %7s %7s %6s %s\n",
+		"format", "ch", "motors", "hz", "load%", "achieved", "misses", "overrun",
+		"txfull", "loop%", "sim%", "verdict");
+	fflush(out);
+
+	for (const point &pt : points) {
+		const outcome o = run_point(pt, duration, cpu);
+
+		outcomes.push_back(o);
+		fprintf(out, "%-7s %2u %6u %5u %7.1f %9.1f %8llu %8llu %7llu "
+			"%7.1f %6.1f %s\n", pt.fd ? "fd" : "classic", pt.channels,
+			pt.motors, pt.hz, o.load, o.complete / o.seconds,
+			(unsigned long long)o.misses,
+			(unsigned long long)o.overruns,
+			(unsigned long long)o.tx_full, o.loop_cpu, o.sim_cpu,
+			verdict(o));
+		fflush(out);
+	}
+
+	/* highest rate without miss of each format/channels/motors */
+	fprintf(out, "\n# highest rate without miss (Hz), motors per channel:\n");
+	fprintf(out, "%-7s %2s", "format", "ch");
+	for (unsigned nm : motors)
+		fprintf(out, " %6u", nm);
+	fprintf(out, "\n");
+	for (bool fd : formats) {
+		for (unsigned nc : channels) {
+			fprintf(out, "%-7s %2u", fd ? "fd" : "classic", nc);
+			for (unsigned nm : motors) {
+				unsigned best = 0;
+
+				for (size_t i = 0; i < points.size(); i++) {
+					const point &pt = points[i];
+
+					if (pt.fd == fd && pt.channels == nc &&
+						pt.motors == nm && pt.hz > best &&
+						point_ok(outcomes[i]))
+						best = pt.hz;
+				}
+				if (best)
+					fprintf(out, " %6u", best);
+				else
+					fprintf(out, " %6s", "-");
+			}
+			fprintf(out, "\n");
+		}
+	}
+
+	CAN_Uninitialize(PCAN_NONEBUS);
+	fclose(out);
+	return 0;
+}
@@ -0,0 +1,180 @@
+/* SPDX-License-Identifier: LGPL-2.1-only */
+/*
+ * tx_lanes_bench.cpp - emergency stop latency under full bus load
+ *
+ * Simulates (1 us steps) a channel at 1 Mbit/s: the driver TX FIFO, the
+ * bus (worst-case stuffed 8-byte classic frames, 135 us) and a control
+ * loop sending the commands of 12 motors at 500 Hz plus parameter reads,
+ * with bursts of bulk frames every 100 ms (about 95% of the bus, up to
+ * overload during the bursts). Exit frames (e-stop) are pushed at random
+ * times and their latency is measured from the push to the end of the
+ * frame on the bus, for:
+ *   fifo:   every frame written straight to the driver FIFO,
+ *   1 lane: deadline_tx with all the frames in one lane,
+ *   lanes:  deadline_tx with the safety/control/bulk lanes.
+ *
+ * The CAN_GetValue()/CAN_WriteMany() functions of the library are replaced
+ * by the simulated driver, this program is not linked with libpcanbasic.
+ *
+ * usage: tx_lanes_bench [seconds] [depth]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <deque>
+#include <vector>
+
+#include <pcanmotor/deadline_tx.hpp>
+
+using namespace pcanmotor;
+
+#define MOTORS		12
+#define PERIOD_US	2000
+#define BULK_PER_CYCLE	2
+#define BURST_US	100000
+#define BURST_FRAMES	40
+#define FRAME_US	135	/* 8 data bytes, standard id, worst stuffing */
+#define POLL_US		50	/* refill period of the driver queue */
+
+/* simulated driver and bus */
+static struct {
+	int64_t now;
+	std::deque<struct pcanfd_msg> fifo;
+	int64_t busy_until;
+	bool busy;
+} sim;
+
+TPCANStatus CAN_GetValue(TPCANHandle, TPCANParameter param, void *buf, DWORD)
+{
+	if (param != PCAN_TX_PENDING_MSGS)
+		return PCAN_ERROR_UNKNOWN;
+
+	*(__u32 *)buf = (__u32)sim.fifo.size();
+	return PCAN_ERROR_OK;
+}
+
+/* not inlined: the list is a msg_list<N>, larger than struct pcanfd_msgs */
+__attribute__((noinline))
+TPCANStatus CAN_WriteMany(TPCANHandle, struct pcanfd_msgs *msgs)
+{
+	for (unsigned i = 0; i < msgs->count; i++)
+		sim.fifo.push_back(msgs->list[i]);
+	return PCAN_ERROR_OK;
+}
+
+enum scenario { FIFO, ONE_LANE, LANES };
+
+static const char *names[] = { "fifo", "1 lane", "lanes" };
+
+static struct pcanfd_msg frame(uint32_t id, uint8_t tag)
+{
+	struct pcanfd_msg msg;
+
+	memset(&msg, 0, sizeof(msg));
+	msg.type = PCANFD_TYPE_CAN20_MSG;
+	msg.id = id;
+	msg.data_len = mit::CMD_LEN;
+	msg.data[0] = tag;
+	return msg;
+}
+
+/* returns the e-stop latencies (us) */
+static std::vector<int64_t> run(scenario sc, int64_t duration, unsigned depth)
+{
+	deadline_tx<64> q(PCAN_USBBUS1, depth);
+	std::vector<int64_t> lat;
+	std::vector<int64_t> pushed;	/* push time of the pending e-stops */
+	int64_t next_estop = 1000;
+
+	sim.now = 0;
+	sim.fifo.clear();
+	sim.busy = false;
+	srand(1);
+
+	auto push = [&](const struct pcanfd_msg &msg, int64_t deadline,
+			tx_lane ln) {
+		if (sc == FIFO) {
+			sim.fifo.push_back(msg);
+			return;
+		}
+		q.push(msg, deadline, sc == ONE_LANE ? tx_lane::control : ln);
+	};
+
+	for (sim.now = 0; sim.now < duration; sim.now++) {
+		const int64_t t = sim.now;
+		bool pump = t % POLL_US == 0;
+
+		/* bus: end of the frame on the wire, start of the next one */
+		if (sim.busy && t >= sim.busy_until) {
+			const struct pcanfd_msg &msg = sim.fifo.front();
+
+			if (mit::is_mode(msg.data, msg.data_len)) {
+				lat.push_back(t - pushed.front());
+				pushed.erase(pushed.begin());
+			}
+			sim.fifo.pop_front();
+			sim.busy = false;
+		}
+		if (!sim.busy && !sim.fifo.empty()) {
+			sim.busy = true;
+			sim.busy_until = t + FRAME_US;
+		}
+
+		if (t % PERIOD_US == 0) {
+			for (unsigned m = 1; m <= MOTORS; m++)
+				push(frame(m, (uint8_t)t), t + PERIOD_US,
+					tx_lane::control);
+			for (unsigned b = 0; b < BULK_PER_CYCLE; b++)
+				push(frame(0x100 + b, 0), 0, tx_lane::bulk);
+			pump = true;
+		}
+		if (t % BURST_US == BURST_US / 2)
+			for (unsigned b = 0; b < BURST_FRAMES; b++)
+				push(frame(0x200 + b, 0), 0, tx_lane::bulk);
+
+		if (t >= next_estop) {
+			struct pcanfd_msg msg = frame(1 + rand() % MOTORS, 0);
+
+			mit::pack_mode(msg.data, mit::mode::exit);
+			pushed.push_back(t);
+			push(msg, 0, tx_lane::safety);
+			next_estop = t + 1000 + rand() % 5000;
+			pump = true;
+		}
+
+		if (pump && sc != FIFO)
+			q.pump(t);
+	}
+
+	return lat;
+}
+
+int main(int argc, char *argv[])
+{
+	const int64_t duration = (argc > 1 ? atoi(argv[1]) : 20) * 1000000LL;
+	const unsigned depth = argc > 2 ? atoi(argv[2]) : 2;
+
+	printf("# %u motors at %u Hz + %u bulk frames/cycle + %u every %u ms, "
+		"%u us frames, driver depth %u\n", MOTORS, 1000000 / PERIOD_US,
+		BULK_PER_CYCLE, BURST_FRAMES, BURST_US / 1000, FRAME_US, depth);
+	printf("%-8s %8s %10s %10s %10s %10s\n", "tx", "e-stops", "mean us",
+		"p99 us", "max us", "frames");
+
+	for (scenario sc : { FIFO, ONE_LANE, LANES }) {
+		std::vector<int64_t> lat = run(sc, duration, depth);
+		double sum = 0;
+
+		std::sort(lat.begin(), lat.end());
+		for (int64_t l : lat)
+			sum += l;
+
+		printf("%-8s %8zu %10.0f %10lld %10lld %10.1f\n", names[sc],
+			lat.size(), lat.empty() ? 0 : sum / lat.size(),
+			lat.empty() ? 0 : (long long)lat[lat.size() * 99 / 100],
+			lat.empty() ? 0 : (long long)lat.back(),
+			lat.empty() ? 0 : (double)lat.back() / FRAME_US);
+	}
+
+	return 0;
+}
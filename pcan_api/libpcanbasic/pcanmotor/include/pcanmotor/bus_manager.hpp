@@ -0,0 +1,183 @@
+/* SPDX-License-Identifier: LGPL-2.1-only */
+/*
+ * @file bus_manager.hpp
+ * @brief Control loop of the motors of several PCAN channels
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Each channel is served by its own worker thread (real-time and pinned as
+ * given by its loop_config). All the workers share the same period
+ * schedule. Each cycle, a worker:
+ *   1. waits for the start of the period,
+ *   2. waits for the other workers at a spin barrier; the last one to
+ *      arrive calls the controller, which sees the states of all the
+ *      channels and writes the commands of all the channels,
+ *   3. sends the commands of its channel and collects their replies until
+ *      the reply deadline (see control_loop).
+ * The channels are driven in parallel, so that the cycle time is the one
+ * of the busiest channel and not the sum of all of them.
+ */
+#ifndef PCANMOTOR_BUS_MANAGER_HPP_
+#define PCANMOTOR_BUS_MANAGER_HPP_
+
+#include <memory>
+
+#include <pcanmotor/control_loop.hpp>
+
+namespace pcanmotor {
+
+template <class Limits = mit::ak10_9, unsigned MaxMotors = 32,
+	unsigned MaxChannels = 4>
+class bus_manager {
+public:
+	typedef control_loop<Limits, MaxMotors> loop;
+	typedef std::function<void(bus_manager &)> controller;
+
+	/**
+	 * @param period_ns Period of every channel
+	 * @param reply_deadline_ns Reply deadline of every channel, 0 for 80%
+	 * 	of the period
+	 * @param clock Source of the wake-ups
+	 */
+	explicit bus_manager(int64_t period_ns, int64_t reply_deadline_ns = 0,
+			rt::clock_source clock = rt::clock_source::nanosleep)
+		: period_(period_ns), deadline_(reply_deadline_ns), clock_(clock),
+		  channels_(0), running_(false), go_(false) {}
+
+	~bus_manager() { stop(); }
+
+	bus_manager(const bus_manager &) = delete;
+	bus_manager &operator=(const bus_manager &) = delete;
+
+	/**
+	 * @brief Adds a channel (before start()). Its period, reply deadline
+	 * and clock are the ones of the manager.
+	 *
+	 * @return the index of the channel or -1 if full or running.
+	 */
+	int add_channel(loop_config cfg) {
+		if (channels_ >= MaxChannels || running_)
+			return -1;
+
+		cfg.period_ns = period_;
+		cfg.reply_deadline_ns = deadline_;
+		cfg.clock = clock_;
+		loops_[channels_].reset(new loop(cfg));
+		return channels_++;
+	}
+
+	unsigned channels() const { return channels_; }
+	loop &channel(unsigned i) { return *loops_[i]; }
+	const loop &channel(unsigned i) const { return *loops_[i]; }
+
+	/**
+	 * @brief Starts one worker per channel.
+	 *
+	 * @param ctrl Controller, called once per cycle by one of the workers
+	 * @return PCAN_ERROR_OK, PCAN_ERROR_ILLOPERATION if running or without
+	 * 	channel, or the status of control_loop::open() of the first
+	 * 	channel which failed.
+	 */
+	TPCANStatus start(controller ctrl) {
+		unsigned i;
+
+		if (running_ || !channels_)
+			return PCAN_ERROR_ILLOPERATION;
+
+		for (i = 0; i < channels_; i++) {
+			TPCANStatus sts = loops_[i]->open();
+
+			if (sts != PCAN_ERROR_OK)
+				return sts;
+			loops_[i]->reset_stats();
+			barrier_wait_[i].reset();
+		}
+
+		ctrl_ = std::move(ctrl);
+		barrier_.reset(channels_);
+		running_ = true;
+		go_ = true;
+
+		/* every worker starts its schedule at the same time */
+		const int64_t first = rt::now_ns() + period_;
+		for (i = 0; i < channels_; i++)
+			threads_[i] = std::thread(&bus_manager::run, this, i, first);
+
+		return PCAN_ERROR_OK;
+	}
+
+	/** Stops the workers (at the end of the current cycle) */
+	void stop() {
+		running_ = false;
+		for (unsigned i = 0; i < channels_; i++)
+			if (threads_[i].joinable())
+				threads_[i].join();
+	}
+
+	bool running() const { return running_; }
+
+	/** Number of cycles run so far (may be read at any time) */
+	uint64_t cycles() const {
+		return channels_ ? loops_[0]->cycles() : 0;
+	}
+
+	/**
+	 * @brief Time from the start of the period to the release of the
+	 * barrier, for the worker of a channel; may only be read from the
+	 * controller or when stopped.
+	 */
+	const rt::series &barrier_wait(unsigned i) const {
+		return barrier_wait_[i];
+	}
+
+private:
+	void run(unsigned i, int64_t first) {
+		loop &l = *loops_[i];
+		rt::periodic timer(period_, clock_);
+
+		l.prepare(timer, first);
+		for (;;) {
+			const int64_t start = l.wait(timer);
+
+			/* the last worker decides for all whether to go on, so
+			 * that none of them is left alone in the barrier */
+			barrier_.arrive_and_wait([this] {
+				go_.store(running_.load(std::memory_order_relaxed),
+					std::memory_order_relaxed);
+				if (go_.load(std::memory_order_relaxed) && ctrl_)
+					ctrl_(*this);
+			});
+			barrier_wait_[i].add(rt::now_ns() - start);
+			if (!go_.load(std::memory_order_relaxed))
+				break;
+
+			l.send(start);
+			l.collect(start, start + l.config().reply_deadline_ns);
+			l.end_cycle(start, timer.next());
+		}
+	}
+
+	int64_t period_;
+	int64_t deadline_;
+	rt::clock_source clock_;
+	unsigned channels_;
+	std::unique_ptr<loop> loops_[MaxChannels];
+	std::thread threads_[MaxChannels];
+	rt::series barrier_wait_[MaxChannels];
+	rt::spin_barrier barrier_;
+	controller ctrl_;
+	std::atomic<bool> running_;
+	std::atomic<bool> go_;
+};
+
+} /* namespace pcanmotor */
+
+#endif /* PCANMOTOR_BUS_MANAGER_HPP_ */
@@ -0,0 +1,69 @@
+/* SPDX-License-Identifier: LGPL-2.1-only */
+/*
+ * @file channel.hpp
+ * @brief Receive event and RX queue helpers of a libpcanbasic channel
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+#ifndef PCANMOTOR_CHANNEL_HPP_
+#define PCANMOTOR_CHANNEL_HPP_
+
+#include <poll.h>
+
+#include <pcanmotor/msg_list.hpp>
+
+namespace pcanmotor {
+
+/**
+ * @brief Returns the fd of PCAN_RECEIVE_EVENT of an initialized channel,
+ * readable while frames are waiting, or -1 if the channel has none (it
+ * must then be polled).
+ */
+inline int receive_event(TPCANHandle h) {
+	int fd = -1;
+
+	if (CAN_GetValue(h, PCAN_RECEIVE_EVENT, &fd, sizeof(fd)) != PCAN_ERROR_OK)
+		return -1;
+	return fd;
+}
+
+/**
+ * @brief Waits until the receive event fd is readable.
+ *
+ * @return false at timeout.
+ */
+inline bool wait_event(int fd, int timeout_ms) {
+	struct pollfd pfd = { fd, POLLIN, 0 };
+
+	return poll(&pfd, 1, timeout_ms) > 0;
+}
+
+/**
+ * @brief Reads and drops every frame waiting in the RX queue of h.
+ *
+ * @return the number of frames dropped.
+ */
+inline unsigned flush(TPCANHandle h) {
+	msg_list<64> l;
+	unsigned n = 0;
+
+	for (;;) {
+		l.count = 64;
+		if (CAN_ReadMany(h, l.msgs()) != PCAN_ERROR_OK)
+			break;
+		n += l.count;
+	}
+	return n;
+}
+
+} /* namespace pcanmotor */
+
+#endif /* PCANMOTOR_CHANNEL_HPP_ */
@@ -0,0 +1,124 @@
+/* SPDX-License-Identifier: LGPL-2.1-only */
+/*
+ * @file command_cache.hpp
+ * @brief Suppression of the commands equal to the last acknowledged ones
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Holding a pose re-sends bit-identical frames every cycle. The cache
+ * keeps the last frame sent to each motor and whether the motor replied
+ * to it (a MIT motor replies to each command). A frame is suppressed when
+ * its payload equals the last one and that one was acknowledged, unless
+ *   - it was sent refresh_cycles cycles ago or more,
+ *   - or the motor watchdog would expire before the next chance to send.
+ */
+#ifndef PCANMOTOR_COMMAND_CACHE_HPP_
+#define PCANMOTOR_COMMAND_CACHE_HPP_
+
+#include <stdint.h>
+#include <string.h>
+
+#include <PCANBasic.h>
+
+namespace pcanmotor {
+
+template <unsigned MaxMotors>
+class command_cache {
+public:
+	/**
+	 * @param refresh_cycles Resend an unchanged frame at least every
+	 * 	refresh_cycles cycles (0: no suppression)
+	 * @param watchdog_ns Resend an unchanged frame before this time
+	 * 	elapsed since it was sent (0: no watchdog)
+	 */
+	explicit command_cache(unsigned refresh_cycles = 0, int64_t watchdog_ns = 0)
+		: refresh_(refresh_cycles), watchdog_(watchdog_ns), suppressed_(0) {
+		clear();
+	}
+
+	void configure(unsigned refresh_cycles, int64_t watchdog_ns) {
+		refresh_ = refresh_cycles;
+		watchdog_ = watchdog_ns;
+	}
+
+	bool enabled() const { return refresh_ > 0; }
+
+	/** Forgets every motor: their next frame is sent */
+	void clear() {
+		for (unsigned i = 0; i < MaxMotors; i++)
+			invalidate(i);
+	}
+
+	/** Forgets a motor (e.g. after a mode frame) */
+	void invalidate(unsigned slot) {
+		slots_[slot].len = 0;
+		slots_[slot].acked = false;
+	}
+
+	/**
+	 * @brief Tells whether msg must be sent to the motor of slot.
+	 *
+	 * @param cycle Number of the current cycle
+	 * @param next_ns Time of the next chance to send (CLOCK_MONOTONIC, ns)
+	 * @return false (and counts the frame as suppressed) if the frame can
+	 * 	be skipped.
+	 */
+	bool must_send(unsigned slot, const struct pcanfd_msg &msg,
+			uint64_t cycle, int64_t next_ns) {
+		const entry &e = slots_[slot];
+
+		if (!refresh_ || !e.acked || e.len != msg.data_len ||
+			memcmp(e.data, msg.data, msg.data_len) ||
+			cycle - e.cycle >= refresh_ ||
+			(watchdog_ && next_ns - e.sent_ns >= watchdog_))
+			return true;
+
+		suppressed_++;
+		return false;
+	}
+
+	/** Records that msg was given to the driver for the motor of slot */
+	void sent(unsigned slot, const struct pcanfd_msg &msg, uint64_t cycle,
+			int64_t now_ns) {
+		entry &e = slots_[slot];
+
+		e.len = msg.data_len;
+		memcpy(e.data, msg.data, msg.data_len);
+		e.cycle = cycle;
+		e.sent_ns = now_ns;
+		e.acked = false;
+	}
+
+	/** Records that the motor of slot replied */
+	void acked(unsigned slot) { slots_[slot].acked = true; }
+
+	/** Frames suppressed so far */
+	uint64_t suppressed() const { return suppressed_; }
+	void reset_stats() { suppressed_ = 0; }
+
+private:
+	struct entry {
+		uint8_t data[64];
+		uint8_t len;
+		bool acked;
+		uint64_t cycle;
+		int64_t sent_ns;
+	};
+
+	unsigned refresh_;
+	int64_t watchdog_;
+	uint64_t suppressed_;
+	entry slots_[MaxMotors];
+};
+
+} /* namespace pcanmotor */
+
+#endif /* PCANMOTOR_COMMAND_CACHE_HPP_ */
@@ -0,0 +1,608 @@
+/* SPDX-License-Identifier: LGPL-2.1-only */
+/*
+ * @file control_loop.hpp
+ * @brief Periodic real-time control loop of the motors of a PCAN channel
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Each cycle of the loop:
+ *   1. waits for the start of the period (clock_nanosleep() or timerfd),
+ *   2. calls the controller, which reads the states and writes the commands,
+ *   3. publishes the frames already in the RX queue (late replies, replies
+ *      to mode frames), so that they are not taken for replies to this
+ *      cycle's commands,
+ *   4. encodes the commands of all the motors and gives them to the driver
+ *      with one CAN_WriteMany() (or through the priority lanes of a
+ *      deadline_tx queue, which keeps the driver queue shallow and drops
+ *      stale commands),
+ *   5. drains the RX queue with CAN_ReadMany() (waiting with ppoll() on the
+ *      channel fd) until every motor replied or the reply deadline is
+ *      reached. The replies are also published in the state table attached
+ *      to the loop, if any.
+ * The loop runs in its own SCHED_FIFO thread, memory locked and optionally
+ * pinned on a CPU, and does not allocate once started.
+ */
+#ifndef PCANMOTOR_CONTROL_LOOP_HPP_
+#define PCANMOTOR_CONTROL_LOOP_HPP_
+
+#include <poll.h>
+
+#include <atomic>
+#include <functional>
+#include <thread>
+
+#include <pcanmotor/deadline_tx.hpp>
+#include <pcanmotor/command_cache.hpp>
+#include <pcanmotor/mit_batch.hpp>
+#include <pcanmotor/rt.hpp>
+#include <pcanmotor/state_table.hpp>
+
+namespace pcanmotor {
+
+/** Configuration of a control loop */
+struct loop_config {
+	TPCANHandle channel = PCAN_NONEBUS;
+	int64_t period_ns = 1000000;		/**< 1 kHz */
+	int64_t reply_deadline_ns = 0;		/**< 0: 80% of the period */
+	rt::clock_source clock = rt::clock_source::nanosleep;
+	rt::thread_config thread;
+	mit::kernel kernel = mit::kernel::best;
+	__u16 msg_type = PCANFD_TYPE_CAN20_MSG;	/**< type of the commands */
+	__u32 msg_flags = PCANFD_MSG_STD;	/**< flags of the commands */
+	unsigned tx_depth = 0;		/**< >0: deadline TX (deadline_tx.hpp)
+					     with at most tx_depth frames in
+					     the driver queue */
+	int64_t tx_lifetime_ns = 0;	/**< deadline TX: a command expires
+					     this long after the start of its
+					     cycle, 0: one period */
+	unsigned refresh_cycles = 0;	/**< >0: delta suppression
+					     (command_cache.hpp), an unchanged
+					     command is resent at least every
+					     refresh_cycles cycles */
+	int64_t watchdog_ns = 0;	/**< delta suppression: watchdog
+					     timeout of the motors, 0: none */
+};
+
+/** Statistics of a control loop (times in ns) */
+struct loop_stats {
+	uint64_t cycles = 0;
+	uint64_t overruns = 0;		/**< periods missed entirely */
+	uint64_t late = 0;		/**< cycles ended after the next period */
+	uint64_t tx_errors = 0;		/**< CAN_WriteMany() failures */
+	uint64_t tx_dropped = 0;	/**< commands not queued */
+	uint64_t tx_superseded = 0;	/**< deadline TX: commands replaced */
+	uint64_t tx_expired = 0;	/**< deadline TX: commands expired */
+	uint64_t tx_suppressed = 0;	/**< delta suppression: commands not
+					     sent, nor replied to */
+	uint64_t rx_errors = 0;		/**< CAN_ReadMany() failures */
+	uint64_t missed_replies = 0;	/**< motors without reply at deadline */
+	uint64_t stale_replies = 0;	/**< replies read before the commands
+					     of the cycle were sent */
+	int setup_error = 0;		/**< errno of rt::setup_thread() */
+	rt::series wakeup;		/**< wake-up latency (jitter) */
+	rt::series cycle;		/**< wake-up to end of cycle */
+	rt::series replies;		/**< wake-up to last reply */
+};
+
+/**
+ * @brief Control loop of up to MaxMotors motors on one channel.
+ *
+ * The channel must be initialized before start(). Motors are added before
+ * start(), their slot indexes the command and state arrays.
+ */
+template <class Limits = mit::ak10_9, unsigned MaxMotors = 32>
+class control_loop {
+public:
+	typedef std::function<void(control_loop &)> controller;
+
+	/** Commands, written by the controller */
+	struct {
+		float p[MaxMotors];
+		float v[MaxMotors];
+		float kp[MaxMotors];
+		float kd[MaxMotors];
+		float t[MaxMotors];
+	} cmd;
+
+	/** Latest states, read by the controller */
+	struct {
+		float p[MaxMotors];
+		float v[MaxMotors];
+		float t[MaxMotors];
+	} state;
+
+	/**
+	 * replied[slot] is 1 if the motor replied in the last cycle. With
+	 * delta suppression, a motor whose command was not sent does not
+	 * reply: its state is the one of its last reply.
+	 */
+	uint8_t replied[MaxMotors];
+
+	explicit control_loop(const loop_config &cfg)
+		: cfg_(cfg), motors_(0), fd_(-1), table_(nullptr), table_base_(0),
+		  want_(0), tx_cycle_(0), running_(false), cycles_(0) {
+		memset(&cmd, 0, sizeof(cmd));
+		memset(&state, 0, sizeof(state));
+		memset(replied, 0, sizeof(replied));
+		memset(on_wire_, 0, sizeof(on_wire_));
+		if (cfg_.reply_deadline_ns <= 0)
+			cfg_.reply_deadline_ns = cfg_.period_ns * 8 / 10;
+		if (cfg_.tx_lifetime_ns <= 0)
+			cfg_.tx_lifetime_ns = cfg_.period_ns;
+		txq_.set_channel(cfg_.channel);
+		txq_.set_depth(cfg_.tx_depth);
+		cache_.configure(cfg_.refresh_cycles, cfg_.watchdog_ns);
+	}
+
+	~control_loop() { stop(); }
+
+	control_loop(const control_loop &) = delete;
+	control_loop &operator=(const control_loop &) = delete;
+
+	const loop_config &config() const { return cfg_; }
+
+	/**
+	 * @brief Adds a motor (before start()).
+	 *
+	 * @return its slot or -1 if the loop is full or the id is used.
+	 */
+	int add_motor(uint8_t id) {
+		if (motors_ >= MaxMotors || running_)
+			return -1;
+
+		const int s = dec_.add_motor(id);
+		if (s < 0)
+			return -1;
+
+		ids_[s] = id;
+		motors_++;
+		return s;
+	}
+
+	unsigned motors() const { return motors_; }
+	uint8_t id(unsigned slot) const { return ids_[slot]; }
+
+	/**
+	 * @brief Publishes the replies into a shared state table (before
+	 * start()): slot s of the loop is slot base + s of the table.
+	 */
+	void attach(state_table *table, unsigned base = 0) {
+		table_ = table;
+		table_base_ = base;
+	}
+
+	/**
+	 * @brief Prepares the loop for cycle() without starting the thread.
+	 *
+	 * @return PCAN_ERROR_OK or the status of CAN_GetValue().
+	 */
+	TPCANStatus open() {
+		int fd = -1;
+		TPCANStatus sts = CAN_GetValue(cfg_.channel, PCAN_RECEIVE_EVENT,
+				&fd, sizeof(fd));
+
+		fd_ = (sts == PCAN_ERROR_OK) ? fd : -1;
+		return sts;
+	}
+
+	/**
+	 * @brief Starts the loop thread.
+	 *
+	 * @return PCAN_ERROR_OK, PCAN_ERROR_ILLOPERATION if already running or
+	 * 	the status of open().
+	 */
+	TPCANStatus start(controller ctrl) {
+		if (running_)
+			return PCAN_ERROR_ILLOPERATION;
+
+		TPCANStatus sts = open();
+		if (sts != PCAN_ERROR_OK)
+			return sts;
+
+		ctrl_ = std::move(ctrl);
+		cache_.clear();
+		reset_stats();
+		running_ = true;
+		thread_ = std::thread(&control_loop::run, this);
+		return PCAN_ERROR_OK;
+	}
+
+	/** Stops the loop thread (at the end of its current cycle) */
+	void stop() {
+		running_ = false;
+		if (thread_.joinable())
+			thread_.join();
+	}
+
+	bool running() const { return running_; }
+
+	/** Number of cycles run so far (may be read at any time) */
+	uint64_t cycles() const { return cycles_.load(std::memory_order_relaxed); }
+
+	/**
+	 * @brief Statistics; may only be read from the controller or when the
+	 * loop is stopped.
+	 */
+	const loop_stats &stats() const { return stats_; }
+
+	/**
+	 * @brief Runs one cycle: controller, send, collect the replies until
+	 * every motor replied or until deadline (CLOCK_MONOTONIC, ns).
+	 *
+	 * @param start Start time of the cycle (for the reply time)
+	 * @return the number of motors which replied.
+	 */
+	unsigned cycle(int64_t start, int64_t deadline) {
+		if (ctrl_)
+			ctrl_(*this);
+
+		send(start);
+		return collect(start, deadline);
+	}
+
+	/**
+	 * @brief Encodes the commands and gives them to the driver (through
+	 * the deadline TX queue if cfg.tx_depth is set). With delta
+	 * suppression, the commands equal to the last acknowledged ones are
+	 * not sent. The frames received until then are published first and
+	 * are not counted as replies by collect().
+	 *
+	 * @param start Start time of the cycle, 0 for now
+	 * @return the status of CAN_WriteMany().
+	 */
+	TPCANStatus send(int64_t start = 0) {
+		const mit::commands_soa in = {
+			cmd.p, cmd.v, cmd.kp, cmd.kd, cmd.t
+		};
+		const int64_t now = rt::now_ns();
+		TPCANStatus sts;
+		unsigned i;
+
+		mit::batch_codec<Limits>::encode(cfg_.kernel, in, ids_, motors_,
+			tx_.list, cfg_.msg_type, cfg_.msg_flags);
+		memset(replied, 0, sizeof(replied));
+		want_ = select(now);
+		tx_cycle_++;
+		drain();
+
+		if (cfg_.tx_depth) {
+			const int64_t deadline = (start ? start : now) +
+						cfg_.tx_lifetime_ns;
+
+			for (i = 0; i < want_; i++)
+				txq_.push(tx_.list[i], deadline);
+			return pump(now);
+		}
+
+		if (!want_)
+			return PCAN_ERROR_OK;
+
+		tx_.count = want_;
+		sts = CAN_WriteMany(cfg_.channel, tx_.msgs());
+		if (sts != PCAN_ERROR_OK && sts != PCAN_ERROR_QXMTFULL)
+			stats_.tx_errors++;
+		stats_.tx_dropped += want_ - tx_.count;
+		for (i = 0; i < tx_.count; i++) {
+			cache_.sent(slot_[i], tx_.list[i], tx_cycle_, now);
+			on_wire_[slot_[i]] = 1;
+		}
+
+		/* the motors whose command the driver did not take won't reply */
+		for (; i < want_; i++)
+			expect_[slot_[i]] = 0;
+		want_ = tx_.count;
+		return sts;
+	}
+
+	/**
+	 * @brief Sends a mode frame to the motor of a slot. Must be called from
+	 * the loop thread (i.e. the controller) once started. With deadline TX,
+	 * mode frames are never replaced nor dropped and exit frames go through
+	 * the safety lane, ahead of every other waiting frame.
+	 *
+	 * @return the status of CAN_WriteMany().
+	 */
+	TPCANStatus send_mode(unsigned slot, mit::mode m) {
+		struct pcanfd_msg &msg = tx_.list[0];
+
+		memset(&msg, 0, sizeof(msg));
+		msg.type = cfg_.msg_type;
+		msg.flags = cfg_.msg_flags;
+		msg.id = ids_[slot];
+		msg.data_len = mit::CMD_LEN;
+		mit::pack_mode(msg.data, m);
+		cache_.invalidate(slot);
+
+		if (cfg_.tx_depth) {
+			txq_.push(msg, 0);
+			return pump(rt::now_ns());
+		}
+
+		tx_.count = 1;
+		TPCANStatus sts = CAN_WriteMany(cfg_.channel, tx_.msgs());
+		if (sts != PCAN_ERROR_OK)
+			stats_.tx_errors++;
+		return sts;
+	}
+
+	/**
+	 * @brief Sends any frame (e.g. parameter reads) in a TX lane. Must be
+	 * called from the loop thread once started.
+	 *
+	 * @param deadline_ns Deadline TX: CLOCK_MONOTONIC time after which the
+	 * 	frame is dropped, 0 for never
+	 * @return the status of CAN_WriteMany().
+	 */
+	TPCANStatus send_frame(const struct pcanfd_msg &msg,
+			tx_lane ln = tx_lane::bulk, int64_t deadline_ns = 0) {
+		if (cfg_.tx_depth) {
+			txq_.push(msg, deadline_ns, ln);
+			return pump(rt::now_ns());
+		}
+
+		tx_.list[0] = msg;
+		tx_.count = 1;
+		TPCANStatus sts = CAN_WriteMany(cfg_.channel, tx_.msgs());
+		if (sts != PCAN_ERROR_OK)
+			stats_.tx_errors++;
+		return sts;
+	}
+
+	/** Deadline TX queue (used if cfg.tx_depth is set) */
+	const deadline_tx<MaxMotors * 2> &tx_queue() const { return txq_; }
+
+	/**
+	 * @brief Drains the replies until every motor which was sent a command
+	 * replied or deadline.
+	 *
+	 * @return the number of motors which were sent a command and replied.
+	 */
+	unsigned collect(int64_t start, int64_t deadline) {
+		unsigned count = 0, i;
+
+		while (count < want_) {
+			rx_.count = RX_MAX;
+			TPCANStatus sts = CAN_ReadMany(cfg_.channel, rx_.msgs());
+
+			if (sts == PCAN_ERROR_OK) {
+				publish();
+				for (i = 0; i < motors_; i++) {
+					if (!upd_[i])
+						continue;
+					if (on_wire_[i])
+						cache_.acked(i);
+					if (!replied[i]) {
+						replied[i] = 1;
+						count += expect_[i];
+					}
+				}
+				if (count == want_)
+					stats_.replies.add(rt::now_ns() - start);
+				continue;
+			}
+
+			if (sts != PCAN_ERROR_QRCVEMPTY) {
+				stats_.rx_errors++;
+				break;
+			}
+
+			const int64_t now = rt::now_ns();
+			int64_t left = deadline - now;
+			if (left <= 0 || fd_ < 0)
+				break;
+
+			/* frames waiting for room in the driver queue */
+			if (txq_.pending()) {
+				pump(now);
+				if (left > TX_POLL_NS)
+					left = TX_POLL_NS;
+			}
+
+			struct pollfd pfd = { fd_, POLLIN, 0 };
+			const struct timespec ts = rt::to_timespec(left);
+			ppoll(&pfd, 1, &ts, NULL);
+		}
+
+		stats_.missed_replies += want_ - count;
+		return count;
+	}
+
+	/**
+	 * @brief Sets the calling thread up (cfg.thread) and starts timer.
+	 * The timer is started even if the thread setup failed: the loop
+	 * then runs without real-time scheduling, and the errno code of
+	 * rt::setup_thread() is kept in stats().setup_error as a warning.
+	 *
+	 * @param first Start of the first period, 0 for one period from now
+	 * @return 0 or the errno code of timer.start().
+	 */
+	int prepare(rt::periodic &timer, int64_t first = 0) {
+		stats_.setup_error = rt::setup_thread(cfg_.thread);
+		return timer.start(first);
+	}
+
+	/**
+	 * @brief Waits for the next period of timer and records the wake-up.
+	 *
+	 * @return the start time of the period.
+	 */
+	int64_t wait(rt::periodic &timer) {
+		int64_t wakeup;
+
+		stats_.overruns += timer.wait(&wakeup);
+		stats_.wakeup.add(wakeup);
+		return timer.current();
+	}
+
+	/**
+	 * @brief Records the end of the cycle started at start, next being the
+	 * start of the next period.
+	 */
+	void end_cycle(int64_t start, int64_t next) {
+		const int64_t end = rt::now_ns();
+
+		stats_.cycle.add(end - start);
+		stats_.late += end > next;
+		stats_.cycles++;
+		cycles_.store(stats_.cycles, std::memory_order_relaxed);
+	}
+
+	/** Resets the statistics (loop stopped) */
+	void reset_stats() {
+		stats_ = loop_stats();
+		txq_.reset_stats();
+		cache_.reset_stats();
+	}
+
+private:
+	/* one drain reads at most the replies of two cycles */
+	static constexpr unsigned RX_MAX = 2 * MaxMotors;
+
+	/* deadline TX: period of the refills of the driver queue while
+	 * waiting for the replies */
+	static constexpr int64_t TX_POLL_NS = 50000;
+
+	/* decodes the frames of rx_ into state and the table, upd_[] tells
+	 * the motors which replied */
+	void publish() {
+		const mit::states_soa out = { state.p, state.v, state.t };
+		const int64_t rx_ns = rt::now_ns();
+
+		dec_.decode(cfg_.kernel, rx_.list, rx_.count, out, upd_);
+		if (!table_)
+			return;
+		for (unsigned i = 0; i < motors_; i++)
+			if (upd_[i])
+				table_->write(table_base_ + i, state.p[i],
+					state.v[i], state.t[i], rx_ns);
+	}
+
+	/*
+	 * Publishes the frames received before the commands are sent, without
+	 * counting them as replies nor acknowledging the commands. The
+	 * timestamps of the frames can't tell it: their clock depends on the
+	 * channel (virtual bus, pcan driver, SocketCAN).
+	 */
+	void drain() {
+		TPCANStatus sts;
+
+		memset(on_wire_, 0, sizeof(on_wire_));
+
+		do {
+			rx_.count = RX_MAX;
+			sts = CAN_ReadMany(cfg_.channel, rx_.msgs());
+			if (sts != PCAN_ERROR_OK)
+				break;
+
+			publish();
+			for (unsigned i = 0; i < motors_; i++)
+				stats_.stale_replies += upd_[i];
+		} while (rx_.count == RX_MAX);
+
+		if (sts != PCAN_ERROR_OK && sts != PCAN_ERROR_QRCVEMPTY)
+			stats_.rx_errors++;
+	}
+
+	/*
+	 * Refills the driver queue from the deadline TX queue. Only the
+	 * commands the driver took are recorded as sent for delta suppression:
+	 * a command superseded or expired in the queue never reached the
+	 * motor.
+	 */
+	TPCANStatus pump(int64_t now) {
+		const TPCANStatus sts = txq_.pump(now);
+		const tx_stats &ts = txq_.stats();
+		unsigned i, s;
+
+		for (i = 0; i < txq_.taken(); i++) {
+			const struct pcanfd_msg &msg = txq_.taken(i);
+
+			if (msg.data_len != mit::CMD_LEN ||
+				mit::is_mode(msg.data, msg.data_len))
+				continue;
+			for (s = 0; s < motors_; s++)
+				if (ids_[s] == msg.id) {
+					cache_.sent(s, msg, tx_cycle_, now);
+					on_wire_[s] = 1;
+					break;
+				}
+		}
+
+		stats_.tx_errors = ts.write_errors;
+		stats_.tx_dropped = ts.overflows;
+		stats_.tx_superseded = ts.superseded;
+		stats_.tx_expired = ts.expired;
+		return sts;
+	}
+
+	/*
+	 * Keeps at the head of tx_ the frames to send this cycle, with their
+	 * slots in slot_[], and returns their count. A suppressed frame must
+	 * not be older than the watchdog at the next cycle.
+	 */
+	unsigned select(int64_t now) {
+		unsigned i, n = 0;
+
+		for (i = 0; i < motors_; i++) {
+			expect_[i] = !cache_.enabled() ||
+				cache_.must_send(i, tx_.list[i], tx_cycle_,
+					now + cfg_.period_ns);
+			if (!expect_[i])
+				continue;
+			if (n != i)
+				tx_.list[n] = tx_.list[i];
+			slot_[n++] = i;
+		}
+
+		stats_.tx_suppressed = cache_.suppressed();
+		return n;
+	}
+
+	void run() {
+		rt::periodic timer(cfg_.period_ns, cfg_.clock);
+
+		prepare(timer);
+		while (running_.load(std::memory_order_relaxed)) {
+			const int64_t start = wait(timer);
+
+			cycle(start, start + cfg_.reply_deadline_ns);
+			end_cycle(start, timer.next());
+		}
+	}
+
+	loop_config cfg_;
+	unsigned motors_;
+	uint32_t ids_[MaxMotors];
+	mit::batch_decoder<Limits> dec_;
+	uint8_t upd_[mit::batch_decoder<Limits>::MAX_MOTORS];
+	msg_list<MaxMotors> tx_;
+	msg_list<RX_MAX> rx_;
+	deadline_tx<MaxMotors * 2> txq_;
+	int fd_;
+	state_table *table_;
+	unsigned table_base_;
+	command_cache<MaxMotors> cache_;
+	uint8_t expect_[MaxMotors];	/* command sent this cycle */
+	uint8_t on_wire_[MaxMotors];	/* command given to the driver since
+					   the last drain() */
+	unsigned slot_[MaxMotors];	/* slot of tx_.list[i] */
+	unsigned want_;			/* commands sent this cycle */
+	uint64_t tx_cycle_;
+	controller ctrl_;
+	loop_stats stats_;
+	std::atomic<bool> running_;
+	std::atomic<uint64_t> cycles_;
+	std::thread thread_;
+};
+
+} /* namespace pcanmotor */
+
+#endif /* PCANMOTOR_CONTROL_LOOP_HPP_ */
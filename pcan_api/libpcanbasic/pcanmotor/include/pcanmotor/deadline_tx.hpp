@@ -0,0 +1,308 @@
+/* SPDX-License-Identifier: LGPL-2.1-only */
+/*
+ * @file deadline_tx.hpp
+ * @brief Deadline-aware, prioritized TX queue in front of the driver queue
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * A frame given to the driver can't be taken back: if the driver queue
+ * backs up (error frames, bus load), the commands queued in it reach the
+ * motors late, and an exit frame waits behind all of them. Here frames
+ * wait in software lanes, each with a deadline, and are given to the
+ * driver only while it holds less than "depth" frames
+ * (PCAN_TX_PENDING_MSGS):
+ *   - the driver queue is refilled from the lanes in priority order
+ *     (safety, then control, then bulk), so that a safety frame only waits
+ *     for the frames already in the driver queue,
+ *   - a frame for an id which still has a frame waiting in the same lane
+ *     replaces it (the newest command wins),
+ *   - a frame whose deadline passed is dropped,
+ *   - mode frames (FF..FC enter, FF..FD exit, FF..FE zero) are never
+ *     replaced nor dropped,
+ *   - an exit frame cancels the frames of the same motor still waiting in
+ *     the other lanes (enter, commands), which would otherwise be sent
+ *     after it and enable the motor again.
+ */
+#ifndef PCANMOTOR_DEADLINE_TX_HPP_
+#define PCANMOTOR_DEADLINE_TX_HPP_
+
+#include <pcanmotor/mit.hpp>
+#include <pcanmotor/msg_list.hpp>
+
+namespace pcanmotor {
+
+/** TX lanes, by decreasing priority */
+enum class tx_lane : unsigned {
+	safety = 0,	/**< exit motor mode (emergency stop) */
+	control = 1,	/**< commands and enter motor mode */
+	bulk = 2,	/**< set zero, parameters, other frames */
+};
+
+constexpr unsigned TX_LANES = 3;
+
+/** Default lane of a frame */
+inline tx_lane lane_of(const struct pcanfd_msg &msg) {
+	mit::mode m;
+
+	if (mit::is_mode(msg.data, msg.data_len, &m))
+		return m == mit::mode::exit ? tx_lane::safety :
+			m == mit::mode::enter ? tx_lane::control : tx_lane::bulk;
+
+	return msg.data_len == mit::CMD_LEN ? tx_lane::control : tx_lane::bulk;
+}
+
+/** Counters of a deadline TX queue */
+struct tx_stats {
+	uint64_t queued = 0;		/**< frames pushed */
+	uint64_t sent = 0;		/**< frames given to the driver */
+	uint64_t superseded = 0;	/**< frames replaced by a newer one */
+	uint64_t expired = 0;		/**< frames dropped at their deadline */
+	uint64_t overflows = 0;		/**< frames dropped, lane full */
+	uint64_t cancelled = 0;		/**< frames dropped by an exit frame */
+	uint64_t write_errors = 0;	/**< CAN_WriteMany() failures */
+	uint64_t lane_sent[TX_LANES] = {};	/**< frames sent by lane */
+};
+
+template <unsigned MaxPending = 64>
+class deadline_tx {
+public:
+	/**
+	 * @param channel Channel to write to
+	 * @param depth Maximum number of frames in the driver queue
+	 */
+	explicit deadline_tx(TPCANHandle channel = PCAN_NONEBUS,
+			unsigned depth = 2)
+		: channel_(channel), depth_(depth ? depth : 1) {
+		buf_.count = 0;
+	}
+
+	void set_channel(TPCANHandle channel) { channel_ = channel; }
+	void set_depth(unsigned depth) { depth_ = depth ? depth : 1; }
+
+	/** Frames waiting in the lanes */
+	unsigned pending() const {
+		unsigned n = 0;
+
+		for (const lane &l : lanes_)
+			n += l.count;
+		return n;
+	}
+
+	/** Frames waiting in one lane */
+	unsigned pending(tx_lane l) const { return lanes_[(unsigned)l].count; }
+
+	const tx_stats &stats() const { return stats_; }
+	void reset_stats() { stats_ = tx_stats(); }
+
+	/** Frames given to the driver by the last pump(), in their order */
+	unsigned taken() const { return buf_.count; }
+	const struct pcanfd_msg &taken(unsigned i) const { return buf_.list[i]; }
+
+	/**
+	 * @brief Queues a frame in its default lane (see lane_of()).
+	 *
+	 * @param deadline_ns CLOCK_MONOTONIC time after which the frame is
+	 * 	useless, 0 for never (ignored for mode frames).
+	 * @return false if the frame was dropped because its lane is full
+	 * 	of frames which can't be dropped.
+	 */
+	bool push(const struct pcanfd_msg &msg, int64_t deadline_ns) {
+		return push(msg, deadline_ns, lane_of(msg));
+	}
+
+	bool push(const struct pcanfd_msg &msg, int64_t deadline_ns,
+			tx_lane ln) {
+		lane &l = lanes_[(unsigned)ln];
+		mit::mode m;
+		const bool keep = mit::is_mode(msg.data, msg.data_len, &m);
+		unsigned i;
+
+		stats_.queued++;
+		if (keep && m == mit::mode::exit)
+			for (lane &o : lanes_)
+				cancel(o, msg);
+
+		/* the newest command replaces the one still waiting, unless a
+		 * mode frame of the same motor is queued after it */
+		for (i = l.count; i-- > 0; ) {
+			entry &e = l.at(i);
+
+			if (!same_motor(e.msg, msg))
+				continue;
+			if (keep || e.keep)
+				break;
+
+			e.msg = msg;
+			e.deadline = deadline_ns;
+			stats_.superseded++;
+			return true;
+		}
+
+		if (l.count == MaxPending && !make_room(l, keep)) {
+			stats_.overflows++;
+			return false;
+		}
+
+		entry &e = l.at(l.count++);
+		e.msg = msg;
+		e.deadline = keep ? 0 : deadline_ns;
+		e.keep = keep;
+		return true;
+	}
+
+	/**
+	 * @brief Drops the expired frames and gives the driver, in priority
+	 * order, as many frames as it can take without holding more than
+	 * depth frames.
+	 *
+	 * @return PCAN_ERROR_OK or the status of CAN_WriteMany().
+	 */
+	TPCANStatus pump(int64_t now_ns) {
+		TPCANStatus sts;
+		__u32 in_driver = 0;
+		unsigned room, n, k;
+
+		buf_.count = 0;
+		for (lane &l : lanes_)
+			expire(l, now_ns);
+		if (!pending())
+			return PCAN_ERROR_OK;
+
+		/* without the count of the driver, keep one frame in it */
+		if (CAN_GetValue(channel_, PCAN_TX_PENDING_MSGS, &in_driver,
+				sizeof(in_driver)) != PCAN_ERROR_OK)
+			in_driver = depth_ - 1;
+		if (in_driver >= depth_)
+			return PCAN_ERROR_OK;
+
+		room = depth_ - in_driver;
+		n = 0;
+		for (k = 0; k < TX_LANES && n < room; k++)
+			for (unsigned i = 0; i < lanes_[k].count && n < room; i++)
+				buf_.list[n++] = lanes_[k].at(i).msg;
+		buf_.count = n;
+
+		sts = CAN_WriteMany(channel_, buf_.msgs());
+		if (sts != PCAN_ERROR_OK && sts != PCAN_ERROR_QXMTFULL)
+			stats_.write_errors++;
+
+		/* frames not taken by the driver stay queued */
+		n = buf_.count;
+		stats_.sent += n;
+		for (k = 0; k < TX_LANES && n; k++) {
+			lane &l = lanes_[k];
+			const unsigned taken = n < l.count ? n : l.count;
+
+			l.head = (l.head + taken) % MaxPending;
+			l.count -= taken;
+			stats_.lane_sent[k] += taken;
+			n -= taken;
+		}
+
+		return sts == PCAN_ERROR_QXMTFULL ? PCAN_ERROR_OK : sts;
+	}
+
+	/** Drops every waiting frame, mode frames included */
+	void clear() {
+		for (lane &l : lanes_)
+			l.head = l.count = 0;
+	}
+
+private:
+	struct entry {
+		struct pcanfd_msg msg;
+		int64_t deadline;
+		bool keep;
+	};
+
+	struct lane {
+		entry ring[MaxPending];
+		unsigned head = 0;
+		unsigned count = 0;
+
+		entry &at(unsigned i) { return ring[(head + i) % MaxPending]; }
+	};
+
+	static bool same_motor(const struct pcanfd_msg &a,
+			const struct pcanfd_msg &b) {
+		return a.id == b.id &&
+			!((a.flags ^ b.flags) & PCANFD_MSG_EXT);
+	}
+
+	/* removes the expired frames, keeping the order of the others */
+	void expire(lane &l, int64_t now_ns) {
+		unsigned i, n = 0;
+
+		for (i = 0; i < l.count; i++) {
+			entry &e = l.at(i);
+
+			if (!e.keep && e.deadline && e.deadline <= now_ns) {
+				stats_.expired++;
+				continue;
+			}
+			if (n != i)
+				l.at(n) = e;
+			n++;
+		}
+		l.count = n;
+	}
+
+	/* removes the frames of the motor of an exit frame, but exit frames */
+	void cancel(lane &l, const struct pcanfd_msg &exit) {
+		unsigned i, n = 0;
+
+		for (i = 0; i < l.count; i++) {
+			entry &e = l.at(i);
+			mit::mode m;
+
+			if (same_motor(e.msg, exit) &&
+				!(mit::is_mode(e.msg.data, e.msg.data_len, &m) &&
+				  m == mit::mode::exit)) {
+				stats_.cancelled++;
+				continue;
+			}
+			if (n != i)
+				l.at(n) = e;
+			n++;
+		}
+		l.count = n;
+	}
+
+	/* a mode frame takes the place of the oldest command */
+	bool make_room(lane &l, bool keep) {
+		unsigned i;
+
+		if (!keep)
+			return false;
+
+		for (i = 0; i < l.count; i++)
+			if (!l.at(i).keep)
+				break;
+		if (i == l.count)
+			return false;
+
+		for (; i + 1 < l.count; i++)
+			l.at(i) = l.at(i + 1);
+		l.count--;
+		stats_.overflows++;
+		return true;
+	}
+
+	TPCANHandle channel_;
+	unsigned depth_;
+	lane lanes_[TX_LANES];
+	msg_list<MaxPending * TX_LANES> buf_;
+	tx_stats stats_;
+};
+
+} /* namespace pcanmotor */
+
+#endif /* PCANMOTOR_DEADLINE_TX_HPP_ */
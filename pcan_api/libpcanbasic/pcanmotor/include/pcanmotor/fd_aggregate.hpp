@@ -0,0 +1,237 @@
+/* SPDX-License-Identifier: LGPL-2.1-only */
+/*
+ * @file fd_aggregate.hpp
+ * @brief Several motor sub-commands per CAN FD frame
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * With one 8-byte frame per motor, arbitration, control, CRC and
+ * interframe bits take most of the bus time. This header defines a
+ * multiplexed frame format of pcanmotor, for a node that demultiplexes it
+ * (e.g. a bridge in front of MIT motors): the sub-commands of several
+ * motors go in one BRS frame of up to 64 bytes:
+ *
+ *   | motor | len | len bytes | motor | len | len bytes | ... | 0 padding |
+ *
+ * Motor 0 marks the end of the sub-frames. The frame is sent with the
+ * smallest DLC holding its sub-frames (fd_dlc.hpp), padding bytes are 0.
+ * Replies use the same layout and are split back per motor with split().
+ * It is not the moteus protocol (moteus.hpp), whose sub-frames are
+ * register accesses of one controller.
+ */
+#ifndef PCANMOTOR_FD_AGGREGATE_HPP_
+#define PCANMOTOR_FD_AGGREGATE_HPP_
+
+#include <stdint.h>
+#include <string.h>
+
+#include <PCANBasic.h>
+
+#include <pcanmotor/fd_dlc.hpp>
+#include <pcanmotor/mit.hpp>
+#include <pcanmotor/msg_list.hpp>
+
+namespace pcanmotor {
+namespace fd_aggregate {
+
+/** Data bytes of a CAN FD frame */
+constexpr unsigned FRAME_LEN = 64;
+/** Bytes before the payload of a sub-frame: motor, length */
+constexpr unsigned SUB_HEADER_LEN = 2;
+/** Motor id marking the end of the sub-frames */
+constexpr uint8_t END = 0;
+
+/** Bus time of the aggregated frames and of one frame per sub-command */
+struct stats {
+	uint64_t frames = 0;		/**< aggregated frames */
+	uint64_t subframes = 0;		/**< sub-commands */
+	uint64_t wire_ns = 0;		/**< wire time of the aggregated frames */
+	uint64_t single_wire_ns = 0;	/**< wire time of one frame per sub-command */
+
+	/** Bus time saved, in % of the one frame per sub-command time */
+	double saving() const {
+		return single_wire_ns ? 100. * (1. - (double)wire_ns / single_wire_ns) : 0.;
+	}
+};
+
+/**
+ * @brief Packs sub-commands into CAN FD frames of one CAN id.
+ *
+ * Frames are filled in the order of add() and the last one is closed by
+ * flush(). With set_bitrates(), the wire time of each frame is accounted in
+ * stats() next to the time of one frame per sub-command (CAN 2.0 frames of
+ * the motor id up to 8 bytes, as sent without aggregation, FD frames above).
+ */
+class aggregator {
+public:
+	explicit aggregator(uint32_t can_id, bool brs = true)
+		: can_id_(can_id), brs_(brs) {}
+
+	/** Enables the bus time accounting (0: disabled) */
+	void set_bitrates(uint32_t nom_bitrate, uint32_t data_bitrate) {
+		nom_bitrate_ = nom_bitrate;
+		data_bitrate_ = data_bitrate;
+	}
+
+	const struct stats &stats() const {
+		return stats_;
+	}
+
+	void reset_stats() {
+		stats_ = fd_aggregate::stats();
+	}
+
+	/**
+	 * @brief Adds the sub-command of motor to the frames of out, opening a
+	 * new frame when the current one is full.
+	 *
+	 * @return false if out is full, or if motor is END or len does not fit
+	 * 	in a frame.
+	 */
+	template <unsigned N>
+	bool add(msg_list<N> &out, uint8_t motor, const uint8_t *data, unsigned len) {
+		if (motor == END || len > FRAME_LEN - SUB_HEADER_LEN)
+			return false;
+		if (open_ && used_ + SUB_HEADER_LEN + len > FRAME_LEN)
+			close(out.list[out.count - 1]);
+		if (!open_) {
+			if (out.count >= N)
+				return false;
+			start(out.list[out.count++]);
+		}
+
+		struct pcanfd_msg &msg = out.list[out.count - 1];
+
+		msg.data[used_] = motor;
+		msg.data[used_ + 1] = (uint8_t)len;
+		memcpy(msg.data + used_ + SUB_HEADER_LEN, data, len);
+		used_ += SUB_HEADER_LEN + len;
+		subs_++;
+		if (nom_bitrate_)
+			stats_.single_wire_ns += single_ns(motor, data, len);
+		return true;
+	}
+
+	/** Adds a MIT command (see mit.hpp) */
+	template <class Codec = mit::codec<>, unsigned N>
+	bool add_command(msg_list<N> &out, uint8_t motor, const mit::command &cmd) {
+		uint8_t buf[mit::CMD_LEN];
+
+		Codec::pack(buf, cmd);
+		return add(out, motor, buf, sizeof(buf));
+	}
+
+	/** Closes the current frame: call once the sub-commands are added */
+	template <unsigned N>
+	void flush(msg_list<N> &out) {
+		if (open_)
+			close(out.list[out.count - 1]);
+	}
+
+private:
+	void start(struct pcanfd_msg &msg) {
+		msg.type = PCANFD_TYPE_CANFD_MSG;
+		msg.flags = PCANFD_MSG_STD | (brs_ ? PCANFD_MSG_BRS : 0);
+		msg.id = can_id_;
+		used_ = 0;
+		subs_ = 0;
+		open_ = true;
+	}
+
+	void close(struct pcanfd_msg &msg) {
+		const unsigned len = fd_padded_len(used_);
+
+		/* motor 0 ends the sub-frames */
+		memset(msg.data + used_, 0, len - used_);
+		msg.data_len = (__u16)len;
+		open_ = false;
+		stats_.frames++;
+		stats_.subframes += subs_;
+		if (nom_bitrate_)
+			stats_.wire_ns += frame_ns(msg);
+	}
+
+	uint64_t frame_ns(const struct pcanfd_msg &msg) const {
+		UINT64 ns = 0;
+
+		CAN_GetFrameTime(&msg, nom_bitrate_, data_bitrate_, PCAN_PARAMETER_OFF, &ns);
+		return ns;
+	}
+
+	uint64_t single_ns(uint8_t motor, const uint8_t *data, unsigned len) const {
+		struct pcanfd_msg msg;
+
+		msg.type = len > 8 ? PCANFD_TYPE_CANFD_MSG : PCANFD_TYPE_CAN20_MSG;
+		msg.flags = PCANFD_MSG_STD | (len > 8 && brs_ ? PCANFD_MSG_BRS : 0);
+		msg.id = motor;
+		msg.data_len = (__u16)len;
+		memcpy(msg.data, data, len);
+		return frame_ns(msg);
+	}
+
+	uint32_t can_id_;
+	bool brs_;
+	bool open_ = false;
+	unsigned used_ = 0;		/**< bytes of the open frame */
+	unsigned subs_ = 0;		/**< sub-commands of the open frame */
+	uint32_t nom_bitrate_ = 0;
+	uint32_t data_bitrate_ = 0;
+	struct stats stats_;
+};
+
+/**
+ * @brief Calls fn(motor, data, len) for each sub-frame of msg.
+ *
+ * @return the number of sub-frames, -1 if a sub-frame overflows the frame
+ * 	(the ones before it were given to fn).
+ */
+template <typename F>
+int split(const struct pcanfd_msg &msg, F &&fn) {
+	unsigned pos = 0, len = msg.data_len > FRAME_LEN ? FRAME_LEN : msg.data_len;
+	int count = 0;
+
+	while (pos + SUB_HEADER_LEN <= len && msg.data[pos] != END) {
+		const unsigned sub_len = msg.data[pos + 1];
+
+		if (pos + SUB_HEADER_LEN + sub_len > len)
+			return -1;
+		fn(msg.data[pos], msg.data + pos + SUB_HEADER_LEN, sub_len);
+		pos += SUB_HEADER_LEN + sub_len;
+		count++;
+	}
+	return count;
+}
+
+/**
+ * @brief Calls fn(const mit::reply &) for each MIT reply of msg (the motor
+ * id of a reply is its first byte, see mit::codec::pack_reply()).
+ *
+ * @return the number of replies, -1 if msg is malformed.
+ */
+template <class Codec = mit::codec<>, typename F>
+int split_replies(const struct pcanfd_msg &msg, F &&fn) {
+	int replies = 0;
+	const int subs = split(msg, [&](uint8_t motor, const uint8_t *data, unsigned len) {
+		mit::reply rep;
+
+		if (Codec::unpack(data, len, rep) && rep.id == motor) {
+			fn(rep);
+			replies++;
+		}
+	});
+
+	return subs < 0 ? -1 : replies;
+}
+
+} /* namespace fd_aggregate */
+} /* namespace pcanmotor */
+
+#endif /* PCANMOTOR_FD_AGGREGATE_HPP_ */
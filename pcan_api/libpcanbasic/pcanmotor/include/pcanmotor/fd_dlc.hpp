@@ -0,0 +1,47 @@
+/* SPDX-License-Identifier: LGPL-2.1-only */
+/*
+ * @file fd_dlc.hpp
+ * @brief CAN FD data length codes
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+#ifndef PCANMOTOR_FD_DLC_HPP_
+#define PCANMOTOR_FD_DLC_HPP_
+
+#include <stdint.h>
+
+namespace pcanmotor {
+
+/** Smallest FD DLC code holding len bytes (15 above 64 bytes) */
+constexpr uint8_t fd_dlc(unsigned len) {
+	return len <= 8 ? (uint8_t)len : len <= 12 ? 9 : len <= 16 ? 10 :
+		len <= 20 ? 11 : len <= 24 ? 12 : len <= 32 ? 13 :
+		len <= 48 ? 14 : 15;
+}
+
+/** Data bytes of a FD DLC code */
+constexpr unsigned fd_len(uint8_t dlc) {
+	return dlc <= 8 ? dlc : dlc == 9 ? 12 : dlc == 10 ? 16 :
+		dlc == 11 ? 20 : dlc == 12 ? 24 : dlc == 13 ? 32 :
+		dlc == 14 ? 48 : 64;
+}
+
+/** Bytes a FD frame of len data bytes is sent with */
+constexpr unsigned fd_padded_len(unsigned len) {
+	return fd_len(fd_dlc(len));
+}
+
+static_assert(fd_padded_len(9) == 12 && fd_padded_len(33) == 48 &&
+	fd_padded_len(64) == 64, "FD DLC table");
+
+} /* namespace pcanmotor */
+
+#endif /* PCANMOTOR_FD_DLC_HPP_ */
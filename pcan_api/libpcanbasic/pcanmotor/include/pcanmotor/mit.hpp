@@ -0,0 +1,285 @@
+/* SPDX-License-Identifier: LGPL-2.1-only */
+/*
+ * @file mit.hpp
+ * @brief MIT mini-cheetah motor protocol codec (header only)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Command frame (8 bytes, big endian bit fields):
+ *   p[16] v[12] kp[12] kd[12] t[12]
+ * Reply frame (6 bytes):
+ *   id[8] p[16] v[12] i[12]
+ * Mode frames: FF FF FF FF FF FF FF {FC: enter, FD: exit, FE: set zero}
+ *
+ * The field ranges are compile-time constants (see struct ak10_9), so
+ * quantization is a clamp, a multiplication by a constant and an exact
+ * integer fix-up instead of the float division of float_to_uint().
+ * Results are bit-exact with makeTMotorPackage() of the Python tests.
+ */
+#ifndef PCANMOTOR_MIT_HPP_
+#define PCANMOTOR_MIT_HPP_
+
+#include <stdint.h>
+#include <string.h>
+
+#include <PCANBasic.h>
+
+namespace pcanmotor {
+namespace mit {
+
+/** Length of a command frame */
+constexpr unsigned CMD_LEN = 8;
+/** Length of a reply frame */
+constexpr unsigned REPLY_LEN = 6;
+
+/** Last byte of the mode frames */
+enum class mode : uint8_t {
+	enter = 0xFC,	/**< enter motor mode (enable) */
+	exit = 0xFD,	/**< exit motor mode (disable) */
+	zero = 0xFE,	/**< set current position as zero */
+};
+
+/** Range of a field, in SI units */
+struct range {
+	double min;
+	double max;
+};
+
+/** Field ranges of the AK10-9 firmware used by the K3lso legs */
+struct ak10_9 {
+	static constexpr range p {-95.5, 95.5};	/**< position (rad) */
+	static constexpr range v {-30.0, 30.0};	/**< velocity (rad/s) */
+	static constexpr range kp {0.0, 500.0};	/**< stiffness (Nm/rad) */
+	static constexpr range kd {0.0, 5.0};	/**< damping (Nm.s/rad) */
+	static constexpr range t {-18.0, 18.0};	/**< torque (Nm) */
+};
+
+/**
+ * @brief Quantizer of a field on Bits bits.
+ *
+ * encode() returns trunc((x - min) * (2^Bits - 1) / span) like the Python
+ * float_to_uint(): x is clamped, (x - min) * (2^Bits - 1) is exact in
+ * double for any float input, the division by span is replaced by a
+ * multiplication by its constant inverse and the result is fixed-up by
+ * comparing it with exact products, so that it is the floor of the real
+ * quotient.
+ */
+template <unsigned Bits>
+struct quant {
+	static constexpr uint32_t max_int = (1U << Bits) - 1;
+
+	double min;
+	double max;
+	double span;
+	double inv;	/**< 1 / span */
+	double step;	/**< span / max_int */
+
+	constexpr quant(range r)
+		: min(r.min), max(r.max), span(r.max - r.min),
+		  inv(1.0 / (r.max - r.min)),
+		  step((r.max - r.min) / max_int) {}
+
+	uint32_t encode(double x) const {
+		/* NaN ends at min */
+		x = x > min ? x : min;
+		x = x < max ? x : max;
+
+		const double a = (x - min) * max_int;
+		uint32_t k = (uint32_t)(a * inv);
+
+		k += (double)(k + 1) * span <= a;
+		k -= (double)k * span > a;
+		return k;
+	}
+
+	float decode(uint32_t k) const {
+		return (float)(k * step + min);
+	}
+};
+
+/** Command of a motor */
+struct command {
+	float p;	/**< position setpoint */
+	float v;	/**< velocity setpoint */
+	float kp;	/**< position gain */
+	float kd;	/**< velocity gain */
+	float t;	/**< feed forward torque */
+};
+
+/** Decoded reply of a motor */
+struct reply {
+	uint8_t id;	/**< motor id (first byte of the reply) */
+	float p;	/**< position */
+	float v;	/**< velocity */
+	float t;	/**< torque */
+};
+
+/**
+ * @brief Returns true if buf is a mode frame (and stores its mode in m).
+ */
+inline bool is_mode(const uint8_t *buf, unsigned len, mode *m = nullptr) {
+	if (len != CMD_LEN)
+		return false;
+	for (unsigned i = 0; i < CMD_LEN - 1; i++)
+		if (buf[i] != 0xFF)
+			return false;
+	if (buf[CMD_LEN - 1] < (uint8_t)mode::enter ||
+		buf[CMD_LEN - 1] > (uint8_t)mode::zero)
+		return false;
+	if (m)
+		*m = (mode)buf[CMD_LEN - 1];
+	return true;
+}
+
+/**
+ * @brief Codec for the field ranges given by Limits.
+ *
+ * Limits is a type with static constexpr range members p, v, kp, kd, t
+ * (see ak10_9).
+ */
+template <class Limits = ak10_9>
+struct codec {
+	static constexpr quant<16> P {Limits::p};
+	static constexpr quant<12> V {Limits::v};
+	static constexpr quant<12> KP {Limits::kp};
+	static constexpr quant<12> KD {Limits::kd};
+	static constexpr quant<12> T {Limits::t};
+
+	/**
+	 * @brief Packs the quantized fields into a command frame.
+	 */
+	static void pack_raw(uint8_t *buf, uint32_t p, uint32_t v, uint32_t kp,
+			uint32_t kd, uint32_t t) {
+		buf[0] = (uint8_t)(p >> 8);
+		buf[1] = (uint8_t)p;
+		buf[2] = (uint8_t)(v >> 4);
+		buf[3] = (uint8_t)((v << 4) | (kp >> 8));
+		buf[4] = (uint8_t)kp;
+		buf[5] = (uint8_t)(kd >> 4);
+		buf[6] = (uint8_t)((kd << 4) | (t >> 8));
+		buf[7] = (uint8_t)t;
+	}
+
+	/**
+	 * @brief Packs a command into buf (CMD_LEN bytes).
+	 */
+	static void pack(uint8_t *buf, double p, double v, double kp, double kd,
+			double t) {
+		pack_raw(buf, P.encode(p), V.encode(v), KP.encode(kp),
+			KD.encode(kd), T.encode(t));
+	}
+
+	static void pack(uint8_t *buf, const command &cmd) {
+		pack(buf, cmd.p, cmd.v, cmd.kp, cmd.kd, cmd.t);
+	}
+
+	/**
+	 * @brief Builds the command frame of motor id in msg.
+	 */
+	static void pack(TPCANMsgFD &msg, uint32_t id, const command &cmd) {
+		msg.ID = id;
+		msg.MSGTYPE = PCAN_MESSAGE_STANDARD;
+		msg.DLC = CMD_LEN;
+		pack(msg.DATA, cmd);
+	}
+
+	static void pack(TPCANMsg &msg, uint32_t id, const command &cmd) {
+		msg.ID = id;
+		msg.MSGTYPE = PCAN_MESSAGE_STANDARD;
+		msg.LEN = CMD_LEN;
+		pack(msg.DATA, cmd);
+	}
+
+	/**
+	 * @brief Decodes a reply frame.
+	 *
+	 * @return false if the frame is too short to be a reply.
+	 */
+	static bool unpack(const uint8_t *buf, unsigned len, reply &rep) {
+		if (len < REPLY_LEN)
+			return false;
+
+		rep.id = buf[0];
+		rep.p = P.decode(((uint32_t)buf[1] << 8) | buf[2]);
+		rep.v = V.decode(((uint32_t)buf[3] << 4) | (buf[4] >> 4));
+		rep.t = T.decode(((uint32_t)(buf[4] & 0xF) << 8) | buf[5]);
+		return true;
+	}
+
+	/**
+	 * @brief Decodes a command frame (motor side, see motor_sim.hpp).
+	 *
+	 * @return false if the frame is not a command (length, mode frame).
+	 */
+	static bool unpack(const uint8_t *buf, unsigned len, command &cmd) {
+		if (len != CMD_LEN || is_mode(buf, len))
+			return false;
+
+		cmd.p = P.decode(((uint32_t)buf[0] << 8) | buf[1]);
+		cmd.v = V.decode(((uint32_t)buf[2] << 4) | (buf[3] >> 4));
+		cmd.kp = KP.decode(((uint32_t)(buf[3] & 0xF) << 8) | buf[4]);
+		cmd.kd = KD.decode(((uint32_t)buf[5] << 4) | (buf[6] >> 4));
+		cmd.t = T.decode(((uint32_t)(buf[6] & 0xF) << 8) | buf[7]);
+		return true;
+	}
+
+	/**
+	 * @brief Packs the reply of motor id into buf (REPLY_LEN bytes,
+	 * motor side).
+	 */
+	static void pack_reply(uint8_t *buf, uint8_t id, double p, double v,
+			double t) {
+		const uint32_t qp = P.encode(p), qv = V.encode(v), qt = T.encode(t);
+
+		buf[0] = id;
+		buf[1] = (uint8_t)(qp >> 8);
+		buf[2] = (uint8_t)qp;
+		buf[3] = (uint8_t)(qv >> 4);
+		buf[4] = (uint8_t)((qv << 4) | (qt >> 8));
+		buf[5] = (uint8_t)qt;
+	}
+
+	static bool unpack(const TPCANMsgFD &msg, reply &rep) {
+		/* DLC 0..8 is the data length */
+		return unpack(msg.DATA, msg.DLC, rep);
+	}
+
+	static bool unpack(const TPCANMsg &msg, reply &rep) {
+		return unpack(msg.DATA, msg.LEN, rep);
+	}
+};
+
+/**
+ * @brief Fills buf (CMD_LEN bytes) with a mode frame.
+ */
+inline void pack_mode(uint8_t *buf, mode m) {
+	memset(buf, 0xFF, CMD_LEN - 1);
+	buf[CMD_LEN - 1] = (uint8_t)m;
+}
+
+inline void pack_mode(TPCANMsgFD &msg, uint32_t id, mode m) {
+	msg.ID = id;
+	msg.MSGTYPE = PCAN_MESSAGE_STANDARD;
+	msg.DLC = CMD_LEN;
+	pack_mode(msg.DATA, m);
+}
+
+inline void pack_mode(TPCANMsg &msg, uint32_t id, mode m) {
+	msg.ID = id;
+	msg.MSGTYPE = PCAN_MESSAGE_STANDARD;
+	msg.LEN = CMD_LEN;
+	pack_mode(msg.DATA, m);
+}
+
+} /* namespace mit */
+} /* namespace pcanmotor */
+
+#endif /* PCANMOTOR_MIT_HPP_ */
@@ -0,0 +1,663 @@
+/* SPDX-License-Identifier: LGPL-2.1-only */
+/*
+ * @file mit_batch.hpp
+ * @brief Batch MIT command encoder and reply decoder (SSE2/AVX2/NEON
+ *        kernels, header only)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * The commands of all the motors of a control cycle are given as
+ * structure of arrays. The kernels clamp and quantize the five fields of
+ * several motors at once and compute the two big endian 32-bit words of
+ * each frame:
+ *   hi = p << 16 | v << 4 | kp >> 8
+ *   lo = kp << 24 | kd << 12 | t
+ * Lanes are computed in double precision, with the same operations as
+ * quant::encode(), so that every kernel is bit-exact with the scalar codec.
+ *
+ * The replies received in one drain of the RX queue are dispatched to the
+ * motors by their first byte, then the fields of the latest reply of each
+ * motor are dequantized by the kernels into structure of arrays.
+ */
+#ifndef PCANMOTOR_MIT_BATCH_HPP_
+#define PCANMOTOR_MIT_BATCH_HPP_
+
+#include <arpa/inet.h>
+
+#include <pcanmotor/mit.hpp>
+#include <pcanfd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define PCANMOTOR_X86
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#define PCANMOTOR_NEON
+#endif
+
+namespace pcanmotor {
+namespace mit {
+
+/** Commands of n motors, as structure of arrays */
+struct commands_soa {
+	const float *p;
+	const float *v;
+	const float *kp;
+	const float *kd;
+	const float *t;
+};
+
+/** Decoded states of n motors, as structure of arrays */
+struct states_soa {
+	float *p;
+	float *v;
+	float *t;
+};
+
+/** Batch encoder/decoder kernels */
+enum class kernel {
+	best,		/**< best kernel supported by the CPU */
+	scalar,
+	sse2,
+	avx2,
+	neon,
+};
+
+/**
+ * @brief Returns true if the kernel k can run on this CPU.
+ */
+inline bool kernel_supported(kernel k) {
+	switch (k) {
+	case kernel::best:
+	case kernel::scalar:
+		return true;
+#ifdef PCANMOTOR_X86
+	case kernel::sse2:
+		return __builtin_cpu_supports("sse2");
+	case kernel::avx2:
+		return __builtin_cpu_supports("avx2");
+#endif
+#ifdef PCANMOTOR_NEON
+	case kernel::neon:
+		return true;
+#endif
+	default:
+		return false;
+	}
+}
+
+/**
+ * @brief Returns the name of a kernel.
+ */
+inline const char *kernel_name(kernel k) {
+	switch (k) {
+	case kernel::best: return "best";
+	case kernel::scalar: return "scalar";
+	case kernel::sse2: return "sse2";
+	case kernel::avx2: return "avx2";
+	case kernel::neon: return "neon";
+	}
+	return "?";
+}
+
+/**
+ * @brief Returns the kernel used for kernel::best.
+ */
+inline kernel best_kernel() {
+	static const kernel best =
+		kernel_supported(kernel::avx2) ? kernel::avx2 :
+		kernel_supported(kernel::neon) ? kernel::neon :
+		kernel_supported(kernel::sse2) ? kernel::sse2 : kernel::scalar;
+	return best;
+}
+
+/**
+ * @brief Returns the kernel to run for k: the best one for kernel::best,
+ * the scalar one if k is not supported by the CPU.
+ */
+inline kernel resolve_kernel(kernel k) {
+	if (k == kernel::best)
+		return best_kernel();
+	return kernel_supported(k) ? k : kernel::scalar;
+}
+
+/**
+ * @brief Batch encoder for the field ranges given by Limits.
+ */
+template <class Limits = ak10_9>
+struct batch_codec {
+	typedef codec<Limits> C;
+
+	/** Motors processed per chunk (size of the stack buffers) */
+	static constexpr unsigned CHUNK = 64;
+
+	static void words_scalar(const commands_soa &in, unsigned n,
+			uint32_t *hi, uint32_t *lo) {
+		for (unsigned i = 0; i < n; i++) {
+			const uint32_t kp = C::KP.encode(in.kp[i]);
+
+			hi[i] = C::P.encode(in.p[i]) << 16 |
+				C::V.encode(in.v[i]) << 4 | kp >> 8;
+			lo[i] = kp << 24 | C::KD.encode(in.kd[i]) << 12 |
+				C::T.encode(in.t[i]);
+		}
+	}
+
+#ifdef PCANMOTOR_X86
+	/* quantizes x[0..1] into the 2 low int32 lanes */
+	template <unsigned Bits>
+	__attribute__((target("sse2")))
+	static __m128i quant_sse2(const quant<Bits> &q, const float *x) {
+		const __m128d one = _mm_set1_pd(1.0);
+		const __m128d span = _mm_set1_pd(q.span);
+		const __m128d min = _mm_set1_pd(q.min);
+		__m128d v, a, k;
+
+		v = _mm_cvtps_pd(_mm_castsi128_ps(
+			_mm_loadl_epi64((const __m128i *)x)));
+
+		/* maxpd returns its 2nd operand for NaN */
+		v = _mm_min_pd(_mm_max_pd(v, min), _mm_set1_pd(q.max));
+		a = _mm_mul_pd(_mm_sub_pd(v, min), _mm_set1_pd(q.max_int));
+		k = _mm_cvtepi32_pd(_mm_cvttpd_epi32(
+			_mm_mul_pd(a, _mm_set1_pd(q.inv))));
+
+		k = _mm_add_pd(k, _mm_and_pd(one, _mm_cmple_pd(
+			_mm_mul_pd(_mm_add_pd(k, one), span), a)));
+		k = _mm_sub_pd(k, _mm_and_pd(one, _mm_cmpgt_pd(
+			_mm_mul_pd(k, span), a)));
+
+		return _mm_cvttpd_epi32(k);
+	}
+
+	/* quantizes x[0..3] into 4 int32 lanes */
+	template <unsigned Bits>
+	__attribute__((target("sse2")))
+	static __m128i quant4_sse2(const quant<Bits> &q, const float *x) {
+		return _mm_unpacklo_epi64(quant_sse2(q, x), quant_sse2(q, x + 2));
+	}
+
+	__attribute__((target("sse2")))
+	static void words_sse2(const commands_soa &in, unsigned n,
+			uint32_t *hi, uint32_t *lo) {
+		unsigned i;
+
+		for (i = 0; i + 4 <= n; i += 4) {
+			const __m128i kp = quant4_sse2(C::KP, in.kp + i);
+			const __m128i h = _mm_or_si128(_mm_or_si128(
+				_mm_slli_epi32(quant4_sse2(C::P, in.p + i), 16),
+				_mm_slli_epi32(quant4_sse2(C::V, in.v + i), 4)),
+				_mm_srli_epi32(kp, 8));
+			const __m128i l = _mm_or_si128(_mm_or_si128(
+				_mm_slli_epi32(kp, 24),
+				_mm_slli_epi32(quant4_sse2(C::KD, in.kd + i), 12)),
+				quant4_sse2(C::T, in.t + i));
+
+			_mm_storeu_si128((__m128i *)(hi + i), h);
+			_mm_storeu_si128((__m128i *)(lo + i), l);
+		}
+
+		words_scalar(shift(in, i), n - i, hi + i, lo + i);
+	}
+
+	/* quantizes x[0..3] into 4 int32 lanes */
+	template <unsigned Bits>
+	__attribute__((target("avx2")))
+	static __m128i quant_avx2(const quant<Bits> &q, const float *x) {
+		const __m256d one = _mm256_set1_pd(1.0);
+		const __m256d span = _mm256_set1_pd(q.span);
+		const __m256d min = _mm256_set1_pd(q.min);
+		__m256d v, a, k;
+
+		v = _mm256_cvtps_pd(_mm_loadu_ps(x));
+		v = _mm256_min_pd(_mm256_max_pd(v, min), _mm256_set1_pd(q.max));
+		a = _mm256_mul_pd(_mm256_sub_pd(v, min),
+			_mm256_set1_pd(q.max_int));
+		k = _mm256_cvtepi32_pd(_mm256_cvttpd_epi32(
+			_mm256_mul_pd(a, _mm256_set1_pd(q.inv))));
+
+		k = _mm256_add_pd(k, _mm256_and_pd(one, _mm256_cmp_pd(
+			_mm256_mul_pd(_mm256_add_pd(k, one), span), a, _CMP_LE_OQ)));
+		k = _mm256_sub_pd(k, _mm256_and_pd(one, _mm256_cmp_pd(
+			_mm256_mul_pd(k, span), a, _CMP_GT_OQ)));
+
+		return _mm256_cvttpd_epi32(k);
+	}
+
+	/* quantizes x[0..7] into 8 int32 lanes */
+	template <unsigned Bits>
+	__attribute__((target("avx2")))
+	static __m256i quant8_avx2(const quant<Bits> &q, const float *x) {
+		return _mm256_inserti128_si256(_mm256_castsi128_si256(
+			quant_avx2(q, x)), quant_avx2(q, x + 4), 1);
+	}
+
+	__attribute__((target("avx2")))
+	static void words_avx2(const commands_soa &in, unsigned n,
+			uint32_t *hi, uint32_t *lo) {
+		unsigned i;
+
+		for (i = 0; i + 8 <= n; i += 8) {
+			const __m256i kp = quant8_avx2(C::KP, in.kp + i);
+			const __m256i h = _mm256_or_si256(_mm256_or_si256(
+				_mm256_slli_epi32(quant8_avx2(C::P, in.p + i), 16),
+				_mm256_slli_epi32(quant8_avx2(C::V, in.v + i), 4)),
+				_mm256_srli_epi32(kp, 8));
+			const __m256i l = _mm256_or_si256(_mm256_or_si256(
+				_mm256_slli_epi32(kp, 24),
+				_mm256_slli_epi32(quant8_avx2(C::KD, in.kd + i), 12)),
+				quant8_avx2(C::T, in.t + i));
+
+			_mm256_storeu_si256((__m256i *)(hi + i), h);
+			_mm256_storeu_si256((__m256i *)(lo + i), l);
+		}
+
+		/* 4 motors step, with VEX encoded 128-bit integer ops */
+		if (i + 4 <= n) {
+			const __m128i kp = quant_avx2(C::KP, in.kp + i);
+			const __m128i h = _mm_or_si128(_mm_or_si128(
+				_mm_slli_epi32(quant_avx2(C::P, in.p + i), 16),
+				_mm_slli_epi32(quant_avx2(C::V, in.v + i), 4)),
+				_mm_srli_epi32(kp, 8));
+			const __m128i l = _mm_or_si128(_mm_or_si128(
+				_mm_slli_epi32(kp, 24),
+				_mm_slli_epi32(quant_avx2(C::KD, in.kd + i), 12)),
+				quant_avx2(C::T, in.t + i));
+
+			_mm_storeu_si128((__m128i *)(hi + i), h);
+			_mm_storeu_si128((__m128i *)(lo + i), l);
+			i += 4;
+		}
+
+		words_scalar(shift(in, i), n - i, hi + i, lo + i);
+	}
+#endif /* PCANMOTOR_X86 */
+
+#ifdef PCANMOTOR_NEON
+	/* quantizes x[0..1] into 2 uint32 lanes */
+	template <unsigned Bits>
+	static uint32x2_t quant_neon(const quant<Bits> &q, const float *x) {
+		const float64x2_t one = vdupq_n_f64(1.0);
+		const uint64x2_t one_bits = vreinterpretq_u64_f64(one);
+		const float64x2_t span = vdupq_n_f64(q.span);
+		const float64x2_t min = vdupq_n_f64(q.min);
+		float64x2_t v, a, k;
+		uint64x2_t c;
+
+		v = vcvt_f64_f32(vld1_f32(x));
+
+		/* fmaxnm returns the number for NaN */
+		v = vminnmq_f64(vmaxnmq_f64(v, min), vdupq_n_f64(q.max));
+		a = vmulq_f64(vsubq_f64(v, min), vdupq_n_f64(q.max_int));
+		k = vcvtq_f64_u64(vcvtq_u64_f64(vmulq_f64(a, vdupq_n_f64(q.inv))));
+
+		c = vcleq_f64(vmulq_f64(vaddq_f64(k, one), span), a);
+		k = vaddq_f64(k, vreinterpretq_f64_u64(vandq_u64(c, one_bits)));
+		c = vcgtq_f64(vmulq_f64(k, span), a);
+		k = vsubq_f64(k, vreinterpretq_f64_u64(vandq_u64(c, one_bits)));
+
+		return vmovn_u64(vcvtq_u64_f64(k));
+	}
+
+	/* quantizes x[0..3] into 4 uint32 lanes */
+	template <unsigned Bits>
+	static uint32x4_t quant4_neon(const quant<Bits> &q, const float *x) {
+		return vcombine_u32(quant_neon(q, x), quant_neon(q, x + 2));
+	}
+
+	static void words_neon(const commands_soa &in, unsigned n,
+			uint32_t *hi, uint32_t *lo) {
+		unsigned i;
+
+		for (i = 0; i + 4 <= n; i += 4) {
+			const uint32x4_t kp = quant4_neon(C::KP, in.kp + i);
+			const uint32x4_t h = vorrq_u32(vorrq_u32(
+				vshlq_n_u32(quant4_neon(C::P, in.p + i), 16),
+				vshlq_n_u32(quant4_neon(C::V, in.v + i), 4)),
+				vshrq_n_u32(kp, 8));
+			const uint32x4_t l = vorrq_u32(vorrq_u32(
+				vshlq_n_u32(kp, 24),
+				vshlq_n_u32(quant4_neon(C::KD, in.kd + i), 12)),
+				quant4_neon(C::T, in.t + i));
+
+			vst1q_u32(hi + i, h);
+			vst1q_u32(lo + i, l);
+		}
+
+		words_scalar(shift(in, i), n - i, hi + i, lo + i);
+	}
+#endif /* PCANMOTOR_NEON */
+
+	static commands_soa shift(const commands_soa &in, unsigned i) {
+		return commands_soa { in.p + i, in.v + i, in.kp + i, in.kd + i,
+			in.t + i };
+	}
+
+	/**
+	 * @brief Computes the big endian words of n commands with kernel k.
+	 */
+	static void words(kernel k, const commands_soa &in, unsigned n,
+			uint32_t *hi, uint32_t *lo) {
+		switch (resolve_kernel(k)) {
+#ifdef PCANMOTOR_X86
+		case kernel::avx2:
+			words_avx2(in, n, hi, lo);
+			return;
+		case kernel::sse2:
+			words_sse2(in, n, hi, lo);
+			return;
+#endif
+#ifdef PCANMOTOR_NEON
+		case kernel::neon:
+			words_neon(in, n, hi, lo);
+			return;
+#endif
+		default:
+			words_scalar(in, n, hi, lo);
+			return;
+		}
+	}
+
+	/**
+	 * @brief Encodes the commands of n motors into out[0..n-1].
+	 *
+	 * @param k Kernel to use
+	 * @param in Commands of the motors
+	 * @param ids CAN id of each motor
+	 * @param n Number of motors
+	 * @param out Messages ready to be sent with pcanfd_send_msgs()
+	 * @param type PCANFD_TYPE_CAN20_MSG or PCANFD_TYPE_CANFD_MSG
+	 * @param flags PCANFD_MSG_xxx flags of the messages (e.g. PCANFD_MSG_BRS)
+	 */
+	static void encode(kernel k, const commands_soa &in, const uint32_t *ids,
+			unsigned n, struct pcanfd_msg *out,
+			__u16 type = PCANFD_TYPE_CAN20_MSG,
+			__u32 flags = PCANFD_MSG_STD) {
+		uint32_t hi[CHUNK], lo[CHUNK];
+
+		for (unsigned base = 0; base < n; base += CHUNK) {
+			const unsigned m = n - base < CHUNK ? n - base : CHUNK;
+
+			words(k, shift(in, base), m, hi, lo);
+
+			for (unsigned i = 0; i < m; i++) {
+				struct pcanfd_msg *msg = out + base + i;
+				const uint32_t be[2] = { htonl(hi[i]), htonl(lo[i]) };
+
+				msg->type = type;
+				msg->data_len = CMD_LEN;
+				msg->id = ids[base + i];
+				msg->flags = flags;
+				memcpy(msg->data, be, CMD_LEN);
+			}
+		}
+	}
+
+	static void encode(const commands_soa &in, const uint32_t *ids,
+			unsigned n, struct pcanfd_msg *out,
+			__u16 type = PCANFD_TYPE_CAN20_MSG,
+			__u32 flags = PCANFD_MSG_STD) {
+		encode(kernel::best, in, ids, n, out, type, flags);
+	}
+};
+
+/**
+ * @brief Batch decoder of the replies of a set of motors.
+ *
+ * Each motor owns a slot (its index in the state arrays). decode() keeps
+ * the latest reply of each motor among the given frames, then dequantizes
+ * them all at once, like quant::decode().
+ */
+template <class Limits = ak10_9>
+class batch_decoder {
+public:
+	typedef codec<Limits> C;
+
+	/** Motor ids are one byte */
+	static constexpr unsigned MAX_MOTORS = 256;
+
+	batch_decoder() : motors_(0), ignored_(0), superseded_(0) {
+		for (unsigned i = 0; i < MAX_MOTORS; i++) {
+			slot_of_[i] = -1;
+			frame_[i] = -1;
+		}
+	}
+
+	/**
+	 * @brief Builds a decoder for n motors, ids[i] being the id of slot i.
+	 */
+	batch_decoder(const uint8_t *ids, unsigned n) : batch_decoder() {
+		for (unsigned i = 0; i < n; i++)
+			add_motor(ids[i]);
+	}
+
+	/**
+	 * @brief Adds a motor.
+	 *
+	 * @return the slot of the motor or -1 if its id is already used.
+	 */
+	int add_motor(uint8_t id) {
+		if (slot_of_[id] >= 0)
+			return -1;
+
+		ids_[motors_] = id;
+		slot_of_[id] = (int16_t)motors_;
+		return motors_++;
+	}
+
+	unsigned motors() const { return motors_; }
+	uint8_t id(unsigned slot) const { return ids_[slot]; }
+	int slot(uint8_t id) const { return slot_of_[id]; }
+
+	/**
+	 * @brief Returns the index (in the frames given to the last decode())
+	 * of the reply used for a slot, or -1 if the motor did not reply.
+	 */
+	int frame(unsigned slot) const { return frame_[slot]; }
+
+	/** Frames which are not replies of a known motor */
+	uint64_t ignored() const { return ignored_; }
+
+	/** Replies replaced by a later reply of the same motor */
+	uint64_t superseded() const { return superseded_; }
+
+	/**
+	 * @brief Decodes the replies found in msgs[0..count-1].
+	 *
+	 * @param k Kernel to use
+	 * @param msgs Frames read in one drain of the RX queue, oldest first
+	 * @param count Number of frames
+	 * @param out State arrays indexed by slot. Slots of the motors that did
+	 * 	not reply are left unchanged.
+	 * @param updated If not NULL, updated[slot] is set to 1 if the motor
+	 * 	replied, 0 otherwise.
+	 * @return the number of updated slots.
+	 */
+	unsigned decode(kernel k, const struct pcanfd_msg *msgs, unsigned count,
+			const states_soa &out, uint8_t *updated = nullptr) {
+		unsigned n = 0, i;
+
+		for (i = 0; i < motors_; i++)
+			frame_[i] = -1;
+
+		for (i = 0; i < count; i++) {
+			const struct pcanfd_msg *msg = msgs + i;
+			int s;
+
+			if ((msg->type != PCANFD_TYPE_CAN20_MSG &&
+				msg->type != PCANFD_TYPE_CANFD_MSG) ||
+				(msg->flags & PCANFD_MSG_RTR) ||
+				msg->data_len < REPLY_LEN ||
+				(s = slot_of_[msg->data[0]]) < 0) {
+				ignored_++;
+				continue;
+			}
+
+			if (frame_[s] < 0)
+				order_[n++] = (uint8_t)s;
+			else
+				superseded_++;
+			frame_[s] = (int)i;
+		}
+
+		for (i = 0; i < n; i++) {
+			const __u8 *d = msgs[frame_[order_[i]]].data;
+
+			raw_[0][i] = (uint32_t)d[1] << 8 | d[2];
+			raw_[1][i] = (uint32_t)d[3] << 4 | d[4] >> 4;
+			raw_[2][i] = (uint32_t)(d[4] & 0xF) << 8 | d[5];
+		}
+
+		k = resolve_kernel(k);
+		dequant(k, C::P, raw_[0], val_[0], n);
+		dequant(k, C::V, raw_[1], val_[1], n);
+		dequant(k, C::T, raw_[2], val_[2], n);
+
+		if (updated)
+			memset(updated, 0, motors_);
+
+		for (i = 0; i < n; i++) {
+			const unsigned s = order_[i];
+
+			out.p[s] = val_[0][i];
+			out.v[s] = val_[1][i];
+			out.t[s] = val_[2][i];
+			if (updated)
+				updated[s] = 1;
+		}
+
+		return n;
+	}
+
+	unsigned decode(const struct pcanfd_msg *msgs, unsigned count,
+			const states_soa &out, uint8_t *updated = nullptr) {
+		return decode(kernel::best, msgs, count, out, updated);
+	}
+
+	template <unsigned Bits>
+	static void dequant_scalar(const quant<Bits> &q, const uint32_t *k,
+			float *x, unsigned n) {
+		for (unsigned i = 0; i < n; i++)
+			x[i] = q.decode(k[i]);
+	}
+
+#ifdef PCANMOTOR_X86
+	template <unsigned Bits>
+	__attribute__((target("sse2")))
+	static void dequant_sse2(const quant<Bits> &q, const uint32_t *k,
+			float *x, unsigned n) {
+		const __m128d step = _mm_set1_pd(q.step);
+		const __m128d min = _mm_set1_pd(q.min);
+		unsigned i;
+
+		for (i = 0; i + 4 <= n; i += 4) {
+			const __m128i r = _mm_loadu_si128((const __m128i *)(k + i));
+			const __m128d lo = _mm_add_pd(_mm_mul_pd(
+				_mm_cvtepi32_pd(r), step), min);
+			const __m128d hi = _mm_add_pd(_mm_mul_pd(
+				_mm_cvtepi32_pd(_mm_srli_si128(r, 8)), step), min);
+
+			_mm_storeu_ps(x + i, _mm_movelh_ps(_mm_cvtpd_ps(lo),
+				_mm_cvtpd_ps(hi)));
+		}
+
+		dequant_scalar(q, k + i, x + i, n - i);
+	}
+
+	template <unsigned Bits>
+	__attribute__((target("avx2")))
+	static void dequant_avx2(const quant<Bits> &q, const uint32_t *k,
+			float *x, unsigned n) {
+		const __m256d step = _mm256_set1_pd(q.step);
+		const __m256d min = _mm256_set1_pd(q.min);
+		unsigned i;
+
+		for (i = 0; i + 4 <= n; i += 4) {
+			const __m256d r = _mm256_cvtepi32_pd(
+				_mm_loadu_si128((const __m128i *)(k + i)));
+
+			_mm_storeu_ps(x + i, _mm256_cvtpd_ps(
+				_mm256_add_pd(_mm256_mul_pd(r, step), min)));
+		}
+
+		dequant_scalar(q, k + i, x + i, n - i);
+	}
+#endif /* PCANMOTOR_X86 */
+
+#ifdef PCANMOTOR_NEON
+	template <unsigned Bits>
+	static void dequant_neon(const quant<Bits> &q, const uint32_t *k,
+			float *x, unsigned n) {
+		const float64x2_t step = vdupq_n_f64(q.step);
+		const float64x2_t min = vdupq_n_f64(q.min);
+		unsigned i;
+
+		for (i = 0; i + 4 <= n; i += 4) {
+			const uint32x4_t r = vld1q_u32(k + i);
+			const float64x2_t lo = vaddq_f64(vmulq_f64(
+				vcvtq_f64_u64(vmovl_u32(vget_low_u32(r))), step), min);
+			const float64x2_t hi = vaddq_f64(vmulq_f64(
+				vcvtq_f64_u64(vmovl_high_u32(r)), step), min);
+
+			vst1q_f32(x + i, vcombine_f32(vcvt_f32_f64(lo),
+				vcvt_f32_f64(hi)));
+		}
+
+		dequant_scalar(q, k + i, x + i, n - i);
+	}
+#endif /* PCANMOTOR_NEON */
+
+	/**
+	 * @brief Dequantizes k[0..n-1] into x[0..n-1] with kernel kern.
+	 */
+	template <unsigned Bits>
+	static void dequant(kernel kern, const quant<Bits> &q, const uint32_t *k,
+			float *x, unsigned n) {
+		switch (resolve_kernel(kern)) {
+#ifdef PCANMOTOR_X86
+		case kernel::avx2:
+			dequant_avx2(q, k, x, n);
+			return;
+		case kernel::sse2:
+			dequant_sse2(q, k, x, n);
+			return;
+#endif
+#ifdef PCANMOTOR_NEON
+		case kernel::neon:
+			dequant_neon(q, k, x, n);
+			return;
+#endif
+		default:
+			dequant_scalar(q, k, x, n);
+			return;
+		}
+	}
+
+private:
+	unsigned motors_;
+	uint8_t ids_[MAX_MOTORS];
+	int16_t slot_of_[MAX_MOTORS];
+
+	/* last decode(): frame of each slot, and updated slots in frame order */
+	int frame_[MAX_MOTORS];
+	uint8_t order_[MAX_MOTORS];
+
+	uint32_t raw_[3][MAX_MOTORS];
+	float val_[3][MAX_MOTORS];
+
+	uint64_t ignored_;
+	uint64_t superseded_;
+};
+
+} /* namespace mit */
+} /* namespace pcanmotor */
+
+#endif /* PCANMOTOR_MIT_BATCH_HPP_ */
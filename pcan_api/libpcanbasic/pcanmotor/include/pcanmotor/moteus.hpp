@@ -0,0 +1,673 @@
+/* SPDX-License-Identifier: LGPL-2.1-only */
+/*
+ * @file moteus.hpp
+ * @brief moteus register protocol codec (header only)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * moteus controllers are driven by CAN FD frames (29-bit id, BRS) made of
+ * sub-frames:
+ *   - write (0x00), read (0x10), reply (0x20): opcode | type << 2 | count,
+ *     [count if not in 1..3], start register, values (write and reply),
+ *     of type int8, int16, int32 or float, little endian,
+ *   - write error (0x30), read error (0x31): register, error,
+ *   - stream data (0x40 to the controller, 0x41 from it): channel, length,
+ *     data, and stream poll (0x42): channel, maximum length,
+ *   - nop (0x50), which also pads the frame up to its FD length.
+ * Counts, registers, channels and lengths are varuints (7 bits per byte,
+ * least significant first, bit 7 set when a byte follows). Integer values
+ * are scaled by a resolution depending on the register and the type, the
+ * lowest value of the type standing for NaN (no limit, current position).
+ *
+ * The id is source << 8 | destination, bit 15 asking for a reply, which
+ * comes back with the ids swapped: 0x8001 is host 0 to controller 1 and
+ * its reply has id 0x100.
+ *
+ * A position command and the query of the state it replies with fit in one
+ * frame (README: "01 00 0a 0e 20 ... 11 00 1f 01 13 0d"):
+ *
+ *	TPCANMsgFD msg;
+ *	pcanmotor::moteus::position_command cmd;
+ *	pcanmotor::moteus::state st;
+ *
+ *	cmd.position = 0.5f;
+ *	pcanmotor::moteus::pack(msg, 1, cmd, pcanmotor::moteus::query());
+ *	CAN_WriteFD(PCAN_PCIBUS1, &msg);
+ *	...
+ *	if (pcanmotor::moteus::unpack(reply_msg, st) &&
+ *			(st.fields & pcanmotor::moteus::POSITION))
+ *		... st.position ...
+ *
+ * Nothing is allocated: frames are written into the caller's buffers and
+ * replies are decoded into a flat state.
+ */
+#ifndef PCANMOTOR_MOTEUS_HPP_
+#define PCANMOTOR_MOTEUS_HPP_
+
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include <PCANBasic.h>
+
+#include <pcanmotor/fd_dlc.hpp>
+
+namespace pcanmotor {
+namespace moteus {
+
+/** Data bytes of a CAN FD frame */
+constexpr unsigned FRAME_LEN = 64;
+/** Id bit asking the controller for a reply */
+constexpr uint32_t REPLY_REQUIRED = 0x8000;
+
+/** Sub-frame opcodes */
+enum op : uint8_t {
+	WRITE = 0x00,		/**< | type << 2 | count */
+	READ = 0x10,		/**< | type << 2 | count */
+	REPLY = 0x20,		/**< | type << 2 | count */
+	WRITE_ERROR = 0x30,
+	READ_ERROR = 0x31,
+	STREAM_CLIENT_DATA = 0x40,
+	STREAM_SERVER_DATA = 0x41,
+	STREAM_POLL = 0x42,
+	NOP = 0x50,
+};
+
+/** Register types */
+enum class type : uint8_t {
+	int8 = 0,
+	int16 = 1,
+	int32 = 2,
+	f32 = 3,
+};
+
+/** Registers */
+namespace reg {
+constexpr uint16_t MODE = 0x000;
+constexpr uint16_t POSITION = 0x001;		/**< rev */
+constexpr uint16_t VELOCITY = 0x002;		/**< rev/s */
+constexpr uint16_t TORQUE = 0x003;		/**< Nm */
+constexpr uint16_t Q_CURRENT = 0x004;		/**< A */
+constexpr uint16_t D_CURRENT = 0x005;		/**< A */
+constexpr uint16_t VOLTAGE = 0x00d;		/**< V */
+constexpr uint16_t TEMPERATURE = 0x00e;		/**< C */
+constexpr uint16_t FAULT = 0x00f;
+constexpr uint16_t CMD_POSITION = 0x020;
+constexpr uint16_t CMD_VELOCITY = 0x021;
+constexpr uint16_t CMD_FEEDFORWARD_TORQUE = 0x022;
+constexpr uint16_t CMD_KP_SCALE = 0x023;
+constexpr uint16_t CMD_KD_SCALE = 0x024;
+constexpr uint16_t CMD_MAX_TORQUE = 0x025;
+constexpr uint16_t CMD_STOP_POSITION = 0x026;
+constexpr uint16_t CMD_WATCHDOG_TIMEOUT = 0x027;	/**< s */
+}
+
+/** Controller modes (register MODE) */
+enum class mode : uint8_t {
+	stopped = 0,
+	fault = 1,
+	pwm = 5,
+	voltage = 6,
+	voltage_foc = 7,
+	voltage_dq = 8,
+	current = 9,
+	position = 10,
+	timeout = 11,
+	zero_velocity = 12,
+	stay_within = 13,
+	measure_inductance = 14,
+	brake = 15,
+};
+
+/** Resolution of the integer types of a register */
+struct resolution {
+	float int8;
+	float int16;
+	float int32;
+};
+
+inline resolution resolution_of(uint16_t r) {
+	switch (r) {
+	case reg::POSITION:
+	case reg::CMD_POSITION:
+	case reg::CMD_STOP_POSITION:
+		return { 0.01f, 0.0001f, 0.00001f };
+	case reg::VELOCITY:
+	case reg::CMD_VELOCITY:
+		return { 0.1f, 0.00025f, 0.00001f };
+	case reg::TORQUE:
+	case reg::CMD_FEEDFORWARD_TORQUE:
+	case reg::CMD_MAX_TORQUE:
+		return { 0.5f, 0.01f, 0.001f };
+	case reg::Q_CURRENT:
+	case reg::D_CURRENT:
+		return { 1.f, 0.1f, 0.001f };
+	case reg::VOLTAGE:
+		return { 0.5f, 0.1f, 0.001f };
+	case reg::TEMPERATURE:
+		return { 1.f, 0.1f, 0.001f };
+	case reg::CMD_KP_SCALE:
+	case reg::CMD_KD_SCALE:
+		return { 1.f / 127, 1.f / 32767, 1.f / 2147483647 };
+	case reg::CMD_WATCHDOG_TIMEOUT:
+		return { 0.01f, 0.001f, 0.000001f };
+	default:
+		/* mode, fault... */
+		return { 1.f, 1.f, 1.f };
+	}
+}
+
+/** Bytes of a value of type t */
+constexpr unsigned size_of(type t) {
+	return t == type::int8 ? 1 : t == type::int16 ? 2 : 4;
+}
+
+/** Raw integer of x at resolution res, on Bits bits (NaN: lowest value) */
+template <unsigned Bits>
+inline int32_t quantize(float x, float res) {
+	constexpr double max = (double)((1LL << (Bits - 1)) - 1);
+
+	if (isnan(x))
+		return (int32_t)(-max - 1);
+
+	double k = nearbyint((double)x / res);
+
+	k = k > max ? max : k;
+	k = k < -max ? -max : k;
+	return (int32_t)k;
+}
+
+/**
+ * @brief Writes sub-frames into a buffer.
+ *
+ * Every method returns false and leaves the buffer as it was when the
+ * sub-frame doesn't fit; ok() stays false afterwards.
+ */
+class writer {
+public:
+	explicit writer(uint8_t *buf, unsigned size = FRAME_LEN)
+		: buf_(buf), size_(size) {}
+
+	/** Bytes written */
+	unsigned size() const {
+		return pos_;
+	}
+
+	bool ok() const {
+		return ok_;
+	}
+
+	/** Writes count values to the registers from start */
+	bool write(uint16_t start, type t, const float *values, unsigned count) {
+		return values_op(WRITE, start, t, values, count);
+	}
+
+	bool write(uint16_t start, type t, float value) {
+		return values_op(WRITE, start, t, &value, 1);
+	}
+
+	/** Asks for count registers from start */
+	bool read(uint16_t start, type t, unsigned count = 1) {
+		const unsigned pos = pos_;
+
+		if (count == 0 || !header(READ, t, count, start))
+			return fail(pos);
+		return true;
+	}
+
+	/** Reply of a controller (motor side, tests) */
+	bool reply(uint16_t start, type t, const float *values, unsigned count) {
+		return values_op(REPLY, start, t, values, count);
+	}
+
+	/** Asks for at most max_len bytes of a stream channel */
+	bool poll(unsigned channel, unsigned max_len) {
+		const unsigned pos = pos_;
+
+		if (!put(STREAM_POLL) || !put_varuint(channel) || !put_varuint(max_len))
+			return fail(pos);
+		return true;
+	}
+
+	/**
+	 * @brief Pads the sub-frames with NOP up to the FD length holding them.
+	 *
+	 * @return the padded length (not above the buffer size).
+	 */
+	unsigned pad() {
+		unsigned len = fd_padded_len(pos_);
+
+		len = len < size_ ? len : size_;
+		while (pos_ < len)
+			buf_[pos_++] = NOP;
+		return pos_;
+	}
+
+private:
+	bool fail(unsigned pos) {
+		pos_ = pos;
+		ok_ = false;
+		return false;
+	}
+
+	bool put(uint8_t b) {
+		if (pos_ >= size_)
+			return false;
+		buf_[pos_++] = b;
+		return true;
+	}
+
+	bool put_varuint(uint32_t v) {
+		while (v >= 0x80) {
+			if (!put((uint8_t)(v | 0x80)))
+				return false;
+			v >>= 7;
+		}
+		return put((uint8_t)v);
+	}
+
+	bool header(uint8_t op, type t, unsigned count, uint16_t start) {
+		const uint8_t code = (uint8_t)(op | (uint8_t)t << 2);
+
+		if (count <= 3)
+			return put((uint8_t)(code | count)) && put_varuint(start);
+		return put(code) && put_varuint(count) && put_varuint(start);
+	}
+
+	bool put_value(uint16_t r, type t, float x) {
+		uint32_t v;
+
+		switch (t) {
+		case type::int8:
+			return put((uint8_t)quantize<8>(x, resolution_of(r).int8));
+		case type::int16:
+			v = (uint32_t)quantize<16>(x, resolution_of(r).int16);
+			return put((uint8_t)v) && put((uint8_t)(v >> 8));
+		case type::int32:
+			v = (uint32_t)quantize<32>(x, resolution_of(r).int32);
+			break;
+		default:
+			memcpy(&v, &x, sizeof(v));
+			break;
+		}
+		return put((uint8_t)v) && put((uint8_t)(v >> 8)) &&
+			put((uint8_t)(v >> 16)) && put((uint8_t)(v >> 24));
+	}
+
+	bool values_op(uint8_t op, uint16_t start, type t, const float *values,
+			unsigned count) {
+		const unsigned pos = pos_;
+
+		if (count == 0 || !header(op, t, count, start))
+			return fail(pos);
+		for (unsigned i = 0; i < count; i++)
+			if (!put_value((uint16_t)(start + i), t, values[i]))
+				return fail(pos);
+		return true;
+	}
+
+	uint8_t *buf_;
+	unsigned size_;
+	unsigned pos_ = 0;
+	bool ok_ = true;
+};
+
+/** Fields of a state (state::fields) and of a query (query::fields) */
+enum field : uint16_t {
+	MODE = 1 << 0,
+	POSITION = 1 << 1,
+	VELOCITY = 1 << 2,
+	TORQUE = 1 << 3,
+	Q_CURRENT = 1 << 4,
+	D_CURRENT = 1 << 5,
+	VOLTAGE = 1 << 6,
+	TEMPERATURE = 1 << 7,
+	FAULT = 1 << 8,
+};
+
+/** Registers of the fields, in field bit order */
+constexpr uint16_t field_regs[] = {
+	reg::MODE, reg::POSITION, reg::VELOCITY, reg::TORQUE, reg::Q_CURRENT,
+	reg::D_CURRENT, reg::VOLTAGE, reg::TEMPERATURE, reg::FAULT,
+};
+constexpr unsigned FIELD_COUNT = sizeof(field_regs) / sizeof(field_regs[0]);
+
+/** State of a controller, as decoded from its replies */
+struct state {
+	uint16_t fields;	/**< fields given by the reply */
+	uint8_t mode;		/**< see enum mode */
+	uint8_t fault;
+	float position;		/**< rev */
+	float velocity;		/**< rev/s */
+	float torque;		/**< Nm */
+	float q_current;	/**< A */
+	float d_current;	/**< A */
+	float voltage;		/**< V */
+	float temperature;	/**< C */
+	uint16_t errors;	/**< write and read errors */
+	uint16_t error_reg;	/**< register of the last error */
+	uint32_t error;		/**< code of the last error */
+};
+
+/** Registers a controller replies with, and their types */
+struct query {
+	uint16_t fields = MODE | POSITION | VELOCITY | TORQUE;
+	type types[FIELD_COUNT] = {
+		type::int8, type::f32, type::f32, type::f32, type::f32,
+		type::f32, type::int8, type::int8, type::int8,
+	};
+};
+
+/** Position mode command (CMD_* registers) */
+struct position_command {
+	float position = 0.f;			/**< rev, NaN: current position */
+	float velocity = 0.f;			/**< rev/s */
+	float feedforward_torque = 0.f;		/**< Nm */
+	float kp_scale = 1.f;
+	float kd_scale = 1.f;
+	float max_torque = NAN;			/**< Nm, NaN: no limit */
+	float stop_position = NAN;		/**< rev, NaN: none */
+	float watchdog_timeout = NAN;		/**< s, NaN: configured one */
+	uint8_t fields = 0x3;			/**< registers written, bit i: CMD_POSITION + i */
+	type value_type = type::f32;		/**< type of the registers written */
+};
+
+/**
+ * @brief Writes the reads of q, registers of the same type that follow
+ * each other sharing one sub-frame.
+ */
+inline bool put_query(writer &w, const query &q) {
+	unsigned i = 0;
+
+	while (i < FIELD_COUNT) {
+		if (!(q.fields & (1u << i))) {
+			i++;
+			continue;
+		}
+
+		unsigned n = 1;
+
+		while (i + n < FIELD_COUNT && (q.fields & (1u << (i + n))) &&
+				q.types[i + n] == q.types[i] &&
+				field_regs[i + n] == field_regs[i] + n)
+			n++;
+		if (!w.read(field_regs[i], q.types[i], n))
+			return false;
+		i += n;
+	}
+	return true;
+}
+
+/**
+ * @brief Writes the position mode and the registers of cmd given by
+ * cmd.fields, each run of registers in one sub-frame.
+ */
+inline bool put_position(writer &w, const position_command &cmd) {
+	const float v[] = {
+		cmd.position, cmd.velocity, cmd.feedforward_torque, cmd.kp_scale,
+		cmd.kd_scale, cmd.max_torque, cmd.stop_position, cmd.watchdog_timeout,
+	};
+	unsigned i = 0;
+
+	if (!w.write(reg::MODE, type::int8, (float)mode::position))
+		return false;
+	while (i < 8) {
+		if (!(cmd.fields & (1u << i))) {
+			i++;
+			continue;
+		}
+
+		unsigned n = 1;
+
+		while (i + n < 8 && (cmd.fields & (1u << (i + n))))
+			n++;
+		if (!w.write((uint16_t)(reg::CMD_POSITION + i), cmd.value_type, v + i, n))
+			return false;
+		i += n;
+	}
+	return true;
+}
+
+/** Id of a frame from source to the controller dest */
+constexpr uint32_t can_id(uint8_t dest, uint8_t source = 0, bool reply = true) {
+	return (reply ? REPLY_REQUIRED : 0) | (uint32_t)(source & 0x7f) << 8 | (dest & 0x7f);
+}
+
+/** Controller a reply comes from */
+constexpr uint8_t reply_source(uint32_t id) {
+	return (uint8_t)((id >> 8) & 0x7f);
+}
+
+/**
+ * @brief Builds in msg the position command of controller dest followed by
+ * the query of q, padded up to its FD length.
+ *
+ * @return false if they don't fit in a frame.
+ */
+inline bool pack(TPCANMsgFD &msg, uint8_t dest, const position_command &cmd,
+		const query &q, uint8_t source = 0) {
+	writer w(msg.DATA);
+
+	if (!put_position(w, cmd) || !put_query(w, q))
+		return false;
+	msg.ID = can_id(dest, source);
+	msg.MSGTYPE = PCAN_MESSAGE_EXTENDED | PCAN_MESSAGE_FD | PCAN_MESSAGE_BRS;
+	msg.DLC = fd_dlc(w.pad());
+	return true;
+}
+
+inline bool pack(struct pcanfd_msg &msg, uint8_t dest, const position_command &cmd,
+		const query &q, uint8_t source = 0) {
+	writer w(msg.data);
+
+	if (!put_position(w, cmd) || !put_query(w, q))
+		return false;
+	msg.type = PCANFD_TYPE_CANFD_MSG;
+	msg.flags = PCANFD_MSG_EXT | PCANFD_MSG_BRS;
+	msg.id = can_id(dest, source);
+	msg.data_len = (__u16)w.pad();
+	return true;
+}
+
+/** Builds in msg the stop command of controller dest ("01 00 00") */
+inline void pack_stop(TPCANMsgFD &msg, uint8_t dest, uint8_t source = 0,
+		bool reply = false) {
+	writer w(msg.DATA);
+
+	w.write(reg::MODE, type::int8, (float)mode::stopped);
+	msg.ID = can_id(dest, source, reply);
+	msg.MSGTYPE = PCAN_MESSAGE_EXTENDED | PCAN_MESSAGE_FD | PCAN_MESSAGE_BRS;
+	msg.DLC = fd_dlc(w.size());
+}
+
+/** Reads sub-frames */
+class reader {
+public:
+	reader(const uint8_t *buf, unsigned len) : buf_(buf), len_(len) {}
+
+	bool done() const {
+		return pos_ >= len_;
+	}
+
+	bool get(uint8_t &b) {
+		if (pos_ >= len_)
+			return false;
+		b = buf_[pos_++];
+		return true;
+	}
+
+	bool get_varuint(uint32_t &v) {
+		uint8_t b;
+
+		v = 0;
+		for (unsigned shift = 0; shift < 32; shift += 7) {
+			if (!get(b))
+				return false;
+			v |= (uint32_t)(b & 0x7f) << shift;
+			if (!(b & 0x80))
+				return true;
+		}
+		return false;
+	}
+
+	/** Value of register r, scaled */
+	bool get_value(uint16_t r, type t, float &x) {
+		const unsigned n = size_of(t);
+		uint32_t v = 0;
+
+		if (pos_ + n > len_)
+			return false;
+		for (unsigned i = 0; i < n; i++)
+			v |= (uint32_t)buf_[pos_ + i] << (8 * i);
+		pos_ += n;
+
+		switch (t) {
+		case type::int8:
+			x = v == 0x80 ? NAN : (int8_t)v * resolution_of(r).int8;
+			break;
+		case type::int16:
+			x = v == 0x8000 ? NAN : (int16_t)v * resolution_of(r).int16;
+			break;
+		case type::int32:
+			x = v == 0x80000000 ? NAN : (float)((int32_t)v * (double)resolution_of(r).int32);
+			break;
+		default:
+			memcpy(&x, &v, sizeof(x));
+			break;
+		}
+		return true;
+	}
+
+	bool skip(unsigned n) {
+		if (pos_ + n > len_)
+			return false;
+		pos_ += n;
+		return true;
+	}
+
+private:
+	const uint8_t *buf_;
+	unsigned len_;
+	unsigned pos_ = 0;
+};
+
+/** Stores the value of register r in st */
+inline void set_field(state &st, uint16_t r, float x) {
+	switch (r) {
+	case reg::MODE:
+		st.mode = (uint8_t)x;
+		st.fields |= MODE;
+		break;
+	case reg::POSITION:
+		st.position = x;
+		st.fields |= POSITION;
+		break;
+	case reg::VELOCITY:
+		st.velocity = x;
+		st.fields |= VELOCITY;
+		break;
+	case reg::TORQUE:
+		st.torque = x;
+		st.fields |= TORQUE;
+		break;
+	case reg::Q_CURRENT:
+		st.q_current = x;
+		st.fields |= Q_CURRENT;
+		break;
+	case reg::D_CURRENT:
+		st.d_current = x;
+		st.fields |= D_CURRENT;
+		break;
+	case reg::VOLTAGE:
+		st.voltage = x;
+		st.fields |= VOLTAGE;
+		break;
+	case reg::TEMPERATURE:
+		st.temperature = x;
+		st.fields |= TEMPERATURE;
+		break;
+	case reg::FAULT:
+		st.fault = (uint8_t)x;
+		st.fields |= FAULT;
+		break;
+	default:
+		break;
+	}
+}
+
+/**
+ * @brief Decodes the reply sub-frames of buf into st.
+ *
+ * st.fields tells the fields given by the reply, the others are left
+ * untouched. Registers outside of state and stream data are skipped.
+ *
+ * @return false if a sub-frame is truncated or is not a reply one (st then
+ * 	holds the fields decoded before it).
+ */
+inline bool decode(const uint8_t *buf, unsigned len, state &st) {
+	reader r(buf, len);
+
+	st.fields = 0;
+	st.errors = 0;
+	while (!r.done()) {
+		uint8_t code;
+		uint32_t count, start, v;
+
+		r.get(code);
+		if (code == NOP)
+			continue;
+		if ((code & 0xf0) == REPLY) {
+			const type t = (type)((code >> 2) & 3);
+
+			count = code & 3;
+			if ((count == 0 && !r.get_varuint(count)) || !r.get_varuint(start))
+				return false;
+			for (uint32_t i = 0; i < count; i++) {
+				float x;
+
+				if (!r.get_value((uint16_t)(start + i), t, x))
+					return false;
+				set_field(st, (uint16_t)(start + i), x);
+			}
+			continue;
+		}
+		switch (code) {
+		case WRITE_ERROR:
+		case READ_ERROR:
+			if (!r.get_varuint(start) || !r.get_varuint(v))
+				return false;
+			st.errors++;
+			st.error_reg = (uint16_t)start;
+			st.error = v;
+			break;
+		case STREAM_SERVER_DATA:
+			if (!r.get_varuint(start) || !r.get_varuint(count) || !r.skip(count))
+				return false;
+			break;
+		default:
+			return false;
+		}
+	}
+	return true;
+}
+
+inline bool unpack(const TPCANMsgFD &msg, state &st) {
+	return decode(msg.DATA, fd_len(msg.DLC), st);
+}
+
+inline bool unpack(const struct pcanfd_msg &msg, state &st) {
+	return decode(msg.data, msg.data_len > FRAME_LEN ? FRAME_LEN : msg.data_len, st);
+}
+
+} /* namespace moteus */
+} /* namespace pcanmotor */
+
+#endif /* PCANMOTOR_MOTEUS_HPP_ */
@@ -0,0 +1,532 @@
+/* SPDX-License-Identifier: LGPL-2.1-only */
+/*
+ * @file motor_sim.hpp
+ * @brief Host-side simulation of a bus of MIT motors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Stands for the motors of a channel so that the control loops can be run
+ * and measured without hardware, either:
+ *   - in process: the frames written by the host are given to write(), the
+ *     replies are taken with read() (fd() becomes readable when replies are
+ *     waiting, like PCAN_RECEIVE_EVENT),
+ *   - or on a channel of libpcanbasic (attach()), e.g. a node of the virtual
+ *     bus (PCANBASIC_VIRTUAL) or a pcan channel wired to the host's: a
+ *     bridge thread gives the frames read on the channel to write() and the
+ *     replies are written to the channel, so that the host runs through the
+ *     real library.
+ *
+ * Each motor runs the MIT firmware behaviour:
+ *   - FF..FC enters motor mode, FF..FD exits it, FF..FE sets the current
+ *     position as zero, each answered by a reply,
+ *   - a command sets the setpoint and is answered by a reply,
+ *   - in motor mode, the torque is kp (p_des - p) + kd (v_des - v) + t_ff,
+ *     limited to the torque range, 0 otherwise,
+ * and a first-order rotor model J dv/dt = torque - b v, integrated at a
+ * fixed step. A reply is sent "latency" after its frame was written (rounded
+ * up to the step) and holds the state quantized at that time. With a 0
+ * latency, the reply is sent at once by the thread which wrote the frame,
+ * with the state of the last step. With a 0 step, there is no rotor model:
+ * a motor in motor mode is at the setpoint of its last command (position,
+ * velocity, feed-forward torque) and replies at once: the motors of the
+ * benchmarks and of canjitter.
+ *
+ * The motors are shared among worker threads (round robin), each
+ * integrating its motors at the step period.
+ */
+#ifndef PCANMOTOR_MOTOR_SIM_HPP_
+#define PCANMOTOR_MOTOR_SIM_HPP_
+
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <pcanmotor/channel.hpp>
+#include <pcanmotor/mit.hpp>
+#include <pcanmotor/rt.hpp>
+#include <pcanfd.h>
+
+namespace pcanmotor {
+
+/** Rotor of a simulated motor: J dv/dt = torque - b v */
+struct plant_params {
+	double inertia = 0.01;		/**< J, rotor and load (kg.m^2) */
+	double damping = 0.05;		/**< b, viscous friction (Nm.s/rad) */
+};
+
+/** Configuration of a simulated bus */
+struct sim_config {
+	int64_t step_ns = 100000;	/**< integration step, 0: motors at
+					     their setpoint, no latency */
+	int64_t latency_ns = 200000;	/**< frame written to reply sent,
+					     0: at once */
+	unsigned workers = 1;		/**< threads integrating the motors */
+	uint32_t reply_id = 0;		/**< CAN id of the replies */
+	unsigned rx_max = 4096;		/**< replies waiting for read() */
+	plant_params plant;
+};
+
+/** Counters of a simulated bus */
+struct sim_stats {
+	uint64_t commands = 0;		/**< command frames received */
+	uint64_t modes = 0;		/**< mode frames received */
+	uint64_t ignored = 0;		/**< frames of unknown ids or lengths */
+	uint64_t replies = 0;		/**< replies sent */
+	uint64_t overflows = 0;		/**< replies lost, read() too slow or
+					     TX queue of the channel full */
+	uint64_t late_steps = 0;	/**< integration steps run late */
+};
+
+/** State of a simulated motor */
+struct sim_state {
+	bool enabled;			/**< in motor mode */
+	double p;			/**< position (rad) */
+	double v;			/**< velocity (rad/s) */
+	double t;			/**< applied torque (Nm) */
+};
+
+template <class Limits = mit::ak10_9>
+class motor_sim {
+public:
+	typedef mit::codec<Limits> C;
+
+	explicit motor_sim(const sim_config &cfg = sim_config())
+		: cfg_(cfg), motors_(0), channel_(PCAN_NONEBUS), chan_fd_(-1),
+		  ignored_(0), overflows_(0), running_(false) {
+		if (cfg_.workers < 1)
+			cfg_.workers = 1;
+		if (cfg_.step_ns <= 0)
+			cfg_.step_ns = 0;
+		if (cfg_.latency_ns <= 0 || !cfg_.step_ns)
+			cfg_.latency_ns = 0;
+		for (unsigned i = 0; i < cfg_.workers; i++)
+			workers_.emplace_back(new worker);
+		for (unsigned i = 0; i < 256; i++)
+			where_[i].w = -1;
+		efd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	}
+
+	~motor_sim() {
+		stop();
+		if (efd_ >= 0)
+			close(efd_);
+	}
+
+	motor_sim(const motor_sim &) = delete;
+	motor_sim &operator=(const motor_sim &) = delete;
+
+	const sim_config &config() const { return cfg_; }
+
+	/** Readable while replies are waiting (-1 if eventfd() failed) */
+	int fd() const { return efd_; }
+
+	/**
+	 * @brief Adds a motor (before start()), at position p.
+	 *
+	 * @return false if the id is already used.
+	 */
+	bool add_motor(uint8_t id, double p = 0) {
+		if (running_ || where_[id].w >= 0)
+			return false;
+
+		const unsigned w = motors_ % cfg_.workers;
+		worker &wk = *workers_[w];
+		motor m = {};
+
+		m.id = id;
+		m.s.p = p;
+		where_[id].w = (int)w;
+		where_[id].i = (unsigned)wk.motors.size();
+		wk.motors.push_back(m);
+		motors_++;
+		return true;
+	}
+
+	unsigned motors() const { return motors_; }
+
+	/**
+	 * @brief Puts the motors on a channel (before start()), initialized by
+	 * the caller: the frames received on the channel are given to write()
+	 * and the replies are written to the channel instead of read().
+	 *
+	 * @return false if the simulator is running.
+	 */
+	bool attach(TPCANHandle channel) {
+		if (running_)
+			return false;
+
+		/* without receive event, the channel is polled */
+		channel_ = channel;
+		chan_fd_ = receive_event(channel);
+		return true;
+	}
+
+	/** Starts the worker threads, and the bridge of an attached channel */
+	void start() {
+		if (running_)
+			return;
+
+		running_ = true;
+		if (cfg_.step_ns)
+			for (auto &w : workers_)
+				w->thread = std::thread(&motor_sim::run, this,
+					w.get());
+		if (channel_ != PCAN_NONEBUS)
+			bridge_ = std::thread(&motor_sim::bridge, this);
+	}
+
+	/** Stops the threads */
+	void stop() {
+		running_ = false;
+		for (auto &w : workers_)
+			if (w->thread.joinable())
+				w->thread.join();
+		if (bridge_.joinable())
+			bridge_.join();
+	}
+
+	/**
+	 * @brief Puts frames on the simulated bus (any thread).
+	 *
+	 * @return the number of frames for a simulated motor.
+	 */
+	unsigned write(const struct pcanfd_msg *msgs, unsigned n) {
+		const int64_t now = rt::now_ns();
+		struct pcanfd_msg out[POST_MAX];
+		unsigned i, taken = 0, k = 0;
+
+		for (i = 0; i < n; i++) {
+			const struct pcanfd_msg &msg = msgs[i];
+
+			if (msg.id > 0xFF || where_[msg.id].w < 0) {
+				ignored_.fetch_add(1, std::memory_order_relaxed);
+				continue;
+			}
+
+			worker &wk = *workers_[where_[msg.id].w];
+			const frame f = { msg, now, where_[msg.id].i };
+
+			taken++;
+			if (k == POST_MAX) {
+				post(out, k);
+				k = 0;
+			}
+
+			std::lock_guard<std::mutex> lock(wk.lock);
+
+			if (cfg_.latency_ns) {
+				wk.inbox.push_back(f);
+				continue;
+			}
+
+			/* no latency: the reply is due now */
+			receive(wk, f);
+			k += take_replies(wk, now, out + k, POST_MAX - k);
+		}
+
+		if (k)
+			post(out, k);
+		return taken;
+	}
+
+	/**
+	 * @brief Takes at most max replies (any thread).
+	 *
+	 * @return the number of replies stored in out.
+	 */
+	unsigned read(struct pcanfd_msg *out, unsigned max) {
+		std::lock_guard<std::mutex> lock(rx_lock_);
+		unsigned n = 0;
+
+		while (n < max && !rx_.empty()) {
+			out[n++] = rx_.front();
+			rx_.pop_front();
+		}
+		if (rx_.empty() && efd_ >= 0) {
+			uint64_t v;
+			ssize_t r = ::read(efd_, &v, sizeof(v));
+
+			(void)r;
+		}
+
+		return n;
+	}
+
+	/**
+	 * @brief Reads the state of a motor (any thread).
+	 *
+	 * @return false if there is no such motor.
+	 */
+	bool state(uint8_t id, sim_state &s) const {
+		if (where_[id].w < 0)
+			return false;
+
+		worker &wk = *workers_[where_[id].w];
+		std::lock_guard<std::mutex> lock(wk.lock);
+
+		s = wk.motors[where_[id].i].s;
+		return true;
+	}
+
+	/** Counters (any thread) */
+	sim_stats stats() const {
+		sim_stats st;
+
+		for (const auto &w : workers_) {
+			std::lock_guard<std::mutex> lock(w->lock);
+
+			st.commands += w->st.commands;
+			st.modes += w->st.modes;
+			st.ignored += w->st.ignored;
+			st.replies += w->st.replies;
+			st.late_steps += w->st.late_steps;
+		}
+		st.ignored += ignored_.load(std::memory_order_relaxed);
+		st.overflows = overflows_.load(std::memory_order_relaxed);
+		return st;
+	}
+
+private:
+	/* frames of a CAN_ReadMany()/CAN_WriteMany() of the channel */
+	static constexpr unsigned POST_MAX = 64;
+
+	struct motor {
+		uint8_t id;
+		sim_state s;
+		mit::command cmd;
+		bool has_cmd;
+	};
+
+	struct frame {
+		struct pcanfd_msg msg;
+		int64_t rx_ns;
+		unsigned motor;
+	};
+
+	/* a reply to send at due_ns */
+	struct pending {
+		int64_t due_ns;
+		unsigned motor;
+		__u16 type;
+		__u32 flags;
+	};
+
+	struct worker {
+		mutable std::mutex lock;
+		std::vector<motor> motors;
+		std::vector<frame> inbox;	/* written by the host */
+		std::deque<pending> replies;	/* ordered by due time */
+		struct pcanfd_msg out[POST_MAX];
+		sim_stats st;
+		std::thread thread;
+	};
+
+	struct place {
+		int w;
+		unsigned i;
+	};
+
+	/* frame f received by its motor */
+	void receive(worker &wk, const frame &f) {
+		motor &m = wk.motors[f.motor];
+		mit::mode md;
+
+		if (mit::is_mode(f.msg.data, f.msg.data_len, &md)) {
+			switch (md) {
+			case mit::mode::enter:
+				m.s.enabled = true;
+				m.has_cmd = false;
+				break;
+			case mit::mode::exit:
+				m.s.enabled = false;
+				break;
+			case mit::mode::zero:
+				m.s.p = 0;
+				break;
+			}
+			wk.st.modes++;
+		} else if (C::unpack(f.msg.data, f.msg.data_len, m.cmd)) {
+			m.has_cmd = true;
+			wk.st.commands++;
+
+			/* no rotor model: the motor is at its setpoint */
+			if (!cfg_.step_ns && m.s.enabled) {
+				m.s.p = m.cmd.p;
+				m.s.v = m.cmd.v;
+				m.s.t = m.cmd.t;
+			}
+		} else {
+			wk.st.ignored++;
+			return;
+		}
+
+		/* replied in the format of the frame */
+		wk.replies.push_back({ f.rx_ns + cfg_.latency_ns, f.motor,
+			f.msg.type, f.msg.flags & PCANFD_MSG_BRS });
+	}
+
+	/* builds the replies due at now into out, returns their count */
+	unsigned take_replies(worker &wk, int64_t now, struct pcanfd_msg *out,
+			unsigned max) {
+		unsigned n = 0;
+
+		while (n < max && !wk.replies.empty() &&
+				wk.replies.front().due_ns <= now) {
+			const pending &r = wk.replies.front();
+			const motor &m = wk.motors[r.motor];
+			struct pcanfd_msg &msg = out[n++];
+
+			memset(&msg, 0, sizeof(msg));
+			msg.type = r.type;
+			msg.flags = r.flags | PCANFD_TIMESTAMP;
+			msg.id = cfg_.reply_id;
+			msg.data_len = mit::REPLY_LEN;
+			C::pack_reply(msg.data, m.id, m.s.p, m.s.v, m.s.t);
+			msg.timestamp.tv_sec = now / rt::NSEC_PER_SEC;
+			msg.timestamp.tv_usec = now % rt::NSEC_PER_SEC / 1000;
+			wk.replies.pop_front();
+		}
+		wk.st.replies += n;
+		return n;
+	}
+
+	void integrate(motor &m, double dt) {
+		const plant_params &pl = cfg_.plant;
+		double t = 0;
+
+		if (m.s.enabled && m.has_cmd) {
+			t = m.cmd.kp * (m.cmd.p - m.s.p) +
+				m.cmd.kd * (m.cmd.v - m.s.v) + m.cmd.t;
+			t = t < Limits::t.min ? Limits::t.min :
+				t > Limits::t.max ? Limits::t.max : t;
+		}
+
+		/* semi-implicit Euler */
+		m.s.t = t;
+		m.s.v += dt * (t - pl.damping * m.s.v) / pl.inertia;
+		m.s.p += dt * m.s.v;
+	}
+
+	void run(worker *wk) {
+		rt::periodic timer(cfg_.step_ns);
+		const double dt = cfg_.step_ns * 1e-9;
+
+		timer.start();
+		while (running_.load(std::memory_order_relaxed)) {
+			const uint64_t missed = timer.wait();
+			const int64_t now = timer.current();
+			unsigned n;
+
+			std::unique_lock<std::mutex> lock(wk->lock);
+
+			wk->st.late_steps += missed;
+			for (const frame &f : wk->inbox)
+				receive(*wk, f);
+			wk->inbox.clear();
+
+			for (uint64_t k = 0; k <= missed; k++)
+				for (motor &m : wk->motors)
+					integrate(m, dt);
+
+			/* posted out of the lock, POST_MAX at a time */
+			while ((n = take_replies(*wk, now, wk->out, POST_MAX))) {
+				lock.unlock();
+				post(wk->out, n);
+				lock.lock();
+			}
+		}
+	}
+
+	/* gives the frames received on the attached channel to the motors */
+	void bridge() {
+		struct pollfd pfd = { chan_fd_, POLLIN, 0 };
+		unsigned i, n;
+
+		while (running_.load(std::memory_order_relaxed)) {
+			if (pfd.fd < 0)
+				usleep(100);
+			else if (poll(&pfd, 1, 10) <= 0)
+				continue;
+
+			do {
+				in_.count = POST_MAX;
+				if (CAN_ReadMany(channel_, in_.msgs()) != PCAN_ERROR_OK)
+					break;
+
+				/* status and error messages are not for the motors */
+				for (i = n = 0; i < in_.count; i++)
+					if (in_.list[i].type == PCANFD_TYPE_CAN20_MSG ||
+						in_.list[i].type == PCANFD_TYPE_CANFD_MSG)
+						in_.list[n++] = in_.list[i];
+				write(in_.list, n);
+			} while (in_.count == POST_MAX);
+		}
+	}
+
+	/* makes the replies readable, or writes them to the attached channel */
+	void post(const struct pcanfd_msg *msgs, unsigned n) {
+		std::lock_guard<std::mutex> lock(rx_lock_);
+		unsigned i;
+
+		if (channel_ != PCAN_NONEBUS) {
+			/* n <= POST_MAX; the channel timestamps the frames */
+			for (i = 0; i < n; i++) {
+				out_.list[i] = msgs[i];
+				out_.list[i].flags &= ~PCANFD_TIMESTAMP;
+			}
+			out_.count = n;
+			if (CAN_WriteMany(channel_, out_.msgs()) != PCAN_ERROR_OK)
+				overflows_.fetch_add(n - out_.count,
+					std::memory_order_relaxed);
+			return;
+		}
+
+		for (i = 0; i < n; i++) {
+			if (rx_.size() >= cfg_.rx_max) {
+				overflows_.fetch_add(1, std::memory_order_relaxed);
+				continue;
+			}
+			rx_.push_back(msgs[i]);
+		}
+		if (efd_ >= 0) {
+			const uint64_t one = 1;
+			ssize_t r = ::write(efd_, &one, sizeof(one));
+
+			(void)r;
+		}
+	}
+
+	sim_config cfg_;
+	std::vector<std::unique_ptr<worker>> workers_;
+	place where_[256];
+	unsigned motors_;
+	int efd_;
+	TPCANHandle channel_;		/* attached channel */
+	int chan_fd_;			/* its receive event */
+	std::thread bridge_;
+	msg_list<POST_MAX> in_;		/* frames read by the bridge */
+	std::mutex rx_lock_;		/* replies, in rx_ or out_ */
+	std::deque<struct pcanfd_msg> rx_;
+	msg_list<POST_MAX> out_;
+	std::atomic<uint64_t> ignored_;
+	std::atomic<uint64_t> overflows_;
+	std::atomic<bool> running_;
+};
+
+} /* namespace pcanmotor */
+
+#endif /* PCANMOTOR_MOTOR_SIM_HPP_ */
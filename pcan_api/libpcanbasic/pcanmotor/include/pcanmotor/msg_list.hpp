@@ -0,0 +1,40 @@
+/* SPDX-License-Identifier: LGPL-2.1-only */
+/*
+ * @file msg_list.hpp
+ * @brief Fixed size lists of struct pcanfd_msg
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+#ifndef PCANMOTOR_MSG_LIST_HPP_
+#define PCANMOTOR_MSG_LIST_HPP_
+
+#include <PCANBasic.h>
+
+namespace pcanmotor {
+
+/**
+ * @brief List of N messages laid out like struct pcanfd_msgs (the
+ * __array_of_struct() types of pcanfd.h can not be sized by a template
+ * parameter), for CAN_ReadMany() and CAN_WriteMany().
+ */
+template <unsigned N>
+struct msg_list {
+	__u32 count;
+	struct pcanfd_msg list[N];
+
+	struct pcanfd_msgs *msgs() {
+		return reinterpret_cast<struct pcanfd_msgs *>(this);
+	}
+};
+
+} /* namespace pcanmotor */
+
+#endif /* PCANMOTOR_MSG_LIST_HPP_ */
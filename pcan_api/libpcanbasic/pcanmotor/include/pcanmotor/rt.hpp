@@ -0,0 +1,388 @@
+/* SPDX-License-Identifier: LGPL-2.1-only */
+/*
+ * @file rt.hpp
+ * @brief Real-time helpers: thread setup, periodic wake-ups, barrier,
+ * statistics, histograms
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+#ifndef PCANMOTOR_RT_HPP_
+#define PCANMOTOR_RT_HPP_
+
+#include <alloca.h>
+#include <errno.h>
+#include <math.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <vector>
+
+namespace pcanmotor {
+namespace rt {
+
+constexpr int64_t NSEC_PER_SEC = 1000000000LL;
+
+/** Returns the time of CLOCK_MONOTONIC in ns */
+inline int64_t now_ns() {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+inline struct timespec to_timespec(int64_t ns) {
+	struct timespec ts;
+
+	ts.tv_sec = ns / NSEC_PER_SEC;
+	ts.tv_nsec = ns % NSEC_PER_SEC;
+	return ts;
+}
+
+/** Scheduling of a real-time thread */
+struct thread_config {
+	int priority = 80;		/**< SCHED_FIFO priority, 0 keeps SCHED_OTHER */
+	int cpu = -1;			/**< CPU to pin the thread on, -1 for none */
+	bool lock_memory = true;	/**< mlockall() current and future pages */
+	size_t prefault_stack = 64 * 1024;	/**< stack bytes to touch */
+};
+
+/**
+ * @brief Applies cfg to the calling thread.
+ *
+ * @return 0 or a positive errno code of the first step that failed (the
+ * 	other steps are still applied).
+ */
+inline int setup_thread(const thread_config &cfg) {
+	int err = 0;
+
+	if (cfg.lock_memory && mlockall(MCL_CURRENT | MCL_FUTURE))
+		err = errno;
+
+	if (cfg.prefault_stack) {
+		/* fault the stack pages in now, not in the first cycles */
+		volatile char *stack = (volatile char *)alloca(cfg.prefault_stack);
+
+		for (size_t i = 0; i < cfg.prefault_stack; i += 4096)
+			stack[i] = 0;
+	}
+
+	if (cfg.cpu >= 0) {
+		cpu_set_t set;
+		int e;
+
+		CPU_ZERO(&set);
+		CPU_SET(cfg.cpu, &set);
+		e = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+		if (e && !err)
+			err = e;
+	}
+
+	if (cfg.priority > 0) {
+		struct sched_param sp;
+		int e;
+
+		memset(&sp, 0, sizeof(sp));
+		sp.sched_priority = cfg.priority;
+		e = pthread_setschedparam(pthread_self(), SCHED_FIFO, &sp);
+		if (e && !err)
+			err = e;
+	}
+
+	return err;
+}
+
+/** Source of the periodic wake-ups */
+enum class clock_source {
+	nanosleep,	/**< clock_nanosleep(TIMER_ABSTIME) */
+	timerfd,	/**< read() on a periodic timerfd */
+};
+
+/**
+ * @brief Periodic wake-ups on CLOCK_MONOTONIC.
+ *
+ * wait() returns at the start of the next period. Periods that are
+ * completely missed are skipped (and counted), so that the schedule never
+ * drifts.
+ */
+class periodic {
+public:
+	periodic(int64_t period_ns, clock_source src = clock_source::nanosleep)
+		: period_(period_ns), src_(src), fd_(-1), next_(0) {}
+
+	~periodic() { stop(); }
+
+	periodic(const periodic &) = delete;
+	periodic &operator=(const periodic &) = delete;
+
+	int64_t period() const { return period_; }
+
+	/** Start time of the current period (ns) */
+	int64_t current() const { return next_ - period_; }
+
+	/** Start time of the next period (ns) */
+	int64_t next() const { return next_; }
+
+	/**
+	 * @brief Starts the schedule.
+	 *
+	 * @param first Start of the first period (CLOCK_MONOTONIC, ns), 0 for
+	 * 	one period from now. Threads given the same first time wake up
+	 * 	together.
+	 * @return 0 or a positive errno code.
+	 */
+	int start(int64_t first = 0) {
+		next_ = first ? first : now_ns() + period_;
+
+		if (src_ == clock_source::timerfd) {
+			struct itimerspec its;
+
+			fd_ = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+			if (fd_ < 0)
+				return errno;
+
+			its.it_value = to_timespec(next_);
+			its.it_interval = to_timespec(period_);
+			if (timerfd_settime(fd_, TFD_TIMER_ABSTIME, &its, NULL)) {
+				int err = errno;
+
+				stop();
+				return err;
+			}
+		}
+
+		return 0;
+	}
+
+	void stop() {
+		if (fd_ >= 0) {
+			close(fd_);
+			fd_ = -1;
+		}
+	}
+
+	/**
+	 * @brief Waits for the start of the next period.
+	 *
+	 * @param[out] wakeup_ns Wake-up latency: time elapsed between the
+	 * 	start of the period and the return of the wait.
+	 * @return the number of periods that were missed (0 if none).
+	 */
+	uint64_t wait(int64_t *wakeup_ns = nullptr) {
+		uint64_t missed = 0;
+		int64_t t;
+
+		if (src_ == clock_source::timerfd && fd_ >= 0) {
+			uint64_t expirations;
+
+			while (read(fd_, &expirations, sizeof(expirations)) < 0 &&
+				errno == EINTR)
+				;
+			t = now_ns();
+
+			/* the timer goes on by itself */
+			if (expirations > 1) {
+				missed = expirations - 1;
+				next_ += missed * period_;
+			}
+		} else {
+			const struct timespec ts = to_timespec(next_);
+
+			while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts,
+				NULL) == EINTR)
+				;
+			t = now_ns();
+
+			/* late by more than one period: skip the missed ones */
+			if (t - next_ >= period_) {
+				missed = (t - next_) / period_;
+				next_ += missed * period_;
+			}
+		}
+
+		if (wakeup_ns)
+			*wakeup_ns = t - next_;
+
+		next_ += period_;
+		return missed;
+	}
+
+private:
+	int64_t period_;
+	clock_source src_;
+	int fd_;
+	int64_t next_;
+};
+
+/** Tells the CPU that the thread is spinning */
+inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+	asm volatile("yield" ::: "memory");
+#endif
+}
+
+/**
+ * @brief Reusable barrier of n threads, without lock nor system call.
+ *
+ * Threads spin on a generation counter, then yield the CPU (so that
+ * threads sharing a CPU still make progress). The last thread to arrive
+ * runs a completion function before releasing the others.
+ */
+class spin_barrier {
+public:
+	/** Spins before yielding the CPU */
+	static constexpr unsigned SPINS = 4096;
+
+	explicit spin_barrier(unsigned n = 1) : n_(n), count_(n), gen_(0) {}
+
+	spin_barrier(const spin_barrier &) = delete;
+	spin_barrier &operator=(const spin_barrier &) = delete;
+
+	/** Sets the number of threads (no thread may be waiting) */
+	void reset(unsigned n) {
+		n_ = n;
+		count_.store(n, std::memory_order_relaxed);
+	}
+
+	/**
+	 * @brief Waits for the n threads, the last one calls completion()
+	 * first.
+	 *
+	 * @return true in the thread which called completion().
+	 */
+	template <class F>
+	bool arrive_and_wait(F &&completion) {
+		const unsigned gen = gen_.load(std::memory_order_acquire);
+
+		if (count_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+			completion();
+			count_.store(n_, std::memory_order_relaxed);
+			gen_.store(gen + 1, std::memory_order_release);
+			return true;
+		}
+
+		for (unsigned spins = 0;
+			gen_.load(std::memory_order_acquire) == gen; spins++) {
+			if (spins < SPINS)
+				cpu_relax();
+			else
+				sched_yield();
+		}
+		return false;
+	}
+
+	bool arrive_and_wait() {
+		return arrive_and_wait([] {});
+	}
+
+private:
+	unsigned n_;
+	/* on their own cache lines: every thread writes count_ */
+	alignas(64) std::atomic<unsigned> count_;
+	alignas(64) std::atomic<unsigned> gen_;
+};
+
+/** Min/max/mean/variance of a series of durations (ns) */
+struct series {
+	uint64_t count = 0;
+	int64_t min = 0;
+	int64_t max = 0;
+	double sum = 0;
+	double sum_sq = 0;
+
+	void add(int64_t v) {
+		if (!count || v < min)
+			min = v;
+		if (!count || v > max)
+			max = v;
+		count++;
+		sum += v;
+		sum_sq += (double)v * v;
+	}
+
+	double mean() const { return count ? sum / count : 0; }
+
+	double stddev() const {
+		if (count < 2)
+			return 0;
+
+		const double m = mean();
+		const double var = sum_sq / count - m * m;
+
+		return var > 0 ? sqrt(var) : 0;
+	}
+
+	void reset() { *this = series(); }
+};
+
+/**
+ * @brief Histogram of durations (ns) in 1 us buckets, like cyclictest -h.
+ *
+ * Durations of buckets_us and more are overflows, the first cycle numbers
+ * that overflowed are kept. The memory is allocated by the
+ * constructor: add() can be called from a real-time thread.
+ */
+class histogram {
+public:
+	explicit histogram(unsigned buckets_us = 1000, unsigned max_cycles = 16)
+		: buckets_(buckets_us ? buckets_us : 1, 0),
+		  max_cycles_(max_cycles), overflows_(0) {
+		cycles_.reserve(max_cycles);
+	}
+
+	/** Counts a duration, measured at the given cycle */
+	void add(int64_t ns, uint64_t cycle = 0) {
+		const int64_t us = ns > 0 ? ns / 1000 : 0;
+
+		stats_.add(ns);
+		if ((uint64_t)us < buckets_.size()) {
+			buckets_[us]++;
+			return;
+		}
+
+		overflows_++;
+		if (cycles_.size() < max_cycles_)
+			cycles_.push_back(cycle);
+	}
+
+	unsigned buckets() const { return (unsigned)buckets_.size(); }
+
+	/** Count of the bucket [us, us + 1[ */
+	uint64_t operator[](unsigned us) const { return buckets_[us]; }
+
+	uint64_t overflows() const { return overflows_; }
+
+	/** First cycles that overflowed */
+	const std::vector<uint64_t> &overflow_cycles() const { return cycles_; }
+
+	/** Min/max/mean of every duration, overflows included */
+	const series &stats() const { return stats_; }
+
+private:
+	std::vector<uint64_t> buckets_;
+	std::vector<uint64_t> cycles_;
+	size_t max_cycles_;
+	uint64_t overflows_;
+	series stats_;
+};
+
+} /* namespace rt */
+} /* namespace pcanmotor */
+
+#endif /* PCANMOTOR_RT_HPP_ */
@@ -0,0 +1,263 @@
+/* SPDX-License-Identifier: LGPL-2.1-only */
+/*
+ * @file rta.hpp
+ * @brief Worst-case response times of a set of periodic CAN messages
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * The analysis is the revised CAN schedulability analysis (Davis, Burns,
+ * Bril, Lukkien, "Controller Area Network (CAN) schedulability analysis:
+ * Refuted, revisited and revised", 2007). For a message m of period T,
+ * queuing jitter J and worst-case wire time C:
+ *   - B, blocking: longest frame of a lower priority (not preempted),
+ *   - t, level-m busy period: B + sum over hep(m) of ceil((t + J_k)/T_k) C_k,
+ *   - for each instance q < ceil((t + J)/T) of the busy period, the queuing
+ *     delay w(q) = B + q C + sum over hp(m) of ceil((w + J_k + tau)/T_k) C_k,
+ *     tau being a nominal bit time, and R(q) = J + w(q) - q T + C,
+ *   - R = max R(q), the message misses its deadline if R > D.
+ * C is given by CAN_GetFrameTime() with the worst case stuff bits of the id
+ * format and DLC of the message.
+ *
+ * The analysis is compatible with Audsley's optimal priority assignment:
+ * assign() finds a priority order meeting every deadline whenever one
+ * exists, and reassign_ids() gives the ids of the set to the messages in
+ * that order.
+ */
+#ifndef PCANMOTOR_RTA_HPP_
+#define PCANMOTOR_RTA_HPP_
+
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+#include <vector>
+
+#include <PCANBasic.h>
+
+namespace pcanmotor {
+namespace rta {
+
+/** Bit rates of the bus */
+struct bus {
+	uint32_t nom_bitrate = 1000000;	/**< nominal bit rate (bps) */
+	uint32_t data_bitrate = 0;	/**< data bit rate of BRS frames (bps, 0: nominal) */
+};
+
+/** A periodic message and, after analyse(), its response time */
+struct message {
+	uint32_t id = 0;
+	bool ext = false;		/**< 29-bit id */
+	bool fd = false;		/**< CAN FD frame */
+	bool brs = false;		/**< CAN FD frame with bit rate switch */
+	uint8_t len = 0;		/**< data bytes */
+	int64_t period_ns = 0;		/**< > 0 */
+	int64_t deadline_ns = 0;	/**< 0: the period */
+	int64_t jitter_ns = 0;		/**< queuing jitter */
+
+	/* results */
+	int64_t c_ns = 0;		/**< worst-case wire time */
+	int64_t b_ns = 0;		/**< blocking by lower priorities */
+	int64_t r_ns = 0;		/**< worst-case response time, -1 if unbounded */
+
+	int64_t deadline() const {
+		return deadline_ns ? deadline_ns : period_ns;
+	}
+
+	bool meets_deadline() const {
+		return r_ns >= 0 && r_ns <= deadline();
+	}
+
+	/** Arbitration order: a lower key wins, a 11-bit id wins over the
+	 * 29-bit ids of the same base id (SRR and IDE are recessive) */
+	uint64_t key() const {
+		if (!ext)
+			return (uint64_t)(id & 0x7ff) << 19;
+		return ((uint64_t)((id >> 18) & 0x7ff) << 19) | (1u << 18) | (id & 0x3ffff);
+	}
+};
+
+/** Sets the id (and format) of m from an arbitration key */
+inline void set_key(message &m, uint64_t key) {
+	m.ext = (key >> 18) & 1;
+	if (m.ext)
+		m.id = (uint32_t)(((key >> 19) << 18) | (key & 0x3ffff));
+	else
+		m.id = (uint32_t)(key >> 19);
+}
+
+/** Worst-case wire time of m, interframe space included (0 on error) */
+inline int64_t frame_ns(const message &m, const bus &b) {
+	struct pcanfd_msg msg;
+	UINT64 ns;
+
+	memset(&msg, 0, sizeof(msg));
+	msg.type = m.fd ? PCANFD_TYPE_CANFD_MSG : PCANFD_TYPE_CAN20_MSG;
+	msg.id = m.id;
+	msg.flags = (m.ext ? PCANFD_MSG_EXT : 0) | (m.brs ? PCANFD_MSG_BRS : 0);
+	msg.data_len = m.len;
+	if (CAN_GetFrameTime(&msg, b.nom_bitrate, b.data_bitrate, PCAN_PARAMETER_ON,
+			&ns) != PCAN_ERROR_OK)
+		return 0;
+	return (int64_t)ns;
+}
+
+inline int64_t ceil_div(int64_t a, int64_t b) {
+	return (a + b - 1) / b;
+}
+
+/**
+ * @brief Worst-case response time of set[m] when the messages of hp have
+ * a higher priority and a frame of blocking_ns can be on the bus.
+ *
+ * c_ns of the messages must be set.
+ *
+ * @return the response time, -1 if the busy period is unbounded
+ * 	(utilization of hp and m of 1 or more)
+ */
+inline int64_t response(const std::vector<message> &set, size_t m,
+		const std::vector<size_t> &hp, int64_t blocking_ns, int64_t tau_ns) {
+	const message &msg = set[m];
+	double u = (double)msg.c_ns / msg.period_ns;
+	int64_t t, prev, r = 0;
+
+	for (size_t k : hp)
+		u += (double)set[k].c_ns / set[k].period_ns;
+	if (u >= 1.)
+		return -1;
+
+	/* level-m busy period */
+	t = msg.c_ns;
+	do {
+		prev = t;
+		t = blocking_ns + ceil_div(prev + msg.jitter_ns, msg.period_ns) * msg.c_ns;
+		for (size_t k : hp)
+			t += ceil_div(prev + set[k].jitter_ns, set[k].period_ns) * set[k].c_ns;
+	} while (t != prev);
+
+	const int64_t instances = ceil_div(t + msg.jitter_ns, msg.period_ns);
+
+	for (int64_t q = 0; q < instances; q++) {
+		int64_t w = blocking_ns + q * msg.c_ns;
+
+		do {
+			prev = w;
+			w = blocking_ns + q * msg.c_ns;
+			for (size_t k : hp)
+				w += ceil_div(prev + set[k].jitter_ns + tau_ns,
+					set[k].period_ns) * set[k].c_ns;
+		} while (w != prev);
+		r = std::max(r, msg.jitter_ns + w - q * msg.period_ns + msg.c_ns);
+	}
+	return r;
+}
+
+/** Nominal bit time (ns, rounded up) */
+inline int64_t bit_ns(const bus &b) {
+	return ceil_div(1000000000LL, b.nom_bitrate);
+}
+
+/** Indexes of set sorted by priority, highest first */
+inline std::vector<size_t> by_priority(const std::vector<message> &set) {
+	std::vector<size_t> order(set.size());
+
+	for (size_t i = 0; i < order.size(); i++)
+		order[i] = i;
+	std::stable_sort(order.begin(), order.end(), [&set](size_t a, size_t b) {
+		return set[a].key() < set[b].key();
+	});
+	return order;
+}
+
+/**
+ * @brief Computes c_ns, b_ns and r_ns of every message, priorities being
+ * given by the ids.
+ *
+ * @return the number of messages missing their deadline
+ */
+inline unsigned analyse(std::vector<message> &set, const bus &b) {
+	const std::vector<size_t> order = by_priority(set);
+	std::vector<size_t> hp;
+	unsigned misses = 0;
+
+	for (message &m : set)
+		m.c_ns = frame_ns(m, b);
+	for (size_t i = 0; i < order.size(); i++) {
+		message &m = set[order[i]];
+
+		m.b_ns = 0;
+		for (size_t j = i + 1; j < order.size(); j++)
+			m.b_ns = std::max(m.b_ns, set[order[j]].c_ns);
+		m.r_ns = response(set, order[i], hp, m.b_ns, bit_ns(b));
+		if (!m.meets_deadline())
+			misses++;
+		hp.push_back(order[i]);
+	}
+	return misses;
+}
+
+/**
+ * @brief Audsley's optimal priority assignment: from the lowest priority,
+ * each level gets a message meeting its deadline with all the unassigned
+ * messages above it. The message with the highest id is tried first, so
+ * that a schedulable set keeps its order.
+ *
+ * analyse() must have been called (c_ns).
+ *
+ * @param order filled with the indexes of set, highest priority first
+ * @return true if every message meets its deadline in this order
+ */
+inline bool assign(const std::vector<message> &set, const bus &b, std::vector<size_t> &order) {
+	std::vector<size_t> unassigned = by_priority(set);
+	std::vector<size_t> lowest_first;
+	int64_t blocking = 0;
+
+	while (!unassigned.empty()) {
+		size_t n = unassigned.size();
+
+		while (n-- > 0) {
+			std::vector<size_t> hp(unassigned);
+
+			hp.erase(hp.begin() + n);
+			const int64_t r = response(set, unassigned[n], hp, blocking, bit_ns(b));
+			if (r >= 0 && r <= set[unassigned[n]].deadline())
+				break;
+		}
+		if (n == (size_t)-1)
+			return false;
+		lowest_first.push_back(unassigned[n]);
+		blocking = std::max(blocking, set[unassigned[n]].c_ns);
+		unassigned.erase(unassigned.begin() + n);
+	}
+	order.assign(lowest_first.rbegin(), lowest_first.rend());
+	return true;
+}
+
+/**
+ * @brief Gives the ids of set to its messages in the priority order
+ * returned by assign(): the highest priority gets the lowest id.
+ *
+ * A message may change id format when the set mixes 11-bit and 29-bit ids,
+ * which changes its wire time: analyse() the result again.
+ */
+inline void reassign_ids(std::vector<message> &set, const std::vector<size_t> &order) {
+	std::vector<uint64_t> keys;
+
+	for (const message &m : set)
+		keys.push_back(m.key());
+	std::sort(keys.begin(), keys.end());
+	for (size_t i = 0; i < order.size(); i++)
+		set_key(set[order[i]], keys[i]);
+}
+
+} /* namespace rta */
+} /* namespace pcanmotor */
+
+#endif /* PCANMOTOR_RTA_HPP_ */
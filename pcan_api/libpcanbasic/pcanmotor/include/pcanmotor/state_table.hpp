@@ -0,0 +1,147 @@
+/* SPDX-License-Identifier: LGPL-2.1-only */
+/*
+ * @file state_table.hpp
+ * @brief Shared table of the latest motor states, seqlock protected
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Each motor owns a slot on its own cache line. The slot is written by a
+ * single thread (the RX path of its channel) and read by any number of
+ * threads (controller, logger, UI, safety checks):
+ *   - the writer never waits: it makes the sequence number odd, stores the
+ *     fields and makes the sequence number even again,
+ *   - a reader copies the fields between two reads of the sequence number
+ *     and retries if a write happened meanwhile. It never blocks the
+ *     writer and try_read() never loops.
+ * Fields are relaxed atomics so that the concurrent accesses are defined.
+ */
+#ifndef PCANMOTOR_STATE_TABLE_HPP_
+#define PCANMOTOR_STATE_TABLE_HPP_
+
+#include <stdint.h>
+
+#include <atomic>
+
+#include <pcanmotor/rt.hpp>
+
+namespace pcanmotor {
+
+/** Snapshot of the state of a motor */
+struct motor_state {
+	float p;		/**< position */
+	float v;		/**< velocity */
+	float t;		/**< torque */
+	int64_t rx_ns;		/**< CLOCK_MONOTONIC time of the reply (ns) */
+	uint32_t replies;	/**< number of replies received so far */
+};
+
+class state_table {
+public:
+	/** One slot per possible motor id */
+	static constexpr unsigned MAX_SLOTS = 256;
+
+	state_table() {
+		for (unsigned i = 0; i < MAX_SLOTS; i++) {
+			slot &s = slots_[i];
+
+			s.seq.store(0, std::memory_order_relaxed);
+			s.p.store(0, std::memory_order_relaxed);
+			s.v.store(0, std::memory_order_relaxed);
+			s.t.store(0, std::memory_order_relaxed);
+			s.rx_ns.store(0, std::memory_order_relaxed);
+			s.replies.store(0, std::memory_order_relaxed);
+		}
+	}
+
+	state_table(const state_table &) = delete;
+	state_table &operator=(const state_table &) = delete;
+
+	/**
+	 * @brief Stores the state of slot i (only one writer per slot).
+	 */
+	void write(unsigned i, float p, float v, float t, int64_t rx_ns) {
+		slot &s = slots_[i];
+		const uint32_t seq = s.seq.load(std::memory_order_relaxed);
+
+		s.seq.store(seq + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+
+		s.p.store(p, std::memory_order_relaxed);
+		s.v.store(v, std::memory_order_relaxed);
+		s.t.store(t, std::memory_order_relaxed);
+		s.rx_ns.store(rx_ns, std::memory_order_relaxed);
+		s.replies.store(s.replies.load(std::memory_order_relaxed) + 1,
+			std::memory_order_relaxed);
+
+		s.seq.store(seq + 2, std::memory_order_release);
+	}
+
+	/**
+	 * @brief Reads slot i once.
+	 *
+	 * @return false if a write was in progress (out is then undefined).
+	 */
+	bool try_read(unsigned i, motor_state &out) const {
+		const slot &s = slots_[i];
+		const uint32_t seq = s.seq.load(std::memory_order_acquire);
+
+		if (seq & 1)
+			return false;
+
+		out.p = s.p.load(std::memory_order_relaxed);
+		out.v = s.v.load(std::memory_order_relaxed);
+		out.t = s.t.load(std::memory_order_relaxed);
+		out.rx_ns = s.rx_ns.load(std::memory_order_relaxed);
+		out.replies = s.replies.load(std::memory_order_relaxed);
+
+		std::atomic_thread_fence(std::memory_order_acquire);
+		return s.seq.load(std::memory_order_relaxed) == seq;
+	}
+
+	/**
+	 * @brief Reads a consistent snapshot of slot i.
+	 *
+	 * Retries while the slot is being written; a write is a few stores,
+	 * so that a retry is rare and short.
+	 */
+	motor_state read(unsigned i) const {
+		motor_state out;
+
+		while (!try_read(i, out))
+			rt::cpu_relax();
+		return out;
+	}
+
+	/**
+	 * @brief Reads slots [first, first + n) into out (each slot is
+	 * consistent, the slots are not read at the same instant).
+	 */
+	void read(unsigned first, unsigned n, motor_state *out) const {
+		for (unsigned i = 0; i < n; i++)
+			out[i] = read(first + i);
+	}
+
+private:
+	struct alignas(64) slot {
+		std::atomic<uint32_t> seq;
+		std::atomic<float> p;
+		std::atomic<float> v;
+		std::atomic<float> t;
+		std::atomic<int64_t> rx_ns;
+		std::atomic<uint32_t> replies;
+	};
+
+	slot slots_[MAX_SLOTS];
+};
+
+} /* namespace pcanmotor */
+
+#endif /* PCANMOTOR_STATE_TABLE_HPP_ */
@@ -0,0 +1,462 @@
+/* SPDX-License-Identifier: LGPL-2.1-only */
+/*
+ * canjitter.cpp - cyclictest-like jitter of a CAN send/receive cycle
+ *
+ * A periodic real-time thread sends, each period, the command of a MIT
+ * motor through libpcanbasic and reads until its reply came (or the period
+ * is over). The frames left in the RX queue by the previous cycle (late
+ * replies) are read before the command is sent, and counted apart. Three
+ * durations are measured at each cycle:
+ *   - wakeup: start of the period to the return of the sleep (the latency
+ *     of cyclictest, only the kernel and the CPU setup are involved),
+ *   - syscall: time spent in CAN_Write()/CAN_Read() (the CAN stack),
+ *   - cycle: start of the period to the reply read (or to the end of the
+ *     drain with -n), the bus and the motor included.
+ * They are printed like the threads of cyclictest: "T:0" wakeup, "T:1"
+ * syscall, "T:2" cycle, in us, and with -h as a cyclictest histogram with
+ * one column per duration.
+ *
+ * By default, the channel is a node of the in-process virtual bus and the
+ * motor is simulated on a second node (motor_sim.hpp, replying at once, set
+ * PCANBASIC_VIRTUAL_PACING=1 to add the wire times). With -b pcan, the
+ * channel is the one of the environment (pcan device, PCANBASIC_SOCKETCAN,
+ * libpcanfake.so) and the motor must be on the bus, or on the channel
+ * given with -R.
+ *
+ * usage: canjitter [-b virtual|pcan] [-c channel] [-R channel]
+ *                  [-F fd_bitrate] [-m id] [-n] [-i us] [-l loops]
+ *                  [-D seconds] [-p prio] [-a cpu] [-T] [-h us] [-q]
+ *   -b  backend (default virtual)
+ *   -c  channel handle (default 0x51: PCAN_USBBUS1)
+ *   -R  channel of the simulated motor (default 0x52 with -b virtual, none
+ *       else)
+ *   -F  open the channels in CAN FD mode with this bit rate string
+ *   -m  motor id (default 1)
+ *   -n  don't wait for the reply: send and drain the RX queue
+ *   -i  interval (default 1000 us)
+ *   -l  number of cycles (default 0: until -D or Ctrl-C)
+ *   -D  duration (default 0: until -l or Ctrl-C)
+ *   -p  SCHED_FIFO priority (default 80, 0 for SCHED_OTHER)
+ *   -a  CPU of the thread (default none)
+ *   -T  wait with a timerfd instead of clock_nanosleep()
+ *   -h  print histograms of us buckets (overflows above)
+ *   -q  quiet: print the summary at the end only
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+
+#include <atomic>
+#include <vector>
+
+#include <pcanmotor/channel.hpp>
+#include <pcanmotor/mit.hpp>
+#include <pcanmotor/motor_sim.hpp>
+#include <pcanmotor/rt.hpp>
+
+using namespace pcanmotor;
+
+#define METRICS		3
+#define REFRESH_MS	100
+#define VIRTUAL_ENV	"PCANBASIC_VIRTUAL"
+
+enum { WAKEUP, SYSCALL, CYCLE };
+
+static const char *metric_names[METRICS] = { "wakeup", "syscall", "cycle" };
+
+/** Options of the measure */
+struct options {
+	TPCANHandle chan = PCAN_USBBUS1;
+	TPCANHandle peer = PCAN_NONEBUS;
+	char *fd_bitrate = NULL;
+	uint8_t motor = 1;
+	bool wait_reply = true;
+	int64_t interval_ns = 1000000;
+	uint64_t loops = 0;
+	double duration = 0;
+	rt::thread_config thread;
+	rt::clock_source clock = rt::clock_source::nanosleep;
+	unsigned histogram_us = 0;
+	bool quiet = false;
+};
+
+/** Latest values of a metric, for the display thread (us) */
+struct live {
+	std::atomic<int64_t> act;
+	std::atomic<int64_t> min;
+	std::atomic<int64_t> max;
+	std::atomic<int64_t> avg;
+	std::atomic<uint64_t> count;
+};
+
+static options opt;
+static live lives[METRICS];
+static std::atomic<pid_t> tid;
+static std::atomic<bool> done;
+static uint64_t lost;
+static uint64_t late;
+static int setup_error;
+static volatile sig_atomic_t stopped;
+
+static void signal_handler(int s)
+{
+	(void)s;
+	stopped = 1;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-b virtual|pcan] [-c channel] [-R channel] "
+		"[-F fd_bitrate] [-m id] [-n] [-i us] [-l loops] [-D seconds] "
+		"[-p prio] [-a cpu] [-T] [-h us] [-q]\n", name);
+	exit(2);
+}
+
+static void fail(const char *what, TPCANStatus sts)
+{
+	char text[256];
+
+	if (CAN_GetErrorText(sts, 0, text) != PCAN_ERROR_OK)
+		snprintf(text, sizeof(text), "error 0x%x", (unsigned)sts);
+	fprintf(stderr, "%s: %s\n", what, text);
+	exit(1);
+}
+
+static void init(TPCANHandle h)
+{
+	TPCANStatus sts;
+
+	if (opt.fd_bitrate)
+		sts = CAN_InitializeFD(h, opt.fd_bitrate);
+	else
+		sts = CAN_Initialize(h, PCAN_BAUD_1M, 0, 0, 0);
+	if (sts != PCAN_ERROR_OK)
+		fail("initialization", sts);
+}
+
+static TPCANStatus write_command(TPCANHandle h)
+{
+	const mit::command cmd = { 0.f, 0.f, 0.f, 0.f, 0.f };
+
+	if (opt.fd_bitrate) {
+		TPCANMsgFD msg;
+
+		mit::codec<>::pack(msg, opt.motor, cmd);
+		msg.MSGTYPE |= PCAN_MESSAGE_FD | PCAN_MESSAGE_BRS;
+		return CAN_WriteFD(h, &msg);
+	}
+
+	TPCANMsg msg;
+
+	mit::codec<>::pack(msg, opt.motor, cmd);
+	return CAN_Write(h, &msg);
+}
+
+/* reads one frame, reply tells if it is the reply of the motor */
+static TPCANStatus read_frame(TPCANHandle h, bool &reply)
+{
+	mit::reply rep;
+	TPCANStatus sts;
+
+	if (opt.fd_bitrate) {
+		TPCANMsgFD msg;
+		TPCANTimestampFD ts;
+
+		sts = CAN_ReadFD(h, &msg, &ts);
+		reply = sts == PCAN_ERROR_OK && mit::codec<>::unpack(msg, rep) &&
+			msg.DLC == mit::REPLY_LEN && rep.id == opt.motor;
+	} else {
+		TPCANMsg msg;
+		TPCANTimestamp ts;
+
+		sts = CAN_Read(h, &msg, &ts);
+		reply = sts == PCAN_ERROR_OK && mit::codec<>::unpack(msg, rep) &&
+			msg.LEN == mit::REPLY_LEN && rep.id == opt.motor;
+	}
+	return sts;
+}
+
+static void publish(unsigned i, const rt::series &s, int64_t ns)
+{
+	live &l = lives[i];
+
+	l.act.store(ns / 1000, std::memory_order_relaxed);
+	l.min.store(s.min / 1000, std::memory_order_relaxed);
+	l.max.store(s.max / 1000, std::memory_order_relaxed);
+	l.avg.store((int64_t)(s.mean() / 1000), std::memory_order_relaxed);
+	l.count.store(s.count, std::memory_order_relaxed);
+}
+
+/* the measured thread */
+static void *measure(void *arg)
+{
+	rt::histogram *hist = (rt::histogram *)arg;
+	rt::periodic timer(opt.interval_ns, opt.clock);
+	const int fd = receive_event(opt.chan);
+	struct pollfd pfd = { fd, POLLIN, 0 };
+	int64_t end = 0, wakeup, start, t, sys, deadline;
+	uint64_t cycle;
+	TPCANStatus sts;
+	bool replied, reply;
+
+	tid = (pid_t)syscall(SYS_gettid);
+	setup_error = rt::setup_thread(opt.thread);
+
+	timer.start();
+	if (opt.duration > 0)
+		end = timer.next() + (int64_t)(opt.duration * rt::NSEC_PER_SEC);
+	for (cycle = 0; !stopped; cycle++) {
+		if (opt.loops && cycle >= opt.loops)
+			break;
+		if (end && timer.next() >= end)
+			break;
+
+		timer.wait(&wakeup);
+		start = timer.current();
+		deadline = timer.next();
+
+		/* a reply which came after the end of its cycle is not taken
+		 * for the reply of this one */
+		t = rt::now_ns();
+		while (read_frame(opt.chan, reply) == PCAN_ERROR_OK)
+			late += reply;
+		sts = write_command(opt.chan);
+		sys = rt::now_ns() - t;
+
+		replied = false;
+		for (;;) {
+			t = rt::now_ns();
+			while (read_frame(opt.chan, reply) == PCAN_ERROR_OK)
+				replied |= reply;
+			t = rt::now_ns() - t;
+			sys += t;
+
+			if (replied || !opt.wait_reply || sts != PCAN_ERROR_OK)
+				break;
+
+			t = rt::now_ns();
+			if (t >= deadline)
+				break;
+			if (fd >= 0) {
+				const struct timespec ts = rt::to_timespec(deadline - t);
+
+				ppoll(&pfd, 1, &ts, NULL);
+			}
+		}
+		t = rt::now_ns();
+
+		hist[WAKEUP].add(wakeup, cycle);
+		hist[SYSCALL].add(sys, cycle);
+		publish(WAKEUP, hist[WAKEUP].stats(), wakeup);
+		publish(SYSCALL, hist[SYSCALL].stats(), sys);
+		if (opt.wait_reply && !replied) {
+			lost++;
+			continue;
+		}
+		hist[CYCLE].add(t - start, cycle);
+		publish(CYCLE, hist[CYCLE].stats(), t - start);
+	}
+	done = true;
+	return NULL;
+}
+
+/* the T: lines of cyclictest, one per metric */
+static void print_summary()
+{
+	const int prio = opt.thread.priority;
+	unsigned i;
+
+	for (i = 0; i < METRICS; i++) {
+		const live &l = lives[i];
+
+		printf("T:%2u (%5d) P:%2d I:%lld C:%7llu Min:%7lld Act:%5lld "
+			"Avg:%5lld Max:%8lld\n", i, (int)tid.load(), prio,
+			(long long)(opt.interval_ns / 1000),
+			(unsigned long long)l.count.load(),
+			(long long)l.min.load(), (long long)l.act.load(),
+			(long long)l.avg.load(), (long long)l.max.load());
+	}
+}
+
+/* cyclictest -h output, one column per metric */
+static void print_histograms(const rt::histogram *hist)
+{
+	unsigned b, i;
+
+	printf("# Histogram\n");
+	for (b = 0; b < opt.histogram_us; b++) {
+		printf("%06u", b);
+		for (i = 0; i < METRICS; i++)
+			printf(" %06llu", (unsigned long long)hist[i][b]);
+		printf("\n");
+	}
+	printf("# Total:");
+	for (i = 0; i < METRICS; i++)
+		printf(" %09llu", (unsigned long long)hist[i].stats().count);
+	printf("\n# Min Latencies:");
+	for (i = 0; i < METRICS; i++)
+		printf(" %05lld", (long long)(hist[i].stats().min / 1000));
+	printf("\n# Avg Latencies:");
+	for (i = 0; i < METRICS; i++)
+		printf(" %05lld", (long long)(hist[i].stats().mean() / 1000));
+	printf("\n# Max Latencies:");
+	for (i = 0; i < METRICS; i++)
+		printf(" %05lld", (long long)(hist[i].stats().max / 1000));
+	printf("\n# Histogram Overflows:");
+	for (i = 0; i < METRICS; i++)
+		printf(" %05llu", (unsigned long long)hist[i].overflows());
+	printf("\n# Histogram Overflow at cycle number:\n");
+	for (i = 0; i < METRICS; i++) {
+		printf("# Thread %u:", i);
+		for (uint64_t c : hist[i].overflow_cycles())
+			printf(" %05llu", (unsigned long long)c);
+		if (hist[i].overflows() > hist[i].overflow_cycles().size())
+			printf(" # %05llu others", (unsigned long long)
+				(hist[i].overflows() - hist[i].overflow_cycles().size()));
+		printf("\n");
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	const char *backend = "virtual";
+	pthread_t measurer;
+	bool peer_set = false;
+	char env[64];
+	int c;
+
+	while ((c = getopt(argc, argv, "b:c:R:F:m:ni:l:D:p:a:Th:q")) != -1) {
+		switch (c) {
+		case 'b':
+			backend = optarg;
+			break;
+		case 'c':
+			opt.chan = (TPCANHandle)strtoul(optarg, NULL, 0);
+			break;
+		case 'R':
+			opt.peer = (TPCANHandle)strtoul(optarg, NULL, 0);
+			peer_set = true;
+			break;
+		case 'F':
+			opt.fd_bitrate = optarg;
+			break;
+		case 'm':
+			opt.motor = (uint8_t)strtoul(optarg, NULL, 0);
+			break;
+		case 'n':
+			opt.wait_reply = false;
+			break;
+		case 'i':
+			opt.interval_ns = strtoll(optarg, NULL, 0) * 1000;
+			break;
+		case 'l':
+			opt.loops = strtoull(optarg, NULL, 0);
+			break;
+		case 'D':
+			opt.duration = strtod(optarg, NULL);
+			break;
+		case 'p':
+			opt.thread.priority = atoi(optarg);
+			break;
+		case 'a':
+			opt.thread.cpu = atoi(optarg);
+			break;
+		case 'T':
+			opt.clock = rt::clock_source::timerfd;
+			break;
+		case 'h':
+			opt.histogram_us = (unsigned)strtoul(optarg, NULL, 0);
+			break;
+		case 'q':
+			opt.quiet = true;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (opt.interval_ns <= 0 || optind != argc)
+		usage(argv[0]);
+
+	if (!strcmp(backend, "virtual")) {
+		if (!peer_set)
+			opt.peer = (TPCANHandle)(opt.chan + 1);
+		snprintf(env, sizeof(env), "0x%x=jitter,0x%x=jitter", opt.chan,
+			opt.peer);
+		setenv(VIRTUAL_ENV, env, 0);
+	} else if (strcmp(backend, "pcan")) {
+		usage(argv[0]);
+	}
+	if (opt.peer == opt.chan)
+		usage(argv[0]);
+
+	std::vector<rt::histogram> hist;
+	unsigned i;
+
+	/* constructed in place: the overflow lists keep their memory */
+	hist.reserve(METRICS);
+	for (i = 0; i < METRICS; i++)
+		hist.emplace_back(opt.histogram_us ? opt.histogram_us : 1);
+
+	signal(SIGINT, signal_handler);
+	signal(SIGTERM, signal_handler);
+
+	/* no rotor model: the motor replies at once */
+	sim_config sc;
+
+	sc.step_ns = 0;
+	motor_sim<> motor(sc);
+
+	init(opt.chan);
+	if (opt.peer != PCAN_NONEBUS) {
+		init(opt.peer);
+		motor.add_motor(opt.motor);
+		motor.attach(opt.peer);
+		motor.start();
+	}
+	if (pthread_create(&measurer, NULL, measure, hist.data())) {
+		fprintf(stderr, "failed to start the measure\n");
+		return 1;
+	}
+
+	printf("# T:0 %s, T:1 %s, T:2 %s (us)\n", metric_names[WAKEUP],
+		metric_names[SYSCALL], metric_names[CYCLE]);
+	fflush(stdout);
+	if (!opt.quiet) {
+		const bool tty = isatty(STDOUT_FILENO);
+		bool first = true;
+
+		/* refreshed in place on a terminal, like cyclictest */
+		while (!done.load()) {
+			usleep(REFRESH_MS * 1000);
+			if (!tty)
+				continue;
+			if (!first)
+				printf("\033[%dA", METRICS);
+			print_summary();
+			fflush(stdout);
+			first = false;
+		}
+		if (tty && !first)
+			printf("\033[%dA", METRICS);
+	}
+	pthread_join(measurer, NULL);
+	motor.stop();
+
+	if (setup_error)
+		fprintf(stderr, "warning: real-time setup failed: %s\n",
+			strerror(setup_error));
+	if (opt.histogram_us)
+		print_histograms(hist.data());
+	print_summary();
+	if (opt.wait_reply)
+		printf("# Lost replies: %llu (late: %llu)\n",
+			(unsigned long long)lost, (unsigned long long)late);
+
+	CAN_Uninitialize(PCAN_NONEBUS);
+	return 0;
+}
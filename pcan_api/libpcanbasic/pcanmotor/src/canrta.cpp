@@ -0,0 +1,274 @@
+/* SPDX-License-Identifier: LGPL-2.1-only */
+/*
+ * canrta.cpp - worst-case response times of a CAN id plan
+ *
+ * Reads a set of periodic messages and prints the worst-case response time
+ * of each one with the revised CAN schedulability analysis (rta.hpp):
+ * blocking by lower priority frames, interference of higher priority ones
+ * and queuing jitter. Frame times are the worst case ones of
+ * CAN_GetFrameTime(), at the bit rates of -b or of the FD bit rate string
+ * of -F (parsed by CAN_CreateBitrateFDProfile(), as CAN_InitializeFD()
+ * does).
+ *
+ * When a message misses its deadline, the ids of the set are given to the
+ * messages in an order meeting every deadline (Audsley's optimal priority
+ * assignment), if there is one, and the resulting id plan is printed in the
+ * input format.
+ *
+ * Input (file or stdin), one message per line, '#' starts a comment:
+ *   id period_us len format sender [deadline_us [jitter_us]]
+ *   - id: 11-bit id, or 29-bit id if above 0x7ff or with format "...:ext"
+ *   - period_us: 1 us or more
+ *   - len: data bytes, 0..8 or 0..64 for FD (sent with the smallest DLC
+ *     holding them)
+ *   - format: classic, fd or brs (FD with bit rate switch), ":ext" for a
+ *     29-bit id
+ *   - sender: name of the sending node, printed with the message
+ *   - deadline_us: the period if 0 or missing
+ *   - jitter_us: queuing jitter (-J if missing)
+ *
+ * usage: canrta [-b bitrate] [-F fd_bitrate] [-J jitter_us] [file]
+ *   -b  nominal bit rate (default 1000000)
+ *   -F  FD bit rate string giving the nominal and data bit rates
+ *   -J  default queuing jitter (default 0 us), the release jitter of the
+ *       senders (see the "cycle" of canjitter)
+ *
+ * Exit status: 0 if every message meets its deadline, 1 if not, 2 on
+ * errors.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include <pcanmotor/rta.hpp>
+
+using namespace pcanmotor;
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-b bitrate] [-F fd_bitrate] [-J jitter_us] [file]\n", name);
+	exit(2);
+}
+
+/* parses a message line, returns 0 if empty, 1 if parsed, -1 on error */
+static int parse_line(char *line, int64_t jitter_ns, rta::message &m,
+		std::string &name)
+{
+	char *hash = strchr(line, '#');
+	char format[32], sender[64];
+	long id;
+	unsigned len;
+	double period, deadline = 0, jitter = -1;
+	int n;
+
+	if (hash)
+		*hash = 0;
+	n = sscanf(line, "%li %lf %u %31s %63s %lf %lf", &id, &period, &len,
+		format, sender, &deadline, &jitter);
+	if (n <= 0)
+		return 0;
+	/* the analysis works in ns */
+	if (n < 5 || id < 0 || period < 1 || deadline < 0)
+		return -1;
+
+	char *ext = strchr(format, ':');
+
+	m.ext = id > 0x7ff;
+	if (ext) {
+		if (strcmp(ext, ":ext"))
+			return -1;
+		*ext = 0;
+		m.ext = true;
+	}
+	if (!strcmp(format, "classic"))
+		m.fd = m.brs = false;
+	else if (!strcmp(format, "fd"))
+		m.fd = true, m.brs = false;
+	else if (!strcmp(format, "brs"))
+		m.fd = m.brs = true;
+	else
+		return -1;
+	if (id > (m.ext ? 0x1fffffffL : 0x7ffL))
+		return -1;
+	if (len > (m.fd ? 64u : 8u))
+		return -1;
+
+	m.id = (uint32_t)id;
+	m.len = (uint8_t)len;
+	m.period_ns = (int64_t)(period * 1000);
+	m.deadline_ns = (int64_t)(deadline * 1000);
+	m.jitter_ns = jitter < 0 ? jitter_ns : (int64_t)(jitter * 1000);
+	name = sender;
+	return 1;
+}
+
+static const char *format_name(const rta::message &m)
+{
+	if (!m.fd)
+		return m.ext ? "classic:ext" : "classic";
+	if (m.brs)
+		return m.ext ? "brs:ext" : "brs";
+	return m.ext ? "fd:ext" : "fd";
+}
+
+static void print_set(const std::vector<rta::message> &set,
+		const std::vector<std::string> &senders, const rta::bus &b)
+{
+	double u = 0;
+
+	for (const rta::message &m : set)
+		u += (double)m.c_ns / m.period_ns;
+	printf("# %u bps nominal", b.nom_bitrate);
+	if (b.data_bitrate)
+		printf(", %u bps data", b.data_bitrate);
+	printf(", %zu messages, utilization %.1f%%\n", set.size(), u * 100);
+	printf("# prio         id  sender        format       len  period_us  deadline_us"
+		"  jitter_us      C_us      B_us       R_us  status\n");
+
+	const std::vector<size_t> order = rta::by_priority(set);
+
+	for (size_t i = 0; i < order.size(); i++) {
+		const rta::message &m = set[order[i]];
+
+		printf("%6zu %10x  %-12s  %-11s  %3u  %9.1f  %11.1f  %9.1f  %8.1f  %8.1f  ",
+			i, m.id, senders[order[i]].c_str(), format_name(m), m.len,
+			m.period_ns / 1e3, m.deadline() / 1e3, m.jitter_ns / 1e3,
+			m.c_ns / 1e3, m.b_ns / 1e3);
+		if (m.r_ns < 0)
+			printf("%9s  MISS (unbounded)\n", "-");
+		else
+			printf("%9.1f  %s\n", m.r_ns / 1e3, m.meets_deadline() ? "ok" : "MISS");
+	}
+}
+
+/* prints set in the input format */
+static void print_plan(const std::vector<rta::message> &set,
+		const std::vector<std::string> &senders)
+{
+	for (size_t i : rta::by_priority(set)) {
+		const rta::message &m = set[i];
+
+		printf("0x%0*x %.1f %u %s %s %.1f %.1f\n", m.ext ? 8 : 3, m.id,
+			m.period_ns / 1e3, m.len, format_name(m), senders[i].c_str(),
+			m.deadline() / 1e3, m.jitter_ns / 1e3);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	std::vector<rta::message> set;
+	std::vector<std::string> senders;	/* of the messages of set */
+	rta::bus bus;
+	char *fd_bitrate = NULL;
+	int64_t jitter_ns = 0;
+	FILE *in = stdin;
+	char line[256];
+	unsigned lineno = 0, misses;
+	int c;
+
+	while ((c = getopt(argc, argv, "b:F:J:")) != -1) {
+		switch (c) {
+		case 'b':
+			bus.nom_bitrate = (uint32_t)strtoul(optarg, NULL, 0);
+			break;
+		case 'F':
+			fd_bitrate = optarg;
+			break;
+		case 'J':
+			jitter_ns = (int64_t)(strtod(optarg, NULL) * 1000);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind < argc - 1 || bus.nom_bitrate == 0 || jitter_ns < 0)
+		usage(argv[0]);
+
+	if (fd_bitrate) {
+		TPCANBitrateFDProfile profile;
+		DWORD nom, data;
+
+		if (CAN_CreateBitrateFDProfile(fd_bitrate, &profile) != PCAN_ERROR_OK ||
+				CAN_GetBitrateFDProfileBitrates(profile, &nom, &data) != PCAN_ERROR_OK) {
+			fprintf(stderr, "invalid FD bit rate string \"%s\"\n", fd_bitrate);
+			return 2;
+		}
+		CAN_FreeBitrateFDProfile(profile);
+		bus.nom_bitrate = nom;
+		bus.data_bitrate = data;
+	}
+
+	if (optind < argc && strcmp(argv[optind], "-")) {
+		in = fopen(argv[optind], "r");
+		if (!in) {
+			perror(argv[optind]);
+			return 2;
+		}
+	}
+	while (fgets(line, sizeof(line), in)) {
+		rta::message m;
+		std::string sender;
+		int r;
+
+		lineno++;
+		r = parse_line(line, jitter_ns, m, sender);
+		if (r < 0) {
+			fprintf(stderr, "line %u: invalid message\n", lineno);
+			return 2;
+		}
+		if (r == 0)
+			continue;
+		if (m.fd && !fd_bitrate) {
+			fprintf(stderr, "line %u: FD message without -F\n", lineno);
+			return 2;
+		}
+		for (size_t i = 0; i < set.size(); i++)
+			if (set[i].key() == m.key()) {
+				fprintf(stderr, "line %u: id 0x%x already used by %s\n",
+					lineno, m.id, senders[i].c_str());
+				return 2;
+			}
+		set.push_back(m);
+		senders.push_back(sender);
+	}
+	if (in != stdin)
+		fclose(in);
+	if (set.empty()) {
+		fprintf(stderr, "no message\n");
+		return 2;
+	}
+
+	misses = rta::analyse(set, bus);
+	print_set(set, senders, bus);
+	if (misses == 0) {
+		printf("# every message meets its deadline\n");
+		return 0;
+	}
+	printf("# %u message(s) miss their deadline\n", misses);
+
+	std::vector<size_t> order;
+
+	if (!rta::assign(set, bus, order)) {
+		printf("# no priority order meets every deadline\n");
+		return 1;
+	}
+
+	std::vector<rta::message> plan(set);
+
+	rta::reassign_ids(plan, order);
+	misses = rta::analyse(plan, bus);
+	printf("#\n# suggested id plan (same ids, priority order meeting every deadline):\n");
+	for (size_t i = 0; i < set.size(); i++)
+		if (set[i].id != plan[i].id || set[i].ext != plan[i].ext)
+			printf("#   %s 0x%x -> 0x%x\n", senders[i].c_str(), set[i].id, plan[i].id);
+	print_set(plan, senders, bus);
+	if (misses)
+		printf("# %u message(s) still miss their deadline: the plan changes the id "
+			"format of some messages\n", misses);
+	print_plan(plan, senders);
+	return 1;
+}
@@ -0,0 +1,323 @@
+/* SPDX-License-Identifier: LGPL-2.1-only */
+/*
+ * mitloop.cpp - runs a real-time control loop on MIT motors
+ *
+ * Enables the given motors, then commands them (zero gains and zero torque
+ * by default: the motors are free) at a fixed rate for some seconds, then
+ * disables them and prints the loop statistics. Each channel is driven by
+ * its own worker thread (see bus_manager.hpp).
+ *
+ * usage: mitloop [-c channel [-C cpu]]... [-F fd_bitrate] [-r hz]
+ *                [-d seconds] [-P priority] [-T] [-q depth] [-D cycles]
+ *                [-W ms] [-k kp] [-K kd] [-v] ids...
+ *   -c  channel handle (default 0x51: PCAN_USBBUS1), may be repeated
+ *   -C  CPU to run the worker of the last given channel on
+ *   -F  open the channels in CAN FD mode with this bit rate string
+ *   -r  loop rate (default 1000 Hz)
+ *   -d  duration (default 5 s)
+ *   -P  SCHED_FIFO priority (default 80, 0 for SCHED_OTHER)
+ *   -T  wait with a timerfd instead of clock_nanosleep()
+ *   -q  deadline TX: keep at most depth frames in the driver queue, stale
+ *       commands are replaced or dropped
+ *  -D  delta suppression: don't resend a command equal to the last
+ *      acknowledged one, but resend it at least every cycles cycles. The
+ *      bus time saved is the worst case wire time (CAN_GetFrameTime()) of
+ *      the commands not sent and of their replies
+ *  -W  delta suppression: watchdog timeout of the motors (ms)
+ *   -k  -K  position and velocity gains (hold the first position read)
+ *   -v  print the states of the motors every second (read from the state
+ *       table, out of the real-time threads)
+ *   ids comma separated motor ids, one list per channel:
+ *       mitloop -c 0x41 -C 2 -c 0x42 -C 3 1,2,3 4,5,6
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include <pcanmotor/bus_manager.hpp>
+
+using namespace pcanmotor;
+
+typedef bus_manager<> manager;
+typedef manager::loop loop;
+
+#define MAX_CHANNELS	4
+
+static volatile sig_atomic_t stopped;
+
+/* bit rates of the channels */
+static DWORD nom_bitrate = 1000000, data_bitrate;
+
+static void signal_handler(int s)
+{
+	(void)s;
+	stopped = 1;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-c channel [-C cpu]]... [-F fd_bitrate] "
+		"[-r hz] [-d seconds] [-P priority] [-T] [-q depth] [-D cycles] "
+		"[-W ms] [-k kp] [-K kd] [-v] ids...\n",
+		name);
+	exit(2);
+}
+
+static TPCANStatus send_mode(TPCANHandle h, bool fd, uint8_t id, mit::mode m)
+{
+	if (fd) {
+		TPCANMsgFD msg;
+
+		mit::pack_mode(msg, id, m);
+		return CAN_WriteFD(h, &msg);
+	}
+
+	TPCANMsg msg;
+
+	mit::pack_mode(msg, id, m);
+	return CAN_Write(h, &msg);
+}
+
+static void print_series(const char *name, const rt::series &s)
+{
+	printf("%-8s min %9.1f avg %9.1f max %9.1f stddev %8.1f us\n", name,
+		s.min / 1e3, s.mean() / 1e3, s.max / 1e3, s.stddev() / 1e3);
+}
+
+/* worst case wire time of a frame of len bytes sent by a loop */
+static uint64_t frame_ns(const loop_config &cfg, unsigned len)
+{
+	struct pcanfd_msg msg;
+	UINT64 ns = 0;
+
+	memset(&msg, 0, sizeof(msg));
+	msg.type = cfg.msg_type;
+	msg.flags = cfg.msg_flags;
+	msg.data_len = len;
+	CAN_GetFrameTime(&msg, nom_bitrate, data_bitrate, PCAN_PARAMETER_ON, &ns);
+	return ns;
+}
+
+static void print_stats(const manager &m, unsigned i)
+{
+	const loop &l = m.channel(i);
+	const loop_stats &st = l.stats();
+
+	printf("channel 0x%02X: %u motors, %llu cycles\n", l.config().channel,
+		l.motors(), (unsigned long long)st.cycles);
+	if (st.setup_error)
+		printf("warning: real-time setup failed: %s\n",
+			strerror(st.setup_error));
+	printf("overruns %llu late %llu tx errors %llu tx dropped %llu "
+		"rx errors %llu missed replies %llu\n",
+		(unsigned long long)st.overruns, (unsigned long long)st.late,
+		(unsigned long long)st.tx_errors,
+		(unsigned long long)st.tx_dropped,
+		(unsigned long long)st.rx_errors,
+		(unsigned long long)st.missed_replies);
+	if (st.stale_replies)
+		printf("stale replies %llu (read before the commands were "
+			"sent)\n", (unsigned long long)st.stale_replies);
+	if (l.config().tx_depth)
+		printf("deadline tx: superseded %llu expired %llu\n",
+			(unsigned long long)st.tx_superseded,
+			(unsigned long long)st.tx_expired);
+	if (l.config().refresh_cycles) {
+		/* a command not sent is not replied to either */
+		const double saved_ns = (double)st.tx_suppressed *
+			(frame_ns(l.config(), mit::CMD_LEN) +
+			 frame_ns(l.config(), mit::REPLY_LEN));
+
+		printf("delta suppression: %llu commands not sent (%.1f%%), "
+			"%.1f ms of bus time saved (%.1f%% of the bus)\n",
+			(unsigned long long)st.tx_suppressed,
+			st.cycles && l.motors() ? 100. * st.tx_suppressed /
+				(st.cycles * l.motors()) : 0.,
+			saved_ns / 1e6, st.cycles ? 100. * saved_ns /
+				(st.cycles * (double)l.config().period_ns) : 0.);
+	}
+	print_series("wakeup", st.wakeup);
+	print_series("barrier", m.barrier_wait(i));
+	print_series("cycle", st.cycle);
+	print_series("replies", st.replies);
+}
+
+int main(int argc, char *argv[])
+{
+	loop_config cfg[MAX_CHANNELS];
+	unsigned channels = 0, i;
+	char *fd_bitrate = NULL;
+	double rate = 1000, duration = 5, kp = 0, kd = 0;
+	int priority = 80;
+	unsigned depth = 0, refresh = 0;
+	double watchdog = 0;
+	rt::clock_source clock = rt::clock_source::nanosleep;
+	bool verbose = false;
+	TPCANStatus sts;
+	int opt;
+
+	cfg[0].channel = PCAN_USBBUS1;
+	while ((opt = getopt(argc, argv, "c:C:F:r:d:P:Tq:D:W:k:K:v")) != -1) {
+		switch (opt) {
+		case 'c':
+			if (channels >= MAX_CHANNELS)
+				usage(argv[0]);
+			cfg[channels++].channel =
+				(TPCANHandle)strtoul(optarg, NULL, 0);
+			break;
+		case 'C':
+			cfg[channels ? channels - 1 : 0].thread.cpu = atoi(optarg);
+			break;
+		case 'F':
+			fd_bitrate = optarg;
+			break;
+		case 'r':
+			rate = strtod(optarg, NULL);
+			break;
+		case 'd':
+			duration = strtod(optarg, NULL);
+			break;
+		case 'P':
+			priority = atoi(optarg);
+			break;
+		case 'T':
+			clock = rt::clock_source::timerfd;
+			break;
+		case 'q':
+			depth = strtoul(optarg, NULL, 0);
+			break;
+		case 'D':
+			refresh = strtoul(optarg, NULL, 0);
+			break;
+		case 'W':
+			watchdog = strtod(optarg, NULL);
+			break;
+		case 'k':
+			kp = strtod(optarg, NULL);
+			break;
+		case 'K':
+			kd = strtod(optarg, NULL);
+			break;
+		case 'v':
+			verbose = true;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (!channels)
+		channels = 1;
+	if (argc - optind != (int)channels || rate <= 0)
+		usage(argv[0]);
+
+	manager m((int64_t)(rt::NSEC_PER_SEC / rate), 0, clock);
+	static state_table table;
+	unsigned slots = 0;
+
+	for (i = 0; i < channels; i++) {
+		cfg[i].thread.priority = priority;
+		cfg[i].tx_depth = depth;
+		cfg[i].refresh_cycles = refresh;
+		cfg[i].watchdog_ns = (int64_t)(watchdog * 1e6);
+		if (fd_bitrate) {
+			cfg[i].msg_type = PCANFD_TYPE_CANFD_MSG;
+			cfg[i].msg_flags = PCANFD_MSG_STD | PCANFD_MSG_BRS;
+		}
+		m.add_channel(cfg[i]);
+		m.channel(i).attach(&table, slots);
+
+		for (char *id = strtok(argv[optind + i], ","); id;
+				id = strtok(NULL, ","))
+			if (m.channel(i).add_motor((uint8_t)strtoul(id, NULL, 0)) < 0) {
+				fprintf(stderr, "can't add motor %s\n", id);
+				return 1;
+			}
+		slots += m.channel(i).motors();
+	}
+
+	if (fd_bitrate) {
+		TPCANBitrateFDProfile profile;
+
+		if (CAN_CreateBitrateFDProfile(fd_bitrate, &profile) == PCAN_ERROR_OK) {
+			CAN_GetBitrateFDProfileBitrates(profile, &nom_bitrate,
+				&data_bitrate);
+			CAN_FreeBitrateFDProfile(profile);
+		}
+	}
+
+	for (i = 0; i < channels; i++) {
+		if (fd_bitrate)
+			sts = CAN_InitializeFD(cfg[i].channel, fd_bitrate);
+		else
+			sts = CAN_Initialize(cfg[i].channel, PCAN_BAUD_1M, 0, 0, 0);
+		if (sts != PCAN_ERROR_OK) {
+			fprintf(stderr, "can't initialize channel 0x%02X: 0x%x\n",
+				cfg[i].channel, sts);
+			CAN_Uninitialize(PCAN_NONEBUS);
+			return 1;
+		}
+	}
+
+	signal(SIGINT, signal_handler);
+	signal(SIGTERM, signal_handler);
+
+	for (i = 0; i < channels; i++)
+		for (unsigned s = 0; s < m.channel(i).motors(); s++)
+			send_mode(cfg[i].channel, fd_bitrate, m.channel(i).id(s),
+				mit::mode::enter);
+
+	/* hold the first position read when gains are given: no gains until
+	 * the motor replied, else it is pulled to 0 */
+	uint8_t held[MAX_CHANNELS][32] = { { 0 } };
+	sts = m.start([&](manager &b) {
+		for (unsigned c = 0; c < b.channels(); c++) {
+			loop &l = b.channel(c);
+
+			for (unsigned s = 0; s < l.motors(); s++) {
+				if (!held[c][s]) {
+					l.cmd.p[s] = l.state.p[s];
+					held[c][s] = l.replied[s];
+				}
+				l.cmd.kp[s] = held[c][s] ? (float)kp : 0.f;
+				l.cmd.kd[s] = held[c][s] ? (float)kd : 0.f;
+			}
+		}
+	});
+	if (sts != PCAN_ERROR_OK) {
+		fprintf(stderr, "can't start the loop: 0x%x\n", sts);
+		CAN_Uninitialize(PCAN_NONEBUS);
+		return 1;
+	}
+
+	const int64_t end = rt::now_ns() + (int64_t)(duration * rt::NSEC_PER_SEC);
+	int64_t next_print = rt::now_ns() + rt::NSEC_PER_SEC;
+	while (!stopped && rt::now_ns() < end) {
+		usleep(10000);
+		if (!verbose || rt::now_ns() < next_print)
+			continue;
+
+		next_print += rt::NSEC_PER_SEC;
+		for (unsigned s = 0; s < slots; s++) {
+			const motor_state st = table.read(s);
+
+			printf("%3u: p %8.3f v %8.3f t %7.3f age %8.1f ms (%u)\n",
+				s, st.p, st.v, st.t,
+				st.replies ? (rt::now_ns() - st.rx_ns) / 1e6 : 0.,
+				st.replies);
+		}
+	}
+	m.stop();
+
+	for (i = 0; i < channels; i++)
+		for (unsigned s = 0; s < m.channel(i).motors(); s++)
+			send_mode(cfg[i].channel, fd_bitrate, m.channel(i).id(s),
+				mit::mode::exit);
+	CAN_Uninitialize(PCAN_NONEBUS);
+
+	printf("%.0f Hz\n", rate);
+	for (i = 0; i < channels; i++)
+		print_stats(m, i);
+
+	return 0;
+}
@@ -0,0 +1,142 @@
+/* SPDX-License-Identifier: LGPL-2.1-only */
+/*
+ * command_cache_test.cpp - delta suppression tests
+ *
+ * Checks that a command is suppressed only when it equals the last one
+ * sent to its motor and the motor acknowledged it, and that it is sent
+ * again after refresh_cycles cycles, before the motor watchdog expires and
+ * after the motor was invalidated (mode frame).
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <pcanmotor/command_cache.hpp>
+
+using namespace pcanmotor;
+
+static int errors;
+
+#define CHECK(cond, ...) do { \
+	if (!(cond)) { \
+		if (errors++ < 20) { \
+			fprintf(stderr, "FAILED %s:%d: ", __FILE__, __LINE__); \
+			fprintf(stderr, __VA_ARGS__); \
+			fputc('\n', stderr); \
+		} \
+	} \
+} while (0)
+
+#define MS	1000000LL
+
+static struct pcanfd_msg command(uint8_t tag)
+{
+	struct pcanfd_msg msg;
+
+	memset(&msg, 0, sizeof(msg));
+	msg.type = PCANFD_TYPE_CAN20_MSG;
+	msg.id = 1;
+	msg.data_len = 8;
+	msg.data[0] = tag;
+	return msg;
+}
+
+static void check_suppression(void)
+{
+	command_cache<4> cache(10, 0);
+	const struct pcanfd_msg a = command(0xa), b = command(0xb);
+	struct pcanfd_msg a4 = command(0xa);
+
+	a4.data_len = 4;
+
+	/* nothing sent yet */
+	CHECK(cache.must_send(0, a, 0, 0), "first command suppressed");
+	cache.sent(0, a, 0, 0);
+
+	/* not acknowledged yet */
+	CHECK(cache.must_send(0, a, 1, 0), "unacknowledged command suppressed");
+	cache.acked(0);
+
+	CHECK(!cache.must_send(0, a, 1, 0), "unchanged command sent");
+	CHECK(cache.must_send(0, b, 1, 0), "changed command suppressed");
+	CHECK(cache.must_send(0, a4, 1, 0), "shorter command suppressed");
+	CHECK(cache.must_send(1, a, 1, 0), "command of another motor suppressed");
+
+	/* a new command must be acknowledged again */
+	cache.sent(0, b, 1, 0);
+	CHECK(cache.must_send(0, b, 2, 0), "unacknowledged command suppressed");
+	cache.acked(0);
+	CHECK(!cache.must_send(0, b, 2, 0), "unchanged command sent");
+
+	/* mode frame */
+	cache.invalidate(0);
+	CHECK(cache.must_send(0, b, 2, 0), "command after invalidate suppressed");
+
+	CHECK(cache.suppressed() == 2, "%llu suppressed",
+		(unsigned long long)cache.suppressed());
+	cache.reset_stats();
+	CHECK(cache.suppressed() == 0, "%llu suppressed",
+		(unsigned long long)cache.suppressed());
+}
+
+static void check_refresh(void)
+{
+	command_cache<4> cache(10, 0);
+	const struct pcanfd_msg a = command(0xa);
+	uint64_t cycle;
+
+	cache.sent(0, a, 100, 0);
+	cache.acked(0);
+	for (cycle = 101; cycle < 110; cycle++)
+		CHECK(!cache.must_send(0, a, cycle, 0), "sent at cycle %llu",
+			(unsigned long long)cycle);
+	CHECK(cache.must_send(0, a, 110, 0), "not refreshed after 10 cycles");
+	CHECK(cache.suppressed() == 9, "%llu suppressed",
+		(unsigned long long)cache.suppressed());
+}
+
+static void check_watchdog(void)
+{
+	command_cache<4> cache(1000, 50 * MS);
+	const struct pcanfd_msg a = command(0xa);
+
+	/* the next chance to send is before the watchdog expires */
+	cache.sent(0, a, 0, 0);
+	cache.acked(0);
+	CHECK(!cache.must_send(0, a, 1, 49 * MS), "sent before the watchdog");
+	CHECK(cache.must_send(0, a, 1, 50 * MS), "watchdog expired");
+
+	/* the watchdog restarts when the command is sent */
+	cache.sent(0, a, 1, 40 * MS);
+	cache.acked(0);
+	CHECK(!cache.must_send(0, a, 2, 80 * MS), "sent before the watchdog");
+	CHECK(cache.must_send(0, a, 2, 90 * MS), "watchdog expired");
+}
+
+static void check_disabled(void)
+{
+	command_cache<4> cache;
+	const struct pcanfd_msg a = command(0xa);
+
+	CHECK(!cache.enabled(), "enabled");
+	cache.sent(0, a, 0, 0);
+	cache.acked(0);
+	CHECK(cache.must_send(0, a, 1, 0), "suppressed without refresh cycles");
+
+	cache.configure(10, 0);
+	CHECK(cache.enabled() && !cache.must_send(0, a, 1, 0),
+		"not suppressed once configured");
+
+	cache.clear();
+	CHECK(cache.must_send(0, a, 1, 0), "suppressed after clear");
+}
+
+int main(void)
+{
+	check_suppression();
+	check_refresh();
+	check_watchdog();
+	check_disabled();
+
+	printf("command_cache_test: %d error(s)\n", errors);
+	return errors ? 1 : 0;
+}
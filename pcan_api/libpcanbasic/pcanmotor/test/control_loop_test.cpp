@@ -0,0 +1,152 @@
+/* SPDX-License-Identifier: LGPL-2.1-only */
+/*
+ * control_loop_test.cpp - control loop send/collect tests
+ *
+ * Checks, against a simulated driver whose TX queue takes only some of the
+ * frames written (PCAN_ERROR_QXMTFULL), that the control loop only waits
+ * for the replies of the commands the driver took, counts the others as
+ * dropped, and sends them at the next cycle even with delta suppression.
+ *
+ * The CAN_GetValue()/CAN_WriteMany()/CAN_ReadMany() functions of the
+ * library are replaced by the simulated driver, this program is not linked
+ * with libpcanbasic.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <pcanmotor/control_loop.hpp>
+
+using namespace pcanmotor;
+
+static int errors;
+
+#define CHECK(cond, ...) do { \
+	if (!(cond)) { \
+		if (errors++ < 20) { \
+			fprintf(stderr, "FAILED %s:%d: ", __FILE__, __LINE__); \
+			fprintf(stderr, __VA_ARGS__); \
+			fputc('\n', stderr); \
+		} \
+	} \
+} while (0)
+
+#define MOTORS		4
+
+/* simulated driver: every command taken is answered at once */
+static struct {
+	unsigned room;			/* frames the TX queue takes per write */
+	unsigned written;		/* frames taken by the last write */
+	uint32_t ids[16];		/* ids of these frames */
+	struct pcanfd_msg rx[16];
+	unsigned rx_count;
+} sim;
+
+TPCANStatus CAN_GetValue(TPCANHandle, TPCANParameter, void *, DWORD)
+{
+	/* no receive event: collect() returns once the RX queue is empty */
+	return PCAN_ERROR_ILLOPERATION;
+}
+
+/* not inlined: the lists are msg_list<N>, larger than struct pcanfd_msgs */
+__attribute__((noinline))
+TPCANStatus CAN_WriteMany(TPCANHandle, struct pcanfd_msgs *msgs)
+{
+	const unsigned count = msgs->count;
+	unsigned i;
+
+	sim.written = 0;
+	for (i = 0; i < count && i < sim.room; i++) {
+		struct pcanfd_msg &rep = sim.rx[sim.rx_count++];
+
+		sim.ids[sim.written++] = msgs->list[i].id;
+		memset(&rep, 0, sizeof(rep));
+		rep.type = PCANFD_TYPE_CAN20_MSG;
+		rep.data_len = mit::REPLY_LEN;
+		mit::codec<mit::ak10_9>::pack_reply(rep.data,
+			(uint8_t)msgs->list[i].id, 0, 0, 0);
+	}
+
+	msgs->count = sim.written;
+	return sim.written < count ? PCAN_ERROR_QXMTFULL : PCAN_ERROR_OK;
+}
+
+__attribute__((noinline))
+TPCANStatus CAN_ReadMany(TPCANHandle, struct pcanfd_msgs *msgs)
+{
+	unsigned i;
+
+	if (!sim.rx_count) {
+		msgs->count = 0;
+		return PCAN_ERROR_QRCVEMPTY;
+	}
+
+	for (i = 0; i < sim.rx_count && i < msgs->count; i++)
+		msgs->list[i] = sim.rx[i];
+	msgs->count = i;
+	sim.rx_count = 0;
+	return PCAN_ERROR_OK;
+}
+
+static void check_partial_write(void)
+{
+	loop_config lc;
+	unsigned i;
+
+	lc.channel = PCAN_USBBUS1;
+	lc.refresh_cycles = 100;
+
+	control_loop<mit::ak10_9, 8> loop(lc);
+
+	for (i = 0; i < MOTORS; i++)
+		loop.add_motor(i + 1);
+
+	/* the driver takes 2 of the 4 commands */
+	memset(&sim, 0, sizeof(sim));
+	sim.room = 2;
+
+	int64_t now = rt::now_ns();
+	TPCANStatus sts = loop.send(now);
+	CHECK(sts == PCAN_ERROR_QXMTFULL, "send: status %x", (unsigned)sts);
+	unsigned got = loop.collect(now, now + 1000000000LL);
+	CHECK(got == 2, "%u replies", got);
+	CHECK(loop.replied[0] && loop.replied[1] && !loop.replied[2] &&
+		!loop.replied[3], "replied %u %u %u %u", loop.replied[0],
+		loop.replied[1], loop.replied[2], loop.replied[3]);
+	CHECK(loop.stats().missed_replies == 0, "%llu missed replies",
+		(unsigned long long)loop.stats().missed_replies);
+	CHECK(loop.stats().tx_dropped == 2, "%llu dropped",
+		(unsigned long long)loop.stats().tx_dropped);
+
+	/* unchanged commands: only the ones not sent yet are written */
+	sim.room = MOTORS;
+	now = rt::now_ns();
+	sts = loop.send(now);
+	CHECK(sts == PCAN_ERROR_OK, "send: status %x", (unsigned)sts);
+	CHECK(sim.written == 2 && sim.ids[0] == 3 && sim.ids[1] == 4,
+		"%u frames written", sim.written);
+	got = loop.collect(now, now + 1000000000LL);
+	CHECK(got == 2, "%u replies", got);
+	CHECK(loop.stats().missed_replies == 0, "%llu missed replies",
+		(unsigned long long)loop.stats().missed_replies);
+
+	/* full driver: nothing to wait for */
+	loop.cmd.t[0] = 1.0f;
+	sim.room = 0;
+	now = rt::now_ns();
+	sts = loop.send(now);
+	CHECK(sts == PCAN_ERROR_QXMTFULL, "send: status %x", (unsigned)sts);
+	got = loop.collect(now, now + 1000000000LL);
+	CHECK(got == 0 && loop.stats().missed_replies == 0,
+		"%u replies, %llu missed", got,
+		(unsigned long long)loop.stats().missed_replies);
+	CHECK(loop.stats().tx_dropped == 3, "%llu dropped",
+		(unsigned long long)loop.stats().tx_dropped);
+}
+
+int main(void)
+{
+	check_partial_write();
+
+	printf("control_loop_test: %d error(s)\n", errors);
+	return errors ? 1 : 0;
+}
@@ -0,0 +1,208 @@
+/* SPDX-License-Identifier: LGPL-2.1-only */
+/*
+ * fd_aggregate_test.cpp - multiplexed CAN FD frame tests
+ *
+ * Packs sub-commands into CAN FD frames and splits them back: the
+ * sub-frames come back in order and unchanged, frames are padded with 0 up
+ * to their DLC length, a new frame is opened when one is full, and
+ * sub-commands that do not fit are refused. Malformed frames are detected
+ * by split().
+ *
+ * This program is linked with libpcanbasic (CAN_GetFrameTime()).
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <vector>
+
+#include <pcanmotor/fd_aggregate.hpp>
+
+using namespace pcanmotor;
+
+static int errors;
+
+#define CHECK(cond, ...) do { \
+	if (!(cond)) { \
+		if (errors++ < 20) { \
+			fprintf(stderr, "FAILED %s:%d: ", __FILE__, __LINE__); \
+			fprintf(stderr, __VA_ARGS__); \
+			fputc('\n', stderr); \
+		} \
+	} \
+} while (0)
+
+#define CAN_ID		0x100
+
+struct sub {
+	uint8_t motor;
+	std::vector<uint8_t> data;
+};
+
+static std::vector<sub> split_all(const struct pcanfd_msg &msg, int &count)
+{
+	std::vector<sub> subs;
+
+	count = fd_aggregate::split(msg, [&](uint8_t motor, const uint8_t *data,
+			unsigned len) {
+		subs.push_back({ motor, std::vector<uint8_t>(data, data + len) });
+	});
+	return subs;
+}
+
+static void check_round_trip(void)
+{
+	fd_aggregate::aggregator agg(CAN_ID);
+	msg_list<2> out;
+	uint8_t data[10];
+	unsigned i;
+	int count;
+
+	/* 2 + 3, 2 + 0, 2 + 10: 19 bytes, sent as 20 */
+	out.count = 0;
+	for (i = 0; i < sizeof(data); i++)
+		data[i] = (uint8_t)(0xa0 + i);
+	CHECK(agg.add(out, 1, data, 3), "add 1");
+	CHECK(agg.add(out, 2, data, 0), "add 2");
+	CHECK(agg.add(out, 3, data, 10), "add 3");
+	agg.flush(out);
+
+	CHECK(out.count == 1, "%u frames", out.count);
+	const struct pcanfd_msg &msg = out.list[0];
+
+	CHECK(msg.type == PCANFD_TYPE_CANFD_MSG && (msg.flags & PCANFD_MSG_BRS) &&
+		msg.id == CAN_ID, "frame type %x flags %x id %x", msg.type,
+		msg.flags, msg.id);
+	CHECK(msg.data_len == 20, "data_len %u", msg.data_len);
+	CHECK(msg.data[19] == fd_aggregate::END, "padding %02x", msg.data[19]);
+
+	std::vector<sub> subs = split_all(msg, count);
+
+	CHECK(count == 3 && subs.size() == 3, "%d sub-frames", count);
+	if (subs.size() == 3) {
+		CHECK(subs[0].motor == 1 && subs[0].data ==
+			std::vector<uint8_t>(data, data + 3), "sub-frame 1");
+		CHECK(subs[1].motor == 2 && subs[1].data.empty(), "sub-frame 2");
+		CHECK(subs[2].motor == 3 && subs[2].data ==
+			std::vector<uint8_t>(data, data + 10), "sub-frame 3");
+	}
+
+	/* MIT commands and replies */
+	mit::command cmd = { 1.f, -2.f, 50.f, 1.f, 0.5f };
+	struct pcanfd_msg rep;
+	unsigned replies = 0;
+
+	out.count = 0;
+	CHECK(agg.add_command(out, 4, cmd), "add_command");
+	agg.flush(out);
+	subs = split_all(out.list[0], count);
+	CHECK(count == 1 && subs[0].motor == 4 &&
+		subs[0].data.size() == mit::CMD_LEN, "command sub-frame");
+
+	memset(&rep, 0, sizeof(rep));
+	rep.data[0] = 4;
+	rep.data[1] = mit::REPLY_LEN;
+	mit::codec<>::pack_reply(rep.data + 2, 4, 0.5, 1., -1.);
+	rep.data[2 + mit::REPLY_LEN] = 7;
+	rep.data[3 + mit::REPLY_LEN] = mit::REPLY_LEN;
+	/* reply of motor 4 in the sub-frame of motor 7: not taken */
+	mit::codec<>::pack_reply(rep.data + 4 + mit::REPLY_LEN, 4, 0., 0., 0.);
+	rep.data_len = fd_padded_len(4 + 2 * mit::REPLY_LEN);
+	count = fd_aggregate::split_replies(rep, [&](const mit::reply &r) {
+		CHECK(r.id == 4 && r.p > 0.49f && r.p < 0.51f, "reply of %u",
+			r.id);
+		replies++;
+	});
+	CHECK(count == 1 && replies == 1, "%d replies", count);
+}
+
+static void check_padding(void)
+{
+	fd_aggregate::aggregator agg(CAN_ID);
+	msg_list<2> out;
+	uint8_t data[62];
+	unsigned len;
+	int count;
+
+	memset(data, 0xff, sizeof(data));
+	for (len = 0; len <= sizeof(data); len++) {
+		out.count = 0;
+		memset(out.list, 0x55, sizeof(out.list));
+		CHECK(agg.add(out, 1, data, len), "add %u bytes", len);
+		agg.flush(out);
+
+		const struct pcanfd_msg &msg = out.list[0];
+		unsigned i;
+
+		CHECK(msg.data_len == fd_padded_len(len + 2) &&
+			msg.data_len >= len + 2, "%u bytes sent as %u", len,
+			msg.data_len);
+		for (i = len + 2; i < msg.data_len; i++)
+			CHECK(msg.data[i] == 0, "%u bytes: padding byte %u is %02x",
+				len, i, msg.data[i]);
+		split_all(msg, count);
+		CHECK(count == 1, "%u bytes: %d sub-frames", len, count);
+	}
+}
+
+static void check_overflow(void)
+{
+	fd_aggregate::aggregator agg(CAN_ID);
+	msg_list<2> out;
+	uint8_t data[64] = {};
+	unsigned i;
+
+	/* 7 sub-commands of 8 bytes fill 70 bytes: 2 frames */
+	out.count = 0;
+	for (i = 1; i <= 7; i++)
+		CHECK(agg.add(out, (uint8_t)i, data, 8), "add %u", i);
+	agg.flush(out);
+	CHECK(out.count == 2 && out.list[0].data_len == 64 &&
+		out.list[1].data_len == 12, "%u frames of %u and %u bytes",
+		out.count, out.list[0].data_len, out.list[1].data_len);
+
+	/* out is full */
+	out.count = 0;
+	CHECK(agg.add(out, 1, data, 62) && agg.add(out, 2, data, 62),
+		"2 frames of 1 sub-command");
+	CHECK(!agg.add(out, 3, data, 1), "third frame added");
+	agg.flush(out);
+	CHECK(out.count == 2, "%u frames", out.count);
+
+	/* sub-commands that can not be sent */
+	out.count = 0;
+	CHECK(!agg.add(out, 1, data, 63), "63 bytes added");
+	CHECK(!agg.add(out, fd_aggregate::END, data, 1), "motor 0 added");
+	CHECK(out.count == 0, "%u frames", out.count);
+
+	/* a sub-frame longer than the frame */
+	struct pcanfd_msg msg;
+	int count;
+
+	memset(&msg, 0, sizeof(msg));
+	msg.data_len = 12;
+	msg.data[0] = 1;
+	msg.data[1] = 2;
+	msg.data[4] = 2;
+	msg.data[5] = 7;
+	split_all(msg, count);
+	CHECK(count == -1, "overflowing sub-frame: %d", count);
+
+	/* the data_len of the frame bounds the sub-frames */
+	msg.data_len = 8;
+	msg.data[5] = 2;
+	split_all(msg, count);
+	CHECK(count == 2, "%d sub-frames", count);
+	msg.data[5] = 3;
+	split_all(msg, count);
+	CHECK(count == -1, "sub-frame after data_len: %d", count);
+}
+
+int main(void)
+{
+	check_round_trip();
+	check_padding();
+	check_overflow();
+
+	printf("fd_aggregate_test: %d error(s)\n", errors);
+	return errors ? 1 : 0;
+}
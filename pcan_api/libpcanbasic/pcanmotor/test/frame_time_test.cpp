@@ -0,0 +1,208 @@
+/* SPDX-License-Identifier: LGPL-2.1-only */
+/*
+ * frame_time_test.cpp - wire time and predicted bus load tests
+ *
+ * Checks the frame times of CAN_GetFrameTime() against bit counts worked
+ * out by hand (at 1 Mbit/s, a bit is 1 us), stuff bits included, with the
+ * stuffing of the frame and the worst case one of its format and DLC.
+ *
+ * Then checks the PCAN_BUSLOAD_TX/PCAN_BUSLOAD_RX meters on two nodes of
+ * the virtual bus: the first query starts the accounting and returns 0,
+ * the frames of a window are reported once it is complete, and a window
+ * without frames has no load.
+ *
+ * This program is linked with libpcanbasic.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <PCANBasic.h>
+
+#include <pcanmotor/rt.hpp>
+
+using namespace pcanmotor;
+
+static int errors;
+
+#define CHECK(cond, ...) do { \
+	if (!(cond)) { \
+		if (errors++ < 20) { \
+			fprintf(stderr, "FAILED %s:%d: ", __FILE__, __LINE__); \
+			fprintf(stderr, __VA_ARGS__); \
+			fputc('\n', stderr); \
+		} \
+	} \
+} while (0)
+
+#define NOM_BITRATE	1000000
+#define DATA_BITRATE	5000000
+#define HOST		PCAN_USBBUS1
+#define PEER		PCAN_USBBUS2
+#define WINDOW_NS	100000000LL	/* window of the load meters */
+#define LOAD_FRAMES	50
+
+static struct pcanfd_msg frame(bool fd, uint32_t id, unsigned len,
+		uint8_t fill)
+{
+	struct pcanfd_msg msg;
+
+	memset(&msg, 0, sizeof(msg));
+	msg.type = fd ? PCANFD_TYPE_CANFD_MSG : PCANFD_TYPE_CAN20_MSG;
+	msg.flags = fd ? PCANFD_MSG_BRS : 0;
+	msg.id = id;
+	msg.data_len = len;
+	memset(msg.data, fill, len);
+	return msg;
+}
+
+static UINT64 frame_ns(const struct pcanfd_msg &msg, bool worst)
+{
+	UINT64 ns = 0;
+	TPCANStatus sts;
+
+	sts = CAN_GetFrameTime(&msg, NOM_BITRATE,
+		msg.type == PCANFD_TYPE_CANFD_MSG ? DATA_BITRATE : 0,
+		worst ? PCAN_PARAMETER_ON : PCAN_PARAMETER_OFF, &ns);
+	CHECK(sts == PCAN_ERROR_OK, "CAN_GetFrameTime: status %x",
+		(unsigned)sts);
+	return ns;
+}
+
+static void check_frame_times(void)
+{
+	struct pcanfd_msg msg;
+	UINT64 ns;
+
+	/* SOF, id, RTR, IDE, r0, DLC, CRC: 34 dominant bits (the CRC of 0 is
+	 * 0), a stuff bit every 5 of them: 6, then CRC delimiter, ACK, EOF
+	 * and IFS: 13 */
+	msg = frame(false, 0, 0, 0);
+	ns = frame_ns(msg, false);
+	CHECK(ns == 53000, "std id 0, DLC 0: %llu ns", (unsigned long long)ns);
+
+	/* worst case: the first stuff bit after 5 bits, then every 4 */
+	ns = frame_ns(msg, true);
+	CHECK(ns == 55000, "std DLC 0 worst case: %llu ns",
+		(unsigned long long)ns);
+
+	/* 0x55 data is never stuffed: 111 bits and 1 stuff bit */
+	msg = frame(false, 0x555, 8, 0x55);
+	ns = frame_ns(msg, false);
+	CHECK(ns == 112000, "std 8 x 0x55: %llu ns", (unsigned long long)ns);
+	ns = frame_ns(msg, true);
+	CHECK(ns == 135000, "std 8 worst case: %llu ns",
+		(unsigned long long)ns);
+
+	/* the worst case does not depend on the id nor on the data */
+	msg = frame(false, 0, 8, 0);
+	CHECK(frame_ns(msg, true) == 135000, "std 8 x 0 worst case: %llu ns",
+		(unsigned long long)frame_ns(msg, true));
+
+	/* FD, BRS at 1M/5M: the arbitration and the end of frame at 1 us a
+	 * bit, the data phase and its CRC at 200 ns a bit */
+	msg = frame(true, 0x555, 64, 0x55);
+	ns = frame_ns(msg, false);
+	CHECK(ns == 139000, "fd 64 x 0x55: %llu ns", (unsigned long long)ns);
+	ns = frame_ns(msg, true);
+	CHECK(ns == 168800, "fd 64 worst case: %llu ns",
+		(unsigned long long)ns);
+
+	/* 9 bytes are sent as 12 (DLC 9), padded with 0 */
+	msg = frame(true, 0x555, 9, 0);
+	ns = frame_ns(msg, false);
+	msg.data_len = 12;
+	CHECK(frame_ns(msg, false) == ns, "fd 9 bytes: %llu ns, 12 bytes: "
+		"%llu ns", (unsigned long long)ns,
+		(unsigned long long)frame_ns(msg, false));
+
+	msg.type = 0;
+	CHECK(CAN_GetFrameTime(&msg, NOM_BITRATE, 0, PCAN_PARAMETER_OFF,
+		&ns) != PCAN_ERROR_OK, "time of a status message");
+}
+
+static unsigned load(TPCANHandle h, TPCANParameter what)
+{
+	unsigned value = ~0U;
+	TPCANStatus sts;
+
+	sts = CAN_GetValue(h, what, &value, sizeof(value));
+	CHECK(sts == PCAN_ERROR_OK, "CAN_GetValue(%x): status %x",
+		(unsigned)what, (unsigned)sts);
+	return value;
+}
+
+/* sleeps until 'offset' after the start of the next window */
+static void next_window(int64_t offset)
+{
+	const int64_t t = (rt::now_ns() / WINDOW_NS + 1) * WINDOW_NS + offset;
+	const struct timespec ts = rt::to_timespec(t);
+
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL))
+		;
+}
+
+static void check_bus_load(void)
+{
+	const struct pcanfd_msg msg = frame(false, 0x555, 8, 0x55);
+	const unsigned expected = (unsigned)(LOAD_FRAMES * frame_ns(msg, false) *
+		10000 / WINDOW_NS);
+	TPCANStatus sts;
+	TPCANMsg m;
+	TPCANTimestamp ts;
+	unsigned i, n;
+
+	sts = CAN_Initialize(HOST, PCAN_BAUD_1M, 0, 0, 0);
+	if (sts == PCAN_ERROR_OK)
+		sts = CAN_Initialize(PEER, PCAN_BAUD_1M, 0, 0, 0);
+	CHECK(sts == PCAN_ERROR_OK, "initialization: status %x", (unsigned)sts);
+	if (sts != PCAN_ERROR_OK)
+		return;
+
+	/* not accounted: the meters start with their first query */
+	memset(&m, 0, sizeof(m));
+	m.ID = 0x555;
+	m.LEN = 8;
+	memset(m.DATA, 0x55, 8);
+	CHECK(CAN_Write(HOST, &m) == PCAN_ERROR_OK, "write");
+	next_window(WINDOW_NS / 10);
+	CHECK(CAN_Read(PEER, &m, &ts) == PCAN_ERROR_OK, "read");
+	CHECK(load(HOST, PCAN_BUSLOAD_TX) == 0, "TX load before metering");
+	CHECK(load(PEER, PCAN_BUSLOAD_RX) == 0, "RX load before metering");
+
+	/* the frames are reported once their window is complete */
+	next_window(WINDOW_NS / 100);
+	for (i = 0; i < LOAD_FRAMES; i++)
+		CHECK(CAN_Write(HOST, &m) == PCAN_ERROR_OK, "write %u", i);
+	for (n = 0; CAN_Read(PEER, &m, &ts) == PCAN_ERROR_OK; n++)
+		;
+	CHECK(n == LOAD_FRAMES, "%u frames read", n);
+	CHECK(load(HOST, PCAN_BUSLOAD_TX) == 0, "TX load of the current window");
+
+	next_window(WINDOW_NS / 10);
+	n = load(HOST, PCAN_BUSLOAD_TX);
+	CHECK(n == expected, "TX load %u, expected %u", n, expected);
+	n = load(PEER, PCAN_BUSLOAD_RX);
+	CHECK(n == expected, "RX load %u, expected %u", n, expected);
+	CHECK(load(HOST, PCAN_BUSLOAD_RX) == 0, "RX load of the writer");
+
+	/* an idle window */
+	next_window(WINDOW_NS / 10);
+	CHECK(load(HOST, PCAN_BUSLOAD_TX) == 0, "TX load of an idle window");
+	CHECK(load(PEER, PCAN_BUSLOAD_RX) == 0, "RX load of an idle window");
+
+	CAN_Uninitialize(PCAN_NONEBUS);
+}
+
+int main(void)
+{
+	/* two nodes of the same virtual bus */
+	setenv("PCANBASIC_VIRTUAL", "0x51=load,0x52=load", 1);
+
+	check_frame_times();
+	check_bus_load();
+
+	printf("frame_time_test: %d error(s)\n", errors);
+	return errors ? 1 : 0;
+}
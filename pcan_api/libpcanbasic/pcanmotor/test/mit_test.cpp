@@ -0,0 +1,276 @@
+/* SPDX-License-Identifier: LGPL-2.1-only */
+/*
+ * mit_test.cpp - MIT codec tests
+ *
+ * Reads the vectors printed by mit_vectors.py on stdin and checks that
+ * the codec packs them bit-exactly like the Python makeTMotorPackage().
+ * Then checks the quantizers against the float_to_uint() formula on
+ * random float inputs, the batch kernels against the scalar codec, and
+ * the reply decoding (one by one and batched) and the motor side codec.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include <pcanmotor/mit_batch.hpp>
+
+using namespace pcanmotor;
+
+typedef mit::codec<> codec;
+
+static int errors;
+
+#define CHECK(cond, ...) do { \
+	if (!(cond)) { \
+		if (errors++ < 20) { \
+			fprintf(stderr, "FAILED %s:%d: ", __FILE__, __LINE__); \
+			fprintf(stderr, __VA_ARGS__); \
+			fputc('\n', stderr); \
+		} \
+	} \
+} while (0)
+
+/* float_to_uint() of the Python tests, after truncate_float() */
+static uint32_t ref_quant(double x, double lo, double hi, unsigned bits)
+{
+	if (x > hi)
+		x = hi;
+	if (x < lo)
+		x = lo;
+	return (uint32_t)((x - lo) * (double)((1U << bits) - 1) / (hi - lo));
+}
+
+static unsigned check_python_vectors(FILE *f)
+{
+	char line[512];
+	unsigned n = 0;
+
+	while (fgets(line, sizeof(line), f)) {
+		double in[5];
+		unsigned exp[mit::CMD_LEN];
+		uint8_t buf[mit::CMD_LEN];
+		char *p = line, *end;
+		unsigned i;
+
+		for (i = 0; i < 5; i++, p = end)
+			in[i] = strtod(p, &end);
+		for (i = 0; i < mit::CMD_LEN; i++, p = end)
+			exp[i] = (unsigned)strtoul(p, &end, 16);
+
+		/* makeTMotorPackage(p_des, v_des, t_ff, kp, kd) */
+		codec::pack(buf, in[0], in[1], in[3], in[4], in[2]);
+		for (i = 0; i < mit::CMD_LEN; i++)
+			if (buf[i] != exp[i])
+				break;
+		CHECK(i == mit::CMD_LEN,
+			"p=%a v=%a t=%a kp=%a kd=%a: byte %u is %02x instead of %02x",
+			in[0], in[1], in[2], in[3], in[4], i, buf[i], exp[i]);
+		n++;
+	}
+
+	return n;
+}
+
+template <unsigned Bits>
+static void check_quant(const mit::quant<Bits> &q, unsigned count)
+{
+	unsigned i;
+
+	for (i = 0; i < count; i++) {
+		double r = (double)rand() / RAND_MAX;
+		float x = (float)(q.min - 1.0 + r * (q.span + 2.0));
+		uint32_t k = q.encode(x);
+
+		CHECK(k == ref_quant(x, q.min, q.max, Bits),
+			"%u bits [%g %g]: x=%a gives %u instead of %u", Bits,
+			q.min, q.max, x, k, ref_quant(x, q.min, q.max, Bits));
+	}
+
+	/* every step boundary */
+	for (i = 0; i <= q.max_int; i++) {
+		double x = q.min + i * q.span / q.max_int;
+
+		CHECK(q.encode(x) == ref_quant(x, q.min, q.max, Bits),
+			"%u bits [%g %g]: step %u", Bits, q.min, q.max, i);
+		CHECK(q.encode(q.decode(i)) == ref_quant((float)(i * q.step + q.min),
+			q.min, q.max, Bits), "%u bits: decode(%u)", Bits, i);
+	}
+
+	CHECK(q.encode(NAN) == 0, "NaN");
+	CHECK(q.encode(INFINITY) == q.max_int, "+inf");
+	CHECK(q.encode(-INFINITY) == 0, "-inf");
+}
+
+#define MAX_BATCH	256
+
+static void check_batch(unsigned n)
+{
+	static const mit::kernel kernels[] = {
+		mit::kernel::scalar, mit::kernel::sse2, mit::kernel::avx2,
+		mit::kernel::neon,
+	};
+	static float f[5][MAX_BATCH];
+	static uint32_t ids[MAX_BATCH];
+	static struct pcanfd_msg msgs[MAX_BATCH];
+	mit::commands_soa in = { f[0], f[1], f[2], f[3], f[4] };
+	unsigned i, j;
+
+	for (i = 0; i < n; i++) {
+		ids[i] = i + 1;
+		for (j = 0; j < 5; j++)
+			f[j][i] = (float)(rand() - RAND_MAX / 2) / (RAND_MAX / 200);
+	}
+	if (n > 3) {
+		f[0][1] = NAN;
+		f[3][2] = -INFINITY;
+	}
+
+	for (const mit::kernel k : kernels) {
+		if (!mit::kernel_supported(k))
+			continue;
+
+		memset(msgs, 0, sizeof(msgs));
+		mit::batch_codec<>::encode(k, in, ids, n, msgs,
+			PCANFD_TYPE_CANFD_MSG, PCANFD_MSG_BRS);
+
+		for (i = 0; i < n; i++) {
+			uint8_t buf[mit::CMD_LEN];
+
+			codec::pack(buf, f[0][i], f[1][i], f[2][i], f[3][i], f[4][i]);
+			CHECK(!memcmp(buf, msgs[i].data, sizeof(buf)) &&
+				msgs[i].id == ids[i] && msgs[i].data_len == 8 &&
+				msgs[i].type == PCANFD_TYPE_CANFD_MSG &&
+				msgs[i].flags == PCANFD_MSG_BRS,
+				"%s kernel: motor %u/%u differs", mit::kernel_name(k),
+				i, n);
+		}
+	}
+}
+
+static void check_decode(unsigned count)
+{
+	static const mit::kernel kernels[] = {
+		mit::kernel::scalar, mit::kernel::sse2, mit::kernel::avx2,
+		mit::kernel::neon,
+	};
+	static const uint8_t ids[] = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 42 };
+	const unsigned n = sizeof(ids);
+	static struct pcanfd_msg msgs[MAX_BATCH];
+	mit::batch_decoder<> dec(ids, n);
+	float ref[3][n], st[3][n];
+	uint8_t ref_upd[n], upd[n];
+	mit::states_soa out = { st[0], st[1], st[2] };
+	unsigned i, s, ref_count = 0;
+
+	memset(msgs, 0, sizeof(msgs));
+	for (i = 0; i < count; i++) {
+		msgs[i].type = (rand() % 20) ? PCANFD_TYPE_CAN20_MSG :
+						PCANFD_TYPE_STATUS;
+		msgs[i].data_len = (rand() % 20) ? 6 : 5;
+		for (s = 0; s < 6; s++)
+			msgs[i].data[s] = (uint8_t)rand();
+		msgs[i].data[0] = (rand() % 10) ? ids[rand() % n] : 13;
+	}
+
+	memset(ref_upd, 0, n);
+	for (s = 0; s < n; s++)
+		ref[0][s] = ref[1][s] = ref[2][s] = -1.f;
+	for (i = 0; i < count; i++) {
+		mit::reply rep;
+
+		if (msgs[i].type != PCANFD_TYPE_CAN20_MSG ||
+			!codec::unpack(msgs[i].data, msgs[i].data_len, rep) ||
+			dec.slot(rep.id) < 0)
+			continue;
+
+		s = dec.slot(rep.id);
+		ref_count += !ref_upd[s];
+		ref_upd[s] = 1;
+		ref[0][s] = rep.p;
+		ref[1][s] = rep.v;
+		ref[2][s] = rep.t;
+	}
+
+	for (const mit::kernel k : kernels) {
+		if (!mit::kernel_supported(k))
+			continue;
+
+		for (s = 0; s < n; s++)
+			st[0][s] = st[1][s] = st[2][s] = -1.f;
+
+		i = dec.decode(k, msgs, count, out, upd);
+		CHECK(i == ref_count, "%s kernel: %u updated instead of %u",
+			mit::kernel_name(k), i, ref_count);
+		CHECK(!memcmp(upd, ref_upd, n) && !memcmp(st, ref, sizeof(st)),
+			"%s kernel: %u frames decoded differently",
+			mit::kernel_name(k), count);
+	}
+}
+
+static void check_reply(void)
+{
+	/* id 1, p=0x8000, v=0x7ff, i=0x801 */
+	const uint8_t buf[] = { 0x01, 0x80, 0x00, 0x7f, 0xf8, 0x01 };
+	mit::reply rep;
+	TPCANMsgFD msg;
+	uint8_t out[mit::REPLY_LEN];
+
+	CHECK(!codec::unpack(buf, 5, rep), "short reply accepted");
+	CHECK(codec::unpack(buf, sizeof(buf), rep), "reply rejected");
+	CHECK(rep.id == 1, "id %u", rep.id);
+	CHECK(fabsf(rep.p - codec::P.decode(0x8000)) == 0.f, "p %f", rep.p);
+	CHECK(fabsf(rep.v - codec::V.decode(0x7ff)) == 0.f, "v %f", rep.v);
+	CHECK(fabsf(rep.t - codec::T.decode(0x801)) == 0.f, "t %f", rep.t);
+	CHECK(fabsf(rep.p) < 0.002f && fabsf(rep.v) < 0.01f &&
+		fabsf(rep.t) < 0.02f, "reply not centered");
+
+	/* motor side: the reply fields are the decoded quanta */
+	codec::pack_reply(out, 7, 1.5, -2., 3.);
+	CHECK(codec::unpack(out, sizeof(out), rep) && rep.id == 7 &&
+		rep.p == codec::P.decode(codec::P.encode(1.5)) &&
+		rep.v == codec::V.decode(codec::V.encode(-2.)) &&
+		rep.t == codec::T.decode(codec::T.encode(3.)),
+		"reply packed differently");
+
+	/* the command fields are the decoded quanta */
+	mit::command cmd = { 1.5f, -2.f, 30.f, 1.f, 3.f }, dec;
+	uint8_t frame[mit::CMD_LEN];
+	codec::pack(frame, cmd);
+	CHECK(codec::unpack(frame, sizeof(frame), dec), "command rejected");
+	CHECK(dec.p == codec::P.decode(codec::P.encode(cmd.p)) &&
+		dec.v == codec::V.decode(codec::V.encode(cmd.v)) &&
+		dec.kp == codec::KP.decode(codec::KP.encode(cmd.kp)) &&
+		dec.kd == codec::KD.decode(codec::KD.encode(cmd.kd)) &&
+		dec.t == codec::T.decode(codec::T.encode(cmd.t)),
+		"command decoded differently");
+
+	mit::pack_mode(msg, 1, mit::mode::exit);
+	CHECK(!codec::unpack(msg.DATA, msg.DLC, dec), "mode frame decoded");
+	mit::mode m = mit::mode::enter;
+	CHECK(msg.DLC == 8 && msg.DATA[0] == 0xFF && msg.DATA[7] == 0xFD,
+		"exit frame");
+	CHECK(mit::is_mode(msg.DATA, msg.DLC, &m) && m == mit::mode::exit,
+		"exit frame not recognized");
+}
+
+int main(void)
+{
+	unsigned n = check_python_vectors(stdin);
+
+	CHECK(n > 0, "no vector read on stdin");
+
+	srand(1);
+	check_quant(codec::P, 1000000);
+	check_quant(codec::V, 1000000);
+	check_quant(codec::KP, 1000000);
+	check_quant(codec::KD, 1000000);
+	check_quant(codec::T, 1000000);
+	for (unsigned n = 1; n <= MAX_BATCH; n += (n < 20) ? 1 : 37)
+		check_batch(n);
+	for (unsigned n = 0; n <= MAX_BATCH; n += (n < 40) ? 1 : 23)
+		check_decode(n);
+	check_reply();
+
+	printf("mit_test: %u python vectors, %d error(s)\n", n, errors);
+	return errors ? 1 : 0;
+}
@@ -0,0 +1,69 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: LGPL-2.1-only
+#
+# mit_vectors.py - reference vectors for the MIT codec
+#
+# Loads makeTMotorPackage() (and the helpers it uses) from one of the
+# tMotor*.py test scripts without running the script itself, then prints
+# one line per vector:
+#   p v t kp kd b0 b1 b2 b3 b4 b5 b6 b7
+# with the inputs written as hex floats so that they are read back exactly.
+#
+import ast
+import random
+import struct
+import sys
+
+FUNCS = ('truncate_float', 'float_to_uint', 'makeTMotorPackage')
+
+# (min, max, bits) in makeTMotorPackage() arguments order
+RANGES = ((-95.5, 95.5, 16), (-30.0, 30.0, 12), (-18.0, 18.0, 12),
+          (0.0, 500.0, 12), (0.0, 5.0, 12))
+
+
+def load_packer(path):
+    with open(path) as f:
+        tree = ast.parse(f.read(), path)
+    body = [n for n in tree.body
+            if isinstance(n, ast.FunctionDef) and n.name in FUNCS]
+    env = {}
+    exec(compile(ast.Module(body=body, type_ignores=[]), path, 'exec'), env)
+    return env['makeTMotorPackage']
+
+
+def f32(x):
+    return struct.unpack('f', struct.pack('f', x))[0]
+
+
+def field_values(lo, hi, bits, rnd, n):
+    m = (1 << bits) - 1
+    span = hi - lo
+    vals = [lo, hi, 0.0, -0.0, lo - 1.0, hi + 1.0, 2 * lo - 10, 2 * hi + 10]
+    # exact quantization steps and their float neighbours
+    for k in list(range(0, m + 1, max(1, m // 512))) + [m - 1, m]:
+        x = lo + k * span / m
+        vals += [x, f32(x), x + abs(x) * 1e-16, x - abs(x) * 1e-16]
+    vals += [f32(rnd.uniform(lo - 1, hi + 1)) for _ in range(n)]
+    vals += [rnd.uniform(lo, hi) for _ in range(n)]
+    return vals
+
+
+def main():
+    pack = load_packer(sys.argv[1])
+    count = int(sys.argv[2]) if len(sys.argv) > 2 else 20000
+    rnd = random.Random(0x4B3)
+
+    cols = [field_values(lo, hi, bits, rnd, count) for lo, hi, bits in RANGES]
+    rows = max(len(c) for c in cols)
+
+    out = sys.stdout
+    for i in range(rows):
+        args = [c[(i * 7 + j) % len(c)] if i >= len(c) else c[i]
+                for j, c in enumerate(cols)]
+        data = pack(*args)
+        out.write(' '.join(a.hex() for a in args))
+        out.write(' ' + ' '.join('%02x' % b for b in data) + '\n')
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,194 @@
+/* SPDX-License-Identifier: LGPL-2.1-only */
+/*
+ * moteus_test.cpp - moteus register protocol codec tests
+ *
+ * Checks the codec against the frames exchanged with a moteus r4.5 in the
+ * README (stream poll, position command and query, stop, reply), then
+ * round trips the values of every register type through replies, and
+ * checks the decoding of malformed frames.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <pcanmotor/moteus.hpp>
+
+using namespace pcanmotor;
+
+static int errors;
+
+#define CHECK(cond, ...) do { \
+	if (!(cond)) { \
+		if (errors++ < 20) { \
+			fprintf(stderr, "FAILED %s:%d: ", __FILE__, __LINE__); \
+			fprintf(stderr, __VA_ARGS__); \
+			fputc('\n', stderr); \
+		} \
+	} \
+} while (0)
+
+static bool same(const uint8_t *buf, unsigned len, const uint8_t *exp, unsigned exp_len)
+{
+	return len == exp_len && !memcmp(buf, exp, len);
+}
+
+static void check_readme(void)
+{
+	static const uint8_t poll[] = { 0x42, 0x01, 0x20 };
+	static const uint8_t position[] = {
+		0x01, 0x00, 0x0a, 0x0e, 0x20, 0x00, 0x00, 0x00, 0x00, 0x00,
+		0x00, 0x00, 0x00, 0x11, 0x00, 0x1f, 0x01, 0x13, 0x0d,
+	};
+	static const uint8_t stop[] = { 0x01, 0x00, 0x00 };
+	static const uint8_t reply[] = {
+		0x21, 0x00, 0x00, 0x2f, 0x01, 0x29, 0xa3, 0x1a, 0x3d, 0x33,
+		0xe3, 0x8a, 0x3a, 0x00, 0x00, 0x00, 0x00, 0x23, 0x0d, 0x32,
+		0x1c, 0x00, 0x50, 0x50,
+	};
+	uint8_t buf[moteus::FRAME_LEN];
+	moteus::writer w(buf);
+	TPCANMsgFD msg;
+
+	/* test 1: poll of the diagnostic stream */
+	CHECK(w.poll(1, 32) && same(buf, w.size(), poll, sizeof(poll)), "poll frame");
+	CHECK(moteus::can_id(1) == 0x8001, "id 0x%x", moteus::can_id(1));
+
+	/* its reply: no stream data yet */
+	static const uint8_t empty[] = { 0x41, 0x01, 0x00 };
+	moteus::state st;
+
+	CHECK(moteus::decode(empty, sizeof(empty), st) && st.fields == 0, "stream reply");
+
+	/* test 2: position 0, velocity 0, query of the state */
+	moteus::position_command cmd;
+	moteus::query q;
+
+	q.fields |= moteus::VOLTAGE | moteus::TEMPERATURE | moteus::FAULT;
+	memset(&msg, 0xaa, sizeof(msg));
+	CHECK(moteus::pack(msg, 1, cmd, q), "position frame too long");
+	CHECK(msg.ID == 0x8001 && msg.MSGTYPE == (PCAN_MESSAGE_EXTENDED |
+		PCAN_MESSAGE_FD | PCAN_MESSAGE_BRS), "id 0x%x type 0x%x", msg.ID, msg.MSGTYPE);
+	CHECK(msg.DLC == 11, "DLC %u", msg.DLC);
+	CHECK(same(msg.DATA, sizeof(position), position, sizeof(position)), "position frame");
+	CHECK(msg.DATA[19] == moteus::NOP, "padding 0x%02x", msg.DATA[19]);
+
+	struct pcanfd_msg fd;
+
+	CHECK(moteus::pack(fd, 1, cmd, q) && fd.data_len == 20 && fd.id == 0x8001 &&
+		fd.flags == (PCANFD_MSG_EXT | PCANFD_MSG_BRS) &&
+		same(fd.data, sizeof(position), position, sizeof(position)), "pcanfd_msg frame");
+
+	/* stop */
+	moteus::pack_stop(msg, 1);
+	CHECK(msg.ID == 0x0001 && msg.DLC == 3 && same(msg.DATA, 3, stop, sizeof(stop)),
+		"stop frame");
+
+	/* reply of test 2 */
+	memset(&st, 0, sizeof(st));
+	CHECK(moteus::decode(reply, sizeof(reply), st), "reply not decoded");
+	CHECK(st.fields == (moteus::MODE | moteus::POSITION | moteus::VELOCITY |
+		moteus::TORQUE | moteus::VOLTAGE | moteus::TEMPERATURE | moteus::FAULT),
+		"reply fields 0x%x", st.fields);
+	CHECK(st.mode == (uint8_t)moteus::mode::stopped && st.fault == 0, "mode %u fault %u",
+		st.mode, st.fault);
+	CHECK(fabsf(st.position - 0.03775f) < 1e-5f && fabsf(st.velocity - 0.0010596f) < 1e-6f &&
+		st.torque == 0.f, "p=%g v=%g t=%g", st.position, st.velocity, st.torque);
+	CHECK(st.voltage == 25.f && st.temperature == 28.f, "%g V %g C", st.voltage,
+		st.temperature);
+	CHECK(moteus::reply_source(0x100) == 1, "reply source");
+}
+
+/* writes values as a reply with type t and checks them back */
+static void check_type(moteus::type t, uint16_t start, const float *in, unsigned n,
+		float tolerance)
+{
+	uint8_t buf[moteus::FRAME_LEN];
+	moteus::writer w(buf);
+	moteus::state st;
+	float *out[] = { &st.position, &st.velocity, &st.torque, &st.q_current, &st.d_current };
+
+	CHECK(w.reply(start, t, in, n), "type %u: %u values don't fit", (unsigned)t, n);
+	CHECK(moteus::decode(buf, w.pad(), st), "type %u not decoded", (unsigned)t);
+	for (unsigned i = 0; i < n; i++) {
+		const float x = *out[start + i - moteus::reg::POSITION];
+
+		CHECK(isnan(in[i]) ? isnan(x) : fabsf(x - in[i]) <= tolerance,
+			"type %u reg %u: %g gives %g", (unsigned)t, start + i, in[i], x);
+	}
+}
+
+static void check_types(void)
+{
+	const float in[] = { 0.5f, -2.5f, 3.f, NAN, -1.f };
+
+	check_type(moteus::type::int8, moteus::reg::POSITION, in, 3, 0.005f);
+	check_type(moteus::type::int16, moteus::reg::POSITION, in, 4, 0.0005f);
+	check_type(moteus::type::int32, moteus::reg::POSITION, in, 5, 0.0005f);
+	check_type(moteus::type::f32, moteus::reg::POSITION, in, 5, 0.f);
+
+	/* saturation, NaN as the lowest value */
+	CHECK(moteus::quantize<8>(1000.f, 0.01f) == 127, "int8 saturation");
+	CHECK(moteus::quantize<8>(-1000.f, 0.01f) == -127, "int8 negative saturation");
+	CHECK(moteus::quantize<16>(NAN, 0.01f) == -32768, "int16 NaN");
+	CHECK(moteus::quantize<32>(NAN, 0.01f) == INT32_MIN, "int32 NaN");
+
+	/* count above 3 and 2-byte register varuint */
+	uint8_t buf[moteus::FRAME_LEN];
+	moteus::writer w(buf);
+	static const uint8_t exp[] = { 0x10, 0x05, 0x80, 0x01 };
+
+	CHECK(w.read(0x80, moteus::type::int8, 5) && same(buf, w.size(), exp, sizeof(exp)),
+		"read of 5 registers from 0x80");
+
+	/* full position command with int16 registers */
+	moteus::position_command cmd;
+	moteus::query q;
+	TPCANMsgFD msg;
+
+	cmd.fields = 0xff;
+	cmd.value_type = moteus::type::int16;
+	cmd.watchdog_timeout = 0.1f;
+	CHECK(moteus::pack(msg, 5, cmd, q) && msg.DATA[3] == 0x04 && msg.DATA[4] == 0x08 &&
+		msg.DATA[5] == 0x20, "int16 command header %02x %02x %02x", msg.DATA[3],
+		msg.DATA[4], msg.DATA[5]);
+	CHECK(msg.DATA[12] == 0xff && msg.DATA[13] == 0x7f, "kp scale %02x%02x",
+		msg.DATA[13], msg.DATA[12]);
+	CHECK(msg.DATA[20] == 100 && msg.DATA[21] == 0, "watchdog %02x%02x",
+		msg.DATA[21], msg.DATA[20]);
+}
+
+static void check_errors(void)
+{
+	static const uint8_t truncated[] = { 0x2f, 0x01, 0x00, 0x00, 0x00 };
+	static const uint8_t unknown[] = { 0x21, 0x00, 0x0a, 0x07 };
+	static const uint8_t error[] = { 0x21, 0x00, 0x0a, 0x31, 0x81, 0x01, 0x03 };
+	moteus::state st;
+
+	memset(&st, 0, sizeof(st));
+	CHECK(!moteus::decode(truncated, sizeof(truncated), st), "truncated reply");
+	CHECK(!moteus::decode(unknown, sizeof(unknown), st) && st.fields == moteus::MODE &&
+		st.mode == 10, "unknown sub-frame");
+	CHECK(moteus::decode(error, sizeof(error), st) && st.errors == 1 &&
+		st.error_reg == 0x81 && st.error == 3, "read error");
+
+	/* frame full: the sub-frame is not written */
+	uint8_t buf[moteus::FRAME_LEN];
+	moteus::writer w(buf, 8);
+	const float v[] = { 1.f, 2.f };
+
+	CHECK(w.read(moteus::reg::MODE, moteus::type::int8) && w.size() == 2, "read");
+	CHECK(!w.write(moteus::reg::CMD_POSITION, moteus::type::f32, v, 2) &&
+		w.size() == 2 && !w.ok(), "overflowing write");
+	CHECK(w.pad() == 2, "padding of a valid length");
+}
+
+int main(void)
+{
+	check_readme();
+	check_types();
+	check_errors();
+
+	printf("moteus_test: %d error(s)\n", errors);
+	return errors ? 1 : 0;
+}
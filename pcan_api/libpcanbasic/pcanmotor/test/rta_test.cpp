@@ -0,0 +1,149 @@
+/* SPDX-License-Identifier: LGPL-2.1-only */
+/*
+ * rta_test.cpp - CAN schedulability analysis tests
+ *
+ * Checks the response times of analyse() on the example of Davis et al.
+ * (2007), whose lowest priority message meets its deadline with the
+ * original analysis but not with the revised one, then Audsley's
+ * assignment on a set that misses a deadline in id order but not in
+ * another order, and on the example, which has no such order.
+ *
+ * At 135 kbit/s, the worst case frame of 8 bytes with a 11-bit id (135
+ * bits) takes 1 ms, the transmission time of the example.
+ *
+ * This program is linked with libpcanbasic (CAN_GetFrameTime()).
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <pcanmotor/rta.hpp>
+
+using namespace pcanmotor;
+
+static int errors;
+
+#define CHECK(cond, ...) do { \
+	if (!(cond)) { \
+		if (errors++ < 20) { \
+			fprintf(stderr, "FAILED %s:%d: ", __FILE__, __LINE__); \
+			fprintf(stderr, __VA_ARGS__); \
+			fputc('\n', stderr); \
+		} \
+	} \
+} while (0)
+
+#define MS	1000000LL
+#define US	1000LL
+
+static rta::message message(uint32_t id, int64_t period_ns,
+		int64_t deadline_ns)
+{
+	rta::message m;
+
+	m.id = id;
+	m.len = 8;
+	m.period_ns = period_ns;
+	m.deadline_ns = deadline_ns;
+	return m;
+}
+
+static rta::bus example_bus(void)
+{
+	rta::bus b;
+
+	b.nom_bitrate = 135000;
+	return b;
+}
+
+/* Davis et al., table 1: A, B, C in priority order */
+static std::vector<rta::message> example(void)
+{
+	return {
+		message(1, 2500 * US, 2500 * US),
+		message(2, 3500 * US, 3250 * US),
+		message(3, 3500 * US, 3250 * US),
+	};
+}
+
+static void check_example(void)
+{
+	const rta::bus b = example_bus();
+	std::vector<rta::message> set = example();
+	const int64_t r[] = { 2 * MS, 3 * MS, 3500 * US };
+	unsigned misses, i;
+
+	misses = rta::analyse(set, b);
+	for (i = 0; i < set.size(); i++) {
+		CHECK(set[i].c_ns == 1 * MS, "C of %c: %lld ns", 'A' + i,
+			(long long)set[i].c_ns);
+		CHECK(set[i].r_ns == r[i], "R of %c: %lld ns, expected %lld",
+			'A' + i, (long long)set[i].r_ns, (long long)r[i]);
+	}
+	CHECK(set[0].b_ns == 1 * MS && set[1].b_ns == 1 * MS &&
+		set[2].b_ns == 0, "blocking %lld %lld %lld",
+		(long long)set[0].b_ns, (long long)set[1].b_ns,
+		(long long)set[2].b_ns);
+
+	/* C is queued at 0 and 3.5 ms: the second instance is the latest */
+	CHECK(misses == 1 && !set[2].meets_deadline(), "%u misses", misses);
+
+	/* no order meets every deadline */
+	std::vector<size_t> order;
+
+	CHECK(!rta::assign(set, b, order), "example assigned");
+}
+
+static void check_unbounded(void)
+{
+	std::vector<rta::message> set = example();
+
+	/* A and B fill the bus */
+	set[1].period_ns = 1667 * US;
+	rta::analyse(set, example_bus());
+	CHECK(set[2].r_ns == -1 && !set[2].meets_deadline(),
+		"R of C: %lld ns", (long long)set[2].r_ns);
+}
+
+static void check_assign(void)
+{
+	const rta::bus b = example_bus();
+	std::vector<rta::message> set = {
+		message(1, 10 * MS, 0),
+		message(2, 10 * MS, 0),
+		message(3, 5 * MS, 2500 * US),
+	};
+	std::vector<size_t> order;
+	unsigned misses;
+
+	/* behind 1 and 2, 3 waits 2 ms */
+	misses = rta::analyse(set, b);
+	CHECK(misses == 1 && set[2].r_ns == 3 * MS, "%u misses, R %lld ns",
+		misses, (long long)set[2].r_ns);
+
+	CHECK(rta::assign(set, b, order), "not assigned");
+	CHECK(order.size() == 3 && order[0] == 2 && order[1] == 0 &&
+		order[2] == 1, "order %zu %zu %zu", order[0], order[1],
+		order[2]);
+
+	rta::reassign_ids(set, order);
+	CHECK(set[0].id == 2 && set[1].id == 3 && set[2].id == 1,
+		"ids %x %x %x", set[0].id, set[1].id, set[2].id);
+	misses = rta::analyse(set, b);
+	CHECK(misses == 0 && set[2].r_ns == 2 * MS, "%u misses, R %lld ns",
+		misses, (long long)set[2].r_ns);
+
+	/* a schedulable set keeps its order */
+	CHECK(rta::assign(set, b, order) && order[0] == 2 && order[1] == 0 &&
+		order[2] == 1, "order %zu %zu %zu", order[0], order[1],
+		order[2]);
+}
+
+int main(void)
+{
+	check_example();
+	check_unbounded();
+	check_assign();
+
+	printf("rta_test: %d error(s)\n", errors);
+	return errors ? 1 : 0;
+}
@@ -0,0 +1,137 @@
+/* SPDX-License-Identifier: LGPL-2.1-only */
+/*
+ * state_table_test.cpp - seqlock state table tests
+ *
+ * Checks the slots of a state table read back after writes, then hammers
+ * a few slots with a writer thread while readers check that every
+ * snapshot is consistent (all its fields come from the same write) and
+ * that the snapshots of a slot never go back in time. The writes make
+ * the readers retry, the count of failed try_read() is printed.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <atomic>
+#include <thread>
+
+#include <pcanmotor/state_table.hpp>
+
+using namespace pcanmotor;
+
+static int errors;
+
+#define CHECK(cond, ...) do { \
+	if (!(cond)) { \
+		if (errors++ < 20) { \
+			fprintf(stderr, "FAILED %s:%d: ", __FILE__, __LINE__); \
+			fprintf(stderr, __VA_ARGS__); \
+			fputc('\n', stderr); \
+		} \
+	} \
+} while (0)
+
+#define SLOTS		4
+#define DURATION_NS	200000000LL	/* long enough to be preempted */
+#define READERS		2
+
+static void check_read_back(void)
+{
+	static state_table table;
+	motor_state st[3];
+
+	st[0] = table.read(7);
+	CHECK(st[0].replies == 0 && st[0].p == 0 && st[0].rx_ns == 0,
+		"slot 7 not empty");
+
+	table.write(7, 1.5f, -2.0f, 0.25f, 1000);
+	table.write(8, 3.0f, 4.0f, 5.0f, 2000);
+	table.write(8, 6.0f, 7.0f, 8.0f, 3000);
+
+	CHECK(table.try_read(7, st[0]), "try_read of an idle slot failed");
+	CHECK(st[0].p == 1.5f && st[0].v == -2.0f && st[0].t == 0.25f &&
+		st[0].rx_ns == 1000 && st[0].replies == 1, "slot 7 read back");
+
+	table.read(7, 3, st);
+	CHECK(st[1].p == 6.0f && st[1].v == 7.0f && st[1].t == 8.0f &&
+		st[1].rx_ns == 3000 && st[1].replies == 2, "slot 8 read back");
+	CHECK(st[2].replies == 0, "slot 9 written");
+}
+
+/* write k: every field of the slot is k, returns the last k */
+static unsigned writer(state_table *table)
+{
+	const int64_t end = rt::now_ns() + DURATION_NS;
+	unsigned k = 0;
+
+	/* k stays exact as a float */
+	while (k < (1U << 24) && (k & 1023 || rt::now_ns() < end)) {
+		k++;
+		for (unsigned i = 0; i < SLOTS; i++)
+			table->write(i, (float)k, (float)k, (float)k, k);
+	}
+	return k;
+}
+
+static std::atomic<unsigned> started;
+
+static void reader(const state_table *table, std::atomic<bool> *done,
+		unsigned *bad, uint64_t *retries)
+{
+	uint32_t last[SLOTS] = {};
+	motor_state st;
+
+	started++;
+	while (!done->load(std::memory_order_relaxed))
+		for (unsigned i = 0; i < SLOTS; i++) {
+			while (!table->try_read(i, st))
+				(*retries)++;
+
+			if (st.p != (float)st.rx_ns || st.v != st.p ||
+				st.t != st.p || st.replies != st.rx_ns ||
+				st.replies < last[i])
+				(*bad)++;
+			last[i] = st.replies;
+		}
+}
+
+static void check_concurrent(void)
+{
+	static state_table table;
+	std::atomic<bool> done(false);
+	unsigned bad[READERS] = {};
+	uint64_t retries[READERS] = {}, total = 0;
+	std::thread readers[READERS];
+	unsigned i, writes;
+
+	for (i = 0; i < READERS; i++)
+		readers[i] = std::thread(reader, &table, &done, &bad[i],
+			&retries[i]);
+
+	/* the reads overlap the writes */
+	while (started.load() < READERS)
+		std::this_thread::yield();
+	writes = writer(&table);
+	done = true;
+
+	for (i = 0; i < READERS; i++) {
+		readers[i].join();
+		CHECK(!bad[i], "reader %u: %u inconsistent snapshots", i, bad[i]);
+		total += retries[i];
+	}
+
+	for (i = 0; i < SLOTS; i++)
+		CHECK(table.read(i).replies == writes, "slot %u: %u replies", i,
+			table.read(i).replies);
+
+	printf("state_table_test: %u writes, %llu retries\n", writes,
+		(unsigned long long)total);
+}
+
+int main(void)
+{
+	check_read_back();
+	check_concurrent();
+
+	printf("state_table_test: %d error(s)\n", errors);
+	return errors ? 1 : 0;
+}
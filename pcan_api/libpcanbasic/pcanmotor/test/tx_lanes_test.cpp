@@ -0,0 +1,254 @@
+/* SPDX-License-Identifier: LGPL-2.1-only */
+/*
+ * tx_lanes_test.cpp - deadline TX queue tests
+ *
+ * Checks, against a simulated driver queue, that:
+ *   - the newest command of a motor replaces the one still waiting, but
+ *     not across a mode frame,
+ *   - expired commands are dropped and mode frames are kept,
+ *   - the driver queue is kept at most "depth" frames deep and refilled in
+ *     lane priority order,
+ *   - an exit frame cancels the enter and command frames of its motor
+ *     still waiting in the lanes, so that the motor is not enabled again
+ *     after it, and leaves the frames of the other motors alone.
+ *
+ * The CAN_GetValue()/CAN_WriteMany() functions of the library are replaced
+ * by the simulated driver, this program is not linked with libpcanbasic.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <pcanmotor/deadline_tx.hpp>
+
+using namespace pcanmotor;
+
+static int errors;
+
+#define CHECK(cond, ...) do { \
+	if (!(cond)) { \
+		if (errors++ < 20) { \
+			fprintf(stderr, "FAILED %s:%d: ", __FILE__, __LINE__); \
+			fprintf(stderr, __VA_ARGS__); \
+			fputc('\n', stderr); \
+		} \
+	} \
+} while (0)
+
+/* simulated driver queue */
+static struct {
+	struct pcanfd_msg fifo[64];
+	unsigned count;
+	__u32 pending;		/* reported by PCAN_TX_PENDING_MSGS */
+} sim;
+
+TPCANStatus CAN_GetValue(TPCANHandle, TPCANParameter param, void *buf, DWORD)
+{
+	if (param != PCAN_TX_PENDING_MSGS)
+		return PCAN_ERROR_UNKNOWN;
+
+	*(__u32 *)buf = sim.pending;
+	return PCAN_ERROR_OK;
+}
+
+/* not inlined: the list is a msg_list<N>, larger than struct pcanfd_msgs */
+__attribute__((noinline))
+TPCANStatus CAN_WriteMany(TPCANHandle, struct pcanfd_msgs *msgs)
+{
+	for (unsigned i = 0; i < msgs->count && sim.count < 64; i++)
+		sim.fifo[sim.count++] = msgs->list[i];
+	return PCAN_ERROR_OK;
+}
+
+static struct pcanfd_msg mode_frame(uint32_t id, mit::mode m)
+{
+	struct pcanfd_msg msg;
+
+	memset(&msg, 0, sizeof(msg));
+	msg.type = PCANFD_TYPE_CAN20_MSG;
+	msg.id = id;
+	msg.data_len = mit::CMD_LEN;
+	mit::pack_mode(msg.data, m);
+	return msg;
+}
+
+static struct pcanfd_msg command(uint32_t id, uint8_t tag)
+{
+	struct pcanfd_msg msg;
+
+	memset(&msg, 0, sizeof(msg));
+	msg.type = PCANFD_TYPE_CAN20_MSG;
+	msg.id = id;
+	msg.data_len = mit::CMD_LEN;
+	msg.data[0] = tag;
+	return msg;
+}
+
+static bool sent_mode(unsigned i, uint32_t id, mit::mode m)
+{
+	mit::mode got;
+
+	return i < sim.count && sim.fifo[i].id == id &&
+		mit::is_mode(sim.fifo[i].data, sim.fifo[i].data_len, &got) &&
+		got == m;
+}
+
+static void check_supersede(void)
+{
+	deadline_tx<8> q(PCAN_USBBUS1, 8);
+
+	memset(&sim, 0, sizeof(sim));
+	sim.pending = 8;
+
+	/* the newest command of a motor wins, the other motors are kept */
+	q.push(command(1, 0x11), 1000);
+	q.push(command(2, 0x21), 1000);
+	q.push(command(1, 0x12), 2000);
+	CHECK(q.pending() == 2 && q.stats().superseded == 1,
+		"%u pending, %llu superseded", q.pending(),
+		(unsigned long long)q.stats().superseded);
+
+	/* a command queued after an enter frame doesn't replace the command
+	 * queued before it */
+	q.push(mode_frame(1, mit::mode::enter), 0);
+	q.push(command(1, 0x13), 3000);
+	q.push(command(1, 0x14), 3000);
+	CHECK(q.pending(tx_lane::control) == 4 && q.stats().superseded == 2,
+		"%u pending, %llu superseded", q.pending(tx_lane::control),
+		(unsigned long long)q.stats().superseded);
+
+	sim.pending = 0;
+	q.pump(0);
+	CHECK(sim.count == 4, "%u frames sent", sim.count);
+	CHECK(sim.fifo[0].id == 1 && sim.fifo[0].data[0] == 0x12,
+		"first command of motor 1 not replaced");
+	CHECK(sim.fifo[1].id == 2 && sim.fifo[1].data[0] == 0x21,
+		"command of motor 2 lost");
+	CHECK(sent_mode(2, 1, mit::mode::enter), "enter of motor 1 moved");
+	CHECK(sim.fifo[3].id == 1 && sim.fifo[3].data[0] == 0x14,
+		"last command of motor 1 not replaced");
+}
+
+static void check_expire(void)
+{
+	deadline_tx<8> q(PCAN_USBBUS1, 8);
+
+	memset(&sim, 0, sizeof(sim));
+	sim.pending = 8;
+
+	q.push(command(1, 0x11), 1000);
+	q.push(command(2, 0x21), 3000);
+	q.push(command(3, 0x31), 0);		/* never expires */
+	q.push(mode_frame(4, mit::mode::zero), 1000);	/* deadline ignored */
+
+	/* the driver is full: nothing is sent, expired frames are dropped */
+	q.pump(2000);
+	CHECK(!sim.count && q.pending() == 3 && q.stats().expired == 1,
+		"%u sent, %u pending, %llu expired", sim.count, q.pending(),
+		(unsigned long long)q.stats().expired);
+
+	/* a deadline equal to now is expired */
+	sim.pending = 0;
+	q.pump(3000);
+	CHECK(q.stats().expired == 2, "%llu expired",
+		(unsigned long long)q.stats().expired);
+	CHECK(sim.count == 2 && sim.fifo[0].id == 3 &&
+		sent_mode(1, 4, mit::mode::zero), "%u frames sent", sim.count);
+	CHECK(!q.pending(), "%u frames left", q.pending());
+}
+
+static void check_depth(void)
+{
+	deadline_tx<8> q(PCAN_USBBUS1, 3);
+
+	memset(&sim, 0, sizeof(sim));
+	sim.pending = 1;
+
+	q.push(mode_frame(1, mit::mode::zero), 0);	/* bulk */
+	q.push(command(1, 0x11), 0);			/* control */
+	q.push(command(2, 0x21), 0);			/* control */
+	q.push(mode_frame(3, mit::mode::exit), 0);	/* safety */
+
+	/* 2 frames of room, safety first */
+	q.pump(0);
+	CHECK(sim.count == 2 && q.taken() == 2, "%u frames sent", sim.count);
+	CHECK(sent_mode(0, 3, mit::mode::exit) && sim.fifo[1].id == 1 &&
+		sim.fifo[1].data[0] == 0x11, "lane order");
+
+	/* driver full: nothing taken */
+	sim.pending = 3;
+	q.pump(0);
+	CHECK(sim.count == 2 && !q.taken(), "%u frames sent", sim.count);
+
+	sim.pending = 0;
+	q.pump(0);
+	CHECK(sim.count == 4 && sim.fifo[2].id == 2 &&
+		sent_mode(3, 1, mit::mode::zero), "%u frames sent", sim.count);
+	CHECK(q.stats().lane_sent[0] == 1 && q.stats().lane_sent[1] == 2 &&
+		q.stats().lane_sent[2] == 1, "sent by lane %llu %llu %llu",
+		(unsigned long long)q.stats().lane_sent[0],
+		(unsigned long long)q.stats().lane_sent[1],
+		(unsigned long long)q.stats().lane_sent[2]);
+}
+
+static void check_exit_cancels(void)
+{
+	deadline_tx<8> q(PCAN_USBBUS1, 8);
+
+	/* driver full: everything waits in the lanes */
+	memset(&sim, 0, sizeof(sim));
+	sim.pending = 8;
+
+	/* enter, exit, pump: only the exit reaches the driver */
+	q.push(mode_frame(1, mit::mode::enter), 0);
+	q.push(command(1, 0x11), 1000);
+	q.push(mode_frame(1, mit::mode::zero), 0);
+	q.push(mode_frame(2, mit::mode::enter), 0);
+	q.push(mode_frame(1, mit::mode::exit), 0);
+	CHECK(q.pending(tx_lane::control) == 1 && q.pending(tx_lane::bulk) == 0 &&
+		q.pending(tx_lane::safety) == 1, "pending control %u bulk %u safety %u",
+		q.pending(tx_lane::control), q.pending(tx_lane::bulk),
+		q.pending(tx_lane::safety));
+	CHECK(q.stats().cancelled == 3, "cancelled %llu",
+		(unsigned long long)q.stats().cancelled);
+
+	sim.pending = 0;
+	q.pump(0);
+	CHECK(sim.count == 2, "%u frames sent", sim.count);
+	CHECK(sent_mode(0, 1, mit::mode::exit), "exit of motor 1 not first");
+	CHECK(sent_mode(1, 2, mit::mode::enter), "enter of motor 2 lost");
+	CHECK(!q.pending(), "%u frames left", q.pending());
+
+	/* frames pushed after the exit are kept */
+	memset(&sim, 0, sizeof(sim));
+	sim.pending = 8;
+	q.push(mode_frame(1, mit::mode::exit), 0);
+	q.push(mode_frame(1, mit::mode::enter), 0);
+	sim.pending = 0;
+	q.pump(0);
+	CHECK(sim.count == 2 && sent_mode(0, 1, mit::mode::exit) &&
+		sent_mode(1, 1, mit::mode::enter), "enter after exit");
+
+	/* a 29-bit id is another motor */
+	struct pcanfd_msg ext = mode_frame(1, mit::mode::enter);
+
+	ext.flags = PCANFD_MSG_EXT;
+	memset(&sim, 0, sizeof(sim));
+	sim.pending = 8;
+	q.push(ext, 0);
+	q.push(mode_frame(1, mit::mode::exit), 0);
+	sim.pending = 0;
+	q.pump(0);
+	CHECK(sim.count == 2 && sent_mode(0, 1, mit::mode::exit) &&
+		sim.fifo[1].flags == PCANFD_MSG_EXT, "29-bit enter lost");
+}
+
+int main(void)
+{
+	check_supersede();
+	check_expire();
+	check_depth();
+	check_exit_cancels();
+
+	printf("tx_lanes_test: %d error(s)\n", errors);
+	return errors ? 1 : 0;
+}